@@ -1,16 +1,24 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <new>
 #include <string>
+#include <vector>
+#include "Loudness.h"
+#include "Memory.h"
+#include "Profiler.h"
 #include "Result.h"
 
+#ifdef _WIN32
 #include <windows.h> 
 #include <playsoundapi.h>
 #include <mmsystem.h>
-#include <array>
 #pragma comment(lib, "winmm.lib")
+#endif
+#include <array>
 
 
 
@@ -63,12 +71,13 @@ struct AudioLoaderWav
         RIFF riff;
         Format fmt;
         Data data;
+        DynamicAudio::LoudnessInfo loudness;    // Measured at load, so normalizing costs nothing at playback
 
         Wav() :
-            riff(), fmt(), data() {}
+            riff(), fmt(), data(), loudness() {}
 
         Wav(RIFF riff_, Format fmt_, Data data_) :
-            riff(riff_), fmt(fmt_), data(data_) {}
+            riff(riff_), fmt(fmt_), data(data_), loudness() {}
 
 
         void rawAll(uint8_t*& start, uint32_t& size) const
@@ -120,31 +129,153 @@ struct AudioLoaderWav
 
     };
 
+    /// <summary> Hands loadRawFile its sample memory from the global heap, aligned as asked. release gives it back. </summary>
+    struct HeapAllocator {
+        void* allocate(size_t bytes, size_t alignment) { return ::operator new(bytes, std::align_val_t(alignment), std::nothrow); }
+        static void free(void* memory, size_t alignment) { ::operator delete(memory, std::align_val_t(alignment)); }
+    };
+
+    /// <summary> Frees the samples of a wave loaded with the HeapAllocator, ie. by load. Waves from an arena go with the arena. </summary>
+    static void release(Wav& wav)
+    {
+        HeapAllocator::free(wav.data.data, DynamicAudio::SampleAlignment);
+        wav.data.data = nullptr;
+        wav.data.chunkSize = 0;
+    }
+
+    /// <summary> Gives back samples loadRawFile could not finish reading. Other allocators keep them until they are reset. </summary>
+    template<typename Allocator>
+    static void discard(Allocator&, void*) {}
+    static void discard(HeapAllocator&, void* memory) { HeapAllocator::free(memory, DynamicAudio::SampleAlignment); }
+
     static Result loadRawFile(std::string filepath, Wav& wav)
     {
+        HeapAllocator heap;
+        return loadRawFile(filepath, wav, heap);
+    }
+
+    /// <summary> Loads a WAV file, taking the sample memory from an allocator, ie. a DynamicAudio::Arena. </summary>
+    /// <param name="allocator"> Anything with allocate(bytes, alignment), which owns the samples afterwards. </param>
+    /// <param name="measure"> Whether to measure the loudness into wav.loudness, one extra pass over the samples. </param>
+    template<typename Allocator>
+    static Result loadRawFile(std::string filepath, Wav& wav, Allocator& allocator, bool measure = true)
+    {
+        DA_PROFILE_SCOPE("AudioLoaderWav::loadRawFile");
+
         // Open File
         std::ifstream ifs{ filepath, std::ios_base::binary };
         if (ifs.fail()) return CannotOpenFile;
 
-        // Get file length
-        //ifs.seekg(0, ifs.end);
-        //int length = ifs.tellg(); // tellg returns pos
-        //ifs.seekg(0, ifs.beg);
+        RIFF riff;
+        Format fmt{};
+        Data data{};
+        Result header = readHeader(ifs, riff, fmt, data);
+        if (header != Success) return header;
+
+        data.data = (uint8_t*)allocator.allocate(data.size(), DynamicAudio::SampleAlignment);
+        if (data.data == nullptr) return ProblemReadingData;
+
+        ifs.read((char*)data.data, data.chunkSize);
+        if (!ifs) {
+            discard(allocator, data.data);
+            return ProblemReadingData;
+        }
+
+        ifs.close();
+
+        wav = Wav(
+            riff, fmt, data
+        );
+        if (measure) wav.loudness = measureLoudness(wav);
+        
+        return Success;
+    }
+
+    /// <summary> Whether the samples are PCM or float that toFloat can read. </summary>
+    static bool isReadable(const Format& fmt)
+    {
+        // 1 is integer PCM, 3 is float, 0xFFFE is extensible which we read by its bit depth
+        bool integer = (fmt.audioFormat == 1 || fmt.audioFormat == 0xFFFE)
+            && (fmt.bitsPerSample == 8 || fmt.bitsPerSample == 16 || fmt.bitsPerSample == 24 || fmt.bitsPerSample == 32);
+        bool floating = fmt.audioFormat == 3 && fmt.bitsPerSample == 32;
+
+        // Frames are sized by blockAlign, so a header with it zero or disagreeing is never read
+        return (integer || floating) && fmt.numChannels != 0 && fmt.blockAlign == fmt.numChannels * fmt.bitsPerSample / 8;
+    }
+
+    /// <summary> Converts samples in the format of a file to floats in -1 to 1. </summary>
+    static void toFloat(const Format& fmt, const uint8_t* in, float* out, size_t samples)
+    {
+        switch (fmt.audioFormat == 3 ? 0 : fmt.bitsPerSample)
+        {
+        case 0:
+            std::memcpy(out, in, samples * sizeof(float));
+            break;
+
+        case 8: // Unsigned
+            for (size_t i = 0; i < samples; i++) out[i] = (in[i] - 128) * (1.0f / 128.0f);
+            break;
+
+        case 16:
+            for (size_t i = 0; i < samples; i++) {
+                int16_t sample;
+                std::memcpy(&sample, in + i * 2, 2);
+                out[i] = sample * (1.0f / 32768.0f);
+            }
+            break;
+
+        case 24:
+            for (size_t i = 0; i < samples; i++) {
+                const uint8_t* b = in + i * 3;
+                int32_t sample = (int32_t)((uint32_t)b[0] << 8 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 24) >> 8;
+                out[i] = sample * (1.0f / 8388608.0f);
+            }
+            break;
+
+        default:
+            for (size_t i = 0; i < samples; i++) {
+                int32_t sample;
+                std::memcpy(&sample, in + i * 4, 4);
+                out[i] = sample * (1.0f / 2147483648.0f);
+            }
+            break;
+        }
+    }
+
+    /// <summary> Measures the integrated loudness and peaks of a loaded file, a block at a time. </summary>
+    /// <returns> An unmeasured LoudnessInfo when the format cannot be read. </returns>
+    static DynamicAudio::LoudnessInfo measureLoudness(const Wav& wav)
+    {
+        DA_PROFILE_SCOPE("AudioLoaderWav::measureLoudness");
+        if (!isReadable(wav.fmt) || wav.data.data == nullptr) return DynamicAudio::LoudnessInfo();
+
+        const size_t blockFrames = 4096;
+        DynamicAudio::LoudnessMeter meter(wav.fmt.sampleRate, wav.fmt.numChannels);
+        std::vector<float> block(blockFrames * wav.fmt.numChannels);
+
+        size_t frames = wav.data.size() / wav.fmt.blockAlign;
+        for (size_t done = 0; done < frames; done += blockFrames) {
+            size_t n = std::min(blockFrames, frames - done);
+            toFloat(wav.fmt, wav.data.data + done * wav.fmt.blockAlign, block.data(), n * wav.fmt.numChannels);
+            meter.pushInterleaved(block.data(), n, wav.fmt.numChannels);
+        }
+        return meter.info();
+    }
 
+    /// <summary>
+    /// Reads the RIFF header and every chunk up to the samples, leaving the stream on the first sample.
+    /// Shared by loadRawFile and the streaming WavDecoder, which reads the samples a block at a time.
+    /// </summary>
+    /// <param name="data"> Gets the data chunk's id and size, its data pointer is left alone. </param>
+    static Result readHeader(std::istream& ifs, RIFF& riff, Format& fmt, Data& data)
+    {
         // Read RIFF header
-        RIFF riff;
         ifs.read((char*)&riff, sizeof(RIFF));
-        if (!ifs || !isRIFF(riff.chunkID) || !isFORMAT(riff.format)) {
-            ifs.close();
-            return BadFormatting;
-        }
+        if (!ifs || !isRIFF(riff.chunkID) || !isFORMAT(riff.format)) return BadFormatting;
 
         // Read chunk infos iteratively
         ChunkInfo ch;
-        Format fmt;
-        Data data;
         bool fmt_read = false;
-        bool data_read = false;
         while (ifs.read((char*)&ch, sizeof(ChunkInfo)))
         {
             // Fmt chunk
@@ -153,43 +284,40 @@ struct AudioLoaderWav
                 std::copy(std::begin(ch.chunkID), std::end(ch.chunkID), std::begin(fmt.chunkID));
                 fmt.chunkSize = ch.chunkSize;
 
-                ifs.read((char*)&fmt + sizeof(ChunkInfo), ch.chunkSize); // We've already read ChunkInfo
+                // Extended formats carry more than we keep, skip the rest
+                uint32_t known = (uint32_t)(sizeof(Format) - sizeof(ChunkInfo));
+                uint32_t keep = ch.chunkSize < known ? ch.chunkSize : known;
+                ifs.read((char*)&fmt + sizeof(ChunkInfo), keep); // We've already read ChunkInfo
+                ifs.seekg(ch.chunkSize - keep, std::ios_base::cur);
 
                 if (fmt_read) std::cerr << "Multiple FMT chunks found" << std::endl;
                 fmt_read = true;
             }
 
-            // Data chunk
+            // Data chunk, the samples follow
             else if (isDATA(ch.chunkID)) 
             {
+                if (!fmt_read) return BadFormatting;
+
                 std::copy(std::begin(ch.chunkID), std::end(ch.chunkID), std::begin(data.chunkID));
                 data.chunkSize = ch.chunkSize;
-
-                data.data = new uint8_t[data.size()];
-
-                ifs.read((char*)data.data + sizeof(ChunkInfo), ch.chunkSize); // We've already read ChunkInfo
-
-                if (data_read) std::cerr << "Multiple Data chunks found" << std::endl;
-                data_read = true;
+                return Success;
             }
 
             // Otherwise, skip
             else ifs.seekg(ch.chunkSize, std::ios_base::cur);
-        }
 
-        ifs.close();
-
-        if (!data_read || !fmt_read) return ProblemReadingData;
+            // Chunks are padded to an even size
+            if (ch.chunkSize & 1) ifs.seekg(1, std::ios_base::cur);
+        }
 
-        wav = Wav(
-            riff, fmt, data
-        );
-        
-        return Success;
+        return ProblemReadingData;
     }
 
     // TODO: Move to results?
     static bool checkResultForErrors(Result result) {
+        if (result != Success) DA_PROFILE_EVENT("AudioLoaderWav error");
+
         switch (result) {
         case Success: return false;
 
@@ -204,6 +332,14 @@ struct AudioLoaderWav
         case ProblemReadingData:
             std::cerr << "Problem when reading data" << std::endl;
             break;
+
+        case UnsupportedVersion:
+            std::cerr << "Unsupported file version" << std::endl;
+            break;
+
+        case NotSupported:
+            std::cerr << "Unsupported sample format" << std::endl;
+            break;
         }
 
         return true;
@@ -219,6 +355,87 @@ public:
         return wavFile;
     }
 
+    /// <summary>
+    /// Streams PCM frames into a WAV file without holding them in memory.
+    /// The chunk sizes are patched into the header when the writer is closed.
+    /// </summary>
+    class Writer {
+    private:
+        std::ofstream ofs;
+        Format fmt;
+        uint32_t dataBytes;
+
+    public:
+        Writer() : ofs(), fmt(), dataBytes(0) {}
+        ~Writer() { close(); }
+
+        /// <summary> Creates the file and writes a placeholder header. </summary>
+        /// <param name="filepath"> The file to write. </param>
+        /// <param name="sampleRate"> Frames per second. </param>
+        /// <param name="numChannels"> Samples per frame. </param>
+        /// <param name="bitsPerSample"> 16 or 24. </param>
+        Result open(const std::string& filepath, uint32_t sampleRate, uint16_t numChannels, uint16_t bitsPerSample = 16)
+        {
+            close();
+            ofs.open(filepath, std::ios_base::binary | std::ios_base::trunc);
+            if (ofs.fail()) return CannotOpenFile;
+
+            std::memcpy(fmt.chunkID, ID_FMT, 4);
+            fmt.chunkSize = sizeof(Format) - sizeof(ChunkInfo);
+            fmt.audioFormat = 1;
+            fmt.numChannels = numChannels;
+            fmt.sampleRate = sampleRate;
+            fmt.bitsPerSample = bitsPerSample;
+            fmt.blockAlign = (uint16_t)(numChannels * bitsPerSample / 8);
+            fmt.byteRate = sampleRate * fmt.blockAlign;
+            dataBytes = 0;
+
+            writeHeader();
+            return ofs ? Success : ProblemReadingData;
+        }
+
+        bool isOpen() const { return ofs.is_open(); }
+        const Format& format() const { return fmt; }
+
+        /// <summary> The amount of frames written so far. </summary>
+        uint32_t frames() const { return fmt.blockAlign ? dataBytes / fmt.blockAlign : 0; }
+
+        /// <summary> Appends already encoded, interleaved frames. </summary>
+        void writeRaw(const void* frames_, size_t frameCount) {
+            size_t bytes = frameCount * fmt.blockAlign;
+            ofs.write((const char*)frames_, bytes);
+            dataBytes += (uint32_t)bytes;
+        }
+
+        /// <summary> Patches the chunk sizes and closes the file. </summary>
+        void close() {
+            if (!ofs.is_open()) return;
+
+            // Chunks are word aligned
+            if (dataBytes % 2) ofs.put(0);
+
+            ofs.seekp(0, std::ios_base::beg);
+            writeHeader();
+            ofs.close();
+        }
+
+    private:
+        void writeHeader() {
+            RIFF riff;
+            std::memcpy(riff.chunkID, ID_RIFF, 4);
+            std::memcpy(riff.format, FORMAT, 4);
+            riff.chunkSize = (uint32_t)(sizeof(RIFF) - sizeof(ChunkInfo) + sizeof(Format) + sizeof(ChunkInfo) + dataBytes + dataBytes % 2);
+
+            ChunkInfo data;
+            std::memcpy(data.chunkID, ID_DATA, 4);
+            data.chunkSize = dataBytes;
+
+            ofs.write((const char*)&riff, sizeof(RIFF));
+            ofs.write((const char*)&fmt, sizeof(Format));
+            ofs.write((const char*)&data, sizeof(ChunkInfo));
+        }
+    };
+
 
     static void debug_printInfo(const Wav& wav)
     {
@@ -266,6 +483,7 @@ public:
     }
 
 
+#ifdef _WIN32
     static void debug_play(const Wav& wav)
     {
         // TODO
@@ -291,4 +509,5 @@ public:
             SND_MEMORY //| SND_SYNC
         );
     }
+#endif
 };
\ No newline at end of file
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "RingBuffer.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace DynamicAudio {
+
+    /// <summary> One bit per category a source belongs to, ie. UI, voice, SFX, music or a player. </summary>
+    typedef uint64_t AudioMask;
+
+    /// <summary>
+    /// Category masks for every source, indexed by category as bitsets over the sources.
+    /// Muting, soloing and gaining a whole category is one atomic write from any thread,
+    /// and "which sources match" is a walk over 64-source words rather than over sources.
+    /// Per-source mask changes are queued and applied by the audio thread in beginBlock.
+    /// </summary>
+    class AudioMasks {
+    public:
+        static constexpr uint32_t Categories = 64;
+
+        /// <summary> The mask for a single category. </summary>
+        static constexpr AudioMask category(uint32_t index) { return (AudioMask)1 << index; }
+
+    private:
+        struct Change {
+            uint32_t source;
+            AudioMask mask;
+        };
+
+        size_t sourceCount;
+        size_t words;
+
+        // Audio thread state
+        std::vector<AudioMask> masks;               // Per source
+        std::vector<std::vector<uint64_t>> members; // [category][word], bit set if the source is in the category
+        std::vector<uint64_t> audible;              // Bit set if the source is neither muted nor left out by a solo
+        float gains[Categories];
+        AudioMask mutedNow;
+        AudioMask soloedNow;
+
+        // Written by the control threads
+        SpscRingBuffer<Change> changes;
+        std::atomic<AudioMask> muted;
+        std::atomic<AudioMask> soloed;
+        std::atomic<float> categoryGains[Categories];
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="maxSources"> Sources are indices below this, ie. Mixer channels. Every bitset is allocated up front. </param>
+        /// <param name="maxChangesPerBlock"> How many setMask calls can wait for the next block. </param>
+        AudioMasks(size_t maxSources, size_t maxChangesPerBlock = 1024)
+            : sourceCount(maxSources), words((maxSources + 63) / 64),
+            masks(maxSources, 0), members(Categories, std::vector<uint64_t>(words, 0)), audible(words, 0),
+            mutedNow(0), soloedNow(0), changes(maxChangesPerBlock), muted(0), soloed(0)
+        {
+            for (uint32_t c = 0; c < Categories; c++) {
+                gains[c] = 1;
+                categoryGains[c].store(1);
+            }
+            rebuildAudible();
+        }
+
+        size_t size() const { return sourceCount; }
+
+        /// <summary> The amount of 64-bit words in every bitset. </summary>
+        size_t wordCount() const { return words; }
+
+        // Control side, safe while the audio thread is running
+
+        /// <summary> Queues a new mask for a source, applied at the next block. Only one thread may queue changes. </summary>
+        /// <returns> False if the queue is full. </returns>
+        bool setMask(uint32_t source, AudioMask mask) {
+            if (source >= sourceCount) return false;
+            return changes.push(Change{ source, mask });
+        }
+
+        void mute(AudioMask categories) { muted.fetch_or(categories); }
+        void unmute(AudioMask categories) { muted.fetch_and(~categories); }
+        void solo(AudioMask categories) { soloed.fetch_or(categories); }
+        void unsolo(AudioMask categories) { soloed.fetch_and(~categories); }
+
+        /// <summary> Sets the gain of every category in the mask, ie. to duck the music under dialogue. </summary>
+        void setGain(AudioMask categories, float gain) {
+            for (uint32_t c = 0; c < Categories; c++)
+                if (categories & category(c)) categoryGains[c].store(gain, std::memory_order_relaxed);
+        }
+
+        AudioMask getMuted() const { return muted.load(); }
+        AudioMask getSoloed() const { return soloed.load(); }
+
+        // Audio side, only from the thread calling beginBlock
+
+        /// <summary> Applies queued mask changes and takes a snapshot of mute, solo and gains for the block. </summary>
+        void beginBlock() {
+            bool changed = false;
+
+            Change change;
+            while (changes.pop(change)) {
+                AudioMask old = masks[change.source];
+                size_t word = change.source / 64;
+                uint64_t bit = (uint64_t)1 << (change.source % 64);
+
+                for (AudioMask diff = old ^ change.mask; diff != 0; diff &= diff - 1) {
+                    uint32_t c = lowestBit(diff);
+                    members[c][word] ^= bit;
+                }
+                masks[change.source] = change.mask;
+                changed = true;
+            }
+
+            AudioMask m = muted.load(std::memory_order_acquire);
+            AudioMask s = soloed.load(std::memory_order_acquire);
+            if (changed || m != mutedNow || s != soloedNow) {
+                mutedNow = m;
+                soloedNow = s;
+                rebuildAudible();
+            }
+
+            for (uint32_t c = 0; c < Categories; c++)
+                gains[c] = categoryGains[c].load(std::memory_order_relaxed);
+        }
+
+        AudioMask getMask(uint32_t source) const { return masks[source]; }
+
+        /// <summary> Whether a source can be heard this block. </summary>
+        bool isAudible(uint32_t source) const { return (audible[source / 64] >> (source % 64)) & 1; }
+
+        /// <summary> The bitset of audible sources, wordCount words long. </summary>
+        const uint64_t* audibleBits() const { return audible.data(); }
+
+        /// <summary> The product of the gains of every category the source is in. </summary>
+        float gain(uint32_t source) const {
+            float total = 1;
+            for (AudioMask bits = masks[source]; bits != 0; bits &= bits - 1)
+                total *= gains[lowestBit(bits)];
+            return total;
+        }
+
+        /// <summary> The mute, solo and category gains of a source in one value, 0 if it cannot be heard. </summary>
+        float effectiveGain(uint32_t source) const { return isAudible(source) ? gain(source) : 0.0f; }
+
+        /// <summary> Finds the sources in any of the categories. </summary>
+        /// <param name="out"> wordCount words, a bit is set for every matching source. </param>
+        void matchAny(AudioMask categories, uint64_t* out) const {
+            for (size_t w = 0; w < words; w++) out[w] = 0;
+            for (AudioMask bits = categories; bits != 0; bits &= bits - 1) {
+                const uint64_t* set = members[lowestBit(bits)].data();
+                for (size_t w = 0; w < words; w++) out[w] |= set[w];
+            }
+        }
+
+        /// <summary> Finds the sources in every one of the categories. </summary>
+        /// <param name="out"> wordCount words, a bit is set for every matching source. </param>
+        void matchAll(AudioMask categories, uint64_t* out) const {
+            for (size_t w = 0; w < words; w++) out[w] = ~(uint64_t)0;
+            for (AudioMask bits = categories; bits != 0; bits &= bits - 1) {
+                const uint64_t* set = members[lowestBit(bits)].data();
+                for (size_t w = 0; w < words; w++) out[w] &= set[w];
+            }
+            clearTail(out);
+        }
+
+        /// <summary> Calls fn with the index of every set bit, ie. the result of a match. </summary>
+        template<typename Fn>
+        void forEach(const uint64_t* bits, Fn fn) const {
+            for (size_t w = 0; w < words; w++)
+                for (uint64_t word = bits[w]; word != 0; word &= word - 1)
+                    fn((uint32_t)(w * 64 + lowestBit(word)));
+        }
+
+        /// <summary> Counts the set bits of a match. </summary>
+        size_t count(const uint64_t* bits) const {
+            size_t total = 0;
+            for (size_t w = 0; w < words; w++) total += popCount(bits[w]);
+            return total;
+        }
+
+    private:
+        void rebuildAudible() {
+            for (size_t w = 0; w < words; w++) audible[w] = ~(uint64_t)0;
+
+            for (AudioMask bits = mutedNow; bits != 0; bits &= bits - 1) {
+                const uint64_t* set = members[lowestBit(bits)].data();
+                for (size_t w = 0; w < words; w++) audible[w] &= ~set[w];
+            }
+
+            // Once anything is soloed, only sources in a soloed category are heard
+            if (soloedNow != 0) {
+                for (size_t w = 0; w < words; w++) {
+                    uint64_t any = 0;
+                    for (AudioMask bits = soloedNow; bits != 0; bits &= bits - 1)
+                        any |= members[lowestBit(bits)][w];
+                    audible[w] &= any;
+                }
+            }
+
+            clearTail(audible.data());
+        }
+
+        void clearTail(uint64_t* bits) const {
+            if (words != 0 && sourceCount % 64 != 0)
+                bits[words - 1] &= ((uint64_t)1 << (sourceCount % 64)) - 1;
+        }
+
+        static uint32_t lowestBit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+            return (uint32_t)__builtin_ctzll(value);
+#else
+            unsigned long index;
+            _BitScanForward64(&index, value);
+            return (uint32_t)index;
+#endif
+        }
+
+        static uint32_t popCount(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+            return (uint32_t)__builtin_popcountll(value);
+#else
+            return (uint32_t)__popcnt64(value);
+#endif
+        }
+    };
+}
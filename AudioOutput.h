@@ -0,0 +1,357 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioLoaderWav.h"
+#include "OutputConvert.h"
+#include "Profiler.h"
+#include "Result.h"
+#include "RingBuffer.h"
+
+namespace DynamicAudio {
+
+    /// <summary> The shape of the audio handed to a Sink. </summary>
+    struct OutputFormat {
+        uint32_t sampleRate;
+        uint16_t channels;
+        uint32_t blockFrames;   // Frames rendered and written at a time
+
+        OutputFormat(uint32_t sampleRate_ = 48000, uint16_t channels_ = 2, uint32_t blockFrames_ = 256)
+            : sampleRate(sampleRate_), channels(channels_), blockFrames(blockFrames_) {}
+
+        /// <summary> The amount of floats in one block. </summary>
+        size_t blockSamples() const { return (size_t)blockFrames * channels; }
+
+        /// <summary> How long one block lasts. </summary>
+        std::chrono::nanoseconds blockDuration() const {
+            return std::chrono::nanoseconds((int64_t)blockFrames * 1000000000 / sampleRate);
+        }
+    };
+
+    /// <summary> Where the rendered audio ends up, ie. a device or a file. </summary>
+    class Sink {
+    public:
+        virtual ~Sink() {}
+
+        /// <summary> Prepares the sink, allocating anything write will need. </summary>
+        virtual Result open(const OutputFormat& format) = 0;
+
+        /// <summary> Takes one block of interleaved frames. Device sinks block until there is room. </summary>
+        virtual void write(const float* interleaved, size_t frames) = 0;
+
+        virtual void close() = 0;
+
+        /// <summary> Whether write is paced by a hardware clock. Other sinks are paced by the AudioOutput. </summary>
+        virtual bool isRealtime() const { return false; }
+
+        /// <summary> Frames still queued inside the sink, counted towards the latency. </summary>
+        virtual uint32_t bufferedFrames() const { return 0; }
+    };
+
+    /// <summary> Throws the audio away, for running headless or measuring the pipeline itself. </summary>
+    class NullSink : public Sink {
+    public:
+        uint64_t framesWritten;
+
+        NullSink() : framesWritten(0) {}
+
+        Result open(const OutputFormat&) override { framesWritten = 0; return Success; }
+        void write(const float*, size_t frames) override { framesWritten += frames; }
+        void close() override {}
+    };
+
+    /// <summary> Streams the audio into a 16 or 24-bit WAV file. </summary>
+    class WavFileSink : public Sink {
+    private:
+        std::string filepath;
+        uint16_t bitsPerSample;
+        OutputConverter::Dither dither;
+        AudioLoaderWav::Writer writer;
+        OutputConverter converter;
+        std::vector<uint8_t> scratch;
+        uint32_t blockFrames;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="bitsPerSample_"> 16 or 24. </param>
+        /// <param name="dither_"> Added before rounding to the file's bit depth. </param>
+        WavFileSink(const std::string& filepath_, uint16_t bitsPerSample_ = 16, OutputConverter::Dither dither_ = OutputConverter::Dither::Triangular)
+            : filepath(filepath_), bitsPerSample(bitsPerSample_ == 24 ? 24 : 16), dither(dither_), writer(), converter(), scratch(), blockFrames(0) {}
+
+        Result open(const OutputFormat& format) override {
+            converter = OutputConverter(format.channels, dither);
+            scratch.assign(format.blockSamples() * bitsPerSample / 8, 0);
+            blockFrames = format.blockFrames;
+            return writer.open(filepath, format.sampleRate, format.channels, bitsPerSample);
+        }
+
+        void write(const float* interleaved, size_t frames) override {
+            if (frames > blockFrames) frames = blockFrames;
+            converter.convert(interleaved, scratch.data(), frames, bitsPerSample);
+            writer.writeRaw(scratch.data(), frames);
+        }
+
+        void close() override { writer.close(); }
+
+        uint32_t framesWritten() const { return writer.frames(); }
+    };
+
+#ifdef _WIN32
+    /// <summary> Plays the audio through the default waveOut device. </summary>
+    class WaveOutSink : public Sink {
+    private:
+        static constexpr size_t BufferCount = 3;
+
+        HWAVEOUT device;
+        WAVEHDR headers[BufferCount];
+        std::vector<int16_t> buffers[BufferCount];
+        OutputConverter converter;
+        size_t next;
+        uint32_t blockFrames;
+        uint16_t channels;
+
+    public:
+        WaveOutSink() : device(nullptr), headers(), converter(), next(0), blockFrames(0), channels(0) {}
+        ~WaveOutSink() { close(); }
+
+        Result open(const OutputFormat& format) override {
+            WAVEFORMATEX wfx = {};
+            wfx.wFormatTag = WAVE_FORMAT_PCM;
+            wfx.nChannels = format.channels;
+            wfx.nSamplesPerSec = format.sampleRate;
+            wfx.wBitsPerSample = 16;
+            wfx.nBlockAlign = (WORD)(format.channels * sizeof(int16_t));
+            wfx.nAvgBytesPerSec = format.sampleRate * wfx.nBlockAlign;
+
+            if (waveOutOpen(&device, WAVE_MAPPER, &wfx, 0, 0, CALLBACK_NULL) != MMSYSERR_NOERROR) {
+                device = nullptr;
+                return CannotOpenFile;
+            }
+
+            blockFrames = format.blockFrames;
+            channels = format.channels;
+            converter = OutputConverter(format.channels);
+            for (size_t i = 0; i < BufferCount; i++) {
+                buffers[i].assign(format.blockSamples(), 0);
+                headers[i] = {};
+                headers[i].lpData = (LPSTR)buffers[i].data();
+                headers[i].dwBufferLength = (DWORD)(buffers[i].size() * sizeof(int16_t));
+                waveOutPrepareHeader(device, &headers[i], sizeof(WAVEHDR));
+            }
+            next = 0;
+            return Success;
+        }
+
+        void write(const float* interleaved, size_t frames) override {
+            WAVEHDR& header = headers[next];
+            while (header.dwFlags & WHDR_INQUEUE) Sleep(1);
+
+            if (frames > blockFrames) frames = blockFrames;
+            converter.toInt16(interleaved, buffers[next].data(), frames);
+            header.dwBufferLength = (DWORD)(frames * channels * sizeof(int16_t));
+            waveOutWrite(device, &header, sizeof(WAVEHDR));
+
+            next = (next + 1) % BufferCount;
+        }
+
+        void close() override {
+            if (device == nullptr) return;
+
+            waveOutReset(device);
+            for (size_t i = 0; i < BufferCount; i++)
+                waveOutUnprepareHeader(device, &headers[i], sizeof(WAVEHDR));
+            waveOutClose(device);
+            device = nullptr;
+        }
+
+        bool isRealtime() const override { return true; }
+
+        uint32_t bufferedFrames() const override {
+            uint32_t queued = 0;
+            for (size_t i = 0; i < BufferCount; i++)
+                if (headers[i].dwFlags & WHDR_INQUEUE) queued += blockFrames;
+            return queued;
+        }
+    };
+#endif
+
+    /// <summary>
+    /// Drives a Sink from a render callback.
+    /// A render thread fills fixed-size blocks into a lock-free ring, a device thread
+    /// drains the ring into the sink. When the ring is empty the device gets silence
+    /// and an underrun is counted.
+    /// </summary>
+    class AudioOutput {
+    public:
+        /// <summary> Fills 'frames' interleaved frames. Runs on the render thread. </summary>
+        typedef std::function<void(float* interleaved, size_t frames)> Renderer;
+
+        /// <summary> How blocks are handed to sinks without a hardware clock. </summary>
+        enum Clock {
+            Paced,      // One block per block duration, as a device would
+            Freewheel   // As fast as the renderer can go, ie. rendering to a file
+        };
+
+        /// <summary> Counters, safe to read from any thread while running. </summary>
+        struct Stats {
+            std::atomic<uint64_t> blocksRendered;
+            std::atomic<uint64_t> blocksPlayed;
+            std::atomic<uint64_t> underruns;
+            std::atomic<uint64_t> latencyLastNs;    // From starting to render a block until the device has it
+            std::atomic<uint64_t> latencyMaxNs;
+            std::atomic<uint64_t> latencyTotalNs;
+
+            Stats() : blocksRendered(0), blocksPlayed(0), underruns(0), latencyLastNs(0), latencyMaxNs(0), latencyTotalNs(0) {}
+
+            double averageLatencyMs() const {
+                uint64_t played = blocksPlayed.load();
+                return played ? latencyTotalNs.load() / 1e6 / (double)played : 0;
+            }
+        };
+
+    private:
+        struct Block {
+            std::vector<float> samples;
+            std::chrono::steady_clock::time_point renderedAt;
+        };
+
+        OutputFormat format;
+        Renderer renderer;
+        Sink& sink;
+        Clock clock;
+
+        SpscRingBuffer<Block> ring;
+        std::vector<float> silence;
+        Stats counters;
+
+        std::atomic<bool> running;
+        std::thread renderThread;
+        std::thread deviceThread;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="format_"> The block size, sample rate and channels. </param>
+        /// <param name="renderer_"> Called on the render thread for every block. </param>
+        /// <param name="sink_"> Where the blocks go, must outlive the output. </param>
+        /// <param name="ringBlocks"> How many blocks can be rendered ahead of the device. </param>
+        /// <param name="clock_"> How sinks without a hardware clock are paced. </param>
+        AudioOutput(const OutputFormat& format_, Renderer renderer_, Sink& sink_, size_t ringBlocks = 4, Clock clock_ = Paced)
+            : format(format_), renderer(renderer_), sink(sink_), clock(clock_),
+            ring(ringBlocks, Block{ std::vector<float>(format_.blockSamples(), 0), {} }),
+            silence(format_.blockSamples(), 0), counters(), running(false) {}
+
+        ~AudioOutput() { stop(); }
+
+        AudioOutput(const AudioOutput&) = delete;
+        AudioOutput& operator=(const AudioOutput&) = delete;
+
+        const OutputFormat& getFormat() const { return format; }
+        const Stats& stats() const { return counters; }
+        bool isRunning() const { return running.load(); }
+
+        /// <summary> Opens the sink and starts both threads. </summary>
+        Result start() {
+            if (running.load()) return Success;
+
+            Result result = sink.open(format);
+            if (result != Success) return result;
+
+            running.store(true);
+            renderThread = std::thread([this] { renderLoop(); });
+            deviceThread = std::thread([this] { deviceLoop(); });
+            return Success;
+        }
+
+        /// <summary> Stops both threads, writes out the blocks still in the ring and closes the sink. </summary>
+        void stop() {
+            if (!running.exchange(false)) return;
+
+            if (renderThread.joinable()) renderThread.join();
+            if (deviceThread.joinable()) deviceThread.join();
+
+            // Both threads are gone, so this thread reads the ring now. A render to file ends where rendering stopped
+            while (Block* block = ring.acquireRead()) play(*block);
+            sink.close();
+        }
+
+    private:
+        void renderLoop() {
+            DA_PROFILE_THREAD();
+            auto wait = format.blockDuration() / 4;
+
+            while (running.load(std::memory_order_relaxed))
+            {
+                Block* block = ring.acquireWrite();
+                if (block == nullptr) {
+                    if (clock == Freewheel) std::this_thread::yield();
+                    else std::this_thread::sleep_for(wait);
+                    continue;
+                }
+
+                block->renderedAt = std::chrono::steady_clock::now();
+                {
+                    DA_PROFILE_BLOCK("AudioOutput::render", (uint64_t)format.blockDuration().count());
+                    renderer(block->samples.data(), format.blockFrames);
+                }
+                ring.commitWrite();
+                counters.blocksRendered.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        void deviceLoop() {
+            using clock_t = std::chrono::steady_clock;
+            auto period = format.blockDuration();
+            bool paced = !sink.isRealtime() && clock == Paced;
+
+            // Let the renderer get a block ahead before the clock starts
+            while (running.load(std::memory_order_relaxed) && ring.empty())
+                std::this_thread::sleep_for(period / 4);
+
+            auto next = clock_t::now();
+            while (running.load(std::memory_order_relaxed))
+            {
+                if (paced) {
+                    std::this_thread::sleep_until(next);
+                    next += period;
+                }
+
+                Block* block = ring.acquireRead();
+                if (block == nullptr) {
+                    // Freewheeling has no deadline, so wait for the renderer instead
+                    if (clock == Freewheel && !sink.isRealtime()) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+
+                    counters.underruns.fetch_add(1, std::memory_order_relaxed);
+                    sink.write(silence.data(), format.blockFrames);
+                    continue;
+                }
+
+                play(*block);
+            }
+        }
+
+        /// <summary> Writes a rendered block to the sink, hands it back to the renderer and counts its latency. </summary>
+        void play(const Block& block) {
+            sink.write(block.samples.data(), format.blockFrames);
+
+            auto queued = std::chrono::nanoseconds((int64_t)sink.bufferedFrames() * 1000000000 / format.sampleRate);
+            uint64_t latency = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - block.renderedAt + queued).count();
+            ring.commitRead();
+
+            counters.latencyLastNs.store(latency, std::memory_order_relaxed);
+            counters.latencyTotalNs.fetch_add(latency, std::memory_order_relaxed);
+            if (latency > counters.latencyMaxNs.load(std::memory_order_relaxed))
+                counters.latencyMaxNs.store(latency, std::memory_order_relaxed);
+            counters.blocksPlayed.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+}
@@ -0,0 +1,330 @@
+// BatchRender.cpp : Renders Tunes and WAV files offline from a job manifest.
+// Not part of the DLL, built as DynamicAudioBatch by CMakeLists.txt.
+//
+// Usage: DynamicAudioBatch manifest.txt [--threads count] [--block frames]
+//
+// Every manifest line is one job, '#' starts a comment:
+//   tune <input.datn | input.txt> <output.wav> [option=value ...]
+//   wav  <input.wav>              <output.wav> [option=value ...]
+//
+// A text tune has one chord per line, ie. "C4/0.25 E4/0.25 G4/0.5", where a note
+// without a duration lasts a crotchet (0.25).
+//
+// Options:
+//   rate=48000          Output sample rate of a tune, a WAV keeps its own
+//   tempo=120           Beats per minute of a tune, replaces the tempo map a .datn file carries
+//   channels=2          1 or 2
+//   bits=16             16 or 24
+//   dither=tpdf         none, tpdf or shaped
+//   gain=1              Channel gain
+//   pan=0               -1 left to 1 right
+//   envelope=a,d,s,r    ADSR in seconds, retriggered on every chord of a tune
+//   tail=0              Seconds rendered past the end, defaults to the envelope release
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AudioOutput.h"
+#include "Envelope.h"
+#include "Mixer.h"
+#include "SampleCache.h"
+#include "ThreadPool.h"
+#include "Tune.h"
+#include "TuneBinary.h"
+#include "TunePlayer.h"
+
+using namespace DynamicAudio;
+
+struct Job {
+    size_t line;
+    std::string kind;
+    std::string input;
+    std::string output;
+    std::map<std::string, std::string> options;
+
+    double number(const std::string& key, double fallback) const {
+        auto it = options.find(key);
+        return it == options.end() ? fallback : std::atof(it->second.c_str());
+    }
+};
+
+struct JobResult {
+    bool ok;
+    std::string message;
+    double audioSeconds;
+    double wallSeconds;
+};
+
+/// <summary> Reads every job out of the manifest, reporting lines that cannot be used. </summary>
+static bool parseManifest(const std::string& path, std::vector<Job>& jobs)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Cannot open manifest " << path << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+    std::string text;
+    for (size_t line = 1; std::getline(file, text); line++)
+    {
+        text = text.substr(0, text.find('#'));
+        std::istringstream words(text);
+
+        Job job;
+        job.line = line;
+        if (!(words >> job.kind)) continue;
+
+        if ((job.kind != "tune" && job.kind != "wav") || !(words >> job.input >> job.output)) {
+            std::cerr << path << ":" << line << ": expected 'tune|wav <input> <output> [option=value ...]'" << std::endl;
+            ok = false;
+            continue;
+        }
+
+        std::string option;
+        while (words >> option) {
+            size_t equals = option.find('=');
+            if (equals == std::string::npos) {
+                std::cerr << path << ":" << line << ": expected option=value, got '" << option << "'" << std::endl;
+                ok = false;
+                continue;
+            }
+            job.options[option.substr(0, equals)] = option.substr(equals + 1);
+        }
+        jobs.push_back(job);
+    }
+    return ok;
+}
+
+/// <summary> Reads a text tune, one chord of name/duration pairs per line. </summary>
+static bool loadTextTune(const std::string& path, Tune& tune, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file) { error = "cannot open " + path; return false; }
+
+    std::string text;
+    while (std::getline(file, text))
+    {
+        std::istringstream words(text.substr(0, text.find('#')));
+        Chord chord;
+        std::string word;
+        while (words >> word) {
+            size_t slash = word.find('/');
+            double duration = slash == std::string::npos ? 0.25 : std::atof(word.c_str() + slash + 1);
+            chord.addNote(Note(Note::Value::fromString(word.substr(0, slash)), duration));
+        }
+        if (!chord.allNotes().empty()) tune.addChord(chord);
+    }
+
+    if (tune.chords.empty()) { error = path + " has no chords"; return false; }
+    return true;
+}
+
+static bool parseEnvelope(const Job& job, EnvelopeBank::Settings& settings)
+{
+    auto it = job.options.find("envelope");
+    if (it == job.options.end()) return false;
+
+    float values[4] = { 0, 0, 1, 0 };
+    std::istringstream parts(it->second);
+    std::string part;
+    for (int i = 0; i < 4 && std::getline(parts, part, ','); i++) values[i] = (float)std::atof(part.c_str());
+
+    settings = EnvelopeBank::Settings(values[0], values[1], values[2], values[3]);
+    return true;
+}
+
+/// <summary> Renders one job straight into its output file, a block at a time. </summary>
+static JobResult renderJob(const Job& job, SampleCache& cache, size_t blockFrames)
+{
+    auto started = std::chrono::steady_clock::now();
+    JobResult result = { false, "", 0, 0 };
+
+    uint32_t sampleRate = (uint32_t)job.number("rate", 48000);
+    uint16_t channels = (uint16_t)job.number("channels", 2);
+    if (channels != 1 && channels != 2) { result.message = "channels must be 1 or 2"; return result; }
+
+    // The source, and the sample every envelope retrigger lands on
+    Tune tune;
+    std::unique_ptr<Effect::TunePlayer> player;
+    std::unique_ptr<Effect::WavStream> stream;
+    Effect::Abstract* source = nullptr;
+    std::vector<uint64_t> triggers;
+    uint64_t length = 0;
+
+    if (job.kind == "tune")
+    {
+        std::string error;
+        bool isBinary = job.input.size() > 5 && job.input.compare(job.input.size() - 5, 5, ".datn") == 0;
+        if (isBinary) {
+            TuneBinary::MappedFile file;
+            TuneBinary::View view;
+            Result loaded = TuneBinary::load(job.input, file, view);
+            if (loaded != Success) { result.message = "cannot load " + job.input; return result; }
+            tune = view.toTune();
+        }
+        else if (!loadTextTune(job.input, tune, error)) { result.message = error; return result; }
+
+        // An explicit tempo overrides the file's whole tempo map
+        if (job.options.count("tempo")) tune.setTempo(TempoMap(job.number("tempo", 120)));
+
+        player.reset(new Effect::TunePlayer(&tune, sampleRate, 0.25f));
+        source = player.get();
+
+        const Timeline& timeline = tune.timeline(sampleRate);
+        for (size_t i = 0; i < timeline.size(); i++) triggers.push_back(timeline.chordStart(i));
+        length = timeline.length();
+    }
+    else
+    {
+        Result loaded;
+        std::shared_ptr<const Sample> sample = cache.get(job.input, &loaded);
+        if (sample == nullptr) { result.message = "cannot load " + job.input; return result; }
+
+        // WavStream only reads 16-bit mono PCM so far
+        const AudioLoaderWav::Format& format = sample->wav.fmt;
+        if (format.audioFormat != 1 || format.bitsPerSample != 16 || format.numChannels != 1) {
+            result.message = "only 16-bit mono PCM input is supported";
+            return result;
+        }
+
+        sampleRate = format.sampleRate;
+        stream.reset(new Effect::WavStream(nullptr, sample));
+        source = stream.get();
+        triggers.push_back(0);
+        length = stream->sampleCount();
+    }
+
+    // Optional envelope between the source and the mixer
+    EnvelopeBank::Settings settings;
+    bool hasEnvelope = parseEnvelope(job, settings);
+    EnvelopeBank bank(1, sampleRate, blockFrames);
+    Effect::Envelope envelope(source, &bank, 0);
+    if (hasEnvelope) {
+        bank.configure(0, settings);
+        source = &envelope;
+    }
+
+    uint64_t tail = (uint64_t)(job.number("tail", hasEnvelope ? settings.release : 0) * sampleRate);
+    uint64_t total = length + tail;
+
+    Mixer mixer(1, 1, blockFrames);
+    uint32_t channel = (uint32_t)mixer.addChannel(source);
+    mixer.setGain(channel, (float)job.number("gain", 1));
+    mixer.setPan(channel, (float)job.number("pan", 0));
+
+    uint16_t bits = (uint16_t)job.number("bits", 16);
+    if (bits != 16 && bits != 24) { result.message = "bits must be 16 or 24"; return result; }
+
+    OutputConverter::Dither dither = OutputConverter::Dither::Triangular;
+    std::string ditherName = job.options.count("dither") ? job.options.at("dither") : "tpdf";
+    if (ditherName == "none") dither = OutputConverter::Dither::None;
+    else if (ditherName == "shaped") dither = OutputConverter::Dither::Shaped;
+    else if (ditherName != "tpdf") { result.message = "dither must be none, tpdf or shaped"; return result; }
+
+    WavFileSink sink(job.output, bits, dither);
+    if (sink.open(OutputFormat(sampleRate, channels, (uint32_t)blockFrames)) != Success) {
+        result.message = "cannot write " + job.output;
+        return result;
+    }
+
+    std::vector<float> interleaved(blockFrames * 2);
+    size_t next = 0;
+    for (uint64_t position = 0; position < total;)
+    {
+        // Blocks are cut at every trigger, so each retrigger lands on the first sample of a block
+        uint64_t end = std::min<uint64_t>(total, position + blockFrames);
+        if (next < triggers.size() && triggers[next] == position) {
+            uint64_t until = next + 1 < triggers.size() ? triggers[next + 1] : length;
+            if (hasEnvelope) bank.noteOn(0, 0, (uint32_t)(until - position));
+            next++;
+        }
+        if (next < triggers.size() && triggers[next] < end) end = triggers[next];
+
+        size_t frames = (size_t)(end - position);
+        bank.process(frames);
+        mixer.process(frames);
+
+        if (channels == 2) mixer.interleave(interleaved.data(), frames);
+        else for (size_t i = 0; i < frames; i++) interleaved[i] = 0.5f * (mixer.left()[i] + mixer.right()[i]);
+
+        sink.write(interleaved.data(), frames);
+        position = end;
+    }
+    sink.close();
+
+    result.ok = true;
+    result.audioSeconds = total / (double)sampleRate;
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    std::string manifest;
+    size_t threads = 0;
+    size_t blockFrames = 256;
+    bool usage = argc < 2;
+
+    for (int i = 1; i < argc && !usage; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) threads = (size_t)std::atoi(argv[++i]);
+        else if (arg == "--block" && i + 1 < argc) blockFrames = (size_t)std::max(1, std::atoi(argv[++i]));
+        else if (manifest.empty() && arg[0] != '-') manifest = arg;
+        else usage = true;
+    }
+
+    if (usage || manifest.empty()) {
+        std::cerr << "Usage: " << argv[0] << " manifest.txt [--threads count] [--block frames]" << std::endl;
+        return 1;
+    }
+
+    std::vector<Job> jobs;
+    bool parsed = parseManifest(manifest, jobs);
+
+    std::vector<JobResult> results(jobs.size());
+    SampleCache cache;
+    auto started = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        for (size_t i = 0; i < jobs.size(); i++)
+            pool.submit([&, i] { results[i] = renderJob(jobs[i], cache, blockFrames); });
+        pool.wait();
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    size_t failed = 0;
+    double audio = 0;
+    std::cout << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const JobResult& r = results[i];
+        if (!r.ok) {
+            failed++;
+            std::cout << "FAIL  " << manifest << ":" << jobs[i].line << "  " << jobs[i].output << "  " << r.message << std::endl;
+            continue;
+        }
+
+        audio += r.audioSeconds;
+        std::cout << "ok    " << jobs[i].output << "  " << r.audioSeconds << "s audio in " << r.wallSeconds
+            << "s  rtf=" << std::setprecision(1) << r.audioSeconds / std::max(r.wallSeconds, 1e-9) << "x" << std::setprecision(3) << std::endl;
+    }
+
+    std::cout << jobs.size() - failed << " of " << jobs.size() << " jobs, " << audio << "s audio in " << wall << "s"
+        << "  throughput=" << std::setprecision(1) << audio / std::max(wall, 1e-9) << "x realtime, "
+        << (jobs.size() - failed) / std::max(wall, 1e-9) << " jobs/s" << std::endl;
+
+    return failed == 0 && parsed ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+
+namespace DynamicAudio {
+
+    /// <summary> A small timing harness used by the benchmark executable. </summary>
+    struct Benchmark {
+
+        /// <summary> The timing of a single benchmarked case. </summary>
+        struct Entry {
+            std::string name;
+            uint64_t iterations;
+            double totalSeconds;
+            double nsPerIteration;
+
+            /// <summary> Extra measurements, ie. bytes on disk or realtime factor. </summary>
+            std::map<std::string, double> counters;
+        };
+
+        std::deque<Entry> entries;     // A deque so the Entry run hands back stays valid through later runs
+
+        /// <summary> How long each case should be repeated for. </summary>
+        double minSeconds;
+
+        /// <summary> Only cases with this in their name are run, empty runs everything. </summary>
+        std::string filter;
+
+        /// <summary> Handed back by run for filtered out cases, so callers can still add counters. </summary>
+        Entry skipped;
+
+        Benchmark(double minSeconds_ = 0.25) : entries(), minSeconds(minSeconds_), filter(), skipped() {}
+
+        /// <summary> Whether a case with this name would run, to skip expensive setup. </summary>
+        bool enabled(const std::string& name) const {
+            return filter.empty() || name.find(filter) != std::string::npos;
+        }
+
+        /// <summary> Repeats fn, doubling the iterations until it runs for at least minSeconds. </summary>
+        /// <param name="name"> The name of the case. </param>
+        /// <param name="fn"> The work to time. </param>
+        /// <returns> The recorded entry, counters can be added to it. </returns>
+        template<typename Fn>
+        Entry& run(const std::string& name, Fn&& fn)
+        {
+            using clock = std::chrono::steady_clock;
+
+            if (!enabled(name)) {
+                skipped = Entry{ name, 0, 0, 0, {} };
+                return skipped;
+            }
+
+            uint64_t iterations = 1;
+            double seconds = 0;
+            while (true)
+            {
+                auto start = clock::now();
+                for (uint64_t i = 0; i < iterations; i++) fn();
+                seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+                if (seconds >= minSeconds || iterations >= (1ull << 40)) break;
+                iterations *= 2;
+            }
+
+            entries.push_back(Entry{ name, iterations, seconds, seconds * 1e9 / (double)iterations, {} });
+            return entries.back();
+        }
+
+        /// <summary> Stops the compiler from optimising away a result. </summary>
+        template<typename T>
+        static void keep(const T& result) {
+#if defined(__GNUC__) || defined(__clang__)
+            asm volatile("" : : "g"(&result) : "memory");
+#else
+            static volatile char sink;
+            sink = *(const volatile char*)&result;
+#endif
+        }
+
+        /// <summary> Prints every entry as a table. </summary>
+        void print(std::ostream& out) const
+        {
+            for (const Entry& entry : entries)
+            {
+                out << std::left << std::setw(48) << entry.name
+                    << std::right << std::setw(14) << std::fixed << std::setprecision(1) << entry.nsPerIteration << " ns/iter";
+
+                for (const auto& counter : entry.counters)
+                    out << "  " << counter.first << "=" << std::setprecision(3) << counter.second;
+
+                out << std::endl;
+            }
+        }
+
+        /// <summary> Writes every entry as JSON, to compare between builds. </summary>
+        void writeJson(std::ostream& out) const
+        {
+            out << "{\n  \"benchmarks\": [";
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                const Entry& entry = entries[i];
+                out << (i ? ",\n" : "\n") << "    { \"name\": \"" << entry.name << "\""
+                    << ", \"iterations\": " << entry.iterations
+                    << std::setprecision(9) << std::defaultfloat
+                    << ", \"total_seconds\": " << entry.totalSeconds
+                    << ", \"ns_per_iteration\": " << entry.nsPerIteration
+                    << ", \"counters\": {";
+
+                bool first = true;
+                for (const auto& counter : entry.counters) {
+                    out << (first ? " " : ", ") << "\"" << counter.first << "\": ";
+                    if (std::isfinite(counter.second)) out << counter.second;
+                    else out << "null";
+                    first = false;
+                }
+                out << (first ? "} }" : " } }");
+            }
+            out << "\n  ]\n}\n";
+        }
+    };
+}
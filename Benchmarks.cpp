@@ -0,0 +1,1956 @@
+// Benchmarks.cpp : Times the hot paths of the library.
+// Not part of the DLL, built as DynamicAudioBench by CMakeLists.txt.
+// Usage: DynamicAudioBench [--json path] [--filter text] [--min-time seconds]
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioMask.h"
+#include "AudioOutput.h"
+#ifdef DYNAMICAUDIO_C_API
+#include "DynamicAudioC.h"
+#endif
+#include "Benchmark.h"
+#include "EffectDynamics.h"
+#include "EffectStretch.h"
+#include "Envelope.h"
+#include "Fft.h"
+#include "Loudness.h"
+#include "Memory.h"
+#include "Mixer.h"
+#include "OutputConvert.h"
+#include "PitchTracker.h"
+#include "RenderPlan.h"
+#include "Profiler.h"
+#include "SampleCache.h"
+#include "Scheduler.h"
+#include "Spatializer.h"
+#include "SpectrumAnalyzer.h"
+#include "StreamingSource.h"
+#include "Tune.h"
+#include "TuneBinary.h"
+#include "TunePlayer.h"
+#include "VoiceManager.h"
+#include "WaveformPyramid.h"
+
+using namespace DynamicAudio;
+
+// Note names, parsed through Note::fromString when rebuilding a tune from source
+static const char* NOTE_NAMES[] = { "C4", "D4", "E4", "F4", "G4", "A4", "B4", "C5", "Cs4", "Ds4", "Fs4", "Gs4", "As4" };
+
+static std::vector<std::vector<std::string>> makeTuneSource(size_t chordCount, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<std::vector<std::string>> source(chordCount);
+    for (auto& chord : source)
+    {
+        size_t notes = 1 + rng() % 4;
+        for (size_t i = 0; i < notes; i++)
+            chord.push_back(NOTE_NAMES[rng() % (sizeof(NOTE_NAMES) / sizeof(NOTE_NAMES[0]))]);
+    }
+    return source;
+}
+
+static Tune buildTune(const std::vector<std::vector<std::string>>& source)
+{
+    Tune tune;
+    for (const auto& names : source)
+    {
+        Chord chord;
+        for (const std::string& name : names)
+            chord.addNote(Note(Note::Value::fromString(name), 0.25 * (1 + name.size())));
+        tune.addChord(chord);
+    }
+    return tune;
+}
+
+/// <summary> A serialized tune has to open and come back the same, and a corrupt one has to be refused rather than read past. </summary>
+static bool checkTuneBinaryFiles(const Tune& tune)
+{
+    std::vector<uint8_t> bytes = TuneBinary::serialize(tune);
+    TuneBinary::View view;
+    bool roundTrip = TuneBinary::View::open(bytes.data(), bytes.size(), view) == Success
+        && view.size() == tune.chords.size() && view.toTune().chords.size() == tune.chords.size();
+
+    // A chord pointing past the note table, and the same file cut short
+    std::vector<uint8_t> corrupt = bytes;
+    TuneBinary::Header header;
+    std::memcpy(&header, corrupt.data(), sizeof(header));
+    TuneBinary::ChordRecord* chords = (TuneBinary::ChordRecord*)(corrupt.data() + header.chordOffset);
+    chords[header.chordCount - 1].firstNote = header.noteCount;
+    bool outOfRange = TuneBinary::View::open(corrupt.data(), corrupt.size(), view) == BadFormatting;
+    bool truncated = TuneBinary::View::open(bytes.data(), (size_t)header.tempoOffset, view) == BadFormatting;
+
+    if (!roundTrip || !outOfRange || !truncated)
+        std::fprintf(stderr, "Tune binary check failed: round trip %d, chord out of range refused %d, truncated refused %d\n", roundTrip, outOfRange, truncated);
+    return roundTrip && outOfRange && truncated;
+}
+
+static void benchTuneBinary(Benchmark& bench)
+{
+    if (!bench.enabled("tune_binary/")) return;
+
+    const size_t chordCount = 100000;
+    const std::string path = "bench_tune.datn";
+
+    auto source = makeTuneSource(chordCount, 1234);
+    Tune tune = buildTune(source);
+
+    size_t sourceBytes = 0;
+    for (const auto& names : source)
+        for (const std::string& name : names) sourceBytes += name.size() + 1;
+
+    bench.run("tune_binary/rebuild_from_source", [&] {
+        Tune rebuilt = buildTune(source);
+        Benchmark::keep(rebuilt);
+    }).counters["source_bytes"] = (double)sourceBytes;
+
+    bench.run("tune_binary/serialize", [&] {
+        auto bytes = TuneBinary::serialize(tune);
+        Benchmark::keep(bytes);
+    }).counters["files_checked"] = checkTuneBinaryFiles(tune);
+
+    bench.run("tune_binary/write_file", [&] {
+        TuneBinary::write(tune, path);
+    });
+
+    TuneBinary::MappedFile file;
+    TuneBinary::View view;
+    if (TuneBinary::load(path, file, view) != Success) {
+        std::fprintf(stderr, "Could not map %s\n", path.c_str());
+        return;
+    }
+
+    bench.run("tune_binary/mmap_open", [&] {
+        TuneBinary::MappedFile mapped;
+        TuneBinary::View opened;
+        TuneBinary::load(path, mapped, opened);
+        Benchmark::keep(opened);
+    }).counters["file_bytes"] = (double)view.byteSize();
+
+    bench.run("tune_binary/to_tune", [&] {
+        Tune copy = view.toTune();
+        Benchmark::keep(copy);
+    });
+
+    double length = view.chords()[view.size() - 1].start;
+    std::mt19937 rng(99);
+    std::uniform_real_distribution<double> when(0, length);
+
+    bench.run("tune_binary/view_chord_index_at_time", [&] {
+        int index = view.getChordIndexAtTime(when(rng));
+        Benchmark::keep(index);
+    });
+
+    bench.run("tune_binary/view_notes_at_time", [&] {
+        Chord notes = view.getNotesAtTime(when(rng));
+        Benchmark::keep(notes);
+    });
+
+    file.close();
+    std::remove(path.c_str());
+}
+
+/// <summary>
+/// Events for a handful of frames are scheduled again every block until their frame comes, so each frame
+/// gets some cascaded down from the coarser levels and some filed straight into level 0. They have to run
+/// in the order they were scheduled.
+/// </summary>
+static bool checkSameFrameOrder()
+{
+    const uint64_t targets[] = { 255, 300, 1000, 70000, 3 * 65536 + 7 };
+    Scheduler scheduler(4096, 256);
+    uint32_t scheduled = 0;
+    uint32_t last[5] = {};
+    size_t handled = 0;
+    bool ordered = true;
+
+    while (scheduler.now() <= targets[4])
+    {
+        for (uint32_t t = 0; t < 5; t++)
+            if (targets[t] >= scheduler.now() + 97) scheduler.schedule(targets[t], Scheduler::User, t, 0, ++scheduled);
+        scheduler.process(97, [&](const Scheduler::Event& event, size_t) {
+            ordered = ordered && event.frame == targets[event.target] && event.data > last[event.target];
+            last[event.target] = event.data;
+            handled++;
+        });
+    }
+
+    ordered = ordered && handled == scheduled;
+    if (!ordered) std::fprintf(stderr, "Scheduler ran events of one frame out of order, %zu of %u handled\n", handled, scheduled);
+    return ordered;
+}
+
+/// <summary>
+/// A tune longer than the queue is scheduled over several calls, carrying on from the returned note.
+/// Every note has to arrive as a NoteOn and its NoteOff, none twice and none cut in half by a full queue.
+/// </summary>
+static bool checkTuneScheduling()
+{
+    Tune tune = buildTune(makeTuneSource(200, 77));
+    size_t notes = 0, sounding = 0;
+    for (const Chord& chord : tune.chords) {
+        notes += chord.allNotes().size();
+        for (const Note& note : chord.allNotes()) sounding += note.value != Note::Value::null;
+    }
+
+    Scheduler scheduler(4096, 16);
+    const uint64_t start = 48000 * 60;
+    size_t next = 0, calls = 0;
+    int64_t open = 0;
+    size_t ons = 0, offs = 0;
+    bool balanced = true;
+    auto handle = [&](const Scheduler::Event& event, size_t) {
+        if (event.kind == Scheduler::NoteOn) { ons++; open++; }
+        else { offs++; open--; }
+    };
+
+    while (next < notes && calls < 1000) {
+        next = scheduler.scheduleTune(tune, 48000, start, 3, 1, next);
+        calls++;
+        // Each call may only leave whole pairs behind
+        balanced = balanced && scheduler.stats().scheduled.load() % 2 == 0;
+        scheduler.process(256, handle);
+    }
+    while (scheduler.pending() > 0) scheduler.process(48000, handle);
+
+    bool complete = balanced && next == notes && calls > 1 && ons == sounding && offs == sounding && open == 0;
+    if (!complete) std::fprintf(stderr, "Tune scheduling check failed: %zu of %zu notes over %zu calls, %zu note ons, %zu note offs of %zu\n",
+        next, notes, calls, ons, offs, sounding);
+    return complete;
+}
+
+static void benchScheduler(Benchmark& bench)
+{
+    if (!bench.enabled("scheduler/")) return;
+
+    const size_t frames = 256;
+    const uint32_t sampleRate = 48000;
+    const size_t voices = 4096;
+    const uint64_t horizon = 8 * sampleRate;
+
+    // Every event due in the next block, so each is scheduled, filed, split at and handled once
+    {
+        Scheduler scheduler(4096, 4096);
+        std::mt19937_64 rng(41);
+        Benchmark::Entry& entry = bench.run("scheduler/256_events_per_block", [&] {
+            for (size_t i = 0; i < 256; i++)
+                scheduler.schedule(scheduler.now() + rng() % frames, Scheduler::Parameter, (uint32_t)i, 0.5f);
+            scheduler.process(frames, [](size_t offset, size_t count) { Benchmark::keep(offset + count); },
+                [](const Scheduler::Event& event, size_t offset) { Benchmark::keep(event.value + offset); });
+        });
+        entry.counters["ns_per_event"] = entry.nsPerIteration / 256;
+    }
+
+    // Notes spread over the next eight seconds, refilled as they play, so tens of thousands stay pending
+    EnvelopeBank bank(voices, sampleRate, frames);
+    Scheduler scheduler(65536, 4096);
+    std::mt19937_64 rng(37);
+    auto scheduleNotes = [&](size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            uint64_t frame = scheduler.now() + frames + rng() % horizon;
+            uint32_t voice = (uint32_t)(rng() % voices);
+            scheduler.schedule(frame, i % 2 ? Scheduler::NoteOff : Scheduler::NoteOn, voice, 1);
+        }
+    };
+    for (size_t filled = 0; filled < 48000; filled += 4000) {
+        scheduleNotes(4000);
+        scheduler.process(frames, [](const Scheduler::Event&, size_t) {});
+    }
+
+    uint64_t dispatched = scheduler.stats().dispatched.load();
+    size_t blocks = 0;
+    size_t splits = 0;
+    Benchmark::Entry& steady = bench.run("scheduler/48000_pending_256_frames", [&] {
+        scheduleNotes(64);
+        scheduler.process(frames,
+            [&](size_t offset, size_t count) { splits++; Benchmark::keep(offset + count); },
+            [&](const Scheduler::Event& event, size_t offset) {
+                if (event.kind == Scheduler::NoteOn) bank.noteOn(event.target, (uint32_t)offset);
+                else bank.noteOff(event.target, (uint32_t)offset);
+            });
+        blocks++;
+    });
+    steady.counters["pending"] = (double)scheduler.pending();
+    steady.counters["events_per_block"] = blocks ? (double)(scheduler.stats().dispatched.load() - dispatched) / blocks : 0;
+    steady.counters["splits_per_block"] = blocks ? (double)splits / blocks : 0;
+    steady.counters["wheel_full_drops"] = (double)scheduler.stats().dropped.load();
+    steady.counters["blocks_of_budget"] = steady.nsPerIteration / (frames * 1e9 / sampleRate);
+    steady.counters["same_frame_in_order"] = checkSameFrameOrder();
+    steady.counters["tune_pairs_complete"] = checkTuneScheduling();
+}
+
+static void benchEnvelopes(Benchmark& bench)
+{
+    const size_t voices = 4096;
+    const size_t frames = 256;
+    const uint32_t sampleRate = 48000;
+
+    EnvelopeBank bank(voices, sampleRate, frames);
+    for (uint32_t voice = 0; voice < voices; voice++)
+    {
+        EnvelopeBank::Settings settings(0.002f + 0.001f * (voice % 7), 0.05f, 0.7f, 0.08f);
+        bank.configure(voice, voice % 2 ? settings.exponential() : settings);
+    }
+
+    // Retrigger every voice on a staggered sample, so stages keep changing inside blocks
+    uint64_t block = 0;
+    Benchmark::Entry& entry = bench.run("envelope/4096_voices_256_frames", [&] {
+        for (uint32_t voice = (uint32_t)(block % 64); voice < voices; voice += 64)
+            bank.noteOn(voice, voice % frames, (uint32_t)(sampleRate / 10));
+        bank.process(frames);
+        Benchmark::keep(bank.gains(0)[0]);
+        block++;
+    });
+    entry.counters["realtime_factor"] = (frames * 1e9 / sampleRate) / entry.nsPerIteration;
+}
+
+static void benchMixer(Benchmark& bench, size_t channels)
+{
+    const size_t frames = 256;
+    const uint32_t sampleRate = 48000;
+
+    // Four submixes into the master, plus a shared effects return
+    Mixer mixer(channels, 6, frames);
+    uint32_t submixes[4];
+    for (uint32_t& bus : submixes) bus = (uint32_t)mixer.addBus();
+    uint32_t effects = (uint32_t)mixer.addBus();
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> sample(-0.1f, 0.1f);
+    for (size_t i = 0; i < channels; i++)
+    {
+        uint32_t channel = (uint32_t)mixer.addChannel(nullptr, submixes[i % 4]);
+        mixer.setPan(channel, sample(rng) * 10);
+        mixer.setSend(channel, effects, 0.2f);
+
+        float* input = mixer.channelInput(channel);
+        for (size_t f = 0; f < frames; f++) input[f] = sample(rng);
+    }
+
+    // Move a gain every block, so some channels always ramp
+    uint32_t block = 0;
+    Benchmark::Entry& entry = bench.run("mixer/" + std::to_string(channels) + "_channels_stereo_256_frames", [&] {
+        mixer.setGain(block % channels, 0.5f + 0.5f * (block & 1));
+        mixer.process(frames);
+        Benchmark::keep(mixer.left()[0]);
+        block++;
+    });
+    entry.counters["realtime_factor"] = (frames * 1e9 / sampleRate) / entry.nsPerIteration;
+}
+
+static void benchDynamics(Benchmark& bench)
+{
+    if (!bench.enabled("dynamics/")) return;
+
+    const size_t frames = 256;
+    const uint32_t sampleRate = 48000;
+    const double blockNs = frames * 1e9 / sampleRate;
+
+    // Loud stereo noise with a transient every few blocks
+    std::vector<float> sourceLeft(frames * 64), sourceRight(frames * 64);
+    std::mt19937 rng(21);
+    std::normal_distribution<float> level(0, 0.4f);
+    for (size_t i = 0; i < sourceLeft.size(); i++) {
+        sourceLeft[i] = level(rng) * (i % 3000 < 10 ? 4.0f : 1.0f);
+        sourceRight[i] = level(rng);
+    }
+    std::vector<float> left(frames), right(frames), sidechain(frames, 0.5f);
+    size_t block = 0;
+    auto nextBlock = [&] {
+        size_t offset = (block++ % 64) * frames;
+        std::copy(sourceLeft.begin() + offset, sourceLeft.begin() + offset + frames, left.begin());
+        std::copy(sourceRight.begin() + offset, sourceRight.begin() + offset + frames, right.begin());
+    };
+
+    Effect::Compressor compressor((float)sampleRate, -18, 4);
+    Benchmark::Entry& compress = bench.run("dynamics/compressor_stereo_256_frames", [&] {
+        nextBlock();
+        compressor.process(left.data(), right.data(), frames);
+        Benchmark::keep(left[0]);
+    });
+    compress.counters["block_budget_percent"] = 100 * compress.nsPerIteration / blockNs;
+
+    Effect::Compressor ducker((float)sampleRate, -30, 8);
+    ducker.setSidechain(sidechain.data());
+    Benchmark::Entry& duck = bench.run("dynamics/compressor_sidechain_256_frames", [&] {
+        nextBlock();
+        ducker.process(left.data(), right.data(), frames);
+        Benchmark::keep(left[0]);
+    });
+    duck.counters["block_budget_percent"] = 100 * duck.nsPerIteration / blockNs;
+
+    // The queue keeps the cost flat however far the limiter looks ahead
+    for (float lookahead : { 0.001f, 0.005f, 0.02f })
+    {
+        Effect::Limiter limiter((float)sampleRate, frames, -1, lookahead);
+        float loudest = 0;
+        Benchmark::Entry& entry = bench.run("dynamics/limiter_" + std::to_string((int)(lookahead * 1000)) + "ms_lookahead_256_frames", [&] {
+            nextBlock();
+            limiter.process(left.data(), right.data(), frames);
+            loudest = std::max(loudest, std::max(Simd::peak(left.data(), frames), Simd::peak(right.data(), frames)));
+        });
+        entry.counters["block_budget_percent"] = 100 * entry.nsPerIteration / blockNs;
+        entry.counters["peak_db"] = Effect::toDecibels(loudest);
+        entry.counters["gain_reduction_db"] = limiter.gainReduction();
+    }
+}
+
+static void benchSpatializer(Benchmark& bench, size_t sources, std::vector<float> speakerAngles)
+{
+    Spatializer spatializer(sources, speakerAngles);
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> position(-100, 100);
+    std::uniform_real_distribution<float> velocity(-20, 20);
+    for (size_t i = 0; i < sources; i++)
+    {
+        Spatializer::SourceSettings settings(1, 500, 1);
+        if (i % 3 == 0) {
+            settings.coneInnerAngle = 90;
+            settings.coneOuterAngle = 180;
+            settings.coneOuterGain = 0.2f;
+        }
+
+        uint32_t source = (uint32_t)spatializer.addSource(settings);
+        spatializer.setPosition(source, Vector3(position(rng), position(rng), position(rng)));
+        spatializer.setVelocity(source, Vector3(velocity(rng), velocity(rng), velocity(rng)));
+        spatializer.setDirection(source, Vector3(position(rng), 0, position(rng)));
+    }
+
+    // The listener turns a little every block
+    float angle = 0;
+    bench.run("spatializer/" + std::to_string(sources) + "_sources_" + std::to_string(speakerAngles.size()) + "_speakers", [&] {
+        angle += 0.01f;
+        spatializer.listener.forward = Vector3(std::sin(angle), 0, -std::cos(angle));
+        spatializer.process();
+        Benchmark::keep(spatializer.gains()[0]);
+    });
+}
+
+static void benchVoices(Benchmark& bench, size_t voices, bool virtualize)
+{
+    if (!bench.enabled("voices/")) return;
+
+    const size_t frames = 256;
+    const uint32_t sampleRate = 48000;
+
+    // Short looping phrases scattered around a large space, most of them far away
+    std::vector<Tune> tunes(voices);
+    std::vector<Effect::TunePlayer> players;
+    players.reserve(voices);
+    for (size_t i = 0; i < voices; i++) {
+        tunes[i] = buildTune(makeTuneSource(64, (unsigned int)i));
+        players.emplace_back(&tunes[i], sampleRate);
+    }
+
+    Spatializer spatializer(voices);
+    VoiceManager manager(voices, virtualize ? 0.001f : 0.0f);
+    Mixer mixer(voices, 1, frames);
+    std::vector<Effect::Voice> nodes;
+    nodes.reserve(voices);
+
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> position(-2000, 2000);
+    for (size_t i = 0; i < voices; i++)
+    {
+        uint32_t source = (uint32_t)spatializer.addSource(Spatializer::SourceSettings(1, 5000, 1));
+        spatializer.setPosition(source, Vector3(position(rng), 0, position(rng)));
+        nodes.emplace_back(&manager, (uint32_t)manager.addVoice(&players[i]));
+        mixer.addChannel(&nodes.back());
+    }
+
+    Benchmark::Entry& entry = bench.run("voices/" + std::to_string(voices) + (virtualize ? "_virtualized" : "_all_real") + "_256_frames", [&] {
+        spatializer.process();
+        manager.setGains(spatializer.gains());
+        manager.update();
+        for (uint32_t channel = 0; channel < voices; channel++)
+            mixer.setPanGains(channel, spatializer.speakerGains(0)[channel], spatializer.speakerGains(1)[channel]);
+        mixer.process(frames);
+        Benchmark::keep(mixer.left()[0]);
+    });
+    entry.counters["realtime_factor"] = (frames * 1e9 / sampleRate) / entry.nsPerIteration;
+    entry.counters["real_voices"] = manager.stats().realVoices.load();
+    entry.counters["virtual_voices"] = manager.stats().virtualVoices.load();
+}
+
+static void benchMasks(Benchmark& bench, size_t sources)
+{
+    AudioMasks masks(sources, sources);
+
+    // Every source is in one of eight kinds and one of four players
+    for (uint32_t source = 0; source < sources; source++)
+        masks.setMask(source, AudioMasks::category(source % 8) | AudioMasks::category(8 + source % 4));
+    masks.beginBlock();
+
+    std::vector<uint64_t> match(masks.wordCount());
+    std::string size = std::to_string(sources);
+
+    uint32_t block = 0;
+    bench.run("masks/" + size + "_sources_toggle_mute_and_begin_block", [&] {
+        if (block++ & 1) masks.mute(AudioMasks::category(3));
+        else masks.unmute(AudioMasks::category(3));
+        masks.beginBlock();
+        Benchmark::keep(masks.audibleBits()[0]);
+    });
+
+    bench.run("masks/" + size + "_sources_match_all", [&] {
+        masks.matchAll(AudioMasks::category(2) | AudioMasks::category(9), match.data());
+        Benchmark::keep(masks.count(match.data()));
+    });
+
+    // The walk this replaces, for comparison
+    bench.run("masks/" + size + "_sources_match_all_per_source", [&] {
+        AudioMask wanted = AudioMasks::category(2) | AudioMasks::category(9);
+        size_t found = 0;
+        for (uint32_t source = 0; source < sources; source++)
+            found += (masks.getMask(source) & wanted) == wanted;
+        Benchmark::keep(found);
+    });
+}
+
+static void benchGraphAllocation(Benchmark& bench)
+{
+    const size_t nodes = 1024;
+
+    // A chain of stream nodes, the shape of a small effect graph, built and torn down whole
+    AudioLoaderWav::Wav wav;
+    std::vector<Effect::Abstract*> graph(nodes);
+    bench.run("graph/1024_nodes_build_teardown_heap", [&] {
+        Effect::Const* start = new Effect::Const(1);
+        for (size_t i = 0; i < nodes; i++) graph[i] = new Effect::WavStream(i ? graph[i - 1] : start, wav);
+        Benchmark::keep(graph[nodes - 1]);
+        for (size_t i = 0; i < nodes; i++) delete static_cast<Effect::WavStream*>(graph[i]);
+        delete start;
+    });
+
+    Arena arena;
+    size_t heapBefore = 0;
+    Benchmark::Entry& entry = bench.run("graph/1024_nodes_build_teardown_arena", [&] {
+        if (heapBefore == 0) heapBefore = arena.heapAllocations();
+        Effect::Const* start = arena.make<Effect::Const>(1);
+        for (size_t i = 0; i < nodes; i++) graph[i] = arena.make<Effect::WavStream>(i ? graph[i - 1] : start, wav);
+        Benchmark::keep(graph[nodes - 1]);
+        arena.reset();
+    });
+    entry.counters["heap_allocations_after_first"] = (double)(arena.heapAllocations() - heapBefore);
+}
+
+// A steady level, so a fade shows up as the first sample of a block
+struct ConstantSource : public Effect::Abstract {
+    float level;
+    ConstantSource(float level_) : level(level_) {}
+    Effect::value get(Effect::value in) override { return in; }
+    void process(float* out, size_t frames) override { Simd::fill(out, level, frames); }
+};
+
+/// <summary> Publishes twice before the audio thread takes a plan, the fades of the first must survive into the second. </summary>
+static bool checkPlanFades(size_t frames)
+{
+    RenderGraph graph(frames);
+    PlanExchange exchange;
+    graph.publish(exchange);
+    exchange.acquire()->process(frames);
+
+    uint32_t added = (uint32_t)graph.addSource(std::make_shared<ConstantSource>(1.0f));
+    graph.publish(exchange);
+    graph.setPan(added, 0);
+    graph.publish(exchange);
+    RenderPlan* plan = exchange.acquire();
+    plan->process(frames);
+    bool fadedIn = plan->getMixer().left()[0] < 0.01f;
+
+    exchange.acquire()->process(frames);
+    float steady = exchange.acquire()->getMixer().left()[0];
+
+    graph.removeSource(added);
+    graph.publish(exchange);
+    graph.addBus();
+    graph.publish(exchange);
+    plan = exchange.acquire();
+    plan->process(frames);
+    bool fadedOut = std::fabs(plan->getMixer().left()[0] - steady) < 0.01f && plan->getMixer().left()[frames - 1] < 0.01f;
+
+    if (!fadedIn || !fadedOut) std::fprintf(stderr, "Render plan fades lost to a replaced plan: fade in %d, fade out %d\n", fadedIn, fadedOut);
+    return fadedIn && fadedOut;
+}
+
+static void benchRenderPlan(Benchmark& bench)
+{
+    if (!bench.enabled("plan/")) return;
+
+    const size_t frames = 256;
+    const uint32_t sampleRate = 48000;
+    const size_t sources = 64;
+
+    std::vector<uint8_t> pcm(sampleRate * sizeof(int16_t));
+    std::mt19937 rng(29);
+    for (uint8_t& byte : pcm) byte = (uint8_t)rng();
+    AudioLoaderWav::Wav wav;
+    wav.data.chunkSize = (uint32_t)pcm.size();
+    wav.data.data = pcm.data();
+
+    RenderGraph graph(frames);
+    uint32_t music = (uint32_t)graph.addBus();
+    uint32_t effects = (uint32_t)graph.addBus();
+    std::vector<uint32_t> ids;
+    for (size_t i = 0; i < sources; i++)
+        ids.push_back((uint32_t)graph.addSource(std::make_shared<Effect::WavStream>(nullptr, wav), i % 2 ? music : effects));
+    graph.setInsert(Mixer::Master, std::make_shared<Effect::Limiter>((float)sampleRate, frames));
+
+    Benchmark::Entry& compile = bench.run("plan/compile_64_sources", [&] {
+        std::unique_ptr<RenderPlan> plan = graph.compile();
+        Benchmark::keep(plan);
+    });
+    compile.counters["blocks_of_budget"] = compile.nsPerIteration / (frames * 1e9 / sampleRate);
+
+    PlanExchange exchange;
+    graph.publish(exchange);
+    Benchmark::Entry& acquire = bench.run("plan/acquire_unchanged", [&] { Benchmark::keep(exchange.acquire()); });
+
+    auto block = [&] {
+        RenderPlan* plan = exchange.acquire();
+        plan->process(frames);
+        Benchmark::keep(plan->getMixer().left()[0]);
+    };
+    Benchmark::Entry& steady = bench.run("plan/64_sources_256_frames", block);
+    steady.counters["acquire_ns"] = acquire.nsPerIteration;
+
+    // A control thread adding, removing, rerouting and regaining sources as fast as it can
+    std::atomic<bool> running(true);
+    std::atomic<uint64_t> published(0);
+    std::thread control([&] {
+        std::mt19937 edits(31);
+        while (running.load(std::memory_order_relaxed)) {
+            uint32_t victim = ids[edits() % ids.size()];
+            if (edits() % 2) {
+                graph.removeSource(victim);
+                ids.erase(std::find(ids.begin(), ids.end(), victim));
+                ids.push_back((uint32_t)graph.addSource(std::make_shared<Effect::WavStream>(nullptr, wav), edits() % 2 ? music : effects));
+            }
+            else {
+                graph.setGain(victim, (edits() % 100) / 100.0f);
+                graph.route(victim, edits() % 2 ? music : effects);
+            }
+            graph.publish(exchange);
+            published.fetch_add(1, std::memory_order_relaxed);
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    });
+
+    uint64_t firstGeneration = exchange.acquire()->getGeneration();
+    size_t blocks = 0;
+    Benchmark::Entry& edited = bench.run("plan/64_sources_256_frames_concurrent_edits", [&] {
+        block();
+        blocks++;
+    });
+    uint64_t swaps = exchange.acquire()->getGeneration() - firstGeneration;
+    running.store(false);
+    control.join();
+    exchange.collect();
+
+    edited.counters["swaps_per_block"] = blocks ? (double)swaps / blocks : 0;
+    edited.counters["slowdown_percent"] = 100 * (edited.nsPerIteration / steady.nsPerIteration - 1);
+    edited.counters["fades_kept_across_replaced_plans"] = checkPlanFades(frames);
+}
+
+static void benchSampleCache(Benchmark& bench)
+{
+    const std::string path = "bench_sample.wav";
+    const uint32_t sampleRate = 48000;
+
+    // One second of 16-bit mono
+    {
+        AudioLoaderWav::Writer writer;
+        writer.open(path, sampleRate, 1, 16);
+        std::vector<int16_t> frames(sampleRate, 1000);
+        writer.writeRaw(frames.data(), frames.size());
+    }
+
+    bench.run("sample_cache/load_every_time", [&] {
+        std::shared_ptr<Sample> sample;
+        Sample::load(path, sample);
+        Benchmark::keep(sample);
+    });
+
+    SampleCache cache;
+    Benchmark::Entry& entry = bench.run("sample_cache/get_hit", [&] {
+        std::shared_ptr<const Sample> sample = cache.get(path);
+        Benchmark::keep(sample);
+    });
+    SampleCache::Stats stats = cache.stats();
+    entry.counters["hit_rate"] = stats.hits / (double)(stats.hits + stats.misses);
+    entry.counters["resident_kb"] = stats.residentBytes / 1024.0;
+
+    std::remove(path.c_str());
+}
+
+/// <summary> Writes a WAV of noise in any PCM layout, for the loader to read back. </summary>
+static void writeNoiseWav(const std::string& path, uint32_t sampleRate, uint16_t channels, uint16_t bitsPerSample, double seconds)
+{
+    AudioLoaderWav::Writer writer;
+    writer.open(path, sampleRate, channels, bitsPerSample);
+
+    std::mt19937 rng(5);
+    size_t frameBytes = (size_t)channels * bitsPerSample / 8;
+    std::vector<uint8_t> block(4096 * frameBytes);
+    size_t remaining = (size_t)(sampleRate * seconds);
+    while (remaining > 0) {
+        size_t frames = std::min<size_t>(remaining, 4096);
+        for (size_t i = 0; i < frames * frameBytes; i++) block[i] = (uint8_t)rng();
+        writer.writeRaw(block.data(), frames);
+        remaining -= frames;
+    }
+}
+
+/// <summary> A WAV whose header says nothing about the size of a frame, every reader has to turn it away. </summary>
+static void writeZeroBlockWav(const std::string& path)
+{
+    AudioLoaderWav::Format fmt{};
+    std::memcpy(fmt.chunkID, AudioLoaderWav::ID_FMT, 4);
+    fmt.chunkSize = 16;
+    fmt.audioFormat = 1;
+    fmt.numChannels = 2;
+    fmt.sampleRate = 48000;
+    fmt.bitsPerSample = 16;
+
+    uint32_t riffSize = 4 + 8 + 16 + 8 + 4, dataSize = 4, zero = 0;
+    std::ofstream file(path, std::ios_base::binary);
+    file.write(AudioLoaderWav::ID_RIFF, 4);
+    file.write((const char*)&riffSize, 4);
+    file.write(AudioLoaderWav::FORMAT, 4);
+    file.write((const char*)&fmt, 8 + 16);
+    file.write(AudioLoaderWav::ID_DATA, 4);
+    file.write((const char*)&dataSize, 4);
+    file.write((const char*)&zero, 4);
+}
+
+static void benchLoader(Benchmark& bench)
+{
+    struct Layout { const char* name; uint32_t sampleRate; uint16_t channels; uint16_t bits; };
+    const Layout layouts[] = {
+        { "8bit_mono_22k", 22050, 1, 8 },
+        { "16bit_mono_48k", 48000, 1, 16 },
+        { "16bit_stereo_44k", 44100, 2, 16 },
+        { "24bit_stereo_48k", 48000, 2, 24 },
+    };
+    const double lengths[] = { 0.1, 1, 10 };
+    const std::string path = "bench_loader.wav";
+
+    // The arena is reset every load, so the loader is timed rather than the heap
+    Arena arena(1 << 20);
+    for (const Layout& layout : layouts)
+    {
+        for (double seconds : lengths)
+        {
+            std::string name = std::string("loader/load_raw_file_") + layout.name + "_" + std::to_string((int)(seconds * 1000)) + "ms";
+            if (!bench.enabled(name)) continue;
+
+            writeNoiseWav(path, layout.sampleRate, layout.channels, layout.bits, seconds);
+            AudioLoaderWav::Wav wav;
+            Benchmark::Entry& entry = bench.run(name, [&] {
+                AudioLoaderWav::loadRawFile(path, wav, arena, false);
+                Benchmark::keep(wav.data.data[0]);
+                arena.reset();
+            });
+            entry.counters["mb_per_second"] = wav.data.chunkSize / (entry.nsPerIteration * 1e-9) / 1e6;
+        }
+    }
+    std::remove(path.c_str());
+}
+
+static void benchLoudness(Benchmark& bench)
+{
+    if (!bench.enabled("loudness/")) return;
+
+    const size_t frames = 256;
+    const uint32_t sampleRate = 48000;
+    const double blockNs = frames * 1e9 / sampleRate;
+
+    // The EBU reference, a 1kHz sine at -23 dBFS on both channels, reads -23 LUFS
+    std::vector<float> left(sampleRate * 4), right(sampleRate * 4);
+    const float amplitude = std::pow(10.0f, -23.0f / 20.0f);
+    for (size_t i = 0; i < left.size(); i++) left[i] = right[i] = amplitude * (float)std::sin(2 * 3.14159265358979 * 1000 * i / sampleRate);
+
+    LoudnessMeter stereo(sampleRate, 2);
+    size_t offset = 0;
+    Benchmark::Entry& meter = bench.run("loudness/meter_stereo_256_frames", [&] {
+        stereo.push(left.data() + offset, right.data() + offset, frames);
+        offset = offset + 2 * frames > left.size() ? 0 : offset + frames;
+        Benchmark::keep(stereo.momentary());
+    });
+    meter.counters["block_budget_percent"] = 100 * meter.nsPerIteration / blockNs;
+    meter.counters["integrated_lufs"] = stereo.integrated();
+    meter.counters["true_peak_dbtp"] = stereo.truePeak();
+
+    // Four channels cost about what two do, they share the lanes
+    LoudnessMeter quad(sampleRate, 4);
+    const float* planar[4] = { left.data(), right.data(), left.data(), right.data() };
+    Benchmark::Entry& wide = bench.run("loudness/meter_quad_256_frames", [&] {
+        quad.push(planar, frames);
+        Benchmark::keep(quad.momentary());
+    });
+    wide.counters["block_budget_percent"] = 100 * wide.nsPerIteration / blockNs;
+
+    // Peaks must count however the asset ends, a loud final 40ms and a 50ms asset are both under a 100ms sub-block
+    std::vector<float> tail(sampleRate * 105 / 100), blip(sampleRate / 20);
+    for (size_t i = 0; i < tail.size(); i++) {
+        float level = i >= tail.size() - sampleRate / 25 ? 0.99f : 0.1f;
+        tail[i] = level * (float)std::sin(2 * 3.14159265358979 * 997 * i / sampleRate);
+    }
+    for (size_t i = 0; i < blip.size(); i++) blip[i] = 0.5f * (float)std::sin(2 * 3.14159265358979 * 997 * i / sampleRate);
+
+    LoudnessInfo tailInfo, blipInfo;
+    Benchmark::Entry& assets = bench.run("loudness/measure_short_assets", [&] {
+        tailInfo = LoudnessMeter::measure(tail.data(), tail.size(), 1, sampleRate);
+        blipInfo = LoudnessMeter::measure(blip.data(), blip.size(), 1, sampleRate);
+    });
+    assets.counters["loud_tail_true_peak_dbtp"] = tailInfo.truePeak;
+    assets.counters["50ms_true_peak_dbtp"] = blipInfo.truePeak;
+    if (!(tailInfo.truePeak > -0.5f) || !(std::fabs(blipInfo.truePeak + 6.02f) < 0.5f))
+        std::fprintf(stderr, "Loudness peaks missed: %.2f dBTP for a loud tail, %.2f dBTP for a 50ms asset\n", tailInfo.truePeak, blipInfo.truePeak);
+
+    // A 5.1 file is measured on its first four channels, read with the stride of all six
+    {
+        const std::string widePath = "bench_loudness_6ch.wav";
+        const size_t wideFrames = sampleRate * 2;
+        std::vector<float> quad(wideFrames * 4);
+        std::vector<int16_t> six(wideFrames * 6);
+        for (size_t i = 0; i < wideFrames; i++)
+            for (size_t c = 0; c < 6; c++) {
+                float level = c < 4 ? 0.1f : 0.9f;
+                int16_t sample = (int16_t)std::lround(32767 * level * std::sin(2 * 3.14159265358979 * (440 + 110 * c) * i / sampleRate));
+                six[i * 6 + c] = sample;
+                if (c < 4) quad[i * 4 + c] = sample / 32768.0f;
+            }
+        {
+            AudioLoaderWav::Writer writer;
+            writer.open(widePath, sampleRate, 6, 16);
+            writer.writeRaw((const uint8_t*)six.data(), wideFrames);
+        }
+        AudioLoaderWav::Wav sixChannels;
+        AudioLoaderWav::HeapAllocator heap;
+        AudioLoaderWav::loadRawFile(widePath, sixChannels, heap);
+        LoudnessInfo expected = LoudnessMeter::measure(quad.data(), wideFrames, 4, sampleRate);
+        const LoudnessInfo& measured = sixChannels.loudness;
+        bool matches = std::fabs(measured.integrated - expected.integrated) < 0.05f && std::fabs(measured.truePeak - expected.truePeak) < 0.05f
+            && measured.truePeak < -19.5f;
+        if (!matches)
+            std::fprintf(stderr, "Loudness of a 6 channel file read from the wrong channels: %.2f LUFS %.2f dBTP, expected %.2f LUFS %.2f dBTP\n",
+                measured.integrated, measured.truePeak, expected.integrated, expected.truePeak);
+        assets.counters["6_channel_file_matches"] = matches;
+        AudioLoaderWav::release(sixChannels);
+        std::remove(widePath.c_str());
+    }
+
+    // Measuring at load, against the loader alone
+    const std::string path = "bench_loudness.wav";
+    writeNoiseWav(path, 44100, 2, 16, 10);
+    Arena arena(1 << 20);
+    AudioLoaderWav::Wav wav;
+    for (bool measure : { false, true })
+    {
+        Benchmark::Entry& entry = bench.run(std::string("loudness/load_16bit_stereo_44k_10000ms_") + (measure ? "measured" : "unmeasured"), [&] {
+            AudioLoaderWav::loadRawFile(path, wav, arena, measure);
+            Benchmark::keep(wav.data.data[0]);
+            arena.reset();
+        });
+        entry.counters["realtime_factor"] = 10 / (entry.nsPerIteration * 1e-9);
+        if (measure) {
+            entry.counters["integrated_lufs"] = wav.loudness.integrated;
+            entry.counters["normalization_gain"] = wav.loudness.normalizationGain(-23);
+        }
+    }
+    std::remove(path.c_str());
+}
+
+static void benchWaveform(Benchmark& bench)
+{
+    if (!bench.enabled("waveform/")) return;
+
+    const uint32_t sampleRate = 48000;
+    const size_t pixels = 1920;
+    const std::string path = "bench_waveform.wav";
+    writeNoiseWav(path, sampleRate, 2, 16, 60);
+
+    AudioLoaderWav::Wav wav;
+    AudioLoaderWav::HeapAllocator heap;
+    AudioLoaderWav::loadRawFile(path, wav, heap, false);
+    double frames = (double)(wav.data.size() / wav.fmt.blockAlign);
+
+    WaveformPyramid pyramid;
+    Benchmark::Entry& build = bench.run("waveform/build_60s_stereo", [&] {
+        pyramid.build(wav);
+        Benchmark::keep(pyramid.level(0)[0].max);
+    });
+    build.counters["mb_per_second"] = wav.data.chunkSize / (build.nsPerIteration * 1e-9) / 1e6;
+
+    // What drawing did before, every sample of the visible range scanned per redraw
+    std::vector<WaveformPyramid::Column> columns(pixels);
+    Benchmark::Entry& scan = bench.run("waveform/scan_whole_file_1920_pixels", [&] {
+        const int16_t* samples = (const int16_t*)wav.data.data;
+        double framesPerPixel = frames / pixels;
+        for (size_t p = 0; p < pixels; p++) {
+            size_t a = (size_t)(p * framesPerPixel), b = (size_t)((p + 1) * framesPerPixel);
+            float lo = 1, hi = -1;
+            for (size_t f = a; f < b; f++) {
+                float sample = samples[f * 2] * (1.0f / 32768.0f);
+                lo = std::min(lo, sample);
+                hi = std::max(hi, sample);
+            }
+            columns[p] = WaveformPyramid::Column{ lo, hi, 0 };
+        }
+        Benchmark::keep(columns[0].max);
+    });
+
+    struct Zoom { const char* name; double seconds; };
+    const Zoom zooms[] = { { "whole_file", 60 }, { "1s", 1 }, { "10ms", 0.01 } };
+    for (const Zoom& zoom : zooms) {
+        double framesPerPixel = zoom.seconds * sampleRate / pixels;
+        Benchmark::Entry& entry = bench.run(std::string("waveform/query_") + zoom.name + "_1920_pixels", [&] {
+            pyramid.query(0, frames / 3, framesPerPixel, columns.data(), pixels);
+            Benchmark::keep(columns[0].max);
+        });
+        entry.counters["ns_per_pixel"] = entry.nsPerIteration / pixels;
+        if (zoom.seconds == 60) entry.counters["speedup_over_scan"] = scan.nsPerIteration / entry.nsPerIteration;
+    }
+
+    std::string cache = WaveformPyramid::cachePath(path);
+    pyramid.save(cache);
+    WaveformPyramid cached;
+    Benchmark::Entry& load = bench.run("waveform/load_cache_60s_stereo", [&] {
+        cached.load(cache, wav);
+        Benchmark::keep(cached.level(0)[0].max);
+    });
+    load.counters["faster_than_build"] = build.nsPerIteration / load.nsPerIteration;
+
+    // A wave whose frames have no size is refused before anything divides by it, and leaves no cache behind
+    const std::string brokenPath = "bench_waveform_zero_block.wav";
+    writeZeroBlockWav(brokenPath);
+    AudioLoaderWav::Wav broken;
+    AudioLoaderWav::loadRawFile(brokenPath, broken, heap, false);
+    WaveformPyramid refused;
+    bool buildRefused = refused.build(broken) == NotSupported;
+    bool loadRefused = refused.load(cache, broken) == NotSupported;
+    bool cachedRefused = refused.buildCached(brokenPath, broken) == NotSupported && !std::ifstream(WaveformPyramid::cachePath(brokenPath));
+    if (!buildRefused || !loadRefused || !cachedRefused)
+        std::fprintf(stderr, "Waveform check failed: zero block size refused by build %d, load %d, buildCached %d\n", buildRefused, loadRefused, cachedRefused);
+    build.counters["malformed_refused"] = buildRefused && loadRefused && cachedRefused;
+    AudioLoaderWav::release(broken);
+    std::remove(brokenPath.c_str());
+
+    std::remove(cache.c_str());
+    std::remove(path.c_str());
+    AudioLoaderWav::release(wav);
+}
+
+/// <summary>
+/// Every compiled in decoder opens what it should and refuses what it should not. Builds that fetched
+/// minimp3 also decode one of its conformance streams against the reference output shipped with it.
+/// </summary>
+static bool checkDecoders(const std::string& wavPath)
+{
+    std::unique_ptr<Decoder> decoder;
+    bool wav = openDecoder(wavPath, decoder) == Success && decoder->info().frames > 0;
+    writeZeroBlockWav("bench_zero_block.wav");
+    bool zeroBlock = openDecoder("bench_zero_block.wav", decoder) == NotSupported;
+    std::remove("bench_zero_block.wav");
+    bool unknown = openDecoder("bench_decoder.flac", decoder) == NotSupported;
+    bool passed = wav && zeroBlock && unknown;
+    if (!passed) std::fprintf(stderr, "WAV decoder check failed: opened %d, zero block size refused %d, unknown extension refused %d\n", wav, zeroBlock, unknown);
+
+#ifdef DYNAMICAUDIO_VORBIS
+    {
+        std::ofstream("bench_garbage.ogg", std::ios_base::binary) << std::string(4096, 'x');
+        VorbisDecoder vorbis, missing;
+        bool garbage = vorbis.open("bench_garbage.ogg") == BadFormatting;
+        bool absent = missing.open("bench_missing.ogg") == CannotOpenFile;
+        std::remove("bench_garbage.ogg");
+        if (!garbage || !absent) std::fprintf(stderr, "Vorbis decoder check failed: garbage refused %d, missing file refused %d\n", garbage, absent);
+        passed = passed && garbage && absent;
+    }
+#ifdef DYNAMICAUDIO_BENCH_ASSETS
+    {
+        // Three seconds of a 440Hz left and 660Hz right sine at half scale, encoded by libvorbis at quality 6
+        const uint64_t length = 3 * 44100;
+        VorbisDecoder ogg;
+        bool opened = ogg.open(DYNAMICAUDIO_BENCH_ASSETS "/sine_440_660_stereo.ogg") == Success;
+        bool shape = opened && ogg.info().sampleRate == 44100 && ogg.info().channels == 2 && ogg.info().frames == length;
+
+        std::vector<float> decoded;
+        if (shape) {
+            std::vector<float> block(4096 * 2);
+            size_t frames;
+            while ((frames = ogg.read(block.data(), 4096)) > 0) decoded.insert(decoded.end(), block.begin(), block.begin() + frames * 2);
+        }
+        bool whole = shape && decoded.size() == length * 2;
+
+        // Lossy, so against the sine it came from rather than sample for sample
+        double signal = 0, noise = 0;
+        for (size_t i = 0; whole && i < length; i++)
+            for (size_t c = 0; c < 2; c++) {
+                double reference = 0.5 * std::sin(2 * 3.14159265358979 * (c ? 660 : 440) * i / 44100);
+                signal += reference * reference;
+                noise += (decoded[i * 2 + c] - reference) * (decoded[i * 2 + c] - reference);
+            }
+        double snr = noise > 0 ? 10 * std::log10(signal / noise) : 200;
+
+        // Seeking lands on the exact frame, on a later page and back on the first
+        bool seeks = whole;
+        std::vector<float> block(1000 * 2);
+        for (uint64_t target : { (uint64_t)100003, (uint64_t)5 }) {
+            if (!seeks) break;
+            seeks = ogg.seek(target) && ogg.read(block.data(), 1000) == 1000 && ogg.tell() == target + 1000;
+            for (size_t i = 0; seeks && i < block.size(); i++) seeks = std::fabs(block[i] - decoded[target * 2 + i]) < 1e-5f;
+        }
+
+        bool matches = whole && snr > 30 && seeks;
+        if (!matches) std::fprintf(stderr, "Vorbis decoder check failed: opened %d, %zu of %llu samples, %.1f dB SNR, seeks exact %d\n",
+            opened, decoded.size(), (unsigned long long)(length * 2), snr, seeks);
+        passed = passed && matches;
+    }
+#endif
+#endif
+#if defined(DYNAMICAUDIO_MP3) && defined(DYNAMICAUDIO_MP3_VECTORS)
+    {
+        // A 1kHz sine, compared against the 16 bit reference decode over the frames both have
+        Mp3Decoder mp3;
+        std::ifstream reference(DYNAMICAUDIO_MP3_VECTORS "/l3-sin1k0db.pcm", std::ios_base::binary);
+        std::vector<int16_t> expected;
+        int16_t sample;
+        while (reference.read((char*)&sample, sizeof(sample))) expected.push_back(sample);
+
+        bool opened = mp3.open(DYNAMICAUDIO_MP3_VECTORS "/l3-sin1k0db.bit") == Success;
+        std::vector<float> decoded;
+        if (opened) {
+            std::vector<float> block(1152 * mp3.info().channels);
+            size_t frames;
+            while ((frames = mp3.read(block.data(), 1152)) > 0)
+                decoded.insert(decoded.end(), block.begin(), block.begin() + frames * mp3.info().channels);
+        }
+
+        size_t compared = std::min(decoded.size(), expected.size());
+        double signal = 0, noise = 0;
+        for (size_t i = 0; i < compared; i++) {
+            double reference = expected[i] / 32768.0;
+            signal += reference * reference;
+            noise += (decoded[i] - reference) * (decoded[i] - reference);
+        }
+        double snr = noise > 0 ? 10 * std::log10(signal / noise) : 200;
+        bool matches = opened && compared > 0 && decoded.size() + 1152 * 2 >= expected.size() && snr > 60;
+        if (!matches) std::fprintf(stderr, "MP3 decoder check failed: opened %d, %zu of %zu samples, %.1f dB SNR\n", opened, decoded.size(), expected.size(), snr);
+        passed = passed && matches;
+    }
+#endif
+    return passed;
+}
+
+/// <summary>
+/// Plays a stream decoded by a StreamWorker's thread while the reader seeks about, twice in a row at times so
+/// a seek lands while the worker is still decoding for the one before. Every frame read has to be the file's
+/// frame at the reader's position, the end has to be reached, and a removed stream is left alone.
+/// </summary>
+static bool checkStreamWorker()
+{
+    const std::string path = "bench_stream_worker.wav";
+    const size_t length = 200000;
+    auto expected = [](uint64_t frame) { return (int16_t)(uint16_t)(frame * 7919); };
+    {
+        std::vector<int16_t> samples(length);
+        for (size_t i = 0; i < length; i++) samples[i] = expected(i);
+        AudioLoaderWav::Writer writer;
+        writer.open(path, 48000, 1, 16);
+        writer.writeRaw(samples.data(), length);
+    }
+
+    std::unique_ptr<StreamingSource> source;
+    bool matches = StreamingSource::open(path, source, 1024, 8) == Success;
+    StreamWorker worker(std::chrono::microseconds(500));
+    if (matches) worker.add(source.get());
+
+    std::mt19937_64 rng(23);
+    std::vector<float> out(256);
+    size_t checked = 0, seeks = 0;
+    for (size_t block = 0; matches && block < 4000; block++)
+    {
+        if (block % 64 == 63) {
+            source->seek(rng() % length);
+            if (rng() % 2) source->seek(rng() % length);
+            worker.wake();
+            seeks++;
+        }
+
+        uint64_t at = source->position();
+        size_t frames = source->read(out.data(), out.size());
+        for (size_t i = 0; matches && i < frames; i++) matches = out[i] == expected(at + i) / 32768.0f;
+        matches = matches && source->position() == at + frames;
+        checked += frames;
+        if (block % 8 == 0) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    // Reading on from near the end has to finish the file
+    bool finished = false;
+    if (matches) {
+        source->seek(length - 5000);
+        worker.wake();
+        for (size_t tries = 0; !finished && tries < 10000; tries++) {
+            source->read(out.data(), out.size());
+            finished = source->finished();
+            if (!finished) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    // Once removed the worker must not decode for it any more
+    bool removed = false;
+    if (matches) {
+        worker.remove(source.get());
+        source->seek(0);
+        worker.wake();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        removed = source->buffered() == 0;
+    }
+
+    source.reset();
+    std::remove(path.c_str());
+    bool passed = matches && checked > 100000 && seeks > 0 && finished && removed;
+    if (!passed) std::fprintf(stderr, "Stream worker check failed: frames match %d over %zu frames and %zu seeks, finished %d, removed %d\n",
+        matches, checked, seeks, finished, removed);
+    return passed;
+}
+
+static void benchStreaming(Benchmark& bench)
+{
+    if (!bench.enabled("streaming/")) return;
+
+    const std::string path = "bench_stream.wav";
+    const uint32_t sampleRate = 48000;
+    const size_t blockFrames = 256;
+    writeNoiseWav(path, sampleRate, 2, 16, 10);
+
+    // Decoding and reading on one thread, so the decoder's cost is timed rather than the scheduler
+    std::unique_ptr<StreamingSource> source;
+    StreamingSource::open(path, source);
+    std::vector<float> out(blockFrames);
+    Benchmark::Entry& entry = bench.run("streaming/wav_decode_and_read_block", [&] {
+        source->fill();
+        if (source->read(out.data(), blockFrames) < blockFrames) source->seek(0);
+        Benchmark::keep(out[0]);
+    });
+    entry.counters["realtime_factor"] = blockFrames / (double)sampleRate / (entry.nsPerIteration * 1e-9);
+    entry.counters["resident_kb"] = source->capacityFrames() * source->channels() * sizeof(float) / 1024.0;
+    entry.counters["file_kb"] = source->info().frames * source->channels() * sizeof(int16_t) / 1024.0;
+    entry.counters["decoders_checked"] = checkDecoders(path);
+    entry.counters["worker_frames_match"] = checkStreamWorker();
+
+    source.reset();
+    std::remove(path.c_str());
+}
+
+/// <summary> The frequency of the loudest FFT bin, the power of Hann windowed frames of size summed over all of the samples. </summary>
+static double dominantFrequency(const float* samples, size_t count, size_t size, uint32_t sampleRate)
+{
+    Fft fft(size);
+    std::vector<float> windowed(size), re(fft.bins()), im(fft.bins());
+    std::vector<double> power(fft.bins(), 0.0);
+    for (size_t start = 0; start + size <= count; start += size / 2) {
+        for (size_t i = 0; i < size; i++) windowed[i] = samples[start + i] * (float)(0.5 - 0.5 * std::cos(2 * 3.14159265358979 * i / size));
+        fft.forward(windowed.data(), re.data(), im.data());
+        for (size_t k = 0; k < fft.bins(); k++) power[k] += re[k] * re[k] + im[k] * im[k];
+    }
+    size_t loudest = std::max_element(power.begin() + 1, power.end()) - power.begin();
+    return loudest * (double)sampleRate / size;
+}
+
+/// <summary> Plays a stream through to its end in blocks, giving up well past what any speed could make. </summary>
+static std::vector<float> renderStretched(Effect::StretchStream& stretch, size_t limit)
+{
+    std::vector<float> out;
+    std::vector<float> block(256);
+    while (!stretch.finished() && out.size() < limit) {
+        stretch.process(block.data(), block.size());
+        out.insert(out.end(), block.begin(), block.end());
+    }
+    return out;
+}
+
+/// <summary>
+/// WSOLA has to last length / speed at half and double speed and keep a sine's pitch, and at speed 1 the
+/// overlapped Hann frames have to add back up to the source itself past the first frame's fade in.
+/// </summary>
+static bool checkStretchBehavior(const std::string& noisePath, uint32_t sampleRate)
+{
+    const std::string path = "bench_stretch_sine.wav";
+    const size_t length = 2 * sampleRate;
+    const double frequency = 440;
+    {
+        std::vector<int16_t> samples(length);
+        for (size_t i = 0; i < length; i++) samples[i] = (int16_t)std::lround(16384 * std::sin(2 * 3.14159265358979 * frequency * i / sampleRate));
+        AudioLoaderWav::Writer writer;
+        writer.open(path, sampleRate, 1, 16);
+        writer.writeRaw(samples.data(), length);
+    }
+
+    std::shared_ptr<Sample> sine;
+    Sample::load(path, sine);
+    Effect::Const zero(0);
+    Effect::WavStream sineStream(&zero, sine);
+    const size_t fftSize = 8192;
+    const double binHz = (double)sampleRate / fftSize;
+
+    bool passed = true;
+    for (double speed : { 0.5, 2.0 }) {
+        Effect::StretchStream stretch(&sineStream, speed);
+        std::vector<float> out = renderStretched(stretch, 8 * length);
+        double expected = length / speed;
+        double frequencyOut = dominantFrequency(out.data() + 2 * stretch.size, out.size() - 4 * stretch.size, fftSize, sampleRate);
+        bool lengthHolds = std::fabs(out.size() - expected) <= 0.02 * expected + 2 * stretch.size / speed;
+        bool pitchHolds = std::fabs(frequencyOut - frequency) <= 2 * binHz;
+        if (!lengthHolds || !pitchHolds)
+            std::fprintf(stderr, "Stretch check failed at %.1fx: %zu frames for %.0f expected, %.1f Hz for %.1f\n",
+                speed, out.size(), expected, frequencyOut, frequency);
+        passed = passed && lengthHolds && pitchHolds;
+    }
+
+    std::shared_ptr<Sample> noise;
+    Sample::load(noisePath, noise);
+    Effect::WavStream noiseStream(&zero, noise);
+    Effect::StretchStream identity(&noiseStream, 1);
+    std::vector<float> out = renderStretched(identity, 2 * noiseStream.sampleCount());
+    std::vector<float> source(noiseStream.sampleCount());
+    noiseStream.read(0, source.size(), source.data());
+
+    float worst = 0;
+    for (size_t i = identity.hop; i + identity.size < source.size() && i < out.size(); i++) worst = std::max(worst, std::fabs(out[i] - source[i]));
+    bool sameAsSource = out.size() >= source.size() && worst < 1e-4f;
+    if (!sameAsSource) std::fprintf(stderr, "Stretch check failed at 1x: %zu frames for %zu, off by up to %g\n", out.size(), source.size(), worst);
+
+    std::remove(path.c_str());
+    return passed && sameAsSource;
+}
+
+/// <summary> A granular voice on a sine has to sound at the sine's pitch and hand every grain back, when its density drops to 0 and when it goes away. </summary>
+static bool checkGranularBehavior(uint32_t sampleRate)
+{
+    const std::string path = "bench_granular_sine.wav";
+    const size_t length = 2 * sampleRate;
+    const double frequency = 440;
+    {
+        std::vector<int16_t> samples(length);
+        for (size_t i = 0; i < length; i++) samples[i] = (int16_t)std::lround(16384 * std::sin(2 * 3.14159265358979 * frequency * i / sampleRate));
+        AudioLoaderWav::Writer writer;
+        writer.open(path, sampleRate, 1, 16);
+        writer.writeRaw(samples.data(), length);
+    }
+
+    std::shared_ptr<Sample> sine;
+    Sample::load(path, sine);
+    Effect::Const zero(0);
+    Effect::WavStream stream(&zero, sine);
+    DynamicAudio::Pool<Effect::Grain> pool(64);
+
+    const size_t fftSize = 8192;
+    std::vector<float> out(sampleRate);
+    size_t usedWhilePlaying = 0, usedAfterDensity = 0, usedAfterVoice = 0;
+    double frequencyOut = 0, rms = 0;
+    {
+        Effect::GranularStream cloud(&stream, &pool, (float)sampleRate);
+        cloud.setSpeed(0.5);
+        for (size_t done = 0; done < out.size(); done += 256) cloud.process(out.data() + done, std::min<size_t>(256, out.size() - done));
+        usedWhilePlaying = pool.size();
+        rms = std::sqrt(Simd::sumSquares(out.data(), out.size()) / out.size());
+        frequencyOut = dominantFrequency(out.data(), out.size(), fftSize, sampleRate);
+
+        // Grains already going finish, none start
+        cloud.setDensity(0);
+        std::vector<float> tail(sampleRate / 10);
+        cloud.process(tail.data(), tail.size());
+        usedAfterDensity = pool.size();
+
+        cloud.setDensity(50);
+        cloud.process(tail.data(), tail.size());
+    }
+    usedAfterVoice = pool.size();
+
+    std::remove(path.c_str());
+    bool passed = rms > 0.05 && std::fabs(frequencyOut - frequency) <= 2.0 * sampleRate / fftSize
+        && usedWhilePlaying > 0 && usedAfterDensity == 0 && usedAfterVoice == 0;
+    if (!passed) std::fprintf(stderr, "Granular check failed: rms %.3f, %.1f Hz for %.1f, grains in use %zu playing, %zu at density 0, %zu once gone\n",
+        rms, frequencyOut, frequency, usedWhilePlaying, usedAfterDensity, usedAfterVoice);
+    return passed;
+}
+
+static void benchTimeStretch(Benchmark& bench, size_t voices)
+{
+    if (!bench.enabled("stretch/")) return;
+
+    const std::string path = "bench_stretch.wav";
+    const uint32_t sampleRate = 48000;
+    const size_t frames = 256;
+    writeNoiseWav(path, sampleRate, 1, 16, 10);
+
+    std::shared_ptr<Sample> sample;
+    Sample::load(path, sample);
+    Effect::Const zero(0);
+    Effect::WavStream stream(&zero, sample);
+    std::vector<float> out(frames), mix(frames);
+
+    // Every voice at a different speed, as when syncing to several tempos
+    std::vector<std::unique_ptr<Effect::StretchStream>> stretched;
+    for (size_t i = 0; i < voices; i++)
+        stretched.emplace_back(new Effect::StretchStream(&stream, 0.5 + 0.05 * (i % 20)));
+
+    Benchmark::Entry& wsola = bench.run("stretch/wsola_" + std::to_string(voices) + "_voices_256_frames", [&] {
+        std::fill(mix.begin(), mix.end(), 0.0f);
+        for (auto& voice : stretched) {
+            if (voice->finished()) voice->seek(0);
+            voice->process(out.data(), frames);
+            Simd::add(mix.data(), out.data(), frames);
+        }
+        Benchmark::keep(mix[0]);
+    });
+    wsola.counters["realtime_factor"] = (frames * 1e9 / sampleRate) / wsola.nsPerIteration;
+    wsola.counters["length_pitch_and_identity"] = checkStretchBehavior(path, sampleRate);
+
+    // One pool for every granular voice
+    DynamicAudio::Pool<Effect::Grain> pool(voices * 8);
+    std::vector<std::unique_ptr<Effect::GranularStream>> clouds;
+    for (size_t i = 0; i < voices; i++) {
+        clouds.emplace_back(new Effect::GranularStream(&stream, &pool, (float)sampleRate, 0.06f, 50, 0.01f, frames));
+        clouds.back()->setSpeed(0.25 * (i % 4));
+    }
+
+    Benchmark::Entry& granular = bench.run("stretch/granular_" + std::to_string(voices) + "_voices_256_frames", [&] {
+        std::fill(mix.begin(), mix.end(), 0.0f);
+        for (auto& voice : clouds) {
+            voice->process(out.data(), frames);
+            Simd::add(mix.data(), out.data(), frames);
+        }
+        Benchmark::keep(mix[0]);
+    });
+    granular.counters["realtime_factor"] = (frames * 1e9 / sampleRate) / granular.nsPerIteration;
+    granular.counters["grains_in_use"] = (double)pool.size();
+
+    uint64_t dropped = 0;
+    for (auto& voice : clouds) dropped += voice->dropped();
+    granular.counters["grains_dropped"] = (double)dropped;
+    granular.counters["sounds_and_returns_grains"] = checkGranularBehavior(sampleRate);
+
+    clouds.clear();
+    std::remove(path.c_str());
+}
+
+static void benchFft(Benchmark& bench, size_t size)
+{
+    std::string name = "fft/real_forward_" + std::to_string(size);
+    if (!bench.enabled(name)) return;
+
+    Fft fft(size);
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> noise(-1, 1);
+    std::vector<float> in(size), re(fft.bins()), im(fft.bins());
+    for (float& sample : in) sample = noise(rng);
+
+    Benchmark::Entry& entry = bench.run(name, [&] {
+        fft.forward(in.data(), re.data(), im.data());
+        Benchmark::keep(re[1]);
+    });
+    entry.counters["ns_per_point"] = entry.nsPerIteration / size;
+
+    // The direct transform the FFT replaces, only worth timing at small sizes
+    if (size <= 512) {
+        bench.run("fft/naive_dft_" + std::to_string(size), [&] {
+            for (size_t k = 0; k < fft.bins(); k++) {
+                float sumRe = 0, sumIm = 0;
+                for (size_t t = 0; t < size; t++) {
+                    float angle = -6.28318531f * (float)((k * t) % size) / size;
+                    sumRe += in[t] * std::cos(angle);
+                    sumIm += in[t] * std::sin(angle);
+                }
+                re[k] = sumRe;
+                im[k] = sumIm;
+            }
+            Benchmark::keep(re[1]);
+        });
+    }
+}
+
+static void benchSpectrum(Benchmark& bench)
+{
+    const uint32_t sampleRate = 48000;
+    const size_t blockFrames = 256;
+    if (!bench.enabled("spectrum/")) return;
+
+    std::vector<float> block(blockFrames);
+    for (size_t i = 0; i < blockFrames; i++) block[i] = std::sin(i * 0.1f);
+
+    // A 2048 point window every 512 samples, so every second block runs a transform
+    SpectrumAnalyzer analyzer(sampleRate, 2048, 512);
+    analyzer.configureBands(SpectrumAnalyzer::BandScale::Mel, 40);
+    Benchmark::Entry& entry = bench.run("spectrum/push_block_2048_fft_40_mel", [&] {
+        analyzer.push(block.data(), blockFrames);
+    });
+    entry.counters["block_budget_pct"] = entry.nsPerIteration / (blockFrames * 1e9 / sampleRate) * 100;
+
+    bench.run("spectrum/latest", [&] {
+        const SpectrumAnalyzer::Spectrum* spectrum = analyzer.latest();
+        Benchmark::keep(spectrum);
+    });
+}
+
+/// <summary> A sawtooth, so the tracker has harmonics to be fooled by rather than a pure sine. </summary>
+static void writeSawtooth(std::vector<float>& out, double frequency, uint32_t sampleRate)
+{
+    double phase = 0;
+    for (float& sample : out) {
+        sample = 0.3f * (float)(2 * phase - 1);
+        phase += frequency / sampleRate;
+        phase -= std::floor(phase);
+    }
+}
+
+static void benchPitch(Benchmark& bench)
+{
+    const uint32_t sampleRate = 48000;
+    const size_t blockFrames = 256;
+    if (!bench.enabled("pitch/")) return;
+
+    // Accuracy over MIDI notes 40 to 90, each detuned by up to 30 cents
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<double> detune(-30, 30);
+    std::vector<float> tone(sampleRate / 4);
+    size_t estimates = 0, correct = 0;
+    double centsError = 0;
+    for (NoteValueType note = 40; note <= 90; note++)
+    {
+        double cents = detune(rng);
+        writeSawtooth(tone, Note::Value::calculateFrequency(note) * std::pow(2.0, cents / 1200), sampleRate);
+
+        PitchTracker tracker(sampleRate);
+        for (size_t i = 0; i + blockFrames <= tone.size(); i += blockFrames)
+        {
+            tracker.push(tone.data() + i, blockFrames);
+            const PitchTracker::Estimate& estimate = tracker.current();
+            if (estimate.frame + tracker.latencyFrames() != i + blockFrames) continue;
+
+            estimates++;
+            if (estimate.note == note) {
+                correct++;
+                centsError += std::fabs(estimate.cents - cents);
+            }
+        }
+    }
+
+    std::vector<float> signal(sampleRate);
+    writeSawtooth(signal, 220, sampleRate);
+    PitchTracker tracker(sampleRate);
+    size_t offset = 0;
+    Benchmark::Entry& entry = bench.run("pitch/push_block_yin_fft", [&] {
+        tracker.push(signal.data() + offset, blockFrames);
+        offset = offset + 2 * blockFrames <= signal.size() ? offset + blockFrames : 0;
+    });
+    entry.counters["note_accuracy"] = correct / (double)std::max<size_t>(estimates, 1);
+    entry.counters["mean_cents_error"] = centsError / std::max<size_t>(correct, 1);
+    entry.counters["block_budget_pct"] = entry.nsPerIteration / (blockFrames * 1e9 / sampleRate) * 100;
+
+    // The same difference function computed lag by lag, which the FFT path replaces
+    const size_t window = 1600, lags = 802;
+    std::vector<float> difference(lags);
+    bench.run("pitch/difference_direct", [&] {
+        PitchTracker::differenceDirect(signal.data(), window, lags, difference.data());
+        Benchmark::keep(difference[lags - 1]);
+    });
+}
+
+static void benchTuneQueries(Benchmark& bench, size_t chordCount)
+{
+    std::string size = std::to_string(chordCount);
+    if (!bench.enabled("tune/" + size)) return;
+
+    Tune tune = buildTune(makeTuneSource(chordCount, 99));
+    double length = 0;
+    for (const Chord& chord : tune.chords) length += chord.maxDuration();
+
+    std::mt19937 rng(17);
+    std::uniform_real_distribution<double> when(0, length);
+
+    bench.run("tune/" + size + "_chords_get_chord_index_at_time", [&] {
+        Benchmark::keep(tune.getChordIndexAtTime(when(rng)));
+    });
+
+    bench.run("tune/" + size + "_chords_get_notes_at_time", [&] {
+        Chord notes = tune.getNotesAtTime(when(rng));
+        Benchmark::keep(notes);
+    });
+}
+
+static void benchTimeline(Benchmark& bench, size_t chordCount)
+{
+    std::string size = std::to_string(chordCount);
+    if (!bench.enabled("timeline/" + size)) return;
+
+    const uint32_t sampleRate = 48000;
+    Tune tune = buildTune(makeTuneSource(chordCount, 99));
+    tune.setTempo(0, 100, 3, 4);
+    tune.setTempo(tune.chords.size() / 16.0, 140);
+
+    // A tempo change invalidates every chord, an edit at the end only the last
+    Benchmark::Entry& full = bench.run("timeline/" + size + "_chords_full_rebuild", [&] {
+        tune.touch(0);
+        Benchmark::keep(tune.timeline(sampleRate).length());
+    });
+    full.counters["chords_rebuilt"] = (double)tune.timeline(sampleRate).lastRebuilt();
+
+    Benchmark::Entry& incremental = bench.run("timeline/" + size + "_chords_edit_last", [&] {
+        tune.touch(tune.chords.size() - 1);
+        Benchmark::keep(tune.timeline(sampleRate).length());
+    });
+    incremental.counters["chords_rebuilt"] = (double)tune.timeline(sampleRate).lastRebuilt();
+    incremental.counters["speedup"] = full.nsPerIteration / incremental.nsPerIteration;
+
+    const Timeline& timeline = tune.timeline(sampleRate);
+    std::mt19937 rng(17);
+    std::uniform_int_distribution<uint64_t> frame(0, timeline.length());
+    bench.run("timeline/" + size + "_chords_chord_at_frame", [&] {
+        Benchmark::keep(timeline.chordAt(frame(rng)));
+    });
+}
+
+static void benchNotes(Benchmark& bench)
+{
+    std::vector<std::string> names;
+    for (const auto& pair : Note::Value::mapStringToValue) names.push_back(pair.first);
+    names.push_back("NotANote");
+
+    size_t index = 0;
+    bench.run("note/value_from_string", [&] {
+        Benchmark::keep(Note::Value::fromString(names[index++ % names.size()]));
+    });
+
+    NoteValueType value = 0;
+    bench.run("note/value_calculate_frequency", [&] {
+        Benchmark::keep(Note::Value::calculateFrequency(value));
+        value = (value + 1) & 127;
+    });
+}
+
+static void benchEffectGraph(Benchmark& bench)
+{
+    const size_t frames = 256;
+    const uint32_t sampleRate = 48000;
+
+    // Nodes that only implement get, so process falls back to one virtual call per sample
+    Effect::Const low(10), high(200);
+    Effect::Random random(1, &low, &high);
+    std::vector<float> block(frames);
+    Benchmark::Entry& perSample = bench.run("effect/random_const_get_per_sample_256_frames", [&] {
+        random.process(block.data(), frames);
+        Benchmark::keep(block[0]);
+    });
+    perSample.counters["realtime_factor"] = (frames * 1e9 / sampleRate) / perSample.nsPerIteration;
+
+    // Streams through envelopes, the graph each playing sample goes through
+    const size_t voices = 256;
+    std::vector<uint8_t> pcm(sampleRate * sizeof(int16_t));
+    std::mt19937 rng(23);
+    for (uint8_t& byte : pcm) byte = (uint8_t)rng();
+
+    AudioLoaderWav::Wav wav;
+    wav.data.chunkSize = (uint32_t)pcm.size();
+    wav.data.data = pcm.data();
+
+    EnvelopeBank bank(voices, sampleRate, frames);
+    std::vector<Effect::WavStream> streams;
+    std::vector<Effect::Envelope> envelopes;
+    streams.reserve(voices);
+    envelopes.reserve(voices);
+    for (uint32_t voice = 0; voice < voices; voice++) {
+        bank.configure(voice, EnvelopeBank::Settings(0.01f, 0.1f, 0.8f, 0.2f));
+        streams.emplace_back(nullptr, wav);
+        envelopes.emplace_back(&streams.back(), &bank, voice);
+    }
+
+    std::vector<float> mix(frames);
+    uint64_t blockIndex = 0;
+    Benchmark::Entry& graph = bench.run("effect/256_wav_streams_through_envelopes_256_frames", [&] {
+        for (uint32_t voice = (uint32_t)(blockIndex % 32); voice < voices; voice += 32) {
+            streams[voice].position = 0;
+            bank.noteOn(voice, 0, sampleRate / 4);
+        }
+        bank.process(frames);
+
+        std::fill(mix.begin(), mix.end(), 0.0f);
+        for (Effect::Envelope& envelope : envelopes) {
+            envelope.process(block.data(), frames);
+            Simd::add(mix.data(), block.data(), frames);
+        }
+        Benchmark::keep(mix[0]);
+        blockIndex++;
+    });
+    graph.counters["realtime_factor"] = (frames * 1e9 / sampleRate) / graph.nsPerIteration;
+}
+
+static void benchAudioOutput(Benchmark& bench)
+{
+    if (!bench.enabled("audio_output/")) return;
+
+    const OutputFormat format(48000, 2, 256);
+    const uint64_t blocks = 188;    // About a second
+
+    // Freewheeling into a file, every block rendered has to reach it, the ones still in the ring at stop included
+    const std::string path = "bench_output.wav";
+    WavFileSink file(path, 16, OutputConverter::Dither::None);
+    uint64_t frame = 0;
+    auto ramp = [&frame](float* out, size_t frames) {
+        for (size_t i = 0; i < frames; i++) {
+            float value = ((frame + i) % 4096) / 8192.0f;
+            out[i * 2] = value;
+            out[i * 2 + 1] = -value;
+        }
+        frame += frames;
+    };
+    uint64_t rendered = 0, played = 0, underruns = 0, written = 0;
+    Benchmark::Entry& entry = bench.run("audio_output/freewheel_1s_to_wav_file", [&] {
+        frame = 0;
+        AudioOutput output(format, ramp, file, 4, AudioOutput::Freewheel);
+        output.start();
+        while (output.stats().blocksRendered.load() < blocks) std::this_thread::yield();
+        output.stop();
+        rendered = output.stats().blocksRendered.load();
+        played = output.stats().blocksPlayed.load();
+        underruns = output.stats().underruns.load();
+        written = file.framesWritten();
+    });
+    entry.counters["realtime_factor"] = blocks * format.blockDuration().count() / entry.nsPerIteration;
+
+    AudioLoaderWav::Wav wav;
+    AudioLoaderWav::HeapAllocator heap;
+    AudioLoaderWav::loadRawFile(path, wav, heap, false);
+    size_t fileFrames = wav.data.size() / std::max<size_t>(1, wav.fmt.blockAlign);
+    bool samples = fileFrames == written && fileFrames > 0;
+    for (size_t i = 0; samples && i < fileFrames; i++) {
+        int16_t left;
+        std::memcpy(&left, wav.data.data + i * 4, sizeof(left));
+        samples = std::abs(left / 32768.0f - (i % 4096) / 8192.0f) < 2 / 32768.0f;
+    }
+    bool complete = rendered == played && underruns == 0 && written == rendered * format.blockFrames && samples;
+    if (!complete) std::fprintf(stderr, "Audio output to a file lost blocks: %llu rendered, %llu played, %llu underruns, %llu frames written, file intact %d\n",
+        (unsigned long long)rendered, (unsigned long long)played, (unsigned long long)underruns, (unsigned long long)written, samples);
+    entry.counters["every_block_written"] = complete;
+    AudioLoaderWav::release(wav);
+    std::remove(path.c_str());
+
+    // Paced by the clock with a renderer that stalls every 16th block, the sink gets silence for each underrun
+    NullSink null;
+    uint64_t calls = 0;
+    AudioOutput paced(format, [&](float* out, size_t frames) {
+        std::fill(out, out + frames * format.channels, 0.0f);
+        if (++calls % 16 == 0) std::this_thread::sleep_for(format.blockDuration() * 3);
+    }, null, 2, AudioOutput::Paced);
+    paced.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    paced.stop();
+    rendered = paced.stats().blocksRendered.load();
+    played = paced.stats().blocksPlayed.load();
+    underruns = paced.stats().underruns.load();
+    bool accounted = rendered == played && underruns > 0 && null.framesWritten == (played + underruns) * format.blockFrames;
+    if (!accounted) std::fprintf(stderr, "Paced audio output miscounted: %llu rendered, %llu played, %llu underruns, %llu frames written\n",
+        (unsigned long long)rendered, (unsigned long long)played, (unsigned long long)underruns, (unsigned long long)null.framesWritten);
+    entry.counters["underruns_accounted"] = accounted;
+}
+
+static void benchOutputConvert(Benchmark& bench)
+{
+    if (!bench.enabled("output_convert/")) return;
+
+    // One stereo block of music-like levels, with a few samples past full scale
+    const size_t frames = 1024;
+    std::vector<float> input(frames * 2);
+    std::mt19937 rng(13);
+    std::normal_distribution<float> level(0, 0.3f);
+    for (float& sample : input) sample = level(rng);
+
+    std::vector<float> copy(input.size());
+    std::vector<int16_t> pcm16(input.size());
+    std::vector<uint8_t> pcm24(input.size() * 3);
+    size_t bytes = input.size() * sizeof(float);
+
+    Benchmark::Entry& baseline = bench.run("output_convert/memcpy_1024_stereo", [&] {
+        std::memcpy(copy.data(), input.data(), bytes);
+        Benchmark::keep(copy[0]);
+    });
+
+    struct Mode { const char* name; OutputConverter::Dither dither; };
+    const Mode modes[] = {
+        { "none", OutputConverter::Dither::None },
+        { "tpdf", OutputConverter::Dither::Triangular },
+        { "shaped", OutputConverter::Dither::Shaped },
+    };
+
+    for (const Mode& mode : modes)
+    {
+        OutputConverter simd(2, mode.dither), scalar(2, mode.dither);
+        std::vector<int16_t> reference(input.size());
+        simd.toInt16(input.data(), pcm16.data(), frames);
+        scalar.toInt16Reference(input.data(), reference.data(), frames);
+        bool matches = pcm16 == reference;
+
+        Benchmark::Entry& reference16 = bench.run(std::string("output_convert/int16_") + mode.name + "_reference", [&] {
+            scalar.toInt16Reference(input.data(), pcm16.data(), frames);
+            Benchmark::keep(pcm16[0]);
+        });
+        Benchmark::Entry& simd16 = bench.run(std::string("output_convert/int16_") + mode.name, [&] {
+            simd.toInt16(input.data(), pcm16.data(), frames);
+            Benchmark::keep(pcm16[0]);
+        });
+        simd16.counters["matches_reference"] = matches ? 1 : 0;
+        simd16.counters["speedup"] = reference16.nsPerIteration / simd16.nsPerIteration;
+        simd16.counters["memcpy_ratio"] = simd16.nsPerIteration / baseline.nsPerIteration;
+    }
+
+    OutputConverter simd(2), scalar(2);
+    std::vector<uint8_t> reference(pcm24.size());
+    simd.toInt24(input.data(), pcm24.data(), frames);
+    scalar.toInt24Reference(input.data(), reference.data(), frames);
+    bool matches = pcm24 == reference;
+
+    Benchmark::Entry& reference24 = bench.run("output_convert/int24_tpdf_reference", [&] {
+        scalar.toInt24Reference(input.data(), pcm24.data(), frames);
+        Benchmark::keep(pcm24[0]);
+    });
+    Benchmark::Entry& simd24 = bench.run("output_convert/int24_tpdf", [&] {
+        simd.toInt24(input.data(), pcm24.data(), frames);
+        Benchmark::keep(pcm24[0]);
+    });
+    simd24.counters["matches_reference"] = matches ? 1 : 0;
+    simd24.counters["speedup"] = reference24.nsPerIteration / simd24.nsPerIteration;
+    simd24.counters["memcpy_ratio"] = simd24.nsPerIteration / baseline.nsPerIteration;
+}
+
+static void benchProfiler(Benchmark& bench)
+{
+    // The cost of one DA_PROFILE_SCOPE when profiling is compiled in, drained every 1024 scopes
+    Profiler& profiler = Profiler::instance();
+    profiler.registerThread();
+    uint32_t count = 0;
+    Benchmark::Entry& entry = bench.run("profiler/scope_record", [&] {
+        { Profiler::Scope scope("bench"); }
+        if (++count % 1024 == 0) {
+            profiler.drain();
+            profiler.clear();
+        }
+    });
+    entry.counters["dropped"] = (double)profiler.dropped();
+    profiler.drain();
+    profiler.clear();
+
+    // A thread that never registered is only counted, one that exits leaves its log to the next
+    uint64_t unregistered = profiler.unregistered();
+    std::thread([] { Profiler::Scope scope("unregistered"); }).join();
+    std::thread([&profiler] { profiler.registerThread(); Profiler::Scope scope("first"); }).join();
+    size_t logs = profiler.logs();
+    std::thread([&profiler] { profiler.registerThread(); Profiler::Scope scope("second"); }).join();
+    bool counted = profiler.unregistered() == unregistered + 1;
+    bool recycled = profiler.logs() == logs && profiler.drain() == 1;
+    profiler.clear();
+    if (!counted || !recycled) std::fprintf(stderr, "Profiler thread check failed: unregistered counted %d, log reused %d\n", counted, recycled);
+    entry.counters["threads_checked"] = counted && recycled ? 1 : 0;
+}
+
+#ifdef DYNAMICAUDIO_C_API
+static void benchCApi(Benchmark& bench)
+{
+    if (!bench.enabled("capi/")) return;
+
+    const size_t frames = 256;
+    const uint32_t sampleRate = 48000;
+    const uint32_t voices = 64;
+    const std::string path = "bench_capi.wav";
+    writeNoiseWav(path, sampleRate, 1, 16, 1);
+
+    // The same graph built through the library boundary and directly
+    da_wav* wav = nullptr;
+    da_graph* graph = nullptr;
+    da_mixer* mixer = nullptr;
+    da_wav_load(path.c_str(), &wav);
+    da_graph_create(sampleRate, voices, frames, &graph);
+    da_mixer_create(voices, 1, frames, &mixer);
+
+    std::shared_ptr<Sample> sample;
+    Sample::load(path, sample);
+    EnvelopeBank bank(voices, sampleRate, frames);
+    VoiceManager manager(voices);
+    Mixer direct(voices, 1, frames);
+    std::vector<Effect::WavStream> streams;
+    std::vector<Effect::Envelope> envelopes;
+    std::vector<Effect::Voice> nodes;
+    streams.reserve(voices);
+    envelopes.reserve(voices);
+    nodes.reserve(voices);
+
+    std::vector<da_trigger> triggers(voices);
+    std::vector<da_param> params(voices);
+    for (uint32_t voice = 0; voice < voices; voice++)
+    {
+        da_mixer_add_voice_channel(mixer, graph, (uint32_t)da_graph_add_wav_voice(graph, wav, nullptr, 1), DA_MASTER_BUS);
+        triggers[voice] = da_trigger{ DA_TRIGGER_ON, voice, (uint32_t)(voice % frames), sampleRate / 4, 0.5f };
+        params[voice] = da_param{ DA_PARAM_CHANNEL_PAN, voice, 0, (voice % 8) / 4.0f - 1 };
+
+        streams.emplace_back(nullptr, std::shared_ptr<const Sample>(sample));
+        envelopes.emplace_back(&streams.back(), &bank, voice);
+        nodes.emplace_back(&manager, (uint32_t)manager.addVoice(&envelopes.back()));
+        direct.addChannel(&nodes.back());
+    }
+    da_wav_destroy(wav);
+
+    std::vector<float> out(2 * frames);
+
+    // The crossing on its own: an exported call that does nothing against the same constant inline
+    const size_t calls = 256;
+    Benchmark::Entry& inlineCalls = bench.run("capi/256_inline_no_op_calls", [&] {
+        for (size_t i = 0; i < calls; i++) {
+            uint32_t version = DA_API_VERSION;
+            Benchmark::keep(version);
+        }
+    });
+    Benchmark::Entry& emptyCalls = bench.run("capi/256_empty_exported_calls", [&] {
+        for (size_t i = 0; i < calls; i++) Benchmark::keep(da_api_version());
+    });
+    emptyCalls.counters["boundary_ns_per_call"] = (emptyCalls.nsPerIteration - inlineCalls.nsPerIteration) / calls;
+
+    // A block with every voice retriggered and repanned, directly and then across the boundary
+    Benchmark::Entry& inProcess = bench.run("capi/64_voices_trigger_pan_process_direct_256_frames", [&] {
+        for (const da_trigger& trigger : triggers) {
+            streams[trigger.voice].position = 0;
+            manager.setGain(trigger.voice, trigger.gain);
+            bank.noteOn(trigger.voice, trigger.offset, trigger.length);
+        }
+        for (const da_param& param : params) direct.setPan(param.index, param.value);
+        bank.process(frames);
+        manager.update();
+        direct.process(frames);
+        direct.interleave(out.data(), frames);
+        Benchmark::keep(out[0]);
+    });
+
+    // One call each for triggers, parameters and rendering
+    Benchmark::Entry& batched = bench.run("capi/64_voices_trigger_pan_process_256_frames", [&] {
+        da_graph_trigger(graph, triggers.data(), triggers.size());
+        da_mixer_set_params(mixer, params.data(), params.size());
+        da_mixer_process(mixer, out.data(), frames);
+        Benchmark::keep(out[0]);
+    });
+    batched.counters["calls_per_block"] = 3;
+    batched.counters["ratio_to_direct"] = batched.nsPerIteration / inProcess.nsPerIteration;
+    batched.counters["empty_call_ns"] = emptyCalls.nsPerIteration / calls;
+
+    Benchmark::Entry& single = bench.run("capi/64_voices_trigger_pan_single_calls_256_frames", [&] {
+        for (uint32_t voice = 0; voice < voices; voice++) {
+            da_graph_trigger(graph, &triggers[voice], 1);
+            da_mixer_set_params(mixer, &params[voice], 1);
+        }
+        da_mixer_process(mixer, out.data(), frames);
+        Benchmark::keep(out[0]);
+    });
+    single.counters["calls_per_block"] = 2 * voices + 1;
+    single.counters["ratio_to_direct"] = single.nsPerIteration / inProcess.nsPerIteration;
+
+    // Mixers with nothing in them and tiny blocks, so the crossing is most of each call
+    const size_t callFrames = 16;
+    da_mixer* bare = nullptr;
+    da_mixer_create(1, 1, frames, &bare);
+    Mixer bareDirect(1, 1, frames);
+    Benchmark::Entry& directCalls = bench.run("capi/256_empty_mixer_16_frame_blocks_direct", [&] {
+        for (size_t i = 0; i < calls; i++) {
+            bareDirect.process(callFrames);
+            bareDirect.interleave(out.data(), callFrames);
+        }
+        Benchmark::keep(out[0]);
+    });
+    Benchmark::Entry& boundaryCalls = bench.run("capi/256_empty_mixer_16_frame_blocks", [&] {
+        for (size_t i = 0; i < calls; i++) da_mixer_process(bare, out.data(), callFrames);
+        Benchmark::keep(out[0]);
+    });
+    boundaryCalls.counters["ratio_to_direct"] = boundaryCalls.nsPerIteration / directCalls.nsPerIteration;
+    da_mixer_destroy(bare);
+
+    da_mixer_destroy(mixer);
+    da_graph_destroy(graph);
+    std::remove(path.c_str());
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    Benchmark bench;
+    std::string jsonPath;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) jsonPath = argv[++i];
+        else if (arg == "--filter" && i + 1 < argc) bench.filter = argv[++i];
+        else if (arg == "--min-time" && i + 1 < argc) bench.minSeconds = std::atof(argv[++i]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--json path] [--filter text] [--min-time seconds]" << std::endl;
+            return 1;
+        }
+    }
+
+    benchLoader(bench);
+    benchTuneQueries(bench, 1000);
+    benchTuneQueries(bench, 100000);
+    benchTimeline(bench, 100000);
+    benchNotes(bench);
+    benchEffectGraph(bench);
+    benchTuneBinary(bench);
+    benchEnvelopes(bench);
+    benchScheduler(bench);
+    benchMixer(bench, 256);
+    benchMixer(bench, 1024);
+    benchDynamics(bench);
+    benchLoudness(bench);
+    benchWaveform(bench);
+    benchSpatializer(bench, 1024, { -30, 30 });
+    benchSpatializer(bench, 4096, { -30, 30 });
+    benchSpatializer(bench, 4096, { 0, -30, 30, -110, 110 });
+    benchVoices(bench, 2048, false);
+    benchVoices(bench, 2048, true);
+    benchMasks(bench, 65536);
+    benchGraphAllocation(bench);
+    benchRenderPlan(bench);
+    benchSampleCache(bench);
+    benchStreaming(bench);
+    benchTimeStretch(bench, 32);
+    benchFft(bench, 512);
+    benchFft(bench, 2048);
+    benchFft(bench, 8192);
+    benchSpectrum(bench);
+    benchPitch(bench);
+    benchAudioOutput(bench);
+    benchOutputConvert(bench);
+#ifdef DYNAMICAUDIO_C_API
+    benchCApi(bench);
+#endif
+    benchProfiler(bench);
+
+    bench.print(std::cout);
+
+    if (!jsonPath.empty()) {
+        std::ofstream json(jsonPath);
+        if (!json) {
+            std::cerr << "Cannot open " << jsonPath << std::endl;
+            return 1;
+        }
+        bench.writeJson(json);
+    }
+    return 0;
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AudioLoaderWav.h"
+#include "Result.h"
+
+// Compressed formats use single file decoders when they are on the include path.
+// Their headers are included here for the declarations only, one translation unit
+// has to compile the implementation:
+//   stb_vorbis:  #include "stb_vorbis.c"
+//   minimp3:     #define MINIMP3_IMPLEMENTATION, MINIMP3_FLOAT_OUTPUT then #include "minimp3_ex.h"
+// Decoders.cpp does both, the CMake option DYNAMICAUDIO_FETCH_DECODERS fetches the two at pinned commits and builds it.
+#if defined(__has_include)
+#if __has_include("stb_vorbis.c") && !defined(DYNAMICAUDIO_NO_VORBIS)
+#define DYNAMICAUDIO_VORBIS 1
+#define STB_VORBIS_HEADER_ONLY
+#include "stb_vorbis.c"
+#undef STB_VORBIS_HEADER_ONLY
+#endif
+#if __has_include("minimp3_ex.h") && !defined(DYNAMICAUDIO_NO_MP3)
+#define DYNAMICAUDIO_MP3 1
+#ifndef MINIMP3_FLOAT_OUTPUT
+#define MINIMP3_FLOAT_OUTPUT
+#endif
+#include "minimp3_ex.h"
+#endif
+#endif
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// Turns an audio file into interleaved float frames a block at a time, so a
+    /// track never has to be held in memory. Only ever used by one thread at a time.
+    /// </summary>
+    class Decoder {
+    public:
+        struct Info {
+            uint32_t sampleRate;
+            uint16_t channels;
+            uint64_t frames;    // 0 if the length is unknown
+        };
+
+        virtual ~Decoder() {}
+
+        virtual const Info& info() const = 0;
+
+        /// <summary> Decodes the next frames. Fewer than asked for only at the end of the file. </summary>
+        /// <param name="out"> Room for frames * channels interleaved samples. </param>
+        /// <returns> The amount of frames written, 0 at the end. </returns>
+        virtual size_t read(float* out, size_t frames) = 0;
+
+        /// <summary> Moves to a frame, the next read starts exactly there. </summary>
+        virtual bool seek(uint64_t frame) = 0;
+
+        /// <summary> The frame the next read starts at. </summary>
+        virtual uint64_t tell() const = 0;
+    };
+
+    /// <summary> Reads PCM and float WAV files straight from the disk, seeking by arithmetic. </summary>
+    class WavDecoder : public Decoder {
+    private:
+        std::ifstream file;
+        Info fileInfo;
+        AudioLoaderWav::Format fmt;
+        std::streamoff dataStart;
+        uint64_t frame;
+        std::vector<uint8_t> bytes;
+
+    public:
+        WavDecoder() : file(), fileInfo(), fmt(), dataStart(0), frame(0), bytes() {}
+
+        Result open(const std::string& filepath) {
+            file.open(filepath, std::ios_base::binary);
+            if (file.fail()) return CannotOpenFile;
+
+            AudioLoaderWav::RIFF riff;
+            AudioLoaderWav::Data data{};
+            Result header = AudioLoaderWav::readHeader(file, riff, fmt, data);
+            if (header != Success) return header;
+
+            if (!AudioLoaderWav::isReadable(fmt)) return NotSupported;
+
+            dataStart = file.tellg();
+            fileInfo.sampleRate = fmt.sampleRate;
+            fileInfo.channels = fmt.numChannels;
+            fileInfo.frames = data.chunkSize / fmt.blockAlign;
+            frame = 0;
+            return Success;
+        }
+
+        const Info& info() const override { return fileInfo; }
+
+        size_t read(float* out, size_t frames) override {
+            if (frame >= fileInfo.frames) return 0;
+            if (frames > fileInfo.frames - frame) frames = (size_t)(fileInfo.frames - frame);
+
+            bytes.resize(frames * fmt.blockAlign);
+            file.read((char*)bytes.data(), bytes.size());
+            frames = (size_t)file.gcount() / fmt.blockAlign;
+
+            AudioLoaderWav::toFloat(fmt, bytes.data(), out, frames * fileInfo.channels);
+            frame += frames;
+            return frames;
+        }
+
+        bool seek(uint64_t target) override {
+            if (target > fileInfo.frames) target = fileInfo.frames;
+            file.clear();
+            file.seekg(dataStart + (std::streamoff)(target * fmt.blockAlign), std::ios_base::beg);
+            frame = target;
+            return (bool)file;
+        }
+
+        uint64_t tell() const override { return frame; }
+
+    };
+
+#ifdef DYNAMICAUDIO_VORBIS
+    /// <summary>
+    /// Decodes Ogg Vorbis through stb_vorbis, reading pages from the disk as it goes.
+    /// Seeking bisects the Ogg pages by their granule positions, then decodes forward to the exact frame.
+    /// </summary>
+    class VorbisDecoder : public Decoder {
+    private:
+        stb_vorbis* vorbis;
+        Info fileInfo;
+        uint64_t frame;
+
+    public:
+        VorbisDecoder() : vorbis(nullptr), fileInfo(), frame(0) {}
+        ~VorbisDecoder() { if (vorbis != nullptr) stb_vorbis_close(vorbis); }
+
+        VorbisDecoder(const VorbisDecoder&) = delete;
+        VorbisDecoder& operator=(const VorbisDecoder&) = delete;
+
+        Result open(const std::string& filepath) {
+            int error = 0;
+            vorbis = stb_vorbis_open_filename(filepath.c_str(), &error, nullptr);
+            if (vorbis == nullptr) return error == VORBIS_file_open_failure ? CannotOpenFile : BadFormatting;
+
+            stb_vorbis_info vorbisInfo = stb_vorbis_get_info(vorbis);
+            fileInfo.sampleRate = vorbisInfo.sample_rate;
+            fileInfo.channels = (uint16_t)vorbisInfo.channels;
+            fileInfo.frames = stb_vorbis_stream_length_in_samples(vorbis);
+            return Success;
+        }
+
+        const Info& info() const override { return fileInfo; }
+
+        size_t read(float* out, size_t frames) override {
+            int channels = fileInfo.channels;
+            size_t done = (size_t)stb_vorbis_get_samples_float_interleaved(vorbis, channels, out, (int)(frames * channels));
+            frame += done;
+            return done;
+        }
+
+        bool seek(uint64_t target) override {
+            if (stb_vorbis_seek(vorbis, (unsigned int)target) == 0) return false;
+            frame = target;
+            return true;
+        }
+
+        uint64_t tell() const override { return frame; }
+    };
+#endif
+
+#ifdef DYNAMICAUDIO_MP3
+    /// <summary>
+    /// Decodes MP3 through minimp3. The file is mapped and its frame headers indexed once
+    /// on open, so seeking jumps to the right MP3 frame and decodes forward to the exact sample.
+    /// </summary>
+    class Mp3Decoder : public Decoder {
+    private:
+        mp3dec_ex_t mp3;
+        bool opened;
+        Info fileInfo;
+        uint64_t frame;
+
+    public:
+        Mp3Decoder() : mp3(), opened(false), fileInfo(), frame(0) {}
+        ~Mp3Decoder() { if (opened) mp3dec_ex_close(&mp3); }
+
+        Mp3Decoder(const Mp3Decoder&) = delete;
+        Mp3Decoder& operator=(const Mp3Decoder&) = delete;
+
+        Result open(const std::string& filepath) {
+            int error = mp3dec_ex_open(&mp3, filepath.c_str(), MP3D_SEEK_TO_SAMPLE);
+            if (error == MP3D_E_IOERROR) return CannotOpenFile;
+            if (error != 0) return BadFormatting;
+            opened = true;
+
+            if (mp3.info.channels <= 0) return BadFormatting;
+            fileInfo.sampleRate = (uint32_t)mp3.info.hz;
+            fileInfo.channels = (uint16_t)mp3.info.channels;
+            fileInfo.frames = mp3.samples / mp3.info.channels;
+            return Success;
+        }
+
+        const Info& info() const override { return fileInfo; }
+
+        size_t read(float* out, size_t frames) override {
+            // minimp3 counts samples across every channel
+            size_t done = mp3dec_ex_read(&mp3, out, frames * fileInfo.channels) / fileInfo.channels;
+            frame += done;
+            return done;
+        }
+
+        bool seek(uint64_t target) override {
+            if (mp3dec_ex_seek(&mp3, target * fileInfo.channels) != 0) return false;
+            frame = target;
+            return true;
+        }
+
+        uint64_t tell() const override { return frame; }
+    };
+#endif
+
+    /// <summary> Opens a decoder picked by the file's extension. </summary>
+    /// <returns> NotSupported for an unknown extension or a format that was not compiled in. </returns>
+    inline Result openDecoder(const std::string& filepath, std::unique_ptr<Decoder>& decoder) {
+        std::string extension = filepath.substr(filepath.find_last_of('.') + 1);
+        for (char& c : extension) c = (char)std::tolower((unsigned char)c);
+
+        if (extension == "wav") {
+            std::unique_ptr<WavDecoder> wav(new WavDecoder());
+            Result result = wav->open(filepath);
+            if (result == Success) decoder = std::move(wav);
+            return result;
+        }
+#ifdef DYNAMICAUDIO_VORBIS
+        if (extension == "ogg") {
+            std::unique_ptr<VorbisDecoder> vorbis(new VorbisDecoder());
+            Result result = vorbis->open(filepath);
+            if (result == Success) decoder = std::move(vorbis);
+            return result;
+        }
+#endif
+#ifdef DYNAMICAUDIO_MP3
+        if (extension == "mp3") {
+            std::unique_ptr<Mp3Decoder> mp3(new Mp3Decoder());
+            Result result = mp3->open(filepath);
+            if (result == Success) decoder = std::move(mp3);
+            return result;
+        }
+#endif
+        return NotSupported;
+    }
+}
@@ -0,0 +1,9 @@
+// Decoders.cpp : Compiles the single file decoders Decoder.h uses for Ogg Vorbis and MP3.
+// Built as DynamicAudioDecoders by CMakeLists.txt when DYNAMICAUDIO_FETCH_DECODERS is on,
+// a build that puts stb_vorbis.c and minimp3_ex.h on the include path itself can add it too.
+#define MINIMP3_IMPLEMENTATION
+#include "Decoder.h"
+
+#ifdef DYNAMICAUDIO_VORBIS
+#include "stb_vorbis.c"
+#endif
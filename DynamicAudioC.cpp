@@ -0,0 +1,376 @@
+// DynamicAudioC.cpp : The exported C interface, see DynamicAudioC.h.
+// Built without the precompiled header, so the same file builds the Windows DLL and the Linux shared library.
+#include "DynamicAudioC.h"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "Envelope.h"
+#include "Mixer.h"
+#include "SampleCache.h"
+#include "Tune.h"
+#include "TuneBinary.h"
+#include "TunePlayer.h"
+#include "VoiceManager.h"
+
+using namespace DynamicAudio;
+
+struct da_wav {
+    std::shared_ptr<Sample> sample;
+};
+
+struct da_tune {
+    Tune tune;
+};
+
+struct da_graph {
+    EnvelopeBank bank;
+    VoiceManager manager;
+    uint32_t sampleRate;
+    size_t maxFrames;
+    const da_mixer* mixer;      // The one mixer advancing it, once a channel is added
+
+    // Per voice, the source is a WavStream or a TunePlayer so a trigger can restart it
+    std::vector<std::unique_ptr<Effect::Abstract>> sources;
+    std::vector<Effect::WavStream*> waves;
+    std::vector<Effect::TunePlayer*> tunes;
+    std::vector<std::unique_ptr<Effect::Envelope>> envelopes;
+    std::vector<std::unique_ptr<Effect::Voice>> voices;
+
+    da_graph(uint32_t sampleRate_, size_t maxVoices, size_t maxFrames_)
+        : bank(maxVoices, sampleRate_, maxFrames_), manager(maxVoices), sampleRate(sampleRate_), maxFrames(maxFrames_), mixer(nullptr)
+    {
+        sources.reserve(maxVoices);
+        waves.reserve(maxVoices);
+        tunes.reserve(maxVoices);
+        envelopes.reserve(maxVoices);
+        voices.reserve(maxVoices);
+    }
+
+    /// <summary> Takes ownership of a source and wraps it in an envelope and a voice. </summary>
+    int32_t add(std::unique_ptr<Effect::Abstract> source, Effect::WavStream* wave, Effect::TunePlayer* player,
+        const da_envelope* envelope, float priority)
+    {
+        if (voices.size() == bank.size()) return -DA_OUT_OF_ROOM;
+        uint32_t voice = (uint32_t)voices.size();
+
+        bank.configure(voice, envelope != nullptr
+            ? EnvelopeBank::Settings(envelope->attack, envelope->decay, envelope->sustain, envelope->release)
+            : EnvelopeBank::Settings());
+        envelopes.emplace_back(new Effect::Envelope(source.get(), &bank, voice));
+        if (manager.addVoice(envelopes.back().get(), priority) < 0) {
+            envelopes.pop_back();
+            return -DA_OUT_OF_ROOM;
+        }
+        voices.emplace_back(new Effect::Voice(&manager, voice));
+        sources.push_back(std::move(source));
+        waves.push_back(wave);
+        tunes.push_back(player);
+        return (int32_t)voice;
+    }
+
+    /// <summary> Moves the envelopes and the real / virtual split on by a block, before the mixer renders it. </summary>
+    void advance(size_t frames) {
+        bank.process(frames);
+        manager.update();
+    }
+};
+
+struct da_mixer {
+    Mixer mixer;
+    size_t maxFrames;
+    std::vector<da_graph*> graphs;
+
+    da_mixer(size_t maxChannels, size_t maxBuses, size_t maxFrames_)
+        : mixer(maxChannels, maxBuses, maxFrames_), maxFrames(maxFrames_), graphs() {}
+};
+
+// Nothing may throw across the boundary, allocation failure included
+template<typename Function>
+static da_result guarded(Function function) {
+    try { return function(); }
+    catch (const std::bad_alloc&) { return DA_OUT_OF_ROOM; }
+    catch (...) { return DA_UNKNOWN_ERROR; }
+}
+
+// Result values match da_result up to UnknownError, the ones added after it are mapped
+static da_result toResult(Result result) {
+    return result == NotSupported ? DA_NOT_SUPPORTED : (da_result)result;
+}
+
+uint32_t da_api_version(void) { return DA_API_VERSION; }
+
+
+// Waves
+
+da_result da_wav_load(const char* path, da_wav** wav)
+{
+    if (path == nullptr || wav == nullptr) return DA_INVALID_ARGUMENT;
+    *wav = nullptr;
+    return guarded([&] {
+        std::unique_ptr<da_wav> loaded(new da_wav());
+        Result result = Sample::load(path, loaded->sample);
+        if (result != Success) return toResult(result);
+        *wav = loaded.release();
+        return DA_SUCCESS;
+    });
+}
+
+void da_wav_destroy(da_wav* wav) { delete wav; }
+
+da_result da_wav_info_get(const da_wav* wav, da_wav_info* info)
+{
+    if (wav == nullptr || info == nullptr) return DA_INVALID_ARGUMENT;
+    const AudioLoaderWav::Wav& w = wav->sample->wav;
+    info->sample_rate = w.fmt.sampleRate;
+    info->channels = w.fmt.numChannels;
+    info->bits_per_sample = w.fmt.bitsPerSample;
+    info->frames = w.fmt.blockAlign ? w.data.chunkSize / w.fmt.blockAlign : 0;
+    info->integrated_lufs = w.loudness.integrated;
+    info->true_peak_dbtp = w.loudness.truePeak;
+    return DA_SUCCESS;
+}
+
+float da_wav_normalization_gain(const da_wav* wav, float target_lufs, float ceiling_dbtp)
+{
+    return wav != nullptr ? wav->sample->wav.loudness.normalizationGain(target_lufs, ceiling_dbtp) : 1.0f;
+}
+
+
+// Tunes
+
+da_result da_tune_create(da_tune** tune)
+{
+    if (tune == nullptr) return DA_INVALID_ARGUMENT;
+    *tune = nullptr;
+    return guarded([&] {
+        *tune = new da_tune();
+        return DA_SUCCESS;
+    });
+}
+
+da_result da_tune_load(const char* path, da_tune** tune)
+{
+    if (path == nullptr || tune == nullptr) return DA_INVALID_ARGUMENT;
+    *tune = nullptr;
+    return guarded([&] {
+        TuneBinary::MappedFile file;
+        TuneBinary::View view;
+        Result result = TuneBinary::load(path, file, view);
+        if (result != Success) return toResult(result);
+
+        std::unique_ptr<da_tune> loaded(new da_tune());
+        loaded->tune = view.toTune();
+        *tune = loaded.release();
+        return DA_SUCCESS;
+    });
+}
+
+da_result da_tune_save(const da_tune* tune, const char* path)
+{
+    if (tune == nullptr || path == nullptr) return DA_INVALID_ARGUMENT;
+    return guarded([&] { return toResult(TuneBinary::write(tune->tune, path)); });
+}
+
+void da_tune_destroy(da_tune* tune) { delete tune; }
+
+da_result da_tune_add_chords(da_tune* tune, const da_note* notes, const uint32_t* chord_sizes, size_t chord_count)
+{
+    if (tune == nullptr || (chord_count > 0 && (notes == nullptr || chord_sizes == nullptr))) return DA_INVALID_ARGUMENT;
+    return guarded([&] {
+        size_t first = tune->tune.chords.size();
+        tune->tune.chords.reserve(first + chord_count);
+
+        std::vector<Note> chord;
+        for (size_t c = 0; c < chord_count; c++) {
+            chord.clear();
+            for (uint32_t n = 0; n < chord_sizes[c]; n++, notes++) chord.push_back(Note(notes->value, notes->duration));
+            tune->tune.addChord(Chord(chord));
+        }
+        tune->tune.touch(first);
+        return DA_SUCCESS;
+    });
+}
+
+da_result da_tune_set_tempo(da_tune* tune, double bpm)
+{
+    if (tune == nullptr || !(bpm > 0)) return DA_INVALID_ARGUMENT;
+    return guarded([&] {
+        tune->tune.setTempo(TempoMap(bpm));
+        return DA_SUCCESS;
+    });
+}
+
+size_t da_tune_chord_count(const da_tune* tune) { return tune != nullptr ? tune->tune.chords.size() : 0; }
+
+
+// Effect graphs
+
+da_result da_graph_create(uint32_t sample_rate, uint32_t max_voices, uint32_t max_frames, da_graph** graph)
+{
+    if (graph == nullptr || sample_rate == 0 || max_voices == 0 || max_frames == 0) return DA_INVALID_ARGUMENT;
+    *graph = nullptr;
+    return guarded([&] {
+        *graph = new da_graph(sample_rate, max_voices, max_frames);
+        return DA_SUCCESS;
+    });
+}
+
+void da_graph_destroy(da_graph* graph) { delete graph; }
+
+int32_t da_graph_add_wav_voice(da_graph* graph, const da_wav* wav, const da_envelope* envelope, float priority)
+{
+    if (graph == nullptr || wav == nullptr) return -DA_INVALID_ARGUMENT;
+    int32_t voice = -DA_OUT_OF_ROOM;
+    da_result result = guarded([&] {
+        Effect::WavStream* stream = new Effect::WavStream(nullptr, std::shared_ptr<const Sample>(wav->sample));
+        voice = graph->add(std::unique_ptr<Effect::Abstract>(stream), stream, nullptr, envelope, priority);
+        return DA_SUCCESS;
+    });
+    return result == DA_SUCCESS ? voice : -result;
+}
+
+int32_t da_graph_add_tune_voice(da_graph* graph, const da_tune* tune, float amplitude, const da_envelope* envelope, float priority)
+{
+    if (graph == nullptr || tune == nullptr) return -DA_INVALID_ARGUMENT;
+    int32_t voice = -DA_OUT_OF_ROOM;
+    da_result result = guarded([&] {
+        Effect::TunePlayer* player = new Effect::TunePlayer(&tune->tune, graph->sampleRate, amplitude);
+        voice = graph->add(std::unique_ptr<Effect::Abstract>(player), nullptr, player, envelope, priority);
+        return DA_SUCCESS;
+    });
+    return result == DA_SUCCESS ? voice : -result;
+}
+
+da_result da_graph_trigger(da_graph* graph, const da_trigger* triggers, size_t count)
+{
+    if (graph == nullptr || (count > 0 && triggers == nullptr)) return DA_INVALID_ARGUMENT;
+
+    da_result result = DA_SUCCESS;
+    for (size_t i = 0; i < count; i++)
+    {
+        const da_trigger& trigger = triggers[i];
+        if (trigger.voice >= graph->voices.size() || trigger.offset >= graph->maxFrames) {
+            result = DA_INVALID_ARGUMENT;
+            continue;
+        }
+
+        uint32_t voice = trigger.voice;
+        if (trigger.kind == DA_TRIGGER_ON) {
+            if (graph->waves[voice] != nullptr) graph->waves[voice]->position = 0;
+            if (graph->tunes[voice] != nullptr) graph->tunes[voice]->seek(0);
+            graph->manager.setGain(voice, trigger.gain);
+            graph->bank.noteOn(voice, trigger.offset, trigger.length ? trigger.length : EnvelopeBank::None);
+        }
+        else if (trigger.kind == DA_TRIGGER_OFF) graph->bank.noteOff(voice, trigger.offset);
+        else result = DA_INVALID_ARGUMENT;
+    }
+    return result;
+}
+
+da_result da_graph_voice_counts(const da_graph* graph, uint32_t* real_voices, uint32_t* virtual_voices)
+{
+    if (graph == nullptr) return DA_INVALID_ARGUMENT;
+    if (real_voices != nullptr) *real_voices = graph->manager.stats().realVoices.load(std::memory_order_relaxed);
+    if (virtual_voices != nullptr) *virtual_voices = graph->manager.stats().virtualVoices.load(std::memory_order_relaxed);
+    return DA_SUCCESS;
+}
+
+
+// Mixers
+
+da_result da_mixer_create(uint32_t max_channels, uint32_t max_buses, uint32_t max_frames, da_mixer** mixer)
+{
+    if (mixer == nullptr || max_buses == 0 || max_frames == 0) return DA_INVALID_ARGUMENT;
+    *mixer = nullptr;
+    return guarded([&] {
+        *mixer = new da_mixer(max_channels, max_buses, max_frames);
+        return DA_SUCCESS;
+    });
+}
+
+void da_mixer_destroy(da_mixer* mixer) { delete mixer; }
+
+int32_t da_mixer_add_bus(da_mixer* mixer, uint32_t output_bus)
+{
+    if (mixer == nullptr || output_bus >= mixer->mixer.busCount()) return -DA_INVALID_ARGUMENT;
+    int bus = mixer->mixer.addBus(output_bus);
+    return bus < 0 ? -DA_OUT_OF_ROOM : bus;
+}
+
+int32_t da_mixer_add_voice_channel(da_mixer* mixer, da_graph* graph, uint32_t voice, uint32_t output_bus)
+{
+    if (mixer == nullptr || graph == nullptr || voice >= graph->voices.size() || output_bus >= mixer->mixer.busCount())
+        return -DA_INVALID_ARGUMENT;
+
+    // Two mixers would advance the graph twice a block
+    if (graph->mixer != nullptr && graph->mixer != mixer) return -DA_INVALID_ARGUMENT;
+    if (graph->maxFrames < mixer->maxFrames) return -DA_INVALID_ARGUMENT;
+
+    int32_t channel = -DA_OUT_OF_ROOM;
+    da_result result = guarded([&] {
+        // Room first, so once the channel is added taking the graph on cannot fail
+        bool known = std::find(mixer->graphs.begin(), mixer->graphs.end(), graph) != mixer->graphs.end();
+        if (!known) mixer->graphs.reserve(mixer->graphs.size() + 1);
+
+        int added = mixer->mixer.addChannel(graph->voices[voice].get(), output_bus);
+        if (added < 0) return DA_SUCCESS;
+
+        if (!known) mixer->graphs.push_back(graph);
+        graph->mixer = mixer;
+        channel = added;
+        return DA_SUCCESS;
+    });
+    return result == DA_SUCCESS ? channel : -result;
+}
+
+da_result da_mixer_set_params(da_mixer* mixer, const da_param* params, size_t count)
+{
+    if (mixer == nullptr || (count > 0 && params == nullptr)) return DA_INVALID_ARGUMENT;
+
+    Mixer& m = mixer->mixer;
+    size_t channels = m.channelCount();
+    size_t buses = m.busCount();
+
+    da_result result = DA_SUCCESS;
+    for (size_t i = 0; i < count; i++)
+    {
+        const da_param& param = params[i];
+        bool channel = param.kind <= DA_PARAM_CHANNEL_SEND;
+        if (param.index >= (channel ? channels : buses)) {
+            result = DA_INVALID_ARGUMENT;
+            continue;
+        }
+
+        switch (param.kind)
+        {
+        case DA_PARAM_CHANNEL_GAIN: m.setGain(param.index, param.value); break;
+        case DA_PARAM_CHANNEL_PAN: m.setPan(param.index, param.value); break;
+        case DA_PARAM_CHANNEL_MUTE: m.setMuted(param.index, param.value != 0); break;
+        case DA_PARAM_CHANNEL_SEND:
+            if (!m.setSend(param.index, param.bus, param.value)) result = DA_INVALID_ARGUMENT;
+            break;
+        case DA_PARAM_BUS_GAIN: m.setBusGain(param.index, param.value); break;
+        case DA_PARAM_BUS_BALANCE: m.setBalance(param.index, param.value); break;
+        case DA_PARAM_BUS_MUTE: m.setBusMuted(param.index, param.value != 0); break;
+        default: result = DA_INVALID_ARGUMENT; break;
+        }
+    }
+    return result;
+}
+
+da_result da_mixer_process(da_mixer* mixer, float* out, size_t frames)
+{
+    if (mixer == nullptr || (frames > 0 && out == nullptr)) return DA_INVALID_ARGUMENT;
+
+    for (size_t done = 0; done < frames; done += mixer->maxFrames)
+    {
+        size_t n = std::min(mixer->maxFrames, frames - done);
+        for (da_graph* graph : mixer->graphs) graph->advance(n);
+        mixer->mixer.process(n);
+        mixer->mixer.interleave(out + 2 * done, n);
+    }
+    return DA_SUCCESS;
+}
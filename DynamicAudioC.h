@@ -0,0 +1,170 @@
+/*
+ * DynamicAudioC.h: the C interface exported by the DynamicAudio shared library.
+ *
+ * Everything is reached through opaque handles made by a create or load call and released by the
+ * matching destroy call. Work is handed over in batches, a block of frames, an array of parameter
+ * changes or an array of triggers per call, so crossing the library boundary costs one call a block
+ * rather than one a voice. No call throws, allocates while processing, or keeps a pointer to the
+ * arrays passed in.
+ *
+ * Released structs and functions never change. Anything new comes as new functions and a higher
+ * DA_API_VERSION, so a host built against an older header keeps working.
+ */
+#ifndef DYNAMICAUDIO_C_H
+#define DYNAMICAUDIO_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(DYNAMICAUDIO_EXPORTS)
+#    define DA_API __declspec(dllexport)
+#  else
+#    define DA_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#  define DA_API __attribute__((visibility("default")))
+#else
+#  define DA_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DA_API_VERSION 1
+
+/* The first six match the library's Result enum */
+typedef int32_t da_result;
+#define DA_SUCCESS                  0
+#define DA_CANNOT_OPEN_FILE         1
+#define DA_BAD_FORMATTING           2
+#define DA_PROBLEM_READING_DATA     3
+#define DA_UNSUPPORTED_VERSION      4
+#define DA_UNKNOWN_ERROR            5
+#define DA_INVALID_ARGUMENT         6   /* A null handle, or an index out of range */
+#define DA_OUT_OF_ROOM              7   /* More than the capacity given at create */
+#define DA_NOT_SUPPORTED            8   /* A sample format the library cannot read */
+
+typedef struct da_wav da_wav;
+typedef struct da_tune da_tune;
+typedef struct da_graph da_graph;
+typedef struct da_mixer da_mixer;
+
+/* The version the library was built as, compare against DA_API_VERSION */
+DA_API uint32_t da_api_version(void);
+
+
+/* ---- Waves ---- */
+
+typedef struct da_wav_info {
+    uint32_t sample_rate;
+    uint16_t channels;
+    uint16_t bits_per_sample;
+    uint64_t frames;
+    float integrated_lufs;      /* Measured at load, -infinity for silence */
+    float true_peak_dbtp;
+} da_wav_info;
+
+/* Loads a WAV file. Voices playing it keep the samples alive, so it can be destroyed at any time */
+DA_API da_result da_wav_load(const char* path, da_wav** wav);
+DA_API void da_wav_destroy(da_wav* wav);
+DA_API da_result da_wav_info_get(const da_wav* wav, da_wav_info* info);
+
+/* The gain that brings the wave to target_lufs without its true peak passing ceiling_dbtp, 1 if unmeasured */
+DA_API float da_wav_normalization_gain(const da_wav* wav, float target_lufs, float ceiling_dbtp);
+
+
+/* ---- Tunes ---- */
+
+typedef struct da_note {
+    uint16_t value;             /* MIDI note number */
+    double duration;            /* 1 is a semibreve */
+} da_note;
+
+DA_API da_result da_tune_create(da_tune** tune);
+
+/* Loads a binary .datn tune, tempo map included */
+DA_API da_result da_tune_load(const char* path, da_tune** tune);
+DA_API da_result da_tune_save(const da_tune* tune, const char* path);
+DA_API void da_tune_destroy(da_tune* tune);
+
+/* Appends chord_count chords, chord i made of the next chord_sizes[i] notes. Not while a voice plays the tune */
+DA_API da_result da_tune_add_chords(da_tune* tune, const da_note* notes, const uint32_t* chord_sizes, size_t chord_count);
+DA_API da_result da_tune_set_tempo(da_tune* tune, double bpm);
+DA_API size_t da_tune_chord_count(const da_tune* tune);
+
+
+/* ---- Effect graphs ---- */
+
+/* A voice runs its source, a wave or a tune, through an ADSR envelope; quiet voices go virtual */
+typedef struct da_envelope {
+    float attack;               /* Seconds */
+    float decay;
+    float sustain;              /* Level, 0 to 1 */
+    float release;
+} da_envelope;
+
+#define DA_TRIGGER_ON       0   /* Restart the source and open the envelope */
+#define DA_TRIGGER_OFF      1   /* Release the envelope */
+
+typedef struct da_trigger {
+    uint32_t kind;              /* DA_TRIGGER_ON or DA_TRIGGER_OFF */
+    uint32_t voice;
+    uint32_t offset;            /* Frames into the next block */
+    uint32_t length;            /* Frames until an automatic release, 0 to hold until DA_TRIGGER_OFF */
+    float gain;                 /* Of the voice from now on, ignored by DA_TRIGGER_OFF */
+} da_trigger;
+
+DA_API da_result da_graph_create(uint32_t sample_rate, uint32_t max_voices, uint32_t max_frames, da_graph** graph);
+DA_API void da_graph_destroy(da_graph* graph);
+
+/* Each returns the index of the new voice, or a negative da_result. The tune must outlive the graph */
+DA_API int32_t da_graph_add_wav_voice(da_graph* graph, const da_wav* wav, const da_envelope* envelope, float priority);
+DA_API int32_t da_graph_add_tune_voice(da_graph* graph, const da_tune* tune, float amplitude, const da_envelope* envelope, float priority);
+
+/* Applies count triggers in order, skipping invalid ones. Returns DA_INVALID_ARGUMENT if any were skipped */
+DA_API da_result da_graph_trigger(da_graph* graph, const da_trigger* triggers, size_t count);
+
+DA_API da_result da_graph_voice_counts(const da_graph* graph, uint32_t* real_voices, uint32_t* virtual_voices);
+
+
+/* ---- Mixers ---- */
+
+#define DA_MASTER_BUS 0
+
+#define DA_PARAM_CHANNEL_GAIN       0
+#define DA_PARAM_CHANNEL_PAN        1   /* -1 left to 1 right */
+#define DA_PARAM_CHANNEL_MUTE       2   /* Muted when value is not 0 */
+#define DA_PARAM_CHANNEL_SEND       3   /* Level of the send from channel index to bus */
+#define DA_PARAM_BUS_GAIN           4
+#define DA_PARAM_BUS_BALANCE        5
+#define DA_PARAM_BUS_MUTE           6
+
+typedef struct da_param {
+    uint32_t kind;              /* DA_PARAM_* */
+    uint32_t index;             /* The channel or bus */
+    uint32_t bus;               /* The send's bus, for DA_PARAM_CHANNEL_SEND */
+    float value;
+} da_param;
+
+DA_API da_result da_mixer_create(uint32_t max_channels, uint32_t max_buses, uint32_t max_frames, da_mixer** mixer);
+DA_API void da_mixer_destroy(da_mixer* mixer);
+
+/* Each returns the new index, or a negative da_result */
+DA_API int32_t da_mixer_add_bus(da_mixer* mixer, uint32_t output_bus);
+
+/* Feeds one voice of a graph into a mono channel. The mixer advances the graph every block, the graph must outlive it */
+DA_API int32_t da_mixer_add_voice_channel(da_mixer* mixer, da_graph* graph, uint32_t voice, uint32_t output_bus);
+
+/* Applies count parameter changes in order, skipping invalid ones. Returns DA_INVALID_ARGUMENT if any were skipped */
+DA_API da_result da_mixer_set_params(da_mixer* mixer, const da_param* params, size_t count);
+
+/* Renders frames of interleaved stereo into out, any number of frames, split into blocks of max_frames */
+DA_API da_result da_mixer_process(da_mixer* mixer, float* out, size_t frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
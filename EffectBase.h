@@ -2,23 +2,55 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include "AudioLoaderWav.h"
 #include <chrono>
+#include <memory>
 #include "AudioLoaderWav.h"
+#include "Profiler.h"
+#include "SampleCache.h"
 
 namespace Effect {
 
 	// Unknown what the return type is
 	// Maybe template it?
-	#define value uint8_t
+	typedef uint8_t value;
 
 	/// <summary> The base class for an effect </summary>
 	struct Abstract
 	{
+		virtual ~Abstract() {}
+
 		/// <summary> Gets the calculated effects value. </summary>
 		/// <param name="in"> The value passed in. </param>
 		/// <returns> The value passed out. </returns>
 		virtual value get(value in = 0) = 0;
+
+		/// <summary> Fills a block of samples, calling get once per sample unless overridden. </summary>
+		/// <param name="out"> The samples to write. </param>
+		/// <param name="frames"> The amount of samples in the block. </param>
+		virtual void process(float* out, size_t frames) {
+			for (size_t i = 0; i < frames; i++) out[i] = (float)get(0);
+		}
+
+		/// <summary> Moves the playback position on without producing any samples, ie. while the voice is virtual. </summary>
+		/// <param name="frames"> The amount of samples to skip. </param>
+		virtual void skip(size_t frames) {}
+
+		/// <summary> Whether the last process call only wrote silence, so a mixer can leave it out. </summary>
+		virtual bool silent() const { return false; }
+	};
+
+	/// <summary> Processes a stereo bus in place, ie. dynamics run by the Mixer once the bus has been summed. </summary>
+	struct BusInsert
+	{
+		virtual ~BusInsert() {}
+
+		/// <summary> Processes a block in place. </summary>
+		/// <param name="left"> The left samples, or the only ones of a mono signal. </param>
+		/// <param name="right"> The right samples, or null for mono. </param>
+		/// <param name="frames"> The amount of samples in each. </param>
+		virtual void process(float* left, float* right, size_t frames) = 0;
 	};
 
 	/// <summary> Gets a constant value. </summary>
@@ -65,11 +97,11 @@ namespace Effect {
 
 		/// <summary> Constructor Definition. </summary>
 		TimeSince()
-			: start(std::chrono::high_resolution_clock::now()) {
+			: start(std::chrono::steady_clock::now()) {
 		}
 
 		value get(value in) override {
-			std::chrono::steady_clock::time_point now = std::chrono::high_resolution_clock::now();
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
 			auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - start);
 			return duration.count();
 		}
@@ -85,16 +117,66 @@ namespace Effect {
 	struct WavStream : public Abstract
 	{
 		Abstract* timestamp;
-		AudioLoaderWav::Wav wav;
+
+		/// <summary> The wave handed to the constructor without a cache, left empty for a shared sample. </summary>
+		AudioLoaderWav::Wav owned;
+
+		/// <summary> Keeps the samples alive when they came from a SampleCache, null otherwise. </summary>
+		std::shared_ptr<const DynamicAudio::Sample> sample;
+
+		/// <summary> The next sample process will read. </summary>
+		size_t position;
 
 		/// <summary> Constructor Definition. </summary>
 		WavStream(Abstract* timestamp_, AudioLoaderWav::Wav wav_)
-			: timestamp(timestamp_), wav(wav_) {}
+			: timestamp(timestamp_), owned(wav_), sample(), position(0) {}
+
+		/// <summary> Constructor Definition. </summary>
+		/// <param name="sample_"> A shared sample, ie. from SampleCache::get. Every stream of it reads the same memory. </param>
+		WavStream(Abstract* timestamp_, std::shared_ptr<const DynamicAudio::Sample> sample_)
+			: timestamp(timestamp_), owned(), sample(sample_), position(0) {}
+
+		/// <summary> The wave being read, the shared sample's when there is one. </summary>
+		const AudioLoaderWav::Wav& wav() const { return sample != nullptr ? sample->wav : owned; }
+
+		/// <summary> The amount of samples in the stream. </summary>
+		size_t sampleCount() const {
+			// BUG: We assume 16-bit monochannel samples
+			return wav().data.chunkSize / sizeof(int16_t);
+		}
+
+		/// <summary> Reads any stretch of the samples as floats without moving the position, silence outside the stream. </summary>
+		/// <param name="start"> The first sample, may be negative. </param>
+		void read(int64_t start, size_t count, float* out) const {
+			int64_t total = (int64_t)sampleCount();
+			int64_t first = std::min<int64_t>(std::max<int64_t>(start, 0), start + (int64_t)count);
+			int64_t last = std::max<int64_t>(first, std::min<int64_t>(start + (int64_t)count, total));
+
+			const uint8_t* data = wav().data.data;
+			size_t before = (size_t)(first - start);
+			for (size_t i = 0; i < before; i++) out[i] = 0;
+			for (int64_t i = first; i < last; i++) {
+				int16_t sample;
+				std::memcpy(&sample, data + i * sizeof(int16_t), sizeof(int16_t));
+				out[i - start] = sample * (1.0f / 32768.0f);
+			}
+			for (size_t i = (size_t)(last - start); i < count; i++) out[i] = 0;
+		}
+
+		/// <summary> Reads the next block of samples as floats, silence past the end. </summary>
+		void process(float* out, size_t frames) override {
+			DA_PROFILE_SCOPE("WavStream::process");
+			read((int64_t)position, frames, out);
+			position += frames;
+		}
+
+		void skip(size_t frames) override { position += frames; }
 
 		value get(value in) override {
 			// TODO: multiply timestamp by wav streams per second, ect..
-			unsigned int stamp = std::max(timestamp->get(), (uint8_t)wav.data.chunkSize);
-			return wav.data.data[stamp];
+			const AudioLoaderWav::Wav& source = wav();
+			unsigned int stamp = std::max(timestamp->get(), (uint8_t)source.data.chunkSize);
+			return source.data.data[stamp];
 		}
 	};
 
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "EffectBase.h"
+#include "Loudness.h"
+#include "Profiler.h"
+#include "Simd.h"
+
+namespace Effect {
+
+	/// <summary> Decibels to a linear gain. </summary>
+	inline float fromDecibels(float db) { return std::pow(10.0f, db / 20.0f); }
+
+	/// <summary> A linear gain to decibels, -200 for silence. </summary>
+	inline float toDecibels(float gain) { return 20.0f * std::log10(std::max(gain, 1e-10f)); }
+
+	/// <summary>
+	/// A feed-forward compressor for a bus, with an optional sidechain for ducking.
+	/// The level is followed per sub-block of ControlFrames samples: the peak of the sub-block is found four
+	/// samples at a time, one attack or release step covers the whole sub-block, and the gain is ramped across it.
+	/// So the per-sample cost is a compare and a multiply, and the logs and powers run once per sub-block.
+	/// </summary>
+	struct Compressor : public BusInsert
+	{
+		/// <summary> Samples per gain computation. </summary>
+		static constexpr size_t ControlFrames = 16;
+
+		float sampleRate;
+		float threshold;	// dB
+		float ratio;		// ie. 4 for 4:1, large for limiting
+		float knee;			// Width in dB of the soft knee, 0 for a hard knee
+		float makeup;		// dB
+		float attack;		// Seconds
+		float release;
+
+		// Sidechain, null to detect on the bus itself
+		const float* sidechainLeft;
+		const float* sidechainRight;
+
+		float envelope;			// Linear peak level
+		float currentGain;		// Reached at the end of the last sub-block
+		float minGain;			// The lowest gain of the last process, for metering
+		float attackStep;		// Per full sub-block
+		float releaseStep;
+
+		/// <summary> Constructor Definition. </summary>
+		/// <param name="threshold_"> The level in dB above which the gain is reduced. </param>
+		/// <param name="ratio_"> How many dB in over the threshold make one dB out. </param>
+		/// <param name="attack_"> Seconds to follow a rising level. </param>
+		/// <param name="release_"> Seconds to follow a falling level. </param>
+		Compressor(float sampleRate_, float threshold_ = -18, float ratio_ = 4, float attack_ = 0.005f, float release_ = 0.15f)
+			: sampleRate(sampleRate_), threshold(threshold_), ratio(ratio_), knee(6), makeup(0), attack(0), release(0),
+			sidechainLeft(nullptr), sidechainRight(nullptr), envelope(0), currentGain(1), minGain(1), attackStep(1), releaseStep(1)
+		{
+			setTimes(attack_, release_);
+		}
+
+		/// <summary> Sets the attack and release in seconds. </summary>
+		void setTimes(float attack_, float release_) {
+			attack = attack_;
+			release = release_;
+			attackStep = step(attack, ControlFrames);
+			releaseStep = step(release, ControlFrames);
+		}
+
+		/// <summary>
+		/// Detects on other samples than the ones compressed, ie. Mixer::left and right of a dialogue bus to duck music.
+		/// They have to cover every frame passed to process. Pass nulls to detect on the bus again.
+		/// </summary>
+		void setSidechain(const float* left, const float* right = nullptr) {
+			sidechainLeft = left;
+			sidechainRight = right;
+		}
+
+		/// <summary> How far the gain was pulled down during the last process, in dB. </summary>
+		float gainReduction() const { return -toDecibels(minGain); }
+
+		/// <summary> The gain for a level, both in dB, along a soft knee around the threshold. </summary>
+		float computeGain(float level) const {
+			float over = level - threshold;
+			if (2 * over <= -knee) return 0;
+			if (2 * std::fabs(over) < knee) {
+				float into = over + knee * 0.5f;
+				return (1 / ratio - 1) * into * into / (2 * knee);
+			}
+			return over / ratio - over;
+		}
+
+		void process(float* left, float* right, size_t frames) override {
+			DA_PROFILE_SCOPE("Compressor::process");
+			const float* detectLeft = sidechainLeft ? sidechainLeft : left;
+			const float* detectRight = sidechainLeft ? sidechainRight : right;
+			minGain = currentGain;
+
+			for (size_t start = 0; start < frames; start += ControlFrames)
+			{
+				size_t n = std::min(ControlFrames, frames - start);
+
+				float peak = DynamicAudio::Simd::peak(detectLeft + start, n);
+				if (detectRight != nullptr) peak = std::max(peak, DynamicAudio::Simd::peak(detectRight + start, n));
+
+				float coefficient = peak > envelope ? attackStep : releaseStep;
+				if (n != ControlFrames) coefficient = step(peak > envelope ? attack : release, n);
+				envelope = peak + (envelope - peak) * coefficient;
+
+				float target = fromDecibels(computeGain(toDecibels(envelope)) + makeup);
+				DynamicAudio::Simd::rampScale(left + start, currentGain, target, n);
+				if (right != nullptr) DynamicAudio::Simd::rampScale(right + start, currentGain, target, n);
+				currentGain = target;
+				minGain = std::min(minGain, target);
+			}
+		}
+
+	private:
+		/// <summary> How much of the distance to a new level is left after some frames. </summary>
+		float step(float seconds, size_t frames) const {
+			return seconds > 0 ? std::exp(-(float)frames / (seconds * sampleRate)) : 0.0f;
+		}
+	};
+
+	/// <summary>
+	/// A brick-wall lookahead limiter, no sample leaves it above the ceiling.
+	/// The audio is delayed by the lookahead, while the gain each incoming peak needs is known straight away.
+	/// The lowest gain needed across the lookahead comes from a monotonic queue, so each sample is pushed and
+	/// popped at most once whatever the lookahead. A moving average over the lookahead then ramps the gain down
+	/// so it is reached exactly as the peak comes out, and the release lets it back up.
+	/// </summary>
+	struct Limiter : public BusInsert
+	{
+		float ceiling;			// Linear
+		float releaseStep;		// Per sample
+		size_t lookahead;		// Frames, also the latency and the attack
+		size_t maxFrames;
+
+		// Per channel, the last lookahead input frames followed by room for a block
+		std::vector<float> delayed[2];
+
+		// Peaks in the window, falling from the front, as a ring
+		std::vector<float> queuePeak;
+		std::vector<uint64_t> queueFrame;
+		size_t queueFront;
+		size_t queueSize;
+
+		// The moving average of the gain
+		std::vector<float> history;
+		size_t historyIndex;
+		double historySum;
+
+		std::vector<float> peaks;
+		std::vector<float> gains;
+		float released;
+		float minGain;
+		uint64_t frame;
+
+		/// <summary> Constructor Definition. </summary>
+		/// <param name="maxFrames_"> The largest block process is handed at once, larger ones are split. </param>
+		/// <param name="ceilingDb"> The highest level let out, in dB. </param>
+		/// <param name="lookaheadSeconds"> How far ahead peaks are seen, the latency added to the bus. </param>
+		/// <param name="releaseSeconds"> How quickly the gain recovers after a peak. </param>
+		Limiter(float sampleRate, size_t maxFrames_ = 1024, float ceilingDb = -1, float lookaheadSeconds = 0.005f, float releaseSeconds = 0.05f)
+			: ceiling(fromDecibels(ceilingDb)), releaseStep(0), lookahead((size_t)std::lround(lookaheadSeconds * sampleRate)), maxFrames(maxFrames_ ? maxFrames_ : 1),
+			queuePeak(), queueFrame(), queueFront(0), queueSize(0), history(), historyIndex(0), historySum(0),
+			peaks(maxFrames), gains(maxFrames), released(1), minGain(1), frame(0)
+		{
+			releaseStep = releaseSeconds > 0 ? 1 - std::exp(-1 / (releaseSeconds * sampleRate)) : 1.0f;
+			for (std::vector<float>& channel : delayed) channel.assign(lookahead + maxFrames, 0);
+			queuePeak.assign(lookahead + 1, 0);
+			queueFrame.assign(lookahead + 1, 0);
+			history.assign(lookahead + 1, 1);
+			historySum = (double)history.size();
+		}
+
+		/// <summary> The frames of latency added, the same on every channel. </summary>
+		size_t latencyFrames() const { return lookahead; }
+
+		/// <summary> How far the gain was pulled down during the last process, in dB. </summary>
+		float gainReduction() const { return -toDecibels(minGain); }
+
+		void process(float* left, float* right, size_t frames) override {
+			DA_PROFILE_SCOPE("Limiter::process");
+			minGain = 1;
+			for (size_t done = 0; done < frames; done += maxFrames) {
+				size_t n = std::min(maxFrames, frames - done);
+				processBlock(left + done, right ? right + done : nullptr, n);
+			}
+		}
+
+	private:
+		void processBlock(float* left, float* right, size_t frames) {
+			using DynamicAudio::Simd::Float4;
+
+			// The louder side of each frame, four at a time
+			size_t i = 0;
+			if (right != nullptr) {
+				for (; i < DynamicAudio::Simd::wide(frames); i += DynamicAudio::Simd::Width)
+					Float4::max(Float4::abs(Float4::load(left + i)), Float4::abs(Float4::load(right + i))).store(peaks.data() + i);
+			}
+			else {
+				for (; i < DynamicAudio::Simd::wide(frames); i += DynamicAudio::Simd::Width) Float4::abs(Float4::load(left + i)).store(peaks.data() + i);
+			}
+			for (; i < frames; i++) peaks[i] = std::max(std::fabs(left[i]), right ? std::fabs(right[i]) : 0.0f);
+
+			size_t window = lookahead + 1;
+			double average = 1.0 / window;
+			for (i = 0; i < frames; i++, frame++)
+			{
+				// Drop the peak that left the window and every quieter one before the new peak
+				float peak = peaks[i];
+				if (queueSize > 0 && queueFrame[queueFront] + window <= frame) {
+					queueFront = queueFront + 1 == window ? 0 : queueFront + 1;
+					queueSize--;
+				}
+				size_t back = queueFront + queueSize;
+				back = back >= window ? back - window : back;
+				while (queueSize > 0) {
+					size_t last = back == 0 ? window - 1 : back - 1;
+					if (queuePeak[last] > peak) break;
+					back = last;
+					queueSize--;
+				}
+				queuePeak[back] = peak;
+				queueFrame[back] = frame;
+				queueSize++;
+
+				float loudest = queuePeak[queueFront];
+				float needed = loudest > ceiling ? ceiling / loudest : 1.0f;
+
+				// Falls at once, recovers over the release, so never above what is needed
+				released = needed < released ? needed : released + (needed - released) * releaseStep;
+
+				historySum += released - history[historyIndex];
+				history[historyIndex] = released;
+				historyIndex = historyIndex + 1 == window ? 0 : historyIndex + 1;
+				gains[i] = (float)(historySum * average);
+			}
+
+			float lowest = 1;
+			for (i = 0; i < frames; i++) lowest = std::min(lowest, gains[i]);
+			minGain = std::min(minGain, lowest);
+
+			applyDelayed(delayed[0], left, frames);
+			if (right != nullptr) applyDelayed(delayed[1], right, frames);
+		}
+
+		/// <summary> Writes the input from lookahead frames ago times the gain, keeping the newest lookahead frames for next time. </summary>
+		void applyDelayed(std::vector<float>& line, float* samples, size_t frames) {
+			using DynamicAudio::Simd::Float4;
+			float* buffer = line.data();
+			std::copy(samples, samples + frames, buffer + lookahead);
+
+			// The average can round a hair above the gain needed, so the ceiling is enforced as well
+			Float4 limit(ceiling);
+			size_t i = 0;
+			for (; i < DynamicAudio::Simd::wide(frames); i += DynamicAudio::Simd::Width) {
+				Float4 out = Float4::load(buffer + i) * Float4::load(gains.data() + i);
+				Float4::max(Float4::min(out, limit), Float4(0) - limit).store(samples + i);
+			}
+			for (; i < frames; i++) samples[i] = std::max(-ceiling, std::min(ceiling, buffer[i] * gains[i]));
+
+			std::copy(buffer + frames, buffer + frames + lookahead, buffer);
+		}
+	};
+
+	/// <summary> Measures the loudness of a bus as a Mixer insert, after running another insert on it if given. </summary>
+	struct LoudnessTap : public BusInsert
+	{
+		DynamicAudio::LoudnessMeter* meter;
+		BusInsert* chained;
+
+		/// <summary> Constructor Definition. </summary>
+		/// <param name="chained_"> Run first, ie. the bus limiter, so the meter reads what leaves the bus. </param>
+		LoudnessTap(DynamicAudio::LoudnessMeter* meter_, BusInsert* chained_ = nullptr)
+			: meter(meter_), chained(chained_) {}
+
+		void process(float* left, float* right, size_t frames) override {
+			if (chained != nullptr) chained->process(left, right, frames);
+			meter->push(left, right, frames);
+		}
+	};
+}
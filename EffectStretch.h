@@ -0,0 +1,358 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "EffectBase.h"
+#include "Memory.h"
+#include "Profiler.h"
+#include "Simd.h"
+
+namespace Effect {
+
+	/// <summary>
+	/// Plays a WavStream faster or slower without changing its pitch, by WSOLA.
+	/// Hann windowed frames of the source are overlap-added half a frame apart. Each frame is taken from near
+	/// where the playback speed says it should start, shifted by up to the search range so that it lines up with
+	/// how the previous frame carried on, which keeps the waveform from cancelling itself out where they overlap.
+	/// The search is a coarse pass every few offsets and then a fine one, both Float4 dot products.
+	/// Its buffers are sized from the frame and search lengths when it is built.
+	/// </summary>
+	struct StretchStream : public Abstract
+	{
+		/// <summary> Offsets skipped between candidates of the coarse search. </summary>
+		static constexpr int64_t CoarseStep = 4;
+
+		WavStream* source;
+		double speed;			// Source samples per output sample, 0.5 plays at half speed
+		size_t size;			// Frame length
+		size_t hop;				// Output samples per frame, half the frame
+		size_t search;			// Largest shift either way
+
+		double analysis;		// Where the next frame would start without the search
+		int64_t previous;		// Where the last frame did start
+		bool hasPrevious;
+
+		std::vector<float> window;
+		std::vector<float> target;		// How the last frame carries on
+		std::vector<float> candidates;	// The source around the next frame
+		std::vector<float> segment;
+		std::vector<float> accumulator;	// Overlap-added output, the first hop of it finished
+		size_t ready;					// Finished samples of the accumulator not yet handed out
+
+		/// <summary> Constructor Definition. </summary>
+		/// <param name="source_"> Read through WavStream::read, its own position is left alone. </param>
+		/// <param name="speed_"> Source samples per output sample. </param>
+		/// <param name="size_"> Frame length in samples, around 20 to 40ms. Rounded up to even. </param>
+		/// <param name="search_"> How far a frame may move to line up, about half the lowest period kept smooth. </param>
+		StretchStream(WavStream* source_, double speed_ = 1, size_t size_ = 1024, size_t search_ = 256)
+			: source(source_), speed(speed_), size((std::max<size_t>(size_, 8) + 1) & ~(size_t)1), hop(0), search(search_),
+			analysis(0), previous(0), hasPrevious(false),
+			window(), target(), candidates(), segment(), accumulator(), ready(0)
+		{
+			hop = size / 2;
+			window.resize(size);
+			for (size_t i = 0; i < size; i++)
+				window[i] = (float)(0.5 - 0.5 * std::cos(2 * 3.14159265358979 * i / size));
+
+			target.assign(hop, 0);
+			candidates.assign(2 * search + hop, 0);
+			segment.assign(size, 0);
+			accumulator.assign(size, 0);
+		}
+
+		void setSpeed(double speed_) { speed = speed_; }
+
+		/// <summary> The source sample playing now. </summary>
+		double sourcePosition() const { return analysis - (double)ready * speed; }
+
+		/// <summary> Whether the whole source has been played. </summary>
+		bool finished() const { return ready == 0 && analysis >= (double)source->sampleCount() + size; }
+
+		/// <summary> Starts again from a source sample, without lining up with what played before. </summary>
+		void seek(double sourceSample) {
+			analysis = sourceSample;
+			hasPrevious = false;
+			ready = 0;
+			std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+		}
+
+		value get(value in) override {
+			float sample;
+			process(&sample, 1);
+			return (value)(sample * 127 + 128);
+		}
+
+		void process(float* out, size_t frames) override {
+			DA_PROFILE_SCOPE("StretchStream::process");
+			size_t done = 0;
+			while (done < frames)
+			{
+				if (ready == 0) {
+					if (finished()) { std::fill(out + done, out + frames, 0.0f); return; }
+					synthesize();
+				}
+
+				// The finished samples are the last ready of the first hop
+				size_t take = std::min(frames - done, ready);
+				const float* finishedSamples = accumulator.data() + (hop - ready);
+				std::copy(finishedSamples, finishedSamples + take, out + done);
+				ready -= take;
+				done += take;
+			}
+		}
+
+		/// <summary> Moves on without rendering, the next frame starts fresh. </summary>
+		void skip(size_t frames) override {
+			seek(sourcePosition() + frames * speed);
+		}
+
+		bool silent() const override { return finished(); }
+
+	private:
+		/// <summary> Overlap-adds the next frame, leaving hop finished samples at the front. </summary>
+		void synthesize() {
+			using DynamicAudio::Simd::Float4;
+
+			// Drop the hop handed out last time
+			std::copy(accumulator.begin() + hop, accumulator.end(), accumulator.begin());
+			std::fill(accumulator.begin() + hop, accumulator.end(), 0.0f);
+
+			int64_t nominal = (int64_t)std::floor(analysis);
+			int64_t chosen = nominal;
+			if (hasPrevious && search > 0)
+			{
+				source->read(previous + (int64_t)hop, hop, target.data());
+				source->read(nominal - (int64_t)search, candidates.size(), candidates.data());
+
+				int64_t range = 2 * (int64_t)search;
+				int64_t best = search;
+				float bestScore = -1e30f;
+				for (int64_t offset = 0; offset <= range; offset += CoarseStep) {
+					float score = dot(candidates.data() + offset, target.data(), hop);
+					if (score > bestScore) { bestScore = score; best = offset; }
+				}
+
+				int64_t from = std::max<int64_t>(0, best - CoarseStep + 1), to = std::min<int64_t>(range, best + CoarseStep - 1);
+				for (int64_t offset = from; offset <= to; offset++) {
+					float score = dot(candidates.data() + offset, target.data(), hop);
+					if (score > bestScore) { bestScore = score; best = offset; }
+				}
+				chosen = nominal - (int64_t)search + best;
+			}
+
+			source->read(chosen, size, segment.data());
+			size_t i = 0;
+			for (; i < DynamicAudio::Simd::wide(size); i += DynamicAudio::Simd::Width)
+				(Float4::load(accumulator.data() + i) + Float4::load(segment.data() + i) * Float4::load(window.data() + i)).store(accumulator.data() + i);
+			for (; i < size; i++) accumulator[i] += segment[i] * window[i];
+
+			previous = chosen;
+			hasPrevious = true;
+			analysis += hop * speed;
+			ready = hop;
+		}
+
+		static float dot(const float* a, const float* b, size_t count) {
+			using DynamicAudio::Simd::Float4;
+			Float4 sum;
+			size_t i = 0;
+			for (; i < DynamicAudio::Simd::wide(count); i += DynamicAudio::Simd::Width) sum += Float4::load(a + i) * Float4::load(b + i);
+			float result = sum.sum();
+			for (; i < count; i++) result += a[i] * b[i];
+			return result;
+		}
+	};
+
+	/// <summary> One grain of a GranularStream, kept in a Pool shared by every granular voice. </summary>
+	struct Grain {
+		double position;	// Source sample the grain starts on
+		double increment;	// Source samples per output sample, the grain's pitch
+		uint32_t age;		// Output samples played
+		uint32_t delay;		// Output samples into the block before it starts
+	};
+
+	/// <summary>
+	/// Plays a WavStream as a cloud of short Hann windowed grains. A read position moves through the source at
+	/// the playback speed, and grains are started from around it at the density, each scattered by the jitter.
+	/// The pitch of the grains is separate from the speed, so a speed of 0 freezes the sound without stopping it.
+	/// Grains come from a Pool that any amount of voices can share, so starting one never allocates.
+	/// </summary>
+	struct GranularStream : public Abstract
+	{
+		WavStream* source;
+		DynamicAudio::Pool<Grain>* pool;
+		float sampleRate;
+
+		double speed;			// Source samples per output sample the read position moves
+		double pitch;			// Playback rate of each grain
+		float density;			// Grains per second
+		float jitter;			// Seconds a grain may start either side of the read position
+		float gain;
+
+		double readPosition;
+		double untilNext;		// Output samples until the next grain starts
+		uint32_t rng;
+		uint64_t droppedGrains;
+
+		std::vector<Grain*> active;
+		std::vector<float> window;		// One grain long
+		std::vector<float> scratch;		// The source under a grain for one block
+
+		/// <summary> Constructor Definition. </summary>
+		/// <param name="pool_"> Where grains come from, shared between voices on the same thread. </param>
+		/// <param name="grainSeconds"> The length of every grain. </param>
+		/// <param name="density_"> Grains started per second. </param>
+		/// <param name="jitter_"> Seconds a grain may start either side of the read position. </param>
+		/// <param name="maxFrames"> The largest block process is handed at once, larger ones are split. </param>
+		GranularStream(WavStream* source_, DynamicAudio::Pool<Grain>* pool_, float sampleRate_,
+			float grainSeconds = 0.06f, float density_ = 50, float jitter_ = 0.01f, size_t maxFrames = 1024)
+			: source(source_), pool(pool_), sampleRate(sampleRate_), speed(1), pitch(1), density(density_), jitter(jitter_), gain(1),
+			readPosition(0), untilNext(0), rng(0x2545F491u), droppedGrains(0), active(), window(), scratch()
+		{
+			setGrainSize(grainSeconds, maxFrames);
+		}
+
+		~GranularStream() { stopGrains(); }
+
+		GranularStream(const GranularStream&) = delete;
+		GranularStream& operator=(const GranularStream&) = delete;
+
+		/// <summary> Changes the grain length. Allocates, so call it before playing. </summary>
+		void setGrainSize(float seconds, size_t maxFrames = 1024) {
+			stopGrains();
+			size_t length = std::max<size_t>(4, (size_t)std::lround(seconds * sampleRate));
+			window.resize(length);
+			for (size_t i = 0; i < length; i++)
+				window[i] = (float)(0.5 - 0.5 * std::cos(2 * 3.14159265358979 * i / length));
+
+			// Grains that overlap add up, Hann averages a half
+			gain = 1.0f / std::max(1.0f, 0.5f * density * seconds);
+
+			active.reserve((size_t)std::ceil(density * seconds) + 4);
+			scratch.assign(std::max<size_t>(maxFrames, 1) + 4, 0);
+		}
+
+		void setSpeed(double speed_) { speed = speed_; }
+		void setDensity(float density_) { density = density_; gain = 1.0f / std::max(1.0f, 0.5f * density * window.size() / sampleRate); }
+		void setJitter(float jitter_) { jitter = jitter_; }
+
+		/// <summary> Plays new grains faster or slower, ie. 2 for an octave up, up to 16. </summary>
+		void setPitch(double pitch_) { pitch = std::max(1e-3, std::min(pitch_, 16.0)); }
+
+		/// <summary> Grains not started because the pool or this voice was full. </summary>
+		uint64_t dropped() const { return droppedGrains; }
+
+		size_t grainCount() const { return active.size(); }
+
+		value get(value in) override {
+			// A whole Float4 of room, so the compiler can see the grain loop stays in bounds
+			float samples[DynamicAudio::Simd::Width];
+			process(samples, 1);
+			return (value)(samples[0] * 127 + 128);
+		}
+
+		void process(float* out, size_t frames) override {
+			DA_PROFILE_SCOPE("GranularStream::process");
+			std::fill(out, out + frames, 0.0f);
+
+			// Grains played faster read more source per sample, so the block is cut to fit the scratch
+			size_t blockFrames = std::max<size_t>(1, (size_t)((scratch.size() - 4) / std::max(pitch, 1.0)));
+			for (size_t done = 0; done < frames; done += blockFrames) {
+				size_t n = std::min(blockFrames, frames - done);
+				startGrains(n);
+				renderGrains(out + done, n);
+				readPosition += speed * n;
+			}
+		}
+
+		void skip(size_t frames) override {
+			stopGrains();
+			readPosition += speed * frames;
+			untilNext = std::max(0.0, untilNext - frames);
+		}
+
+		bool silent() const override { return active.empty() && (readPosition >= source->sampleCount() || density <= 0); }
+
+	private:
+		/// <summary> A uniform number from -1 to 1. </summary>
+		float random() {
+			rng ^= rng << 13;
+			rng ^= rng >> 17;
+			rng ^= rng << 5;
+			return (float)(rng >> 8) * (2.0f / 16777216.0f) - 1.0f;
+		}
+
+		void stopGrains() {
+			for (Grain* grain : active) pool->destroy(grain);
+			active.clear();
+		}
+
+		void startGrains(size_t frames) {
+			if (density <= 0) return;
+			double interval = sampleRate / density;
+			for (; untilNext < frames; untilNext += interval)
+			{
+				if (active.size() == active.capacity()) { droppedGrains++; continue; }
+				Grain* grain = pool->create();
+				if (grain == nullptr) { droppedGrains++; continue; }
+
+				grain->delay = (uint32_t)untilNext;
+				grain->position = std::floor(readPosition + speed * grain->delay + random() * jitter * sampleRate);
+				grain->increment = pitch;
+				grain->age = 0;
+				active.push_back(grain);
+			}
+			untilNext -= frames;
+		}
+
+		void renderGrains(float* out, size_t frames) {
+			using DynamicAudio::Simd::Float4;
+			uint32_t length = (uint32_t)window.size();
+			Float4 g(gain);
+
+			for (size_t index = 0; index < active.size();)
+			{
+				Grain* grain = active[index];
+				size_t start = grain->delay;
+				size_t count = std::min<size_t>(frames - start, length - grain->age);
+				const float* shape = window.data() + grain->age;
+				float* target = out + start;
+
+				double from = grain->position + grain->age * grain->increment;
+				int64_t first = (int64_t)std::floor(from);
+				if (grain->increment == 1.0 && from == (double)first) {
+					// At the source's own rate the grain is a straight copy under the window
+					source->read(first, count, scratch.data());
+					size_t i = 0;
+					for (; i < DynamicAudio::Simd::wide(count); i += DynamicAudio::Simd::Width)
+						(Float4::load(target + i) + Float4::load(scratch.data() + i) * Float4::load(shape + i) * g).store(target + i);
+					for (; i < count; i++) target[i] += scratch[i] * shape[i] * gain;
+				}
+				else {
+					// Otherwise linearly interpolated between the samples it passes
+					size_t span = (size_t)std::ceil((from - first) + count * grain->increment) + 2;
+					source->read(first, std::min(span, scratch.size()), scratch.data());
+					double phase = from - first;
+					for (size_t i = 0; i < count; i++, phase += grain->increment) {
+						size_t at = std::min((size_t)phase, scratch.size() - 2);
+						float fraction = (float)(phase - at);
+						float sample = scratch[at] + (scratch[at + 1] - scratch[at]) * fraction;
+						target[i] += sample * shape[i] * gain;
+					}
+				}
+
+				grain->age += (uint32_t)count;
+				grain->delay = 0;
+				if (grain->age >= length) {
+					pool->destroy(grain);
+					active[index] = active.back();
+					active.pop_back();
+				}
+				else index++;
+			}
+		}
+	};
+}
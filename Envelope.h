@@ -0,0 +1,354 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "EffectBase.h"
+#include "Note.h"
+#include "Profiler.h"
+#include "Simd.h"
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// ADSR envelopes for many voices, kept as structure-of-arrays.
+    /// A whole block of per-sample gain is computed for every voice in one call to process,
+    /// with note on / off landing on the exact sample inside the block.
+    /// </summary>
+    class EnvelopeBank {
+    public:
+        enum Stage : uint8_t { Idle, Attack, Decay, Sustain, Release };
+
+        /// <summary> The shape of an envelope, times are in seconds. </summary>
+        struct Settings {
+            float attack;
+            float decay;
+            float sustain;  // Level held while the note is down, 0 - 1
+            float release;
+
+            /// <summary>
+            /// 0 gives straight lines, otherwise each stage curves exponentially.
+            /// Smaller values bend harder, ie. 0.3 is an analog-ish attack, 0.001 a sharp decay.
+            /// </summary>
+            float attackCurve;
+            float decayCurve;
+            float releaseCurve;
+
+            Settings(float attack_ = 0.005f, float decay_ = 0.05f, float sustain_ = 0.8f, float release_ = 0.1f)
+                : attack(attack_), decay(decay_), sustain(sustain_), release(release_),
+                attackCurve(0), decayCurve(0), releaseCurve(0) {}
+
+            /// <summary> The same times, with exponential decay and release curves. </summary>
+            Settings exponential(float attackCurve_ = 0.3f, float decayCurve_ = 0.001f, float releaseCurve_ = 0.001f) const {
+                Settings result = *this;
+                result.attackCurve = attackCurve_;
+                result.decayCurve = decayCurve_;
+                result.releaseCurve = releaseCurve_;
+                return result;
+            }
+        };
+
+        /// <summary> No event is pending this block. </summary>
+        static constexpr uint32_t None = 0xFFFFFFFF;
+
+    private:
+        uint32_t sampleRate;
+        size_t maxFrames;
+
+        // Settings, converted into samples
+        std::vector<uint32_t> attackSamples;
+        std::vector<uint32_t> decaySamples;
+        std::vector<uint32_t> releaseSamples;
+        std::vector<float> sustainLevel;
+        std::vector<float> attackCurve;
+        std::vector<float> decayCurve;
+        std::vector<float> releaseCurve;
+
+        // Running state
+        std::vector<uint8_t> stage;
+        std::vector<float> level;       // The gain reached at the end of the last sample
+        std::vector<float> step;        // Linear stages: added each sample. Exponential: multiplied
+        std::vector<float> target;      // Exponential stages head towards this, past the end level
+        std::vector<float> endLevel;    // Snapped to when the stage ends
+        std::vector<uint32_t> remaining; // Samples left in the stage
+        std::vector<uint32_t> hold;     // Samples until an automatic note off, None to hold forever
+
+        // Events for the next block, as sample offsets
+        std::vector<uint32_t> pendingOn;
+        std::vector<uint32_t> pendingOff;
+        std::vector<uint32_t> pendingHold;
+
+        // Set once an idle voices gain has been cleared, so it is not cleared every block
+        std::vector<uint8_t> silent;
+
+        // voices * maxFrames of gain, rewritten by process
+        std::vector<float> gain;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="voices"> The amount of envelopes, all allocated up front. </param>
+        /// <param name="sampleRate_"> The output sample rate. </param>
+        /// <param name="maxFrames_"> The largest block process will be called with. </param>
+        EnvelopeBank(size_t voices, uint32_t sampleRate_, size_t maxFrames_)
+            : sampleRate(sampleRate_), maxFrames(maxFrames_),
+            attackSamples(voices), decaySamples(voices), releaseSamples(voices), sustainLevel(voices),
+            attackCurve(voices), decayCurve(voices), releaseCurve(voices),
+            stage(voices, Idle), level(voices, 0), step(voices, 0), target(voices, 0), endLevel(voices, 0),
+            remaining(voices, 0), hold(voices, None),
+            pendingOn(voices, None), pendingOff(voices, None), pendingHold(voices, None),
+            silent(voices, 1), gain(voices * maxFrames_, 0)
+        {
+            for (size_t voice = 0; voice < voices; voice++) configure((uint32_t)voice, Settings());
+        }
+
+        size_t size() const { return stage.size(); }
+
+        /// <summary> Changes the shape of a voice, used from its next stage onwards. </summary>
+        void configure(uint32_t voice, const Settings& settings) {
+            attackSamples[voice] = toSamples(settings.attack);
+            decaySamples[voice] = toSamples(settings.decay);
+            releaseSamples[voice] = toSamples(settings.release);
+            sustainLevel[voice] = settings.sustain;
+            attackCurve[voice] = settings.attackCurve;
+            decayCurve[voice] = settings.decayCurve;
+            releaseCurve[voice] = settings.releaseCurve;
+        }
+
+        /// <summary> Starts the attack on a sample of the next block. Retriggering starts from the current level. </summary>
+        /// <param name="voice"> The envelope to start. </param>
+        /// <param name="offset"> The sample inside the next block. </param>
+        /// <param name="length"> Samples until the note is released automatically, None to wait for noteOff. </param>
+        void noteOn(uint32_t voice, uint32_t offset = 0, uint32_t length = None) {
+            pendingOn[voice] = offset;
+            pendingHold[voice] = length;
+        }
+
+        /// <summary> Starts the release on a sample of the next block. </summary>
+        void noteOff(uint32_t voice, uint32_t offset = 0) {
+            pendingOff[voice] = offset;
+        }
+
+        /// <summary> Starts a synthesized Note, released once its duration has passed. </summary>
+        /// <param name="voice"> The envelope to start. </param>
+        /// <param name="note"> The Note to play, null Notes are ignored. </param>
+        /// <param name="samplesPerUnit"> How many samples a duration of 1 lasts. </param>
+        /// <param name="offset"> The sample inside the next block. </param>
+        void trigger(uint32_t voice, const Note& note, double samplesPerUnit, uint32_t offset = 0) {
+            if (Note::Value::isNull(note.value)) return;
+            noteOn(voice, offset, (uint32_t)std::llround(note.duration * samplesPerUnit));
+        }
+
+        /// <summary> Stops the voice immediately. </summary>
+        void reset(uint32_t voice) {
+            stage[voice] = Idle;
+            level[voice] = 0;
+            hold[voice] = None;
+            pendingOn[voice] = pendingOff[voice] = pendingHold[voice] = None;
+        }
+
+        Stage getStage(uint32_t voice) const { return (Stage)stage[voice]; }
+        float getLevel(uint32_t voice) const { return level[voice]; }
+
+        /// <summary> Whether the voice makes any sound, or has an event waiting. </summary>
+        bool isActive(uint32_t voice) const { return stage[voice] != Idle || pendingOn[voice] != None; }
+
+        /// <summary> The gain computed by the last process call, one float per frame. </summary>
+        const float* gains(uint32_t voice) const { return gain.data() + voice * maxFrames; }
+
+        /// <summary> Computes a block of gain for every active voice. </summary>
+        /// <param name="frames"> The block size, no larger than maxFrames. </param>
+        void process(size_t frames) {
+            DA_PROFILE_SCOPE("EnvelopeBank::process");
+            for (uint32_t voice = 0; voice < size(); voice++)
+            {
+                if (stage[voice] == Idle && pendingOn[voice] == None) {
+                    pendingOff[voice] = None;
+                    if (!silent[voice]) {
+                        Simd::fill(gain.data() + voice * maxFrames, 0, maxFrames);
+                        silent[voice] = 1;
+                    }
+                    continue;
+                }
+                render(voice, gain.data() + voice * maxFrames, (uint32_t)frames);
+                silent[voice] = 0;
+            }
+        }
+
+        /// <summary> Multiplies a voices samples by its gain from the last process call. </summary>
+        void apply(uint32_t voice, float* samples, size_t frames) const {
+            Simd::multiply(samples, gains(voice), frames);
+        }
+
+    private:
+        uint32_t toSamples(float seconds) const {
+            return (uint32_t)std::max<long long>(0, std::llround((double)seconds * sampleRate));
+        }
+
+        /// <summary> Sets up a stage heading from the current level to 'to' over 'length' samples. </summary>
+        void enter(uint32_t voice, Stage next, float to, uint32_t length, float curve) {
+            stage[voice] = next;
+            endLevel[voice] = to;
+            remaining[voice] = length;
+
+            // Zero length stages are skipped by render
+            if (length == 0) return;
+
+            float from = level[voice];
+            if (curve <= 0) {
+                step[voice] = (to - from) / (float)length;
+                target[voice] = to;
+            }
+            else {
+                // Aim past 'to' so the curve crosses it exactly after length samples
+                target[voice] = to + (to - from) * curve;
+                step[voice] = (float)std::pow(curve / (1.0 + curve), 1.0 / length);
+            }
+        }
+
+        float curveOf(uint32_t voice, Stage which) const {
+            switch (which) {
+            case Attack: return attackCurve[voice];
+            case Decay: return decayCurve[voice];
+            case Release: return releaseCurve[voice];
+            default: return 0;
+            }
+        }
+
+        /// <summary> Moves to the stage after the one that just ended. </summary>
+        void advance(uint32_t voice) {
+            level[voice] = endLevel[voice];
+            switch (stage[voice]) {
+            case Attack: enter(voice, Decay, sustainLevel[voice], decaySamples[voice], decayCurve[voice]); break;
+            case Decay: stage[voice] = Sustain; level[voice] = sustainLevel[voice]; break;
+            case Release: stage[voice] = Idle; level[voice] = 0; break;
+            default: break;
+            }
+        }
+
+        /// <summary> Writes 'count' samples of the current stage and moves the level along. </summary>
+        void fillStage(uint32_t voice, float* out, uint32_t count) {
+            if (count == 0) return;
+
+            switch (stage[voice]) {
+            case Idle:
+                Simd::fill(out, 0, count);
+                return;
+
+            case Sustain:
+                Simd::fill(out, level[voice], count);
+                return;
+
+            default:
+                break;
+            }
+
+            float from = level[voice];
+            if (curveOf(voice, (Stage)stage[voice]) <= 0) {
+                // Linear, each sample is the level at the end of that sample
+                Simd::ramp(out, from + step[voice], step[voice], count);
+                level[voice] = from + step[voice] * (float)count;
+            }
+            else {
+                // Exponential, y[n] = target + (from - target) * coef^(n + 1), four samples at a time
+                float coef = step[voice];
+                float c2 = coef * coef;
+                Simd::Float4 powers(coef, c2, c2 * coef, c2 * c2);
+                Simd::Float4 advanceBy(c2 * c2);
+                Simd::Float4 t(target[voice]);
+                Simd::Float4 distance = Simd::Float4(from - target[voice]) * powers;
+
+                uint32_t i = 0;
+                for (; i < Simd::wide(count); i += (uint32_t)Simd::Width) {
+                    (t + distance).store(out + i);
+                    distance *= advanceBy;
+                }
+
+                float d = (from - target[voice]) * std::pow(coef, (float)i);
+                for (; i < count; i++) {
+                    d *= coef;
+                    out[i] = target[voice] + d;
+                }
+                level[voice] = out[count - 1];
+            }
+            remaining[voice] -= count;
+        }
+
+        /// <summary> Renders one voice, splitting the block at stage ends and events. </summary>
+        void render(uint32_t voice, float* out, uint32_t frames) {
+            uint32_t position = 0;
+
+            while (position < frames)
+            {
+                // Events landing on this sample
+                if (pendingOn[voice] != None && pendingOn[voice] <= position) {
+                    hold[voice] = pendingHold[voice];
+                    pendingOn[voice] = pendingHold[voice] = None;
+                    enter(voice, Attack, 1.0f, attackSamples[voice], attackCurve[voice]);
+                }
+                if (pendingOff[voice] != None && pendingOff[voice] <= position) {
+                    pendingOff[voice] = None;
+                    hold[voice] = None;
+                    if (stage[voice] != Idle && stage[voice] != Release)
+                        enter(voice, Release, 0.0f, releaseSamples[voice], releaseCurve[voice]);
+                }
+                if (hold[voice] == 0) {
+                    hold[voice] = None;
+                    if (stage[voice] != Idle && stage[voice] != Release)
+                        enter(voice, Release, 0.0f, releaseSamples[voice], releaseCurve[voice]);
+                }
+
+                // Zero length stages end before producing a sample
+                bool timed = stage[voice] == Attack || stage[voice] == Decay || stage[voice] == Release;
+                if (timed && remaining[voice] == 0) { advance(voice); continue; }
+
+                // Run until the next thing happens
+                uint32_t until = frames;
+                if (pendingOn[voice] != None) until = std::min(until, pendingOn[voice]);
+                if (pendingOff[voice] != None) until = std::min(until, pendingOff[voice]);
+                if (hold[voice] != None) until = std::min(until, position + hold[voice]);
+                if (timed) until = std::min(until, position + remaining[voice]);
+
+                uint32_t count = until - position;
+                fillStage(voice, out + position, count);
+                if (hold[voice] != None) hold[voice] -= count;
+                position = until;
+            }
+
+            // Offsets are relative to the block they were given for
+            if (pendingOn[voice] != None) pendingOn[voice] -= std::min(pendingOn[voice], frames);
+            if (pendingOff[voice] != None) pendingOff[voice] -= std::min(pendingOff[voice], frames);
+        }
+    };
+}
+
+namespace Effect {
+
+	/// <summary>
+	/// Shapes its input with one voice of an EnvelopeBank, ie. a WavStream or a synthesized Note.
+	/// The bank has to be processed for the block before this node is.
+	/// </summary>
+	struct Envelope : public Abstract
+	{
+		Abstract* input;
+		DynamicAudio::EnvelopeBank* bank;
+		uint32_t voice;
+
+		/// <summary> Constructor Definition. </summary>
+		Envelope(Abstract* input_, DynamicAudio::EnvelopeBank* bank_, uint32_t voice_)
+			: input(input_), bank(bank_), voice(voice_) {}
+
+		value get(value in) override {
+			return (value)(input->get(in) * bank->getLevel(voice));
+		}
+
+		void process(float* out, size_t frames) override {
+			DA_PROFILE_SCOPE("Envelope::process");
+			input->process(out, frames);
+			bank->apply(voice, out, frames);
+		}
+
+		void skip(size_t frames) override { input->skip(frames); }
+	};
+}
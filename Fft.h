@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Simd.h"
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// A real to complex FFT of one power of two size.
+    /// The real input is packed into a complex FFT of half the size, which runs radix-2
+    /// on separate real and imaginary arrays so four butterflies go through SIMD at once.
+    /// Every table and scratch buffer is allocated by the constructor, transforms never
+    /// touch the heap. One thread at a time per Fft, since the scratch is shared.
+    /// </summary>
+    class Fft {
+    private:
+        size_t n;                   // Real points
+        size_t m;                   // Complex points, n / 2
+        std::vector<uint32_t> reversed;
+        std::vector<float> stageCos;    // Each stage's twiddles back to back, stage of length L starts at L / 2 - 1
+        std::vector<float> stageSin;
+        std::vector<float> splitCos;    // Twiddles untangling the packed halves, k < m
+        std::vector<float> splitSin;
+        std::vector<float> re;
+        std::vector<float> im;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="size"> Real points per transform, a power of two of at least 4. </param>
+        Fft(size_t size)
+            : n(size), m(size / 2), reversed(size / 2), stageCos(size / 2), stageSin(size / 2),
+            splitCos(size / 2), splitSin(size / 2), re(size / 2), im(size / 2)
+        {
+            size_t bits = 0;
+            while (((size_t)1 << bits) < m) bits++;
+            for (size_t i = 0; i < m; i++) {
+                uint32_t r = 0;
+                for (size_t b = 0; b < bits; b++) if (i & ((size_t)1 << b)) r |= 1u << (bits - 1 - b);
+                reversed[i] = r;
+            }
+
+            const double pi = 3.14159265358979323846;
+            for (size_t length = 2; length <= m; length <<= 1) {
+                size_t half = length / 2;
+                for (size_t j = 0; j < half; j++) {
+                    stageCos[half - 1 + j] = (float)std::cos(-2 * pi * j / length);
+                    stageSin[half - 1 + j] = (float)std::sin(-2 * pi * j / length);
+                }
+            }
+
+            for (size_t k = 0; k < m; k++) {
+                splitCos[k] = (float)std::cos(-2 * pi * k / n);
+                splitSin[k] = (float)std::sin(-2 * pi * k / n);
+            }
+        }
+
+        /// <summary> Real points per transform. </summary>
+        size_t size() const { return n; }
+
+        /// <summary> Complex bins a forward transform produces, DC to Nyquist. </summary>
+        size_t bins() const { return m + 1; }
+
+        /// <summary> Unnormalized forward transform. </summary>
+        /// <param name="in"> size() real samples. </param>
+        /// <param name="outRe"> bins() real parts. </param>
+        /// <param name="outIm"> bins() imaginary parts, the first and last are always 0. </param>
+        void forward(const float* in, float* outRe, float* outIm) {
+            // Even samples become the real parts, odd ones the imaginary parts
+            for (size_t k = 0; k < m; k++) {
+                re[reversed[k]] = in[2 * k];
+                im[reversed[k]] = in[2 * k + 1];
+            }
+            butterflies();
+
+            outRe[0] = re[0] + im[0];
+            outIm[0] = 0;
+            outRe[m] = re[0] - im[0];
+            outIm[m] = 0;
+
+            // X[k] = E[k] + W^k O[k], with E and O untangled from Z[k] and Z[m - k]
+            for (size_t k = 1; k < m; k++) {
+                float ar = re[k], ai = im[k];
+                float br = re[m - k], bi = im[m - k];
+
+                float er = 0.5f * (ar + br), ei = 0.5f * (ai - bi);
+                float or_ = 0.5f * (ai + bi), oi = -0.5f * (ar - br);
+
+                outRe[k] = er + splitCos[k] * or_ - splitSin[k] * oi;
+                outIm[k] = ei + splitCos[k] * oi + splitSin[k] * or_;
+            }
+        }
+
+        /// <summary> Inverse of forward, scaled so inverse(forward(x)) gives x back. </summary>
+        /// <param name="inRe"> bins() real parts. </param>
+        /// <param name="inIm"> bins() imaginary parts. </param>
+        /// <param name="out"> size() real samples. </param>
+        void inverse(const float* inRe, const float* inIm, float* out) {
+            // Rebuild the packed spectrum Z[k] = E[k] + i O[k], conjugated so the forward butterflies run it backwards
+            for (size_t k = 0; k < m; k++) {
+                float ar = inRe[k], ai = inIm[k];
+                float br = inRe[m - k], bi = -inIm[m - k];
+
+                float er = 0.5f * (ar + br), ei = 0.5f * (ai + bi);
+                float dr = 0.5f * (ar - br), di = 0.5f * (ai - bi);
+
+                // O = D * conj(W^k)
+                float or_ = dr * splitCos[k] + di * splitSin[k];
+                float oi = di * splitCos[k] - dr * splitSin[k];
+
+                re[reversed[k]] = er - oi;
+                im[reversed[k]] = -(ei + or_);
+            }
+            butterflies();
+
+            float scale = 1.0f / m;
+            for (size_t k = 0; k < m; k++) {
+                out[2 * k] = re[k] * scale;
+                out[2 * k + 1] = -im[k] * scale;
+            }
+        }
+
+        /// <summary> out[k] = |X[k]| * scale </summary>
+        static void magnitudes(const float* inRe, const float* inIm, float* out, size_t count, float scale = 1) {
+            using Simd::Float4;
+            Float4 s(scale);
+            size_t k = 0;
+            for (; k < Simd::wide(count); k += Simd::Width) {
+                Float4 r = Float4::load(inRe + k), i = Float4::load(inIm + k);
+                (Float4::sqrt(r * r + i * i) * s).store(out + k);
+            }
+            for (; k < count; k++) out[k] = std::sqrt(inRe[k] * inRe[k] + inIm[k] * inIm[k]) * scale;
+        }
+
+    private:
+        /// <summary> In-place decimation in time over re and im, which are already in bit reversed order. </summary>
+        void butterflies() {
+            using Simd::Float4;
+            float* r = re.data();
+            float* i = im.data();
+
+            // Lengths 2 and 4 have too few butterflies per group to vectorize
+            for (size_t s = 0; s < m; s += 2) {
+                float tr = r[s + 1], ti = i[s + 1];
+                r[s + 1] = r[s] - tr; i[s + 1] = i[s] - ti;
+                r[s] += tr; i[s] += ti;
+            }
+            if (m >= 4) {
+                for (size_t s = 0; s < m; s += 4) {
+                    // Twiddles of length 4 are 1 and -i
+                    float tr = r[s + 2], ti = i[s + 2];
+                    r[s + 2] = r[s] - tr; i[s + 2] = i[s] - ti;
+                    r[s] += tr; i[s] += ti;
+
+                    tr = i[s + 3]; ti = -r[s + 3];
+                    r[s + 3] = r[s + 1] - tr; i[s + 3] = i[s + 1] - ti;
+                    r[s + 1] += tr; i[s + 1] += ti;
+                }
+            }
+
+            for (size_t length = 8; length <= m; length <<= 1) {
+                size_t half = length / 2;
+                const float* wr = stageCos.data() + half - 1;
+                const float* wi = stageSin.data() + half - 1;
+
+                for (size_t s = 0; s < m; s += length) {
+                    float* ar = r + s;
+                    float* ai = i + s;
+                    float* br = ar + half;
+                    float* bi = ai + half;
+
+                    for (size_t j = 0; j < half; j += Simd::Width) {
+                        Float4 cr = Float4::load(wr + j), ci = Float4::load(wi + j);
+                        Float4 xr = Float4::load(br + j), xi = Float4::load(bi + j);
+                        Float4 tr = xr * cr - xi * ci;
+                        Float4 ti = xr * ci + xi * cr;
+
+                        Float4 yr = Float4::load(ar + j), yi = Float4::load(ai + j);
+                        (yr - tr).store(br + j);
+                        (yi - ti).store(bi + j);
+                        (yr + tr).store(ar + j);
+                        (yi + ti).store(ai + j);
+                    }
+                }
+            }
+        }
+    };
+}
@@ -0,0 +1,374 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "Profiler.h"
+#include "Simd.h"
+
+namespace DynamicAudio {
+
+    /// <summary> How loud a whole asset is, measured once so normalizing it costs nothing later. </summary>
+    struct LoudnessInfo {
+        float integrated;   // LUFS, -infinity when everything was gated out
+        float truePeak;     // dBTP
+        float samplePeak;   // dBFS
+        bool measured;
+
+        LoudnessInfo() : integrated(-std::numeric_limits<float>::infinity()), truePeak(-std::numeric_limits<float>::infinity()),
+            samplePeak(-std::numeric_limits<float>::infinity()), measured(false) {}
+
+        /// <summary> The gain that brings the asset to a loudness, held back so its true peak stays under a ceiling. </summary>
+        /// <param name="targetLufs"> ie. -23 for EBU R128 broadcast, around -16 for games. </param>
+        /// <param name="ceilingDbtp"> The highest true peak allowed after the gain. </param>
+        /// <returns> A linear gain, 1 when the asset was never measured or is silent. </returns>
+        float normalizationGain(float targetLufs = -23, float ceilingDbtp = -1) const {
+            if (!measured || !std::isfinite(integrated)) return 1;
+            float gainDb = targetLufs - integrated;
+            if (std::isfinite(truePeak)) gainDb = std::min(gainDb, ceilingDbtp - truePeak);
+            return std::pow(10.0f, gainDb / 20.0f);
+        }
+    };
+
+    /// <summary>
+    /// Measures loudness as EBU R128 / ITU-R BS.1770 does, a block at a time.
+    /// Up to four channels are K-weighted side by side in the lanes of a Float4, and every 100ms the momentary
+    /// (400ms), short-term (3s) and gated integrated loudness are brought up to date. The 400ms gating blocks are
+    /// kept as a histogram of 0.1 LU bins, so the meter can run forever in fixed memory. True peak comes from 4x
+    /// oversampling, each phase run over four frames at once. Readings are atomics, safe to read from any thread.
+    /// </summary>
+    class LoudnessMeter {
+    public:
+        static constexpr size_t MaxChannels = Simd::Width;
+
+    private:
+        static constexpr size_t Taps = 12;              // Per phase of the true peak filter
+        static constexpr size_t Chunk = 256;            // Frames gathered before the true peak pass
+        static constexpr double BinWidth = 0.1;         // LU per histogram bin
+        static constexpr double LowestBin = -70;        // The absolute gate
+        static constexpr size_t BinCount = 1000;        // Up to +30 LUFS
+
+        struct Biquad {
+            Simd::Float4 b0, b1, b2, a1, a2;
+            Simd::Float4 z1, z2;
+
+            /// <summary> Transposed direct form II, one channel per lane. </summary>
+            Simd::Float4 run(Simd::Float4 x) {
+                Simd::Float4 y = b0 * x + z1;
+                z1 = b1 * x - a1 * y + z2;
+                z2 = b2 * x - a2 * y;
+                return y;
+            }
+        };
+
+        uint32_t sampleRate;
+        uint16_t channels;
+        Biquad shelf;
+        Biquad highPass;
+        float weights[MaxChannels];
+
+        // The current 100ms sub-block
+        size_t subBlockFrames;
+        size_t subBlockFilled;
+        Simd::Float4 subBlockSum;
+
+        // The last 30 sub-blocks' weighted mean squares
+        double history[30];
+        size_t historyIndex;
+        size_t historyCount;
+
+        // Gating blocks over the absolute gate, by loudness
+        std::vector<uint32_t> binCounts;
+        std::vector<double> binEnergy;
+        uint64_t gatedCount;
+        double gatedEnergy;
+
+        // True peak, per channel the last Taps - 1 samples followed by the chunk being gathered
+        float taps[4][Taps];
+        Simd::Float4 wideTaps[4][Taps];
+        std::vector<float> planar[MaxChannels];
+        Simd::Float4 truePeakLinear;
+        Simd::Float4 samplePeakLinear;
+
+        uint64_t framesPushed;
+        std::atomic<float> momentaryLufs;
+        std::atomic<float> shortTermLufs;
+        std::atomic<float> integratedLufs;
+        std::atomic<float> truePeakDb;
+        std::atomic<float> samplePeakDb;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="sampleRate_"> Of the audio pushed. </param>
+        /// <param name="channels_"> Up to MaxChannels. </param>
+        LoudnessMeter(uint32_t sampleRate_, uint16_t channels_ = 2)
+            : sampleRate(sampleRate_), channels((uint16_t)std::max<size_t>(1, std::min<size_t>(channels_, MaxChannels))),
+            shelf(), highPass(), weights{ 1, 1, 1, 1 },
+            subBlockFrames(std::max<size_t>(1, (size_t)std::lround(sampleRate_ / 10.0))), subBlockFilled(0), subBlockSum(),
+            history(), historyIndex(0), historyCount(0),
+            binCounts(BinCount, 0), binEnergy(BinCount, 0), gatedCount(0), gatedEnergy(0),
+            taps(), wideTaps(), planar(), truePeakLinear(), samplePeakLinear(), framesPushed(0),
+            momentaryLufs(silence()), shortTermLufs(silence()), integratedLufs(silence()), truePeakDb(silence()), samplePeakDb(silence())
+        {
+            // The K-weighting pre-filter, a high shelf for the head then a high pass, for any sample rate
+            const double pi = 3.14159265358979323846;
+            double K = std::tan(pi * 1681.974450955533 / sampleRate);
+            double Q = 0.7071752369554196;
+            double Vh = std::pow(10.0, 3.999843853973347 / 20);
+            double Vb = std::pow(Vh, 0.4996667741545416);
+            double a0 = 1 + K / Q + K * K;
+            setBiquad(shelf, (Vh + Vb * K / Q + K * K) / a0, 2 * (K * K - Vh) / a0, (Vh - Vb * K / Q + K * K) / a0,
+                2 * (K * K - 1) / a0, (1 - K / Q + K * K) / a0);
+
+            K = std::tan(pi * 38.13547087602444 / sampleRate);
+            Q = 0.5003270373238773;
+            a0 = 1 + K / Q + K * K;
+            setBiquad(highPass, 1, -2, 1, 2 * (K * K - 1) / a0, (1 - K / Q + K * K) / a0);
+
+            // A windowed sinc interpolating three points between every pair of samples
+            for (size_t p = 0; p < 4; p++) {
+                double sum = 0;
+                for (size_t k = 0; k < Taps; k++) {
+                    double n = 4.0 * k + p;
+                    double t = (n - (4.0 * Taps - 1) / 2) / 4;
+                    double sinc = t == 0 ? 1 : std::sin(pi * t) / (pi * t);
+                    double window = 0.5 - 0.5 * std::cos(2 * pi * (n + 0.5) / (4.0 * Taps));
+                    taps[p][k] = (float)(sinc * window);
+                    sum += taps[p][k];
+                }
+                for (size_t k = 0; k < Taps; k++) taps[p][k] = (float)(taps[p][k] / sum);
+            }
+            for (size_t p = 0; p < 4; p++)
+                for (size_t k = 0; k < Taps; k++) wideTaps[p][k] = Simd::Float4(taps[p][k]);
+            for (std::vector<float>& channel : planar) channel.assign(Taps - 1 + Chunk, 0.0f);
+        }
+
+        LoudnessMeter(const LoudnessMeter&) = delete;
+        LoudnessMeter& operator=(const LoudnessMeter&) = delete;
+
+        uint16_t getChannels() const { return channels; }
+        uint64_t frames() const { return framesPushed; }
+
+        /// <summary> How much a channel counts, ie. 1.41 for the surrounds of 5.1. Every channel counts 1 by default. </summary>
+        void setChannelWeight(uint16_t channel, float weight) { if (channel < MaxChannels) weights[channel] = weight; }
+
+        /// <summary> The last 400ms in LUFS, -infinity before there is any. </summary>
+        float momentary() const { return momentaryLufs.load(std::memory_order_relaxed); }
+
+        /// <summary> The last 3s in LUFS. </summary>
+        float shortTerm() const { return shortTermLufs.load(std::memory_order_relaxed); }
+
+        /// <summary> Everything so far, gated absolutely at -70 LUFS and then 10 LU under its own level. </summary>
+        float integrated() const { return integratedLufs.load(std::memory_order_relaxed); }
+
+        /// <summary> The highest peak between samples so far, in dBTP. </summary>
+        float truePeak() const { return truePeakDb.load(std::memory_order_relaxed); }
+
+        /// <summary> The highest sample so far, in dBFS. </summary>
+        float samplePeak() const { return samplePeakDb.load(std::memory_order_relaxed); }
+
+        /// <summary> The readings so far, as a measurement of a whole asset. </summary>
+        LoudnessInfo info() const {
+            LoudnessInfo result;
+            result.integrated = integrated();
+            result.truePeak = truePeak();
+            result.samplePeak = samplePeak();
+            result.measured = true;
+            return result;
+        }
+
+        /// <summary> Forgets everything measured. Not safe while another thread pushes. </summary>
+        void reset() {
+            shelf.z1 = shelf.z2 = highPass.z1 = highPass.z2 = Simd::Float4();
+            subBlockFilled = 0;
+            subBlockSum = Simd::Float4();
+            historyIndex = historyCount = 0;
+            std::fill(binCounts.begin(), binCounts.end(), 0);
+            std::fill(binEnergy.begin(), binEnergy.end(), 0.0);
+            gatedCount = 0;
+            gatedEnergy = 0;
+            for (std::vector<float>& channel : planar) std::fill(channel.begin(), channel.end(), 0.0f);
+            truePeakLinear = samplePeakLinear = Simd::Float4();
+            framesPushed = 0;
+            for (std::atomic<float>* reading : { &momentaryLufs, &shortTermLufs, &integratedLufs, &truePeakDb, &samplePeakDb })
+                reading->store(silence());
+        }
+
+        /// <summary> Adds planar audio, one pointer per channel. </summary>
+        void push(const float* const* planar, size_t frames) {
+            pushWith(frames, [this, planar](size_t i) {
+                float lanes[MaxChannels] = { 0, 0, 0, 0 };
+                for (uint16_t c = 0; c < channels; c++) lanes[c] = planar[c][i];
+                return Simd::Float4::load(lanes);
+            });
+        }
+
+        /// <summary> Adds a stereo bus, or a mono one when right is null. </summary>
+        void push(const float* left, const float* right, size_t frames) {
+            if (right == nullptr || channels == 1) pushWith(frames, [left](size_t i) { return Simd::Float4(left[i], 0, 0, 0); });
+            else pushWith(frames, [left, right](size_t i) { return Simd::Float4(left[i], right[i], 0, 0); });
+        }
+
+        /// <summary> Adds interleaved frames of getChannels samples. </summary>
+        void pushInterleaved(const float* interleaved, size_t frames) {
+            pushInterleaved(interleaved, frames, channels);
+        }
+
+        /// <summary> Adds interleaved frames of sourceChannels samples, of which only the first MaxChannels are measured. </summary>
+        void pushInterleaved(const float* interleaved, size_t frames, size_t sourceChannels) {
+            pushWith(frames, [this, interleaved, sourceChannels](size_t i) {
+                float lanes[MaxChannels] = { 0, 0, 0, 0 };
+                for (uint16_t c = 0; c < channels; c++) lanes[c] = interleaved[i * sourceChannels + c];
+                return Simd::Float4::load(lanes);
+            });
+        }
+
+        /// <summary> Measures a whole asset at once, the first MaxChannels of a wider one. </summary>
+        static LoudnessInfo measure(const float* interleaved, size_t frames, uint16_t channels, uint32_t sampleRate) {
+            LoudnessMeter meter(sampleRate, channels);
+            meter.pushInterleaved(interleaved, frames, channels);
+            return meter.info();
+        }
+
+        static float toLufs(double meanSquare) {
+            return meanSquare > 0 ? (float)(-0.691 + 10 * std::log10(meanSquare)) : silence();
+        }
+
+    private:
+        static float silence() { return -std::numeric_limits<float>::infinity(); }
+
+        static float toDb(float linear) { return linear > 0 ? 20.0f * std::log10(linear) : silence(); }
+
+        static void setBiquad(Biquad& filter, double b0, double b1, double b2, double a1, double a2) {
+            filter.b0 = Simd::Float4((float)b0);
+            filter.b1 = Simd::Float4((float)b1);
+            filter.b2 = Simd::Float4((float)b2);
+            filter.a1 = Simd::Float4((float)a1);
+            filter.a2 = Simd::Float4((float)a2);
+        }
+
+        template<typename Frame>
+        void pushWith(size_t frames, Frame frame) {
+            DA_PROFILE_SCOPE("LoudnessMeter::push");
+            using Simd::Float4;
+
+            for (size_t i = 0; i < frames;)
+            {
+                size_t run = std::min(std::min(frames - i, subBlockFrames - subBlockFilled), Chunk);
+                Float4 sum;
+                Float4 peak = samplePeakLinear;
+
+                float lanes[MaxChannels];
+                for (size_t j = 0; j < run; j++, i++)
+                {
+                    Float4 x = frame(i);
+                    peak = Float4::max(peak, Float4::abs(x));
+
+                    Float4 y = highPass.run(shelf.run(x));
+                    sum += y * y;
+
+                    x.store(lanes);
+                    for (uint16_t c = 0; c < channels; c++) planar[c][Taps - 1 + j] = lanes[c];
+                }
+                for (uint16_t c = 0; c < channels; c++) oversamplePeak(planar[c].data(), run);
+
+                subBlockSum += sum;
+                samplePeakLinear = peak;
+                subBlockFilled += run;
+                framesPushed += run;
+
+                if (subBlockFilled == subBlockFrames) finishSubBlock();
+            }
+
+            // Every push, so peaks in a final partial sub-block, or an asset under 100ms, are reported
+            truePeakDb.store(toDb(truePeakLinear.maxLane()), std::memory_order_relaxed);
+            samplePeakDb.store(toDb(samplePeakLinear.maxLane()), std::memory_order_relaxed);
+        }
+
+        /// <summary> Runs the four phases of the interpolator over a gathered chunk, then keeps its end as history. </summary>
+        void oversamplePeak(float* history, size_t frames) {
+            using Simd::Float4;
+            const float* x = history + Taps - 1;
+            Float4 loudest = truePeakLinear;
+
+            // Four frames of one phase per Float4, the phases independent of each other
+            size_t j = 0;
+            for (; j < Simd::wide(frames); j += Simd::Width) {
+                Float4 a, b, c, d;
+                for (size_t k = 0; k < Taps; k++) {
+                    Float4 samples = Float4::load(x + j - k);
+                    a += wideTaps[0][k] * samples;
+                    b += wideTaps[1][k] * samples;
+                    c += wideTaps[2][k] * samples;
+                    d += wideTaps[3][k] * samples;
+                }
+                loudest = Float4::max(loudest, Float4::max(Float4::max(Float4::abs(a), Float4::abs(b)), Float4::max(Float4::abs(c), Float4::abs(d))));
+            }
+            for (; j < frames; j++) {
+                for (size_t p = 0; p < 4; p++) {
+                    float acc = 0;
+                    for (size_t k = 0; k < Taps; k++) acc += taps[p][k] * *(x + j - k);
+                    loudest = Float4::max(loudest, Float4(std::fabs(acc)));
+                }
+            }
+            truePeakLinear = loudest;
+
+            std::copy(history + frames, history + frames + Taps - 1, history);
+        }
+
+        void finishSubBlock() {
+            float lanes[MaxChannels];
+            subBlockSum.store(lanes);
+            double energy = 0;
+            for (uint16_t c = 0; c < channels; c++) energy += weights[c] * (double)lanes[c];
+            energy /= subBlockFrames;
+            subBlockSum = Simd::Float4();
+            subBlockFilled = 0;
+
+            history[historyIndex] = energy;
+            historyIndex = historyIndex + 1 == 30 ? 0 : historyIndex + 1;
+            historyCount = std::min<size_t>(historyCount + 1, 30);
+
+            momentaryLufs.store(historyCount >= 4 ? toLufs(recentMean(4)) : silence(), std::memory_order_relaxed);
+            shortTermLufs.store(historyCount >= 30 ? toLufs(recentMean(30)) : silence(), std::memory_order_relaxed);
+
+            // A 400ms gating block ends every 100ms
+            if (historyCount >= 4) {
+                double block = recentMean(4);
+                float lufs = toLufs(block);
+                if (lufs > LowestBin) {
+                    size_t bin = std::min(BinCount - 1, (size_t)((lufs - LowestBin) / BinWidth));
+                    binCounts[bin]++;
+                    binEnergy[bin] += block;
+                    gatedCount++;
+                    gatedEnergy += block;
+                    integratedLufs.store(gatedLoudness(), std::memory_order_relaxed);
+                }
+            }
+        }
+
+        double recentMean(size_t count) const {
+            double sum = 0;
+            for (size_t k = 1; k <= count; k++) sum += history[(historyIndex + 30 - k) % 30];
+            return sum / count;
+        }
+
+        /// <summary> The mean of the blocks no more than 10 LU under the mean of every block over the absolute gate. </summary>
+        float gatedLoudness() const {
+            double relative = toLufs(gatedEnergy / gatedCount) - 10.0;
+            size_t first = relative > LowestBin ? std::min(BinCount - 1, (size_t)((relative - LowestBin) / BinWidth)) : 0;
+
+            double energy = 0;
+            uint64_t count = 0;
+            for (size_t bin = first; bin < BinCount; bin++) {
+                energy += binEnergy[bin];
+                count += binCounts[bin];
+            }
+            return count ? toLufs(energy / count) : silence();
+        }
+    };
+}
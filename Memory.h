@@ -0,0 +1,260 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace DynamicAudio {
+
+    /// <summary> The alignment of sample buffers, a cache line so any SIMD width can load them. </summary>
+    static constexpr size_t SampleAlignment = 64;
+
+    /// <summary>
+    /// A bump allocator for effect graphs and scratch buffers.
+    /// Memory comes from a few large chunks, so allocating is a pointer bump and
+    /// reset hands everything back at once. Objects that need a destructor are
+    /// remembered and destroyed on reset, trivially destructible ones cost nothing.
+    /// </summary>
+    class Arena {
+    private:
+        struct Chunk {
+            Chunk* next;
+            size_t size;    // Usable bytes after the header
+        };
+
+        struct Destructor {
+            Destructor* next;
+            void (*destroy)(void*);
+            void* object;
+        };
+
+        size_t chunkSize;
+        Chunk* first;
+        Chunk* current;
+        uint8_t* cursor;
+        uint8_t* end;
+        Destructor* destructors;
+
+        size_t allocationCount;
+        size_t heapAllocationCount;
+
+    public:
+        /// <summary> Where the arena was at one point, to rewind to later. </summary>
+        struct Marker {
+            Chunk* chunk;
+            uint8_t* cursor;
+            Destructor* destructors;
+        };
+
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="chunkSize_"> Bytes taken from the heap at a time. Larger allocations get a chunk of their own. </param>
+        Arena(size_t chunkSize_ = 64 * 1024)
+            : chunkSize(chunkSize_), first(nullptr), current(nullptr), cursor(nullptr), end(nullptr),
+            destructors(nullptr), allocationCount(0), heapAllocationCount(0) {}
+
+        ~Arena() {
+            reset();
+            while (first != nullptr) {
+                Chunk* next = first->next;
+                ::operator delete(first);
+                first = next;
+            }
+        }
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        /// <summary> Allocations made since construction, including ones reset since. </summary>
+        size_t allocations() const { return allocationCount; }
+
+        /// <summary> Times the arena had to go to the global heap. Equal before and after a block means the block never did. </summary>
+        size_t heapAllocations() const { return heapAllocationCount; }
+
+        /// <summary> Bytes held from the heap, used or not. </summary>
+        size_t capacity() const {
+            size_t total = 0;
+            for (Chunk* chunk = first; chunk != nullptr; chunk = chunk->next) total += chunk->size;
+            return total;
+        }
+
+        /// <summary> Takes uninitialized memory. Never returns null, grows from the heap when full. </summary>
+        /// <param name="bytes"> The size wanted. </param>
+        /// <param name="alignment"> A power of two. </param>
+        void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+            allocationCount++;
+
+            uint8_t* aligned = alignUp(cursor, alignment);
+            if (cursor == nullptr || aligned + bytes > end) {
+                nextChunk(bytes + alignment);
+                aligned = alignUp(cursor, alignment);
+            }
+
+            cursor = aligned + bytes;
+            return aligned;
+        }
+
+        /// <summary> Constructs an object in the arena, ie. an effect node. </summary>
+        template<typename T, typename... Args>
+        T* make(Args&&... args) {
+            T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+            if (!std::is_trivially_destructible<T>::value) {
+                Destructor* entry = new (allocate(sizeof(Destructor), alignof(Destructor))) Destructor();
+                entry->next = destructors;
+                entry->destroy = [](void* pointer) { static_cast<T*>(pointer)->~T(); };
+                entry->object = object;
+                destructors = entry;
+            }
+            return object;
+        }
+
+        /// <summary> Value-initialized array of trivial elements. </summary>
+        template<typename T>
+        T* makeArray(size_t count, size_t alignment = alignof(T)) {
+            static_assert(std::is_trivially_destructible<T>::value, "Arena arrays are never destroyed");
+            T* array = static_cast<T*>(allocate(sizeof(T) * count, alignment < alignof(T) ? alignof(T) : alignment));
+            for (size_t i = 0; i < count; i++) new (array + i) T();
+            return array;
+        }
+
+        /// <summary> A zeroed, SampleAlignment aligned sample buffer. </summary>
+        float* samples(size_t count) { return makeArray<float>(count, SampleAlignment); }
+
+        Marker mark() const { return Marker{ current, cursor, destructors }; }
+
+        /// <summary> Frees everything allocated after the marker, ie. per block scratch. </summary>
+        void rewind(const Marker& marker) {
+            destroyUntil(marker.destructors);
+            current = marker.chunk;
+            cursor = marker.cursor;
+            end = current != nullptr ? chunkData(current) + current->size : nullptr;
+        }
+
+        /// <summary> Frees everything at once. The chunks are kept, so building the same graph again does not touch the heap. </summary>
+        void reset() {
+            destroyUntil(nullptr);
+            current = nullptr;
+            cursor = end = nullptr;
+        }
+
+    private:
+        static uint8_t* chunkData(Chunk* chunk) { return reinterpret_cast<uint8_t*>(chunk + 1); }
+
+        static uint8_t* alignUp(uint8_t* pointer, size_t alignment) {
+            uintptr_t value = reinterpret_cast<uintptr_t>(pointer);
+            return reinterpret_cast<uint8_t*>((value + alignment - 1) & ~(uintptr_t)(alignment - 1));
+        }
+
+        void destroyUntil(Destructor* stop) {
+            while (destructors != stop) {
+                destructors->destroy(destructors->object);
+                destructors = destructors->next;
+            }
+        }
+
+        /// <summary> Moves on to the next chunk big enough, reusing chunks kept by reset before allocating. </summary>
+        void nextChunk(size_t bytes) {
+            Chunk* previous = current;
+            Chunk* chunk = current != nullptr ? current->next : first;
+
+            // Chunks too small for this allocation are skipped, they get used again after the next reset
+            while (chunk != nullptr && chunk->size < bytes) {
+                previous = chunk;
+                chunk = chunk->next;
+            }
+
+            if (chunk == nullptr) {
+                size_t size = bytes > chunkSize ? bytes : chunkSize;
+                chunk = static_cast<Chunk*>(::operator new(sizeof(Chunk) + size));
+                chunk->next = nullptr;
+                chunk->size = size;
+                heapAllocationCount++;
+
+                if (previous != nullptr) previous->next = chunk;
+                else first = chunk;
+            }
+
+            current = chunk;
+            cursor = chunkData(chunk);
+            end = cursor + chunk->size;
+        }
+    };
+
+    /// <summary>
+    /// A fixed number of same-sized slots with a free list threaded through them, ie. for voices or grains.
+    /// Every slot is allocated up front, create and destroy are O(1) and never touch the heap.
+    /// </summary>
+    template<typename T>
+    class Pool {
+    private:
+        union Slot {
+            Slot* next;
+            alignas(T) unsigned char storage[sizeof(T)];
+        };
+
+        Slot* slots;
+        size_t slotCount;
+        Slot* freeList;
+        size_t used;
+        size_t allocationCount;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="capacity"> The most objects alive at once. </param>
+        Pool(size_t capacity)
+            : slots(static_cast<Slot*>(::operator new(sizeof(Slot) * (capacity ? capacity : 1), std::align_val_t(alignof(Slot))))),
+            slotCount(capacity), freeList(nullptr), used(0), allocationCount(0)
+        {
+            for (size_t i = capacity; i > 0; i--) {
+                slots[i - 1].next = freeList;
+                freeList = &slots[i - 1];
+            }
+        }
+
+        /// <summary> Objects still alive are not destroyed, destroy them first if they own anything. </summary>
+        ~Pool() { ::operator delete(slots, std::align_val_t(alignof(Slot))); }
+
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+
+        size_t capacity() const { return slotCount; }
+        size_t size() const { return used; }
+        size_t available() const { return slotCount - used; }
+        bool full() const { return freeList == nullptr; }
+
+        /// <summary> Objects created since construction. </summary>
+        size_t allocations() const { return allocationCount; }
+
+        /// <summary> Constructs an object in a free slot. </summary>
+        /// <returns> The object, or null if every slot is taken. </returns>
+        template<typename... Args>
+        T* create(Args&&... args) {
+            if (freeList == nullptr) return nullptr;
+
+            Slot* slot = freeList;
+            freeList = slot->next;
+            used++;
+            allocationCount++;
+            return new (slot->storage) T(std::forward<Args>(args)...);
+        }
+
+        /// <summary> Destroys an object made by create and frees its slot. </summary>
+        void destroy(T* object) {
+            if (object == nullptr) return;
+
+            object->~T();
+            Slot* slot = reinterpret_cast<Slot*>(object);
+            slot->next = freeList;
+            freeList = slot;
+            used--;
+        }
+
+        /// <summary> Whether the pointer lives in this pool. </summary>
+        bool owns(const T* object) const {
+            const Slot* slot = reinterpret_cast<const Slot*>(object);
+            return slot >= slots && slot < slots + slotCount;
+        }
+    };
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "AudioMask.h"
+#include "EffectBase.h"
+#include "Profiler.h"
+#include "Simd.h"
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// Sums mono input channels into stereo submix buses and a master bus.
+    /// Channels and buses are capped at construction and their buffers sized for maxFrames.
+    /// Gain changes are ramped across one block so they do not click.
+    /// </summary>
+    class Mixer {
+    public:
+        /// <summary> The master bus, every other bus ends up here. </summary>
+        static constexpr uint32_t Master = 0;
+
+        /// <summary> The most sends a channel can have. </summary>
+        static constexpr uint32_t MaxSends = 4;
+
+        /// <summary> A post-fader copy of a channel into another bus, ie. a reverb return. </summary>
+        struct Send {
+            uint32_t bus;
+            float level;
+            float currentLeft;
+            float currentRight;
+        };
+
+        struct Channel {
+            /// <summary> Rendered into the channel input each block, or null if the input is written directly. </summary>
+            Effect::Abstract* source;
+            uint32_t output;
+            float gain;
+            float pan;      // -1 left, 0 centre, 1 right
+            bool muted;
+
+            // Constant-power pan law, cached when the pan changes
+            float panLeft;
+            float panRight;
+
+            // The gains reached at the end of the last block
+            float currentLeft;
+            float currentRight;
+
+            Send sends[MaxSends];
+            uint32_t sendCount;
+
+            // Until the first block the gains jump to whatever was set after adding, there is nothing to ramp from
+            bool primed;
+        };
+
+        struct Bus {
+            uint32_t output;    // Always a lower index, so buses can be summed in reverse order
+            float gain;
+            float balance;      // -1 left, 0 centre, 1 right
+            bool muted;
+
+            float balanceLeft;
+            float balanceRight;
+
+            float currentLeft;
+            float currentRight;
+            bool primed;
+
+            /// <summary> Run on the summed bus before its fader, or null. The master's runs after its fader. </summary>
+            Effect::BusInsert* insert;
+        };
+
+    private:
+        size_t maxFrames;
+        std::vector<Channel> channels;
+        std::vector<Bus> buses;
+
+        // Each channel owns maxFrames of input, each bus 2 * maxFrames of left then right
+        std::vector<float> inputs;
+        std::vector<float> busSamples;
+
+        // Category mute, solo and gain, indexed by channel
+        const AudioMasks* masks;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="maxChannels"> The most input channels that can be added. </param>
+        /// <param name="maxBuses"> The most buses, including the master bus. </param>
+        /// <param name="maxFrames_"> The largest block process will be called with. </param>
+        Mixer(size_t maxChannels, size_t maxBuses, size_t maxFrames_)
+            : maxFrames(maxFrames_), channels(), buses(),
+            inputs(maxChannels * maxFrames_, 0), busSamples(maxBuses * 2 * maxFrames_, 0), masks(nullptr)
+        {
+            channels.reserve(maxChannels);
+            buses.reserve(maxBuses);
+            addBus(Master);
+        }
+
+        /// <summary> Adds a stereo submix bus. </summary>
+        /// <param name="output"> The bus it mixes into. </param>
+        /// <returns> The index of the new bus, or -1 if there is no room. </returns>
+        int addBus(uint32_t output = Master) {
+            if (buses.size() == buses.capacity()) return -1;
+
+            Bus bus = {};
+            bus.output = buses.empty() ? Master : std::min<uint32_t>(output, (uint32_t)buses.size() - 1);
+            bus.gain = 1;
+            buses.push_back(bus);
+            setBalance((uint32_t)buses.size() - 1, 0);
+            return (int)buses.size() - 1;
+        }
+
+        /// <summary> Adds a mono input channel. </summary>
+        /// <param name="source"> Rendered each block, or null to write channelInput directly. </param>
+        /// <param name="output"> The bus it mixes into. </param>
+        /// <returns> The index of the new channel, or -1 if there is no room. </returns>
+        int addChannel(Effect::Abstract* source, uint32_t output = Master) {
+            if (channels.size() == channels.capacity()) return -1;
+
+            Channel channel = {};
+            channel.source = source;
+            channel.output = output < buses.size() ? output : Master;
+            channel.gain = 1;
+            channels.push_back(channel);
+            setPan((uint32_t)channels.size() - 1, 0);
+            return (int)channels.size() - 1;
+        }
+
+        size_t channelCount() const { return channels.size(); }
+        size_t busCount() const { return buses.size(); }
+
+        Channel& getChannel(uint32_t index) { return channels[index]; }
+        Bus& getBus(uint32_t index) { return buses[index]; }
+
+        /// <summary> The input samples of a channel, for channels without a source. </summary>
+        float* channelInput(uint32_t channel) { return inputs.data() + channel * maxFrames; }
+
+        void setGain(uint32_t channel, float gain) { channels[channel].gain = gain; }
+        void setMuted(uint32_t channel, bool muted) { channels[channel].muted = muted; }
+
+        /// <summary> Pans a channel with the constant-power law, so its loudness holds across the field. </summary>
+        void setPan(uint32_t channel, float pan) {
+            Channel& c = channels[channel];
+            c.pan = std::max(-1.0f, std::min(1.0f, pan));
+            float angle = (c.pan + 1) * 0.25f * 3.14159265358979f;
+            c.panLeft = std::cos(angle);
+            c.panRight = std::sin(angle);
+        }
+
+        /// <summary> Sets the left / right gains directly, ie. from a Spatializer, instead of from a pan position. </summary>
+        void setPanGains(uint32_t channel, float left, float right) {
+            channels[channel].panLeft = left;
+            channels[channel].panRight = right;
+        }
+
+        /// <summary> Adds or updates a send from a channel to a bus. </summary>
+        /// <returns> False if the channel has no sends left. </returns>
+        bool setSend(uint32_t channel, uint32_t bus, float level) {
+            Channel& c = channels[channel];
+            for (uint32_t i = 0; i < c.sendCount; i++) {
+                if (c.sends[i].bus == bus) { c.sends[i].level = level; return true; }
+            }
+
+            if (c.sendCount == MaxSends || bus >= buses.size()) return false;
+            c.sends[c.sendCount++] = Send{ bus, level, 0, 0 };
+            return true;
+        }
+
+        /// <summary> Applies category mute, solo and gains to every channel, using the channel index as the source. </summary>
+        /// <param name="masks_"> Its beginBlock has to be called before each process, or null to stop. </param>
+        void setMasks(const AudioMasks* masks_) { masks = masks_; }
+
+        void setBusGain(uint32_t bus, float gain) { buses[bus].gain = gain; }
+
+        /// <summary>
+        /// Processes a bus in place once every channel and child bus is in it, ie. a Compressor or Limiter.
+        /// A sidechain can read any bus with a higher index, those are finished first.
+        /// </summary>
+        /// <param name="insert"> Must outlive the mixer, or null to remove it. </param>
+        void setInsert(uint32_t bus, Effect::BusInsert* insert) { buses[bus].insert = insert; }
+        void setBusMuted(uint32_t bus, bool muted) { buses[bus].muted = muted; }
+
+        /// <summary>
+        /// Balances a stereo bus. The centre leaves both sides untouched,
+        /// moving towards one side fades the other out along a constant-power curve.
+        /// </summary>
+        void setBalance(uint32_t bus, float balance) {
+            Bus& b = buses[bus];
+            b.balance = std::max(-1.0f, std::min(1.0f, balance));
+            float angle = (b.balance + 1) * 0.25f * 3.14159265358979f;
+            b.balanceLeft = std::min(1.0f, std::sqrt(2.0f) * std::cos(angle));
+            b.balanceRight = std::min(1.0f, std::sqrt(2.0f) * std::sin(angle));
+        }
+
+        float* left(uint32_t bus = Master) { return busSamples.data() + bus * 2 * maxFrames; }
+        float* right(uint32_t bus = Master) { return left(bus) + maxFrames; }
+
+        /// <summary> Mixes one block, the result is left in the master bus. </summary>
+        /// <param name="frames"> The block size, no larger than maxFrames. </param>
+        void process(size_t frames) {
+            DA_PROFILE_SCOPE("Mixer::process");
+
+            for (uint32_t bus = 0; bus < buses.size(); bus++) {
+                Simd::fill(left(bus), 0, frames);
+                Simd::fill(right(bus), 0, frames);
+            }
+
+            for (uint32_t index = 0; index < channels.size(); index++)
+            {
+                Channel& channel = channels[index];
+                float* input = channelInput(index);
+                if (channel.source != nullptr) {
+                    DA_PROFILE_SCOPE("Mixer::source");
+                    channel.source->process(input, frames);
+                }
+
+                float fader = channel.muted ? 0.0f : channel.gain;
+                if (masks != nullptr) fader *= masks->effectiveGain(index);
+                float targetLeft = fader * channel.panLeft;
+                float targetRight = fader * channel.panRight;
+
+                // A silent source adds nothing, only the ramps need to catch up
+                bool silent = channel.source != nullptr && channel.source->silent();
+                if (!channel.primed || silent) {
+                    channel.currentLeft = targetLeft;
+                    channel.currentRight = targetRight;
+                    for (uint32_t i = 0; i < channel.sendCount; i++) {
+                        channel.sends[i].currentLeft = targetLeft * channel.sends[i].level;
+                        channel.sends[i].currentRight = targetRight * channel.sends[i].level;
+                    }
+                    channel.primed = true;
+                    if (silent) continue;
+                }
+
+                Simd::rampMultiplyAdd(left(channel.output), input, channel.currentLeft, targetLeft, frames);
+                Simd::rampMultiplyAdd(right(channel.output), input, channel.currentRight, targetRight, frames);
+                channel.currentLeft = targetLeft;
+                channel.currentRight = targetRight;
+
+                for (uint32_t i = 0; i < channel.sendCount; i++) {
+                    Send& send = channel.sends[i];
+                    float sendLeft = targetLeft * send.level;
+                    float sendRight = targetRight * send.level;
+                    Simd::rampMultiplyAdd(left(send.bus), input, send.currentLeft, sendLeft, frames);
+                    Simd::rampMultiplyAdd(right(send.bus), input, send.currentRight, sendRight, frames);
+                    send.currentLeft = sendLeft;
+                    send.currentRight = sendRight;
+                }
+            }
+
+            DA_PROFILE_SCOPE("Mixer::buses");
+
+            // Buses only feed lower indices, so walking down sums every child before its parent
+            for (uint32_t index = (uint32_t)buses.size() - 1; index > Master; index--)
+            {
+                Bus& bus = buses[index];
+                if (bus.insert != nullptr) bus.insert->process(left(index), right(index), frames);
+
+                float targetLeft = bus.muted ? 0.0f : bus.gain * bus.balanceLeft;
+                float targetRight = bus.muted ? 0.0f : bus.gain * bus.balanceRight;
+                if (!bus.primed) {
+                    bus.currentLeft = targetLeft;
+                    bus.currentRight = targetRight;
+                    bus.primed = true;
+                }
+
+                Simd::rampMultiplyAdd(left(bus.output), left(index), bus.currentLeft, targetLeft, frames);
+                Simd::rampMultiplyAdd(right(bus.output), right(index), bus.currentRight, targetRight, frames);
+                bus.currentLeft = targetLeft;
+                bus.currentRight = targetRight;
+            }
+
+            Bus& master = buses[Master];
+            float masterLeft = master.muted ? 0.0f : master.gain * master.balanceLeft;
+            float masterRight = master.muted ? 0.0f : master.gain * master.balanceRight;
+            if (!master.primed) {
+                master.currentLeft = masterLeft;
+                master.currentRight = masterRight;
+                master.primed = true;
+            }
+            Simd::rampScale(left(), master.currentLeft, masterLeft, frames);
+            Simd::rampScale(right(), master.currentRight, masterRight, frames);
+            master.currentLeft = masterLeft;
+            master.currentRight = masterRight;
+            if (master.insert != nullptr) master.insert->process(left(), right(), frames);
+        }
+
+        /// <summary> Copies the master bus out as interleaved stereo frames. </summary>
+        void interleave(float* out, size_t frames) {
+            const float* l = left();
+            const float* r = right();
+            for (size_t i = 0; i < frames; i++) {
+                out[i * 2] = l[i];
+                out[i * 2 + 1] = r[i];
+            }
+        }
+    };
+}
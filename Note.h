@@ -13,139 +13,139 @@ namespace DynamicAudio {
         struct Value {
 
             // See https://inspiredacoustics.com/en/MIDI_note_numbers_and_center_frequencies
-            static const NoteValueType Gs9 = 127;
-            static const NoteValueType G9 = 126;
-            static const NoteValueType Fs9 = 125;
-            static const NoteValueType F9 = 124;
-            static const NoteValueType E9 = 123;
-            static const NoteValueType Ds9 = 122;
-            static const NoteValueType D9 = 121;
-            static const NoteValueType Cs9 = 120;
-            static const NoteValueType C9 = 119;
-            static const NoteValueType B8 = 118;
-            static const NoteValueType As8 = 117;
-            static const NoteValueType A8 = 116;
-            static const NoteValueType Gs8 = 115;
-            static const NoteValueType G8 = 114;
-            static const NoteValueType Fs8 = 113;
-            static const NoteValueType F8 = 112;
-            static const NoteValueType E8 = 111;
-            static const NoteValueType Ds8 = 110;
-            static const NoteValueType D8 = 109;
-            static const NoteValueType Cs8 = 108;
-            static const NoteValueType C8 = 107;
-            static const NoteValueType B7 = 106;
-            static const NoteValueType As7 = 105;
-            static const NoteValueType A7 = 104;
-            static const NoteValueType Gs7 = 103;
-            static const NoteValueType G7 = 102;
-            static const NoteValueType Fs7 = 101;
-            static const NoteValueType F7 = 100;
-            static const NoteValueType E7 = 99;
-            static const NoteValueType Ds7 = 98;
-            static const NoteValueType D7 = 97;
-            static const NoteValueType Cs7 = 96;
-            static const NoteValueType C7 = 95;
-            static const NoteValueType B6 = 94;
-            static const NoteValueType As6 = 93;
-            static const NoteValueType A6 = 92;
-            static const NoteValueType Gs6 = 91;
-            static const NoteValueType G6 = 90;
-            static const NoteValueType Fs6 = 89;
-            static const NoteValueType F6 = 88;
-            static const NoteValueType E6 = 87;
-            static const NoteValueType Ds6 = 86;
-            static const NoteValueType D6 = 85;
-            static const NoteValueType Cs6 = 84;
-            static const NoteValueType C6 = 83;
-            static const NoteValueType B5 = 82;
-            static const NoteValueType As5 = 81;
-            static const NoteValueType A5 = 80;
-            static const NoteValueType Gs5 = 79;
-            static const NoteValueType G5 = 78;
-            static const NoteValueType Fs5 = 77;
-            static const NoteValueType F5 = 76;
-            static const NoteValueType E5 = 75;
-            static const NoteValueType Ds5 = 74;
-            static const NoteValueType D5 = 73;
-            static const NoteValueType Cs5 = 72;
-            static const NoteValueType C5 = 71;
-            static const NoteValueType B4 = 70;
-            static const NoteValueType As4 = 69;
-            static const NoteValueType A4 = 68;
-            static const NoteValueType Gs4 = 67;
-            static const NoteValueType G4 = 66;
-            static const NoteValueType Fs4 = 65;
-            static const NoteValueType F4 = 64;
-            static const NoteValueType E4 = 63;
-            static const NoteValueType Ds4 = 62;
-            static const NoteValueType D4 = 61;
-            static const NoteValueType Cs4 = 60;
-            static const NoteValueType C4 = 59;
-            static const NoteValueType B3 = 58;
-            static const NoteValueType As3 = 57;
-            static const NoteValueType A3 = 56;
-            static const NoteValueType Gs3 = 55;
-            static const NoteValueType G3 = 54;
-            static const NoteValueType Fs3 = 53;
-            static const NoteValueType F3 = 52;
-            static const NoteValueType E3 = 51;
-            static const NoteValueType Ds3 = 50;
-            static const NoteValueType D3 = 49;
-            static const NoteValueType Cs3 = 48;
-            static const NoteValueType C3 = 47;
-            static const NoteValueType B2 = 46;
-            static const NoteValueType As2 = 45;
-            static const NoteValueType A2 = 44;
-            static const NoteValueType Gs2 = 43;
-            static const NoteValueType G2 = 42;
-            static const NoteValueType Fs2 = 41;
-            static const NoteValueType F2 = 40;
-            static const NoteValueType E2 = 39;
-            static const NoteValueType Ds2 = 38;
-            static const NoteValueType D2 = 37;
-            static const NoteValueType Cs2 = 36;
-            static const NoteValueType C2 = 35;
-            static const NoteValueType B1 = 34;
-            static const NoteValueType As1 = 33;
-            static const NoteValueType A1 = 32;
-            static const NoteValueType Gs1 = 31;
-            static const NoteValueType G1 = 30;
-            static const NoteValueType Fs1 = 29;
-            static const NoteValueType F1 = 28;
-            static const NoteValueType E1 = 27;
-            static const NoteValueType Ds1 = 26;
-            static const NoteValueType D1 = 25;
-            static const NoteValueType Cs1 = 24;
-            static const NoteValueType C1 = 23;
-            static const NoteValueType B0 = 22;
-            static const NoteValueType As0 = 21;
-            static const NoteValueType A0 = 20;
-            static const NoteValueType BNeg1 = 19;
-            static const NoteValueType ANeg1 = 18;
-            static const NoteValueType GsNeg1 = 17;
-            static const NoteValueType GNeg1 = 16;
-            static const NoteValueType FsNeg1 = 15;
-            static const NoteValueType FNeg1 = 14;
-            static const NoteValueType ENeg1 = 13;
-            static const NoteValueType DsNeg1 = 12;
-            static const NoteValueType DNeg1 = 11;
-            static const NoteValueType CsNeg1 = 10;
-            static const NoteValueType CNeg1 = 9;
-            static const NoteValueType BNeg2 = 8;
-            static const NoteValueType AsNeg2 = 7;
-            static const NoteValueType ANeg2 = 6;
-            static const NoteValueType GNeg2 = 5;
-            static const NoteValueType GsNeg2 = 4;
-            static const NoteValueType FNeg2 = 3;
-            static const NoteValueType FsNeg2 = 2;
-            static const NoteValueType ENeg2 = 1;
-            static const NoteValueType DsNeg2 = 0;
-
-            static const NoteValueType Middle_C = Cs4;
-            static const NoteValueType MIDI_A440 = As4;
-
-            static const NoteValueType null = 0;
+            static constexpr NoteValueType Gs9 = 127;
+            static constexpr NoteValueType G9 = 126;
+            static constexpr NoteValueType Fs9 = 125;
+            static constexpr NoteValueType F9 = 124;
+            static constexpr NoteValueType E9 = 123;
+            static constexpr NoteValueType Ds9 = 122;
+            static constexpr NoteValueType D9 = 121;
+            static constexpr NoteValueType Cs9 = 120;
+            static constexpr NoteValueType C9 = 119;
+            static constexpr NoteValueType B8 = 118;
+            static constexpr NoteValueType As8 = 117;
+            static constexpr NoteValueType A8 = 116;
+            static constexpr NoteValueType Gs8 = 115;
+            static constexpr NoteValueType G8 = 114;
+            static constexpr NoteValueType Fs8 = 113;
+            static constexpr NoteValueType F8 = 112;
+            static constexpr NoteValueType E8 = 111;
+            static constexpr NoteValueType Ds8 = 110;
+            static constexpr NoteValueType D8 = 109;
+            static constexpr NoteValueType Cs8 = 108;
+            static constexpr NoteValueType C8 = 107;
+            static constexpr NoteValueType B7 = 106;
+            static constexpr NoteValueType As7 = 105;
+            static constexpr NoteValueType A7 = 104;
+            static constexpr NoteValueType Gs7 = 103;
+            static constexpr NoteValueType G7 = 102;
+            static constexpr NoteValueType Fs7 = 101;
+            static constexpr NoteValueType F7 = 100;
+            static constexpr NoteValueType E7 = 99;
+            static constexpr NoteValueType Ds7 = 98;
+            static constexpr NoteValueType D7 = 97;
+            static constexpr NoteValueType Cs7 = 96;
+            static constexpr NoteValueType C7 = 95;
+            static constexpr NoteValueType B6 = 94;
+            static constexpr NoteValueType As6 = 93;
+            static constexpr NoteValueType A6 = 92;
+            static constexpr NoteValueType Gs6 = 91;
+            static constexpr NoteValueType G6 = 90;
+            static constexpr NoteValueType Fs6 = 89;
+            static constexpr NoteValueType F6 = 88;
+            static constexpr NoteValueType E6 = 87;
+            static constexpr NoteValueType Ds6 = 86;
+            static constexpr NoteValueType D6 = 85;
+            static constexpr NoteValueType Cs6 = 84;
+            static constexpr NoteValueType C6 = 83;
+            static constexpr NoteValueType B5 = 82;
+            static constexpr NoteValueType As5 = 81;
+            static constexpr NoteValueType A5 = 80;
+            static constexpr NoteValueType Gs5 = 79;
+            static constexpr NoteValueType G5 = 78;
+            static constexpr NoteValueType Fs5 = 77;
+            static constexpr NoteValueType F5 = 76;
+            static constexpr NoteValueType E5 = 75;
+            static constexpr NoteValueType Ds5 = 74;
+            static constexpr NoteValueType D5 = 73;
+            static constexpr NoteValueType Cs5 = 72;
+            static constexpr NoteValueType C5 = 71;
+            static constexpr NoteValueType B4 = 70;
+            static constexpr NoteValueType As4 = 69;
+            static constexpr NoteValueType A4 = 68;
+            static constexpr NoteValueType Gs4 = 67;
+            static constexpr NoteValueType G4 = 66;
+            static constexpr NoteValueType Fs4 = 65;
+            static constexpr NoteValueType F4 = 64;
+            static constexpr NoteValueType E4 = 63;
+            static constexpr NoteValueType Ds4 = 62;
+            static constexpr NoteValueType D4 = 61;
+            static constexpr NoteValueType Cs4 = 60;
+            static constexpr NoteValueType C4 = 59;
+            static constexpr NoteValueType B3 = 58;
+            static constexpr NoteValueType As3 = 57;
+            static constexpr NoteValueType A3 = 56;
+            static constexpr NoteValueType Gs3 = 55;
+            static constexpr NoteValueType G3 = 54;
+            static constexpr NoteValueType Fs3 = 53;
+            static constexpr NoteValueType F3 = 52;
+            static constexpr NoteValueType E3 = 51;
+            static constexpr NoteValueType Ds3 = 50;
+            static constexpr NoteValueType D3 = 49;
+            static constexpr NoteValueType Cs3 = 48;
+            static constexpr NoteValueType C3 = 47;
+            static constexpr NoteValueType B2 = 46;
+            static constexpr NoteValueType As2 = 45;
+            static constexpr NoteValueType A2 = 44;
+            static constexpr NoteValueType Gs2 = 43;
+            static constexpr NoteValueType G2 = 42;
+            static constexpr NoteValueType Fs2 = 41;
+            static constexpr NoteValueType F2 = 40;
+            static constexpr NoteValueType E2 = 39;
+            static constexpr NoteValueType Ds2 = 38;
+            static constexpr NoteValueType D2 = 37;
+            static constexpr NoteValueType Cs2 = 36;
+            static constexpr NoteValueType C2 = 35;
+            static constexpr NoteValueType B1 = 34;
+            static constexpr NoteValueType As1 = 33;
+            static constexpr NoteValueType A1 = 32;
+            static constexpr NoteValueType Gs1 = 31;
+            static constexpr NoteValueType G1 = 30;
+            static constexpr NoteValueType Fs1 = 29;
+            static constexpr NoteValueType F1 = 28;
+            static constexpr NoteValueType E1 = 27;
+            static constexpr NoteValueType Ds1 = 26;
+            static constexpr NoteValueType D1 = 25;
+            static constexpr NoteValueType Cs1 = 24;
+            static constexpr NoteValueType C1 = 23;
+            static constexpr NoteValueType B0 = 22;
+            static constexpr NoteValueType As0 = 21;
+            static constexpr NoteValueType A0 = 20;
+            static constexpr NoteValueType BNeg1 = 19;
+            static constexpr NoteValueType ANeg1 = 18;
+            static constexpr NoteValueType GsNeg1 = 17;
+            static constexpr NoteValueType GNeg1 = 16;
+            static constexpr NoteValueType FsNeg1 = 15;
+            static constexpr NoteValueType FNeg1 = 14;
+            static constexpr NoteValueType ENeg1 = 13;
+            static constexpr NoteValueType DsNeg1 = 12;
+            static constexpr NoteValueType DNeg1 = 11;
+            static constexpr NoteValueType CsNeg1 = 10;
+            static constexpr NoteValueType CNeg1 = 9;
+            static constexpr NoteValueType BNeg2 = 8;
+            static constexpr NoteValueType AsNeg2 = 7;
+            static constexpr NoteValueType ANeg2 = 6;
+            static constexpr NoteValueType GNeg2 = 5;
+            static constexpr NoteValueType GsNeg2 = 4;
+            static constexpr NoteValueType FNeg2 = 3;
+            static constexpr NoteValueType FsNeg2 = 2;
+            static constexpr NoteValueType ENeg2 = 1;
+            static constexpr NoteValueType DsNeg2 = 0;
+
+            static constexpr NoteValueType Middle_C = Cs4;
+            static constexpr NoteValueType MIDI_A440 = As4;
+
+            static constexpr NoteValueType null = 0;
 
             /// <summary> Is the note value null. </summary>
             /// <param name="value"> The value to check. </param>
@@ -184,6 +184,22 @@ namespace DynamicAudio {
                 return 440.0 * pow(2.0, (value - 69) / 12.0);
             }
 
+            /// <summary> The nearest note to a frequency, the inverse of calculateFrequency. </summary>
+            /// <param name="frequency"> The frequency in hertz. </param>
+            /// <param name="cents"> Set to how far the frequency is from the note, -50 to 50, if given. </param>
+            /// <returns> The notes value, or null if it falls outside the table. </returns>
+            static NoteValueType fromFrequency(double frequency, double* cents = nullptr) {
+                if (cents != nullptr) *cents = 0;
+                if (frequency <= 0) return null;
+
+                double exact = 69 + 12 * std::log2(frequency / 440.0);
+                double nearest = std::round(exact);
+                if (nearest < 1 || nearest > Gs9) return null;
+
+                if (cents != nullptr) *cents = (exact - nearest) * 100;
+                return (NoteValueType)nearest;
+            }
+
             // Define the noteMap
             static std::map<std::string, NoteValueType> mapStringToValue;
 
@@ -278,7 +294,7 @@ namespace DynamicAudio {
 }
 
 
-std::map<std::string, DynamicAudio::NoteValueType> DynamicAudio::Note::Value::mapStringToValue = {
+inline std::map<std::string, DynamicAudio::NoteValueType> DynamicAudio::Note::Value::mapStringToValue = {
     {"Gs9",  DynamicAudio::Note::Value::Gs9},
     {"G9",  DynamicAudio::Note::Value::G9},
     {"Fs9",  DynamicAudio::Note::Value::Fs9},
@@ -422,15 +438,15 @@ std::map<std::string, DynamicAudio::NoteValueType> DynamicAudio::Note::Value::ma
     { "C",  DynamicAudio::Note::Value::C4 }
 };
 
-DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Maxima = 1 * 8;
-DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Long = 1 * 4;
-DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Breve = 1 * 2;
-DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Semibreve = 1; // 1 whole note
-DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Minim = 1 / 2;
-DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Crotchet = 1 / 4;
-DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Quaver = 1 / 8;
-DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Semiquaver = 1 / 16;
-DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Demisemiquaver = 1 / 32;
-DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Hemidemisemiquaver = 1 / 64;
-DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Semihemidemisemiquaver = 1 / 128;
-DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Demisemihemidemisemiquaver = 1 / 256;
\ No newline at end of file
+inline DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Maxima = 1 * 8;
+inline DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Long = 1 * 4;
+inline DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Breve = 1 * 2;
+inline DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Semibreve = 1; // 1 whole note
+inline DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Minim = 1.0 / 2;
+inline DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Crotchet = 1.0 / 4;
+inline DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Quaver = 1.0 / 8;
+inline DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Semiquaver = 1.0 / 16;
+inline DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Demisemiquaver = 1.0 / 32;
+inline DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Hemidemisemiquaver = 1.0 / 64;
+inline DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Semihemidemisemiquaver = 1.0 / 128;
+inline DynamicAudio::NoteDurationType DynamicAudio::Note::Duration::Demisemihemidemisemiquaver = 1.0 / 256;
\ No newline at end of file
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Profiler.h"
+#include "Simd.h"
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// Turns float samples into interleaved 16 or 24-bit PCM for a device or a WAV, clipping anything past full scale.
+    /// Dither is triangular, one least significant bit either side, drawn from eight xorshift generators run
+    /// side by side, so the SIMD path and the scalar reference write the same bits.
+    /// Noise shaping pushes the dither and rounding noise up towards Nyquist, where it is hardest to hear.
+    /// Its error feedback depends on the previous sample of the same channel, so it always takes the scalar path.
+    /// </summary>
+    class OutputConverter {
+    public:
+        enum class Dither {
+            None,           // Plain rounding
+            Triangular,     // TPDF, decorrelates the rounding error from the signal
+            Shaped          // TPDF through second order error feedback, (1 - z^-1)^2
+        };
+
+    private:
+        static constexpr uint32_t One = 0x3F800000;     // The bits of 1.0f
+        static constexpr size_t Generators = 2 * Simd::Width;   // Two independent sets, so the SIMD path is not one long dependency chain
+
+        uint16_t channels;
+        Dither mode;
+        uint32_t state[Generators];     // Sample i of a call draws from generator i % Generators
+        std::vector<float> errors;      // The last two shaped errors of each channel
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="channels_"> Samples per frame. </param>
+        /// <param name="mode_"> The dither added before rounding. </param>
+        /// <param name="seed"> Two converters with the same seed dither identically. </param>
+        OutputConverter(uint16_t channels_ = 2, Dither mode_ = Dither::Triangular, uint32_t seed = 1)
+            : channels(channels_ ? channels_ : 1), mode(mode_), state(), errors(2 * (size_t)(channels_ ? channels_ : 1), 0.0f)
+        {
+            reset(seed);
+        }
+
+        uint16_t getChannels() const { return channels; }
+        Dither getDither() const { return mode; }
+        void setDither(Dither mode_) { mode = mode_; }
+
+        /// <summary> Reseeds the dither and forgets the shaped error, ie. before a new file. </summary>
+        void reset(uint32_t seed = 1) {
+            for (size_t k = 0; k < Generators; k++) {
+                uint32_t s = seed * 0x9E3779B9u + (uint32_t)(k + 1) * 0x85EBCA6Bu;
+                state[k] = s ? s : 1;
+            }
+            std::fill(errors.begin(), errors.end(), 0.0f);
+        }
+
+        /// <summary> Converts interleaved frames to 16-bit PCM. </summary>
+        void toInt16(const float* in, int16_t* out, size_t frames) {
+            DA_PROFILE_SCOPE("OutputConverter::toInt16");
+            quantize(in, frames * channels, 32767.0f,
+                [out](size_t i, Simd::Int4 a, Simd::Int4 b) { Simd::Int4::storeInt16(out + i, a, b); },
+                [out](size_t i, int32_t v) { out[i] = (int16_t)v; });
+        }
+
+        /// <summary> Converts interleaved frames to packed little endian 24-bit PCM, three bytes a sample. </summary>
+        void toInt24(const float* in, uint8_t* out, size_t frames) {
+            DA_PROFILE_SCOPE("OutputConverter::toInt24");
+            quantize(in, frames * channels, 8388607.0f,
+                [out](size_t i, Simd::Int4 a, Simd::Int4 b) {
+                    uint32_t lanes[2 * Simd::Width];
+                    a.store(lanes);
+                    b.store(lanes + Simd::Width);
+                    for (size_t k = 0; k < 2 * Simd::Width; k++) write24(out + 3 * (i + k), (int32_t)lanes[k]);
+                },
+                [out](size_t i, int32_t v) { write24(out + 3 * i, v); });
+        }
+
+        /// <summary> Converts to 16 or 24-bit PCM, out holds frames * channels * bits / 8 bytes. </summary>
+        void convert(const float* in, void* out, size_t frames, uint16_t bitsPerSample) {
+            if (bitsPerSample == 24) toInt24(in, (uint8_t*)out, frames);
+            else toInt16(in, (int16_t*)out, frames);
+        }
+
+        /// <summary> toInt16 one sample at a time, the reference the SIMD path is checked against. </summary>
+        void toInt16Reference(const float* in, int16_t* out, size_t frames) {
+            size_t samples = frames * channels;
+            for (size_t i = 0; i < samples; i++) out[i] = (int16_t)quantizeOne(in[i], 32767.0f, i);
+        }
+
+        /// <summary> toInt24 one sample at a time, the reference the SIMD path is checked against. </summary>
+        void toInt24Reference(const float* in, uint8_t* out, size_t frames) {
+            size_t samples = frames * channels;
+            for (size_t i = 0; i < samples; i++) write24(out + 3 * i, quantizeOne(in[i], 8388607.0f, i));
+        }
+
+    private:
+        static uint32_t next(uint32_t x) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            return x;
+        }
+
+        static Simd::Int4 next(Simd::Int4 x) {
+            x = x ^ (x << 13);
+            x = x ^ (x >> 17);
+            x = x ^ (x << 5);
+            return x;
+        }
+
+        static float asFloat(uint32_t bits) {
+            float f;
+            std::memcpy(&f, &bits, sizeof(f));
+            return f;
+        }
+
+        /// <summary> The difference of the two 16-bit halves as uniforms, triangular over -1 to 1. </summary>
+        static float triangular(uint32_t r) {
+            return asFloat(((r & 0xFFFF) << 7) | One) - asFloat(((r >> 16) << 7) | One);
+        }
+
+        static Simd::Float4 triangular(Simd::Int4 r) {
+            return (((r & Simd::Int4(0xFFFF)) << 7) | Simd::Int4(One)).asFloat() - (((r >> 16) << 7) | Simd::Int4(One)).asFloat();
+        }
+
+        static void write24(uint8_t* out, int32_t v) {
+            out[0] = (uint8_t)v;
+            out[1] = (uint8_t)(v >> 8);
+            out[2] = (uint8_t)(v >> 16);
+        }
+
+        /// <summary> Scales, dithers, clips and rounds, writing eight samples at a time and the rest one by one. </summary>
+        template<typename Write8, typename Write1>
+        void quantize(const float* in, size_t samples, float fullScale, Write8 write8, Write1 write1) {
+            using Simd::Float4;
+            using Simd::Int4;
+
+            const size_t step = Generators;
+            size_t wide = samples - samples % step;
+            size_t i = 0;
+            if (mode != Dither::Shaped)
+            {
+                Float4 scale(fullScale), low(-fullScale - 1), high(fullScale);
+                Int4 rngA = Int4::load(state), rngB = Int4::load(state + Simd::Width);
+                if (mode == Dither::Triangular) {
+                    for (; i < wide; i += step) {
+                        rngA = next(rngA);
+                        rngB = next(rngB);
+                        Float4 a = Float4::load(in + i) * scale + triangular(rngA);
+                        Float4 b = Float4::load(in + i + Simd::Width) * scale + triangular(rngB);
+                        write8(i, Int4::round(Float4::min(Float4::max(a, low), high)), Int4::round(Float4::min(Float4::max(b, low), high)));
+                    }
+                }
+                else {
+                    for (; i < wide; i += step) {
+                        Float4 a = Float4::load(in + i) * scale;
+                        Float4 b = Float4::load(in + i + Simd::Width) * scale;
+                        write8(i, Int4::round(Float4::min(Float4::max(a, low), high)), Int4::round(Float4::min(Float4::max(b, low), high)));
+                    }
+                }
+                rngA.store(state);
+                rngB.store(state + Simd::Width);
+            }
+
+            for (; i < samples; i++) write1(i, quantizeOne(in[i], fullScale, i));
+        }
+
+        int32_t quantizeOne(float sample, float fullScale, size_t i) {
+            float low = -fullScale - 1;
+            float x = sample * fullScale;
+            if (mode == Dither::None) return (int32_t)std::lrint(clip(x, low, fullScale));
+
+            uint32_t& rng = state[i % Generators];
+            rng = next(rng);
+            if (mode == Dither::Triangular) return (int32_t)std::lrint(clip(x + triangular(rng), low, fullScale));
+
+            // Feed the last two errors back so the noise comes out shaped by (1 - z^-1)^2
+            float* error = errors.data() + 2 * (i % channels);
+            float wanted = x - 2 * error[0] + error[1];
+            float y = std::nearbyint(clip(wanted + triangular(rng), low, fullScale));
+
+            // Clipping would otherwise feed back a huge error and make the loop ring
+            float e = y - wanted;
+            e = e > 2 ? 2 : (e < -2 ? -2 : e);
+            error[1] = error[0];
+            error[0] = e;
+            return (int32_t)y;
+        }
+
+        /// <summary> Matches Float4::min(Float4::max(x, low), high), NaN included. </summary>
+        static float clip(float x, float low, float high) {
+            x = x > low ? x : low;
+            return x < high ? x : high;
+        }
+    };
+}
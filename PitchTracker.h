@@ -0,0 +1,326 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Fft.h"
+#include "Note.h"
+#include "Profiler.h"
+#include "RingBuffer.h"
+#include "Simd.h"
+#include "Tune.h"
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// Follows the pitch of monophonic audio, ie. a microphone or a WAV, and turns it back into Notes.
+    /// Every hop the YIN difference function is taken over the latest window. Its correlation term
+    /// comes from FFTs, so a hop costs O(n log n) rather than a multiply per lag per sample.
+    /// Notes that hold steady for a few hops become NoteEvents, read from another thread through poll.
+    /// The FFT, history and note queue are sized once for the window, so push can run on the audio thread.
+    /// </summary>
+    class PitchTracker {
+    public:
+        /// <summary> The pitch of one window. </summary>
+        struct Estimate {
+            float frequency;        // Hz, 0 when unvoiced
+            float clarity;          // 1 for a pure periodic signal, towards 0 for noise
+            NoteValueType note;     // Nearest note, null when unvoiced
+            float cents;            // Distance from the note
+            uint64_t frame;         // First frame of the window
+        };
+
+        /// <summary> A note that held steady, from its first frame up to but not including its end. </summary>
+        struct NoteEvent {
+            NoteValueType note;
+            float cents;            // Average over the note
+            uint64_t start;
+            uint64_t end;
+        };
+
+    private:
+        uint32_t sampleRate;
+        size_t window;          // Samples summed per lag
+        size_t minLag;
+        size_t maxLag;
+        size_t length;          // window + maxLag, the samples one estimate needs
+        size_t hop;
+        float threshold;
+        float minClarity;
+        float minLevel;
+
+        Fft fft;
+        std::vector<float> history;     // The last length samples, circular
+        size_t writeIndex;
+        size_t sinceEstimate;
+        uint64_t framesPushed;
+
+        // Scratch for one estimate
+        std::vector<float> frame;
+        std::vector<float> head;
+        std::vector<float> frameRe, frameIm, headRe, headIm;
+        std::vector<float> correlation;
+        std::vector<float> difference;
+
+        Estimate last;
+
+        // Note tracking
+        size_t stableHops;
+        NoteValueType candidate;
+        size_t candidateHops;
+        uint64_t candidateStart;
+        NoteValueType active;
+        uint64_t activeStart;
+        double activeCents;
+        size_t activeEstimates;
+
+        SpscRingBuffer<NoteEvent> events;
+        uint64_t droppedEvents;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="sampleRate_"> Of the audio pushed. </param>
+        /// <param name="minHz"> The lowest pitch looked for, sets how much audio an estimate needs. </param>
+        /// <param name="maxHz"> The highest pitch looked for. </param>
+        /// <param name="hop_"> Samples between estimates. </param>
+        /// <param name="window_"> Samples compared per lag, 0 picks two periods of minHz. </param>
+        PitchTracker(uint32_t sampleRate_, float minHz = 60, float maxHz = 1500, size_t hop_ = 256, size_t window_ = 0)
+            : sampleRate(sampleRate_),
+            window(window_ ? window_ : (size_t)std::ceil(2.0 * sampleRate_ / minHz)),
+            minLag(std::max<size_t>(2, (size_t)std::floor(sampleRate_ / maxHz))),
+            maxLag((size_t)std::ceil(sampleRate_ / minHz) + 2),
+            length(0), hop(hop_ ? hop_ : 1), threshold(0.15f), minClarity(0.5f), minLevel(1e-4f),
+            fft(fftSizeFor(window + maxLag)), history(), writeIndex(0), sinceEstimate(0), framesPushed(0),
+            frame(), head(), frameRe(), frameIm(), headRe(), headIm(), correlation(), difference(),
+            last(), stableHops(3), candidate(Note::Value::null), candidateHops(0), candidateStart(0),
+            active(Note::Value::null), activeStart(0), activeCents(0), activeEstimates(0),
+            events(256), droppedEvents(0)
+        {
+            length = window + maxLag;
+            history.assign(length, 0);
+            frame.assign(fft.size(), 0);
+            head.assign(fft.size(), 0);
+            frameRe.assign(fft.bins(), 0);
+            frameIm.assign(fft.bins(), 0);
+            headRe.assign(fft.bins(), 0);
+            headIm.assign(fft.bins(), 0);
+            correlation.assign(fft.size(), 0);
+            difference.assign(maxLag, 0);
+        }
+
+        PitchTracker(const PitchTracker&) = delete;
+        PitchTracker& operator=(const PitchTracker&) = delete;
+
+        /// <summary> How low the normalized difference has to dip for a lag to count as the period, YIN's absolute threshold. </summary>
+        void setThreshold(float threshold_) { threshold = threshold_; }
+
+        /// <summary> Windows less clear than this are unvoiced. </summary>
+        void setMinClarity(float clarity) { minClarity = clarity; }
+
+        /// <summary> Windows with a lower RMS are unvoiced without being analyzed. </summary>
+        void setMinLevel(float rms) { minLevel = rms; }
+
+        /// <summary> Hops a note has to hold before it starts, so vibrato and transients do not split it. </summary>
+        void setStableHops(size_t hops) { stableHops = hops ? hops : 1; }
+
+        /// <summary> The latency from a sound to its first estimate. </summary>
+        size_t latencyFrames() const { return length; }
+
+        /// <summary> The newest estimate. Audio thread only. </summary>
+        const Estimate& current() const { return last; }
+
+        /// <summary> Events lost because the reader did not poll often enough. </summary>
+        uint64_t dropped() const { return droppedEvents; }
+
+        /// <summary> Adds audio, estimating once per hop. Audio thread only. </summary>
+        void push(const float* samples, size_t frames) {
+            DA_PROFILE_SCOPE("PitchTracker::push");
+
+            for (size_t i = 0; i < frames;)
+            {
+                size_t take = std::min(frames - i, hop - sinceEstimate);
+                for (size_t j = 0; j < take; j++) {
+                    history[writeIndex] = samples[i + j];
+                    writeIndex = writeIndex + 1 == length ? 0 : writeIndex + 1;
+                }
+                i += take;
+                sinceEstimate += take;
+                framesPushed += take;
+
+                if (sinceEstimate == hop) {
+                    sinceEstimate = 0;
+                    if (framesPushed >= length) {
+                        estimate();
+                        track();
+                    }
+                }
+            }
+        }
+
+        /// <summary> Ends the note being held, ie. at the end of the input. Audio thread only. </summary>
+        void flush() {
+            endNote(framesPushed);
+            candidate = Note::Value::null;
+            candidateHops = 0;
+        }
+
+        /// <summary> Takes the oldest finished note. Reader thread only. </summary>
+        bool poll(NoteEvent& event) { return events.pop(event); }
+
+        /// <summary> Lays events out as a Tune, with silences for the gaps between them. </summary>
+        /// <param name="sampleRate_"> Of the audio the events came from. </param>
+        /// <param name="tempo"> Turns frames into Note durations, and is stored with the tune. </param>
+        static Tune toTune(const std::vector<NoteEvent>& noteEvents, uint32_t sampleRate_, const TempoMap& tempo = TempoMap()) {
+            Tune tune;
+            tune.setTempo(tempo);
+            double position = 0;
+            for (const NoteEvent& event : noteEvents) {
+                double start = tempo.positionAt((double)event.start / sampleRate_);
+                double end = tempo.positionAt((double)event.end / sampleRate_);
+                if (start > position) tune.addSilence(start - position);
+                tune.addSingle(Note(event.note, end - std::max(start, position)));
+                position = end;
+            }
+            return tune;
+        }
+
+        /// <summary>
+        /// The direct YIN difference function, d(lag) = sum (x[j] - x[j + lag])^2, a multiply per lag per sample.
+        /// Kept as the reference the FFT path is checked and timed against.
+        /// </summary>
+        static void differenceDirect(const float* samples, size_t windowSize, size_t lags, float* out) {
+            using Simd::Float4;
+            for (size_t lag = 0; lag < lags; lag++) {
+                Float4 sum;
+                size_t j = 0;
+                for (; j < Simd::wide(windowSize); j += Simd::Width) {
+                    Float4 d = Float4::load(samples + j) - Float4::load(samples + j + lag);
+                    sum += d * d;
+                }
+                float total = sum.sum();
+                for (; j < windowSize; j++) total += (samples[j] - samples[j + lag]) * (samples[j] - samples[j + lag]);
+                out[lag] = total;
+            }
+        }
+
+    private:
+        static size_t fftSizeFor(size_t samples) {
+            size_t size = 4;
+            while (size < samples) size <<= 1;
+            return size;
+        }
+
+        void estimate() {
+            using Simd::Float4;
+            last = Estimate{ 0, 0, Note::Value::null, 0, framesPushed - length };
+
+            // Oldest first, zero padded up to the FFT size
+            size_t tail = length - writeIndex;
+            std::copy(history.begin() + writeIndex, history.end(), frame.begin());
+            std::copy(history.begin(), history.begin() + writeIndex, frame.begin() + tail);
+
+            float energy = Simd::sumSquares(frame.data(), window);
+            if (energy < minLevel * minLevel * window) return;
+
+            // r(lag) = sum x[j] x[j + lag] over the window, as the inverse of conj(H) * F
+            std::copy(frame.begin(), frame.begin() + window, head.begin());
+            fft.forward(frame.data(), frameRe.data(), frameIm.data());
+            fft.forward(head.data(), headRe.data(), headIm.data());
+
+            size_t k = 0;
+            for (; k < Simd::wide(fft.bins()); k += Simd::Width) {
+                Float4 ar = Float4::load(headRe.data() + k), ai = Float4::load(headIm.data() + k);
+                Float4 br = Float4::load(frameRe.data() + k), bi = Float4::load(frameIm.data() + k);
+                (ar * br + ai * bi).store(frameRe.data() + k);
+                (ar * bi - ai * br).store(frameIm.data() + k);
+            }
+            for (; k < fft.bins(); k++) {
+                float ar = headRe[k], ai = headIm[k], br = frameRe[k], bi = frameIm[k];
+                frameRe[k] = ar * br + ai * bi;
+                frameIm[k] = ar * bi - ai * br;
+            }
+            fft.inverse(frameRe.data(), frameIm.data(), correlation.data());
+
+            // d(lag) = energy of the window + energy of the window shifted by lag - 2 r(lag)
+            float shifted = energy;
+            difference[0] = 0;
+            for (size_t lag = 1; lag < maxLag; lag++) {
+                shifted += frame[lag + window - 1] * frame[lag + window - 1] - frame[lag - 1] * frame[lag - 1];
+                difference[lag] = std::max(0.0f, energy + shifted - 2 * correlation[lag]);
+            }
+
+            // Cumulative mean normalized, then the first dip under the threshold
+            float running = 0;
+            size_t best = 0;
+            float bestValue = 2;
+            for (size_t lag = 1; lag < maxLag; lag++) {
+                running += difference[lag];
+                difference[lag] = running > 0 ? difference[lag] * lag / running : 1;
+            }
+            for (size_t lag = minLag; lag + 1 < maxLag; lag++) {
+                if (difference[lag] < threshold) {
+                    while (lag + 1 < maxLag && difference[lag + 1] < difference[lag]) lag++;
+                    best = lag;
+                    bestValue = difference[lag];
+                    break;
+                }
+                if (difference[lag] < bestValue) {
+                    best = lag;
+                    bestValue = difference[lag];
+                }
+            }
+
+            float clarity = 1 - bestValue;
+            if (best == 0 || clarity < minClarity) return;
+
+            // Parabolic interpolation between the neighbouring lags
+            float period = (float)best;
+            if (best > 1 && best + 1 < maxLag) {
+                float a = difference[best - 1], b = difference[best], c = difference[best + 1];
+                float curve = a - 2 * b + c;
+                if (curve > 0) period += 0.5f * (a - c) / curve;
+            }
+
+            double cents;
+            last.frequency = sampleRate / period;
+            last.clarity = clarity;
+            last.note = Note::Value::fromFrequency(last.frequency, &cents);
+            last.cents = (float)cents;
+        }
+
+        /// <summary> Starts and ends notes once an estimate has held for stableHops. </summary>
+        void track() {
+            if (last.note != candidate) {
+                candidate = last.note;
+                candidateHops = 0;
+                candidateStart = last.frame;
+            }
+            candidateHops++;
+
+            if (candidate == active) {
+                if (active != Note::Value::null) {
+                    activeCents += last.cents;
+                    activeEstimates++;
+                }
+                return;
+            }
+            if (candidateHops < stableHops) return;
+
+            endNote(candidateStart);
+            active = candidate;
+            activeStart = candidateStart;
+            activeCents = 0;
+            activeEstimates = 0;
+        }
+
+        void endNote(uint64_t end) {
+            if (active == Note::Value::null) return;
+
+            NoteEvent event = { active, activeEstimates ? (float)(activeCents / activeEstimates) : 0.0f, activeStart, end };
+            if (!events.push(event)) droppedEvents++;
+            active = Note::Value::null;
+        }
+    };
+}
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "RingBuffer.h"
+
+// Instrumentation is only compiled in when DYNAMICAUDIO_PROFILE is defined,
+// otherwise every macro below expands to nothing.
+#ifdef DYNAMICAUDIO_PROFILE
+#define DA_PROFILE_CONCAT_(a, b) a##b
+#define DA_PROFILE_CONCAT(a, b) DA_PROFILE_CONCAT_(a, b)
+
+/// <summary> Times the rest of the enclosing scope. The name has to be a string literal. </summary>
+#define DA_PROFILE_SCOPE(name) ::DynamicAudio::Profiler::Scope DA_PROFILE_CONCAT(daProfileScope, __LINE__)(name)
+
+/// <summary> Times the rest of the enclosing scope as one audio block, counting it as missed past the deadline. </summary>
+#define DA_PROFILE_BLOCK(name, deadlineNs) ::DynamicAudio::Profiler::BlockScope DA_PROFILE_CONCAT(daProfileBlock, __LINE__)(name, deadlineNs)
+
+/// <summary> Marks a moment on the trace, ie. an error. </summary>
+#define DA_PROFILE_EVENT(name) ::DynamicAudio::Profiler::instance().instant(name)
+
+/// <summary> Gives the calling thread its log, at the start of a thread before it records anything. </summary>
+#define DA_PROFILE_THREAD() ::DynamicAudio::Profiler::instance().registerThread()
+#else
+#define DA_PROFILE_SCOPE(name) ((void)0)
+#define DA_PROFILE_BLOCK(name, deadlineNs) ((void)0)
+#define DA_PROFILE_EVENT(name) ((void)0)
+#define DA_PROFILE_THREAD() ((void)0)
+#endif
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// Collects timed scopes from every thread into Chrome trace JSON.
+    /// Each thread writes into its own lock-free ring, so recording never waits on
+    /// another thread. One thread at a time drains the rings, ie. when exporting.
+    /// A thread gets its ring from registerThread, outside of real-time code, and hands it back when it
+    /// exits. Records from a thread that never registered are counted and thrown away.
+    /// </summary>
+    class Profiler {
+    public:
+        /// <summary> Events a thread can hold before they are drained, any more are dropped and counted. </summary>
+        static constexpr size_t RingCapacity = 1 << 16;
+
+        /// <summary> Block times are bucketed by powers of two microseconds, the first bucket is under 1us. </summary>
+        static constexpr size_t HistogramBuckets = 24;
+
+        struct Event {
+            const char* name;
+            uint64_t start;     // Nanoseconds since the profiler started
+            uint64_t duration;
+            bool instant;
+        };
+
+        /// <summary> Per-block timing, safe to read from any thread. </summary>
+        struct BlockStats {
+            std::atomic<uint64_t> blocks;
+            std::atomic<uint64_t> deadlineMisses;
+            std::atomic<uint64_t> maxNs;
+            std::atomic<uint64_t> totalNs;
+            std::atomic<uint64_t> histogram[HistogramBuckets];
+
+            BlockStats() : blocks(0), deadlineMisses(0), maxNs(0), totalNs(0) {
+                for (std::atomic<uint64_t>& bucket : histogram) bucket.store(0);
+            }
+
+            /// <summary> The lowest time in microseconds a histogram bucket holds. </summary>
+            static uint64_t bucketStartUs(size_t bucket) { return bucket == 0 ? 0 : (uint64_t)1 << (bucket - 1); }
+        };
+
+    private:
+        struct ThreadLog {
+            uint32_t id;
+            bool free;          // Its thread exited, the next thread to register takes it
+            SpscRingBuffer<Event> ring;
+            std::atomic<uint64_t> dropped;
+
+            ThreadLog(uint32_t id_) : id(id_), free(false), ring(RingCapacity), dropped(0) {}
+        };
+
+        /// <summary> Hands the thread's log back when the thread exits. </summary>
+        struct Registration {
+            ThreadLog* log = nullptr;
+
+            ~Registration() {
+                if (log == nullptr) return;
+                current() = nullptr;
+                instance().release(*log);
+            }
+        };
+
+        struct Collected {
+            uint32_t thread;
+            Event event;
+        };
+
+        std::chrono::steady_clock::time_point origin;
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadLog>> threads;
+        std::vector<Collected> collected;
+        BlockStats blockStats;
+        uint32_t registered;
+        std::atomic<uint64_t> unregisteredRecords;
+
+        Profiler() : origin(std::chrono::steady_clock::now()), registered(0), unregisteredRecords(0) {}
+
+    public:
+        static Profiler& instance() {
+            static Profiler profiler;
+            return profiler;
+        }
+
+        /// <summary> Nanoseconds since the profiler started. </summary>
+        uint64_t now() const {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+        }
+
+        /// <summary>
+        /// Gives the calling thread a log to record into, one a finished thread left behind if there is one.
+        /// Locks and may allocate, so call it where a thread starts and not from real-time code.
+        /// </summary>
+        void registerThread() {
+            if (current() != nullptr) return;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            ThreadLog* log = nullptr;
+            for (const auto& candidate : threads) {
+                if (candidate->free) {
+                    log = candidate.get();
+                    break;
+                }
+            }
+
+            if (log != nullptr) {
+                // Keep what the last owner left under its own id
+                collect(*log);
+                log->id = ++registered;
+                log->free = false;
+            }
+            else {
+                threads.push_back(std::unique_ptr<ThreadLog>(new ThreadLog(++registered)));
+                log = threads.back().get();
+            }
+
+            thread_local Registration registration;
+            registration.log = log;
+            current() = log;
+        }
+
+        /// <summary> Adds a finished scope to the calling thread's ring. </summary>
+        void record(const char* name, uint64_t start, uint64_t end) {
+            ThreadLog* log = current();
+            if (log == nullptr) {
+                unregisteredRecords.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (!log->ring.push(Event{ name, start, end - start, false }))
+                log->dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void instant(const char* name) {
+            ThreadLog* log = current();
+            if (log == nullptr) {
+                unregisteredRecords.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (!log->ring.push(Event{ name, now(), 0, true }))
+                log->dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /// <summary> Adds one block's render time to the histogram. </summary>
+        void recordBlock(uint64_t durationNs, uint64_t deadlineNs) {
+            blockStats.blocks.fetch_add(1, std::memory_order_relaxed);
+            blockStats.totalNs.fetch_add(durationNs, std::memory_order_relaxed);
+            if (durationNs > deadlineNs) blockStats.deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+            if (durationNs > blockStats.maxNs.load(std::memory_order_relaxed)) blockStats.maxNs.store(durationNs, std::memory_order_relaxed);
+
+            size_t bucket = 0;
+            for (uint64_t us = durationNs / 1000; us != 0 && bucket + 1 < HistogramBuckets; us >>= 1) bucket++;
+            blockStats.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        const BlockStats& blocks() const { return blockStats; }
+
+        /// <summary> Events lost to full rings, drain more often if this is not zero. </summary>
+        uint64_t dropped() {
+            std::lock_guard<std::mutex> lock(mutex);
+            uint64_t total = 0;
+            for (const auto& log : threads) total += log->dropped.load();
+            return total;
+        }
+
+        /// <summary> Events thrown away because their thread never called registerThread. </summary>
+        uint64_t unregistered() const { return unregisteredRecords.load(std::memory_order_relaxed); }
+
+        /// <summary> Logs ever allocated, threads that exited leave theirs to be reused. </summary>
+        size_t logs() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return threads.size();
+        }
+
+        /// <summary> Moves every recorded event out of the rings. Only one thread may drain at a time. </summary>
+        /// <returns> The amount of events moved. </returns>
+        size_t drain() {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t moved = 0;
+            for (const auto& log : threads) moved += collect(*log);
+            return moved;
+        }
+
+        /// <summary> Forgets every drained event. </summary>
+        void clear() {
+            std::lock_guard<std::mutex> lock(mutex);
+            collected.clear();
+        }
+
+        /// <summary> Drains and writes every event as Chrome trace JSON, for chrome://tracing or Perfetto. </summary>
+        void writeChromeTrace(std::ostream& out) {
+            drain();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            out << "{\"traceEvents\":[";
+            for (size_t i = 0; i < collected.size(); i++)
+            {
+                const Collected& c = collected[i];
+                out << (i ? ",\n" : "\n") << "{\"name\":\"" << c.event.name << "\",\"pid\":1,\"tid\":" << c.thread
+                    << ",\"ts\":" << c.event.start / 1000 << "." << (c.event.start % 1000) / 100;
+
+                if (c.event.instant) out << ",\"ph\":\"i\",\"s\":\"t\"}";
+                else out << ",\"ph\":\"X\",\"dur\":" << c.event.duration / 1000 << "." << (c.event.duration % 1000) / 100 << "}";
+            }
+            out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+        }
+
+        /// <summary> Records the time from construction to destruction. </summary>
+        struct Scope {
+            const char* name;
+            uint64_t start;
+
+            Scope(const char* name_) : name(name_), start(instance().now()) {}
+            ~Scope() { instance().record(name, start, instance().now()); }
+        };
+
+        /// <summary> A Scope that is also one audio block, checked against its deadline. </summary>
+        struct BlockScope {
+            const char* name;
+            uint64_t start;
+            uint64_t deadline;
+
+            BlockScope(const char* name_, uint64_t deadlineNs) : name(name_), start(instance().now()), deadline(deadlineNs) {}
+            ~BlockScope() {
+                uint64_t end = instance().now();
+                instance().record(name, start, end);
+                instance().recordBlock(end - start, deadline);
+            }
+        };
+
+    private:
+        /// <summary> The calling thread's log, null until it registers. A plain pointer, so reading it never allocates. </summary>
+        static ThreadLog*& current() {
+            thread_local ThreadLog* log = nullptr;
+            return log;
+        }
+
+        void release(ThreadLog& log) {
+            std::lock_guard<std::mutex> lock(mutex);
+            log.free = true;
+        }
+
+        /// <summary> Moves one log's events into collected, the mutex is held. </summary>
+        size_t collect(ThreadLog& log) {
+            size_t moved = 0;
+            Event event;
+            while (log.ring.pop(event)) {
+                collected.push_back(Collected{ log.id, event });
+                moved++;
+            }
+            return moved;
+        }
+    };
+}
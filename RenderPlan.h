@@ -0,0 +1,459 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "EffectBase.h"
+#include "Mixer.h"
+#include "RingBuffer.h"
+#include "Simd.h"
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// A compiled graph: a Mixer with every source, bus, send and insert in place, and buffers allocated.
+    /// Its topology never changes once built, only the audio thread runs it, and it keeps every node it
+    /// plays alive so a node removed from the graph is destroyed with the plan, off the audio thread.
+    /// </summary>
+    class RenderPlan {
+        friend class RenderGraph;
+
+        Mixer mixer;
+        std::vector<std::shared_ptr<Effect::Abstract>> nodes;
+        std::vector<std::shared_ptr<Effect::BusInsert>> inserts;
+        std::vector<uint32_t> busIds;       // By bus index
+        std::vector<uint32_t> departing;    // Channels of removed sources, fading out over the first block
+        size_t maxFrames;
+        uint64_t generation;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        RenderPlan(size_t maxChannels, size_t maxBuses, size_t maxFrames_)
+            : mixer(maxChannels, maxBuses, maxFrames_), nodes(), inserts(), busIds(), departing(), maxFrames(maxFrames_), generation(0)
+        {
+            nodes.reserve(maxChannels);
+            busIds.reserve(maxBuses);
+        }
+
+        RenderPlan(const RenderPlan&) = delete;
+        RenderPlan& operator=(const RenderPlan&) = delete;
+
+        /// <summary> Counts up with every compile, so the audio thread can tell a new plan arrived. </summary>
+        uint64_t getGeneration() const { return generation; }
+
+        /// <summary> The compiled mixer, ie. for its left and right master samples after process. Audio thread only. </summary>
+        Mixer& getMixer() { return mixer; }
+
+        /// <summary> The Mixer index of a RenderGraph bus, or -1 if the plan does not have it. </summary>
+        int busIndex(uint32_t id) const {
+            for (size_t index = 0; index < busIds.size(); index++)
+                if (busIds[index] == id) return (int)index;
+            return -1;
+        }
+
+        /// <summary> Mixes one block, no larger than the graph's maxFrames. Audio thread only. </summary>
+        void process(size_t frames) {
+            mixer.process(frames);
+
+            // Removed sources have ramped to silence, stop rendering them
+            for (uint32_t channel : departing) {
+                mixer.getChannel(channel).source = nullptr;
+                Simd::fill(mixer.channelInput(channel), 0, maxFrames);
+            }
+            departing.clear();
+        }
+    };
+
+    /// <summary>
+    /// Hands compiled plans from one control thread to the audio thread, read-copy-update style.
+    /// The audio thread takes a new plan with a single exchange at a block boundary and hands the one it
+    /// replaced back through a ring, the control thread deletes it on its next publish or collect.
+    /// Neither side ever waits on the other, and the audio side never allocates or frees.
+    /// </summary>
+    class PlanExchange {
+    private:
+        alignas(64) std::atomic<RenderPlan*> pending;     // Published, not yet taken
+        alignas(64) RenderPlan* current;                  // Owned by the audio thread
+        SpscRingBuffer<RenderPlan*> retired;            // Audio to control, waiting to be deleted
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="retireCapacity"> Replaced plans held until collected. When full the audio thread keeps its plan a little longer. </param>
+        PlanExchange(size_t retireCapacity = 16)
+            : pending(nullptr), current(nullptr), retired(retireCapacity, nullptr) {}
+
+        PlanExchange(const PlanExchange&) = delete;
+        PlanExchange& operator=(const PlanExchange&) = delete;
+
+        /// <summary> Neither thread may be using the exchange. </summary>
+        ~PlanExchange() {
+            collect();
+            delete pending.load();
+            delete current;
+        }
+
+        /// <summary>
+        /// Makes a plan the next one the audio thread takes. A plan published before it but never taken is deleted,
+        /// RenderGraph::publish withdraws it first so the new plan starts from what the audio thread really played.
+        /// Control thread only.
+        /// </summary>
+        void publish(std::unique_ptr<RenderPlan> plan) {
+            collect();
+            delete pending.exchange(plan.release(), std::memory_order_acq_rel);
+        }
+
+        /// <summary> Takes back the published plan if the audio thread has not taken it yet, it never will now. Control thread only. </summary>
+        /// <returns> Null if there was none, or it was taken. </returns>
+        std::unique_ptr<RenderPlan> withdraw() {
+            return std::unique_ptr<RenderPlan>(pending.exchange(nullptr, std::memory_order_acq_rel));
+        }
+
+        /// <summary> Deletes the plans the audio thread has finished with. Control thread only. </summary>
+        /// <returns> How many were deleted. </returns>
+        size_t collect() {
+            size_t deleted = 0;
+            RenderPlan* plan = nullptr;
+            while (retired.pop(plan)) {
+                delete plan;
+                deleted++;
+            }
+            return deleted;
+        }
+
+        /// <summary> The plan to render this block with, the newest published one. Once per block, audio thread only. </summary>
+        /// <returns> Null until the first plan is published. </returns>
+        RenderPlan* acquire() {
+            if (pending.load(std::memory_order_relaxed) == nullptr) return current;
+
+            // The old plan has to go somewhere the control thread can free it
+            RenderPlan** slot = nullptr;
+            if (current != nullptr) {
+                slot = retired.acquireWrite();
+                if (slot == nullptr) return current;
+            }
+
+            RenderPlan* next = pending.exchange(nullptr, std::memory_order_acq_rel);
+            if (next == nullptr) return current;
+            if (slot != nullptr) {
+                *slot = current;
+                retired.commitWrite();
+            }
+            current = next;
+            return current;
+        }
+    };
+
+    /// <summary>
+    /// The editable description of what plays, owned by the control thread.
+    /// Sources and buses are named by ids that stay the same across edits. Nothing here is seen by the
+    /// audio thread until compile turns it into a RenderPlan, so edits can be made at any time and in any
+    /// number before publishing. Gains carry over between plans, so a changed gain ramps over the first
+    /// block of the new plan, an added source fades in and a removed one fades out.
+    /// </summary>
+    class RenderGraph {
+    public:
+        /// <summary> The id of the master bus, which cannot be removed. </summary>
+        static constexpr uint32_t Master = 0;
+
+        /// <summary> The gains a plan ends its first block on. </summary>
+        struct Ramp {
+            bool published;     // False until a plan has played it
+            float left;
+            float right;
+        };
+
+        struct Send {
+            uint32_t bus;
+            float level;
+            float publishedLevel;
+            float previousLevel;
+        };
+
+        struct Source {
+            std::shared_ptr<Effect::Abstract> node;
+            uint32_t bus;
+            float gain;
+            float pan;
+            bool muted;
+            std::vector<Send> sends;
+
+            // The last compiled plan ramps from previous to published, compiled is its generation
+            Ramp published;
+            Ramp previous;
+            uint64_t compiled;
+        };
+
+        struct Bus {
+            uint32_t output;
+            float gain;
+            float balance;
+            bool muted;
+            std::shared_ptr<Effect::BusInsert> insert;
+
+            Ramp published;
+            Ramp previous;
+            uint64_t compiled;
+        };
+
+    private:
+        size_t maxFrames;
+        std::map<uint32_t, Source> sources;
+        std::map<uint32_t, Bus> buses;
+        std::vector<Source> removed;    // Since the last compile, faded out by the next plan
+        std::vector<Source> fading;     // Faded out by the last compiled plan
+        uint32_t nextId;
+        uint64_t generation;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="maxFrames_"> The largest block the plans will be processed with. </param>
+        RenderGraph(size_t maxFrames_)
+            : maxFrames(maxFrames_), sources(), buses(), removed(), fading(), nextId(Master + 1), generation(0)
+        {
+            buses[Master] = Bus{ Master, 1, 0, false, nullptr, Ramp(), Ramp(), 0 };
+        }
+
+        size_t sourceCount() const { return sources.size(); }
+        size_t busCount() const { return buses.size(); }
+        bool hasSource(uint32_t id) const { return sources.count(id) != 0; }
+        bool hasBus(uint32_t id) const { return buses.count(id) != 0; }
+
+        /// <summary> Adds a source, rendered into a mono channel of its bus. </summary>
+        /// <param name="node"> Shared with every plan that plays it, the last one to go destroys it. </param>
+        /// <returns> The id of the source, or -1 if the bus does not exist. </returns>
+        int addSource(std::shared_ptr<Effect::Abstract> node, uint32_t bus = Master) {
+            if (node == nullptr || !hasBus(bus)) return -1;
+            uint32_t id = nextId++;
+            sources[id] = Source{ std::move(node), bus, 1, 0, false, {}, Ramp(), Ramp(), 0 };
+            return (int)id;
+        }
+
+        /// <summary> Removes a source, it fades out over the first block of the next plan. </summary>
+        bool removeSource(uint32_t id) {
+            auto found = sources.find(id);
+            if (found == sources.end()) return false;
+            if (found->second.published.published) removed.push_back(std::move(found->second));
+            sources.erase(found);
+            return true;
+        }
+
+        /// <summary> Adds a stereo submix bus. </summary>
+        /// <returns> The id of the bus, or -1 if the output does not exist. </returns>
+        int addBus(uint32_t output = Master) {
+            if (!hasBus(output)) return -1;
+            uint32_t id = nextId++;
+            buses[id] = Bus{ output, 1, 0, false, nullptr, Ramp(), Ramp(), 0 };
+            return (int)id;
+        }
+
+        /// <summary> Removes a bus, everything that went into it goes into its output instead. </summary>
+        bool removeBus(uint32_t id) {
+            auto found = buses.find(id);
+            if (id == Master || found == buses.end()) return false;
+            uint32_t output = found->second.output;
+
+            for (auto& entry : sources) {
+                Source& source = entry.second;
+                if (source.bus == id) source.bus = output;
+                source.sends.erase(std::remove_if(source.sends.begin(), source.sends.end(), [id](const Send& send) { return send.bus == id; }), source.sends.end());
+            }
+            for (auto& entry : buses)
+                if (entry.second.output == id) entry.second.output = output;
+            buses.erase(found);
+            return true;
+        }
+
+        /// <summary> Moves a source to another bus. </summary>
+        bool route(uint32_t source, uint32_t bus) {
+            if (!hasSource(source) || !hasBus(bus)) return false;
+            sources[source].bus = bus;
+            return true;
+        }
+
+        /// <summary> Moves a bus into another. </summary>
+        /// <returns> False if either does not exist, or the bus would end up feeding itself. </returns>
+        bool routeBus(uint32_t bus, uint32_t output) {
+            if (bus == Master || !hasBus(bus) || !hasBus(output)) return false;
+            for (uint32_t above = output; above != Master; above = buses[above].output)
+                if (above == bus) return false;
+            buses[bus].output = output;
+            return true;
+        }
+
+        bool setGain(uint32_t source, float gain) { return edit(source, [gain](Source& s) { s.gain = gain; }); }
+        bool setPan(uint32_t source, float pan) { return edit(source, [pan](Source& s) { s.pan = pan; }); }
+        bool setMuted(uint32_t source, bool muted) { return edit(source, [muted](Source& s) { s.muted = muted; }); }
+
+        /// <summary> Adds, updates or with a level of 0 removes a send from a source to a bus. </summary>
+        /// <returns> False if either does not exist, or the source has Mixer::MaxSends already. </returns>
+        bool setSend(uint32_t source, uint32_t bus, float level) {
+            if (!hasSource(source) || !hasBus(bus)) return false;
+            std::vector<Send>& sends = sources[source].sends;
+            for (size_t i = 0; i < sends.size(); i++) {
+                if (sends[i].bus != bus) continue;
+                if (level == 0) sends.erase(sends.begin() + i);
+                else sends[i].level = level;
+                return true;
+            }
+            if (level == 0) return true;
+            if (sends.size() == Mixer::MaxSends) return false;
+            sends.push_back(Send{ bus, level, 0, 0 });
+            return true;
+        }
+
+        bool setBusGain(uint32_t bus, float gain) { return editBus(bus, [gain](Bus& b) { b.gain = gain; }); }
+        bool setBalance(uint32_t bus, float balance) { return editBus(bus, [balance](Bus& b) { b.balance = balance; }); }
+        bool setBusMuted(uint32_t bus, bool muted) { return editBus(bus, [muted](Bus& b) { b.muted = muted; }); }
+
+        /// <summary> Sets the insert of a bus, shared with every plan using it so its state carries over. Null removes it. </summary>
+        bool setInsert(uint32_t bus, std::shared_ptr<Effect::BusInsert> insert) {
+            return editBus(bus, [&insert](Bus& b) { b.insert = std::move(insert); });
+        }
+
+        /// <summary>
+        /// Builds a plan of the graph as it is now. Allocates, so it belongs on the control thread.
+        /// The gains it starts from are the ones the previous compile ended on, so every compiled plan has
+        /// to be played; publish takes care of one that is replaced before the audio thread took it.
+        /// </summary>
+        std::unique_ptr<RenderPlan> compile() {
+            // Every bus after the one it feeds, as the Mixer wants them
+            std::vector<uint32_t> order(1, Master);
+            for (size_t i = 0; i < order.size(); i++)
+                for (const auto& entry : buses)
+                    if (entry.first != Master && entry.second.output == order[i]) order.push_back(entry.first);
+
+            std::map<uint32_t, uint32_t> index;
+            for (uint32_t i = 0; i < order.size(); i++) index[order[i]] = i;
+
+            std::unique_ptr<RenderPlan> plan(new RenderPlan(sources.size() + removed.size(), order.size(), maxFrames));
+            Mixer& mixer = plan->mixer;
+            plan->busIds = order;
+            plan->generation = ++generation;
+
+            for (uint32_t i = 0; i < order.size(); i++)
+            {
+                Bus& bus = buses[order[i]];
+                if (i != Master) mixer.addBus(index[bus.output]);
+                mixer.setBusGain(i, bus.gain);
+                mixer.setBalance(i, bus.balance);
+                mixer.setBusMuted(i, bus.muted);
+                mixer.setInsert(i, bus.insert.get());
+                if (bus.insert != nullptr) plan->inserts.push_back(bus.insert);
+
+                Mixer::Bus& compiled = mixer.getBus(i);
+                float targetLeft = bus.muted ? 0.0f : bus.gain * compiled.balanceLeft;
+                float targetRight = bus.muted ? 0.0f : bus.gain * compiled.balanceRight;
+                compiled.currentLeft = bus.published.published ? bus.published.left : targetLeft;
+                compiled.currentRight = bus.published.published ? bus.published.right : targetRight;
+                compiled.primed = true;
+                bus.previous = bus.published;
+                bus.published = Ramp{ true, targetLeft, targetRight };
+                bus.compiled = generation;
+            }
+
+            for (auto& entry : sources)
+            {
+                Source& source = entry.second;
+                uint32_t channel = (uint32_t)mixer.addChannel(source.node.get(), index[source.bus]);
+                mixer.setGain(channel, source.gain);
+                mixer.setPan(channel, source.pan);
+                mixer.setMuted(channel, source.muted);
+                for (const Send& send : source.sends) mixer.setSend(channel, index[send.bus], send.level);
+                plan->nodes.push_back(source.node);
+
+                // New sources fade in from silence, the rest ramp from where the last plan left them
+                Mixer::Channel& compiled = mixer.getChannel(channel);
+                float fader = source.muted ? 0.0f : source.gain;
+                float targetLeft = fader * compiled.panLeft;
+                float targetRight = fader * compiled.panRight;
+                compiled.currentLeft = source.published.published ? source.published.left : 0.0f;
+                compiled.currentRight = source.published.published ? source.published.right : 0.0f;
+                compiled.primed = true;
+                for (uint32_t i = 0; i < compiled.sendCount; i++) {
+                    Send& send = source.sends[i];
+                    compiled.sends[i].currentLeft = compiled.currentLeft * (source.published.published ? send.publishedLevel : 0.0f);
+                    compiled.sends[i].currentRight = compiled.currentRight * (source.published.published ? send.publishedLevel : 0.0f);
+                    send.previousLevel = send.publishedLevel;
+                    send.publishedLevel = send.level;
+                }
+                source.previous = source.published;
+                source.published = Ramp{ true, targetLeft, targetRight };
+                source.compiled = generation;
+            }
+
+            // Removed sources play one more block, muted so they ramp down to nothing
+            for (Source& source : removed)
+            {
+                bool stillPlaying = false;
+                for (const auto& entry : sources) stillPlaying = stillPlaying || entry.second.node == source.node;
+                if (stillPlaying) continue;
+
+                auto bus = index.find(source.bus);
+                uint32_t channel = (uint32_t)mixer.addChannel(source.node.get(), bus != index.end() ? bus->second : (uint32_t)Master);
+                mixer.setMuted(channel, true);
+                Mixer::Channel& compiled = mixer.getChannel(channel);
+                compiled.currentLeft = source.published.left;
+                compiled.currentRight = source.published.right;
+                compiled.primed = true;
+                plan->nodes.push_back(source.node);
+                plan->departing.push_back(channel);
+            }
+            fading = std::move(removed);
+            removed.clear();
+
+            return plan;
+        }
+
+        /// <summary>
+        /// Compiles and publishes in one go, freeing whatever plans the audio thread is done with.
+        /// If the last plan was never taken it is withdrawn and undone first, so the new one ramps from the
+        /// gains the audio thread is really on and still fades in and out what that plan would have.
+        /// The graph must be the only one publishing to the exchange.
+        /// </summary>
+        void publish(PlanExchange& exchange) {
+            if (exchange.withdraw() != nullptr) rollback();
+            exchange.publish(compile());
+        }
+
+    private:
+        /// <summary> Puts back the gains and removals from before the last compile, its plan was never played. </summary>
+        void rollback() {
+            for (auto& entry : sources) undo(entry.second);
+            for (auto& entry : buses)
+                if (entry.second.compiled == generation) entry.second.published = entry.second.previous;
+
+            // Removed since, undone the same way, and dropped if they were never heard at all
+            for (Source& source : removed) undo(source);
+            removed.erase(std::remove_if(removed.begin(), removed.end(), [](const Source& source) { return !source.published.published; }), removed.end());
+
+            for (Source& source : fading) removed.push_back(std::move(source));
+            fading.clear();
+        }
+
+        void undo(Source& source) {
+            if (source.compiled != generation) return;
+            source.published = source.previous;
+            for (Send& send : source.sends) send.publishedLevel = send.previousLevel;
+        }
+
+        template<typename Edit>
+        bool edit(uint32_t id, Edit change) {
+            auto found = sources.find(id);
+            if (found == sources.end()) return false;
+            change(found->second);
+            return true;
+        }
+
+        template<typename Edit>
+        bool editBus(uint32_t id, Edit change) {
+            auto found = buses.find(id);
+            if (found == buses.end()) return false;
+            change(found->second);
+            return true;
+        }
+    };
+}
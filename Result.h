@@ -5,5 +5,7 @@ enum Result {
 	CannotOpenFile,
 	BadFormatting,
 	ProblemReadingData,
-	UnknownError
+	UnsupportedVersion,
+	UnknownError,
+	NotSupported
 };
\ No newline at end of file
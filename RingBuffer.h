@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// A lock-free ring for exactly one producer thread and one consumer thread.
+    /// Slots are allocated once and reused, so a slot can be filled in place
+    /// through acquireWrite / commitWrite without copying.
+    /// </summary>
+    template<typename T>
+    class SpscRingBuffer {
+    private:
+        std::vector<T> slots;
+        size_t mask;
+
+        // Kept on their own cache lines so the two threads do not fight over them
+        alignas(64) std::atomic<size_t> head;   // Next slot to read, owned by the consumer
+        alignas(64) std::atomic<size_t> tail;   // Next slot to write, owned by the producer
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="capacity"> Rounded up to a power of two. </param>
+        /// <param name="prototype"> Every slot starts as a copy of this, ie. a preallocated block. </param>
+        SpscRingBuffer(size_t capacity, const T& prototype = T())
+            : slots(), mask(0), head(0), tail(0)
+        {
+            size_t size = 1;
+            while (size < capacity) size <<= 1;
+            slots.assign(size, prototype);
+            mask = size - 1;
+        }
+
+        size_t capacity() const { return slots.size(); }
+
+        /// <summary> Roughly how many slots are filled, exact on either owning thread. </summary>
+        size_t size() const {
+            return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+        }
+
+        bool empty() const { return size() == 0; }
+
+        /// <summary> The next slot to fill, or null if the ring is full. Producer only. </summary>
+        T* acquireWrite() {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == slots.size()) return nullptr;
+            return &slots[t & mask];
+        }
+
+        /// <summary> Publishes the slot returned by acquireWrite. Producer only. </summary>
+        void commitWrite() {
+            tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /// <summary> The oldest filled slot, or null if the ring is empty. Consumer only. </summary>
+        T* acquireRead() {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)) return nullptr;
+            return &slots[h & mask];
+        }
+
+        /// <summary> Hands the slot returned by acquireRead back to the producer. Consumer only. </summary>
+        void commitRead() {
+            head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /// <summary> Copies a value in. Returns false if the ring is full. </summary>
+        bool push(const T& value) {
+            T* slot = acquireWrite();
+            if (slot == nullptr) return false;
+            *slot = value;
+            commitWrite();
+            return true;
+        }
+
+        /// <summary> Copies the oldest value out. Returns false if the ring is empty. </summary>
+        bool pop(T& value) {
+            T* slot = acquireRead();
+            if (slot == nullptr) return false;
+            value = *slot;
+            commitRead();
+            return true;
+        }
+    };
+
+    /// <summary>
+    /// A bounded lock-free queue any number of producer threads can push into and one consumer thread drains.
+    /// Every cell carries a sequence number telling whose turn it is, so producers only contend on the
+    /// tail index and never wait on each other or on the consumer. Nothing is allocated after construction.
+    /// </summary>
+    template<typename T>
+    class MpscRingBuffer {
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        std::unique_ptr<Cell[]> cells;
+        size_t mask;
+
+        alignas(64) std::atomic<size_t> tail;   // Next cell to claim, shared by the producers
+        alignas(64) size_t head;                // Next cell to read, owned by the consumer
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="capacity"> Rounded up to a power of two. </param>
+        MpscRingBuffer(size_t capacity)
+            : cells(), mask(0), tail(0), head(0)
+        {
+            size_t size = 2;
+            while (size < capacity) size <<= 1;
+            cells.reset(new Cell[size]);
+            for (size_t i = 0; i < size; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+            mask = size - 1;
+        }
+
+        MpscRingBuffer(const MpscRingBuffer&) = delete;
+        MpscRingBuffer& operator=(const MpscRingBuffer&) = delete;
+
+        size_t capacity() const { return mask + 1; }
+
+        /// <summary> Copies a value in. Returns false if the queue is full. Any thread. </summary>
+        bool push(const T& value) {
+            size_t position = tail.load(std::memory_order_relaxed);
+            for (;;) {
+                Cell& cell = cells[position & mask];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                std::ptrdiff_t turn = (std::ptrdiff_t)(sequence - position);
+                if (turn == 0) {
+                    if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        cell.value = value;
+                        cell.sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (turn < 0) return false;
+                else position = tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        /// <summary> Copies count values in next to each other, all of them or none. Returns false if they do not fit. Any thread. </summary>
+        bool push(const T* values, size_t count) {
+            if (count == 0) return true;
+            if (count > capacity()) return false;
+            size_t position = tail.load(std::memory_order_relaxed);
+            for (;;) {
+                // The consumer frees cells in order, so the last one being free means all of them are
+                size_t sequence = cells[position & mask].sequence.load(std::memory_order_acquire);
+                size_t last = cells[(position + count - 1) & mask].sequence.load(std::memory_order_acquire);
+                std::ptrdiff_t turn = (std::ptrdiff_t)(sequence - position);
+                if (turn == 0 && last == position + count - 1) {
+                    if (tail.compare_exchange_weak(position, position + count, std::memory_order_relaxed)) {
+                        for (size_t i = 0; i < count; i++) {
+                            Cell& cell = cells[(position + i) & mask];
+                            cell.value = values[i];
+                            cell.sequence.store(position + i + 1, std::memory_order_release);
+                        }
+                        return true;
+                    }
+                }
+                else if (turn <= 0) return false;
+                else position = tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        /// <summary> Copies the oldest value out. Returns false if the queue is empty, or its next value is still being written. Consumer only. </summary>
+        bool pop(T& value) {
+            Cell& cell = cells[head & mask];
+            if (cell.sequence.load(std::memory_order_acquire) != head + 1) return false;
+            value = cell.value;
+            cell.sequence.store(head + mask + 1, std::memory_order_release);
+            head++;
+            return true;
+        }
+    };
+}
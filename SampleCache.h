@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AudioLoaderWav.h"
+#include "Result.h"
+
+namespace DynamicAudio {
+
+    /// <summary> A loaded WAV file that owns its samples. Handed out as immutable, shared between every stream playing it. </summary>
+    struct Sample {
+        std::string key;
+        AudioLoaderWav::Wav wav;        // data.data points into bytes
+        std::vector<uint8_t> bytes;
+
+        Sample() : key(), wav(), bytes() {}
+        Sample(const Sample&) = delete;
+        Sample& operator=(const Sample&) = delete;
+
+        /// <summary> Memory charged against the cache budget. </summary>
+        size_t byteSize() const { return bytes.size() + sizeof(Sample); }
+
+        /// <summary> Loads a WAV file into a new sample. </summary>
+        static Result load(const std::string& filepath, std::shared_ptr<Sample>& sample) {
+            struct Owner {
+                std::vector<uint8_t>& bytes;
+                void* allocate(size_t size, size_t) { bytes.resize(size); return bytes.data(); }
+            };
+
+            std::shared_ptr<Sample> loaded = std::make_shared<Sample>();
+            Owner owner{ loaded->bytes };
+            Result result = AudioLoaderWav::loadRawFile(filepath, loaded->wav, owner);
+            if (result != Success) return result;
+
+            loaded->key = filepath;
+            sample = loaded;
+            return Success;
+        }
+    };
+
+    /// <summary>
+    /// Loads every sample once and shares it, keeping what is resident under a memory budget.
+    /// When the budget is exceeded the least recently used samples are evicted, skipping any
+    /// still held outside the cache. Safe to use from several threads.
+    /// </summary>
+    class SampleCache {
+    public:
+        struct Stats {
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t evictions;
+            uint64_t failures;      // Loads that returned an error
+            size_t residentBytes;
+            size_t entries;
+        };
+
+    private:
+        struct Entry {
+            std::string key;
+            std::shared_ptr<const Sample> sample;
+            size_t bytes;
+        };
+
+        mutable std::mutex mutex;
+        size_t budget;
+        std::list<Entry> recent;    // Most recently used at the front
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        Stats counters;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="budgetBytes"> How much sample memory may stay resident while nothing uses it. </param>
+        SampleCache(size_t budgetBytes = 256 * 1024 * 1024)
+            : budget(budgetBytes), recent(), index(), counters() {}
+
+        /// <summary> Gets a sample by path, loading it on a miss. </summary>
+        /// <param name="result"> Set to why loading failed, if given. </param>
+        /// <returns> The shared sample, or null if it could not be loaded. </returns>
+        std::shared_ptr<const Sample> get(const std::string& filepath, Result* result = nullptr) {
+            if (std::shared_ptr<const Sample> hit = find(filepath)) {
+                if (result != nullptr) *result = Success;
+                return hit;
+            }
+
+            // Loading happens outside the lock, so hits on other threads do not wait for the disk
+            std::shared_ptr<Sample> loaded;
+            Result loadResult = Sample::load(filepath, loaded);
+            if (result != nullptr) *result = loadResult;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.misses++;
+            if (loadResult != Success) {
+                counters.failures++;
+                return nullptr;
+            }
+            return insertLocked(filepath, loaded);
+        }
+
+        /// <summary> Adds a sample made elsewhere, ie. decoded or generated, under any key such as a content hash. </summary>
+        /// <returns> The cached sample, which is the existing one if the key was already cached. </returns>
+        std::shared_ptr<const Sample> insert(const std::string& key, std::shared_ptr<Sample> sample) {
+            sample->key = key;
+            std::lock_guard<std::mutex> lock(mutex);
+            return insertLocked(key, sample);
+        }
+
+        /// <summary> Gets a sample only if it is already resident, without counting a miss. </summary>
+        std::shared_ptr<const Sample> find(const std::string& key) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = index.find(key);
+            if (it == index.end()) return nullptr;
+
+            recent.splice(recent.begin(), recent, it->second);
+            counters.hits++;
+            return it->second->sample;
+        }
+
+        bool contains(const std::string& key) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return index.count(key) != 0;
+        }
+
+        /// <summary> Changes the budget, evicting straight away if it shrank. </summary>
+        void setBudget(size_t budgetBytes) {
+            std::lock_guard<std::mutex> lock(mutex);
+            budget = budgetBytes;
+            evictLocked();
+        }
+
+        size_t getBudget() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return budget;
+        }
+
+        /// <summary> Evicts everything not in use. </summary>
+        void clear() {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t kept = budget;
+            budget = 0;
+            evictLocked();
+            budget = kept;
+        }
+
+        /// <summary> Evicts down to the budget again, ie. after streams let go of their samples. </summary>
+        void trim() {
+            std::lock_guard<std::mutex> lock(mutex);
+            evictLocked();
+        }
+
+        Stats stats() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            Stats copy = counters;
+            copy.entries = index.size();
+            return copy;
+        }
+
+    private:
+        std::shared_ptr<const Sample> insertLocked(const std::string& key, std::shared_ptr<const Sample> sample) {
+            // Another thread may have loaded the same key while this one was reading
+            auto it = index.find(key);
+            if (it != index.end()) {
+                recent.splice(recent.begin(), recent, it->second);
+                return it->second->sample;
+            }
+
+            size_t bytes = sample->byteSize();
+            recent.push_front(Entry{ key, sample, bytes });
+            index[key] = recent.begin();
+            counters.residentBytes += bytes;
+
+            evictLocked();
+            return sample;
+        }
+
+        void evictLocked() {
+            auto it = recent.end();
+            while (counters.residentBytes > budget && it != recent.begin())
+            {
+                --it;
+
+                // Held by a stream, so evicting would free nothing
+                if (it->sample.use_count() > 1) continue;
+
+                counters.residentBytes -= it->bytes;
+                counters.evictions++;
+                index.erase(it->key);
+                it = recent.erase(it);
+            }
+        }
+    };
+}
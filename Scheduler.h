@@ -0,0 +1,323 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "Memory.h"
+#include "Profiler.h"
+#include "RingBuffer.h"
+#include "Tune.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// Runs events on the exact sample frame they were scheduled for.
+    /// Any thread schedules into a lock-free queue. Once per block the audio thread moves what has arrived
+    /// into a hierarchical timing wheel, four levels of 256 slots at 1, 256, 65536 and 16777216 frames a
+    /// slot, so scheduling and taking the due events are constant time however many are pending. A block
+    /// is then handed out in pieces split at every event, with the events of each frame in between.
+    /// Wheel nodes come from a pool sized up front, the audio thread never allocates.
+    /// </summary>
+    class Scheduler {
+    public:
+        enum Kind : uint32_t {
+            NoteOn,         // target is the voice, data the note value, value the velocity
+            NoteOff,
+            Trigger,        // Start a sample, target is the voice, value its gain
+            Parameter,      // target is the parameter, value what it is set to
+            User            // And above, for the host's own events
+        };
+
+        struct Event {
+            uint64_t frame;     // Since the scheduler started
+            uint32_t kind;
+            uint32_t target;
+            uint32_t data;
+            float value;
+        };
+
+        /// <summary> Counters, safe to read from any thread. </summary>
+        struct Stats {
+            std::atomic<uint64_t> scheduled;    // Accepted by schedule
+            std::atomic<uint64_t> rejected;     // Turned away by a full queue
+            std::atomic<uint64_t> dropped;      // Lost to a full wheel
+            std::atomic<uint64_t> late;         // Arrived after their frame, run at the start of the block
+            std::atomic<uint64_t> dispatched;
+
+            Stats() : scheduled(0), rejected(0), dropped(0), late(0), dispatched(0) {}
+        };
+
+    private:
+        static constexpr size_t Levels = 4;
+        static constexpr size_t Bits = 8;
+        static constexpr size_t Slots = 1 << Bits;
+        static constexpr uint64_t SlotMask = Slots - 1;
+
+        struct Node {
+            Event event;
+            uint64_t sequence;  // Order of arrival, events of one frame run in it
+            Node* next;
+        };
+
+        struct List {
+            Node* head;
+            Node* tail;
+
+            void append(Node* node) {
+                node->next = nullptr;
+                if (tail != nullptr) tail->next = node;
+                else head = node;
+                tail = node;
+            }
+
+            /// <summary> Files a node after every node that arrived before it. Constant time when it is the newest. </summary>
+            void insert(Node* node) {
+                if (tail == nullptr || tail->sequence < node->sequence) {
+                    append(node);
+                    return;
+                }
+                Node** link = &head;
+                while ((*link)->sequence < node->sequence) link = &(*link)->next;
+                node->next = *link;
+                *link = node;
+            }
+
+            void append(List& other) {
+                if (other.head == nullptr) return;
+                if (tail != nullptr) tail->next = other.head;
+                else head = other.head;
+                tail = other.tail;
+                other.head = other.tail = nullptr;
+            }
+        };
+
+        MpscRingBuffer<Event> incoming;
+        Pool<Node> nodes;
+        List wheel[Levels][Slots];
+        uint64_t occupied[Slots / 64];      // Which level 0 slots hold anything
+        List overflow;                      // Further than the top level reaches
+        List due;                           // Taken for the current block, in frame order
+        uint64_t current;                   // The first frame of the next block
+        uint64_t arrivals;                  // Sequence of the next event drained
+        size_t waiting;
+        Stats counters;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="maxPending"> The most events held in the wheel at once. </param>
+        /// <param name="queueCapacity"> The most events scheduled between two blocks. </param>
+        Scheduler(size_t maxPending = 65536, size_t queueCapacity = 8192)
+            : incoming(queueCapacity), nodes(maxPending), wheel(), occupied(), overflow(), due(), current(0), arrivals(0), waiting(0) {}
+
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+
+        /// <summary> The first frame of the next block. Audio thread only. </summary>
+        uint64_t now() const { return current; }
+
+        /// <summary> Events in the wheel, not counting ones still queued. Audio thread only. </summary>
+        size_t pending() const { return waiting; }
+
+        const Stats& stats() const { return counters; }
+
+        /// <summary> Queues an event. Any thread, never blocks. </summary>
+        /// <returns> False if the queue is full, the audio thread has not caught up. </returns>
+        bool schedule(const Event& event) {
+            if (!incoming.push(event)) {
+                counters.rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            counters.scheduled.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        bool schedule(uint64_t frame, uint32_t kind, uint32_t target, float value = 0, uint32_t data = 0) {
+            return schedule(Event{ frame, kind, target, data, value });
+        }
+
+        /// <summary> Queues events together, all of them or none, ie. a NoteOn with its NoteOff. Any thread, never blocks. </summary>
+        /// <returns> False if the queue has no room for all of them. </returns>
+        bool schedule(const Event* events, size_t count) {
+            if (!incoming.push(events, count)) {
+                counters.rejected.fetch_add(count, std::memory_order_relaxed);
+                return false;
+            }
+            counters.scheduled.fetch_add(count, std::memory_order_relaxed);
+            return true;
+        }
+
+        /// <summary>
+        /// Schedules a NoteOn and a NoteOff for every note of a tune, rests left out, each pair queued together.
+        /// The timeline is read on the calling thread, so the tune must not be edited meanwhile.
+        /// </summary>
+        /// <param name="start"> The frame the tune starts on. </param>
+        /// <param name="voice"> The target of every event. </param>
+        /// <param name="from"> The first note to schedule, counting every note of every chord in order, rests too. </param>
+        /// <returns> The note to carry on from once the queue has room, the tune's note count when all of it was queued. </returns>
+        size_t scheduleTune(const Tune& tune, uint32_t sampleRate, uint64_t start, uint32_t voice, float velocity = 1, size_t from = 0) {
+            const Timeline& timeline = tune.timeline(sampleRate);
+            size_t index = 0;
+            for (size_t chord = 0; chord < timeline.size(); chord++)
+            {
+                const std::vector<Note>& notes = tune.chords[chord].allNotes();
+                if (index + notes.size() <= from) {
+                    index += notes.size();
+                    continue;
+                }
+
+                const uint64_t* ends = timeline.noteEndFrames(chord);
+                for (size_t n = 0; n < notes.size(); n++, index++) {
+                    if (index < from || notes[n].value == Note::Value::null) continue;
+                    Event pair[2] = {
+                        Event{ start + timeline.chordStart(chord), NoteOn, voice, notes[n].value, velocity },
+                        Event{ start + ends[n], NoteOff, voice, notes[n].value, 0 }
+                    };
+                    if (!schedule(pair, 2)) return index;
+                }
+            }
+            return index;
+        }
+
+        /// <summary>
+        /// Runs one block, split at its events. Audio thread only.
+        /// render(offset, frames) is called for each stretch without events, handle(event, offset) for each
+        /// event before the stretch starting on its offset, events of one frame in the order they arrived.
+        /// </summary>
+        template<typename Render, typename Handle>
+        void process(size_t frames, Render render, Handle handle) {
+            DA_PROFILE_SCOPE("Scheduler::process");
+            uint64_t start = current;
+            drain();
+            advance(frames);
+
+            size_t offset = 0;
+            while (due.head != nullptr)
+            {
+                Node* node = due.head;
+                due.head = node->next;
+
+                size_t at = (size_t)(node->event.frame - start);
+                if (at > offset) {
+                    render(offset, at - offset);
+                    offset = at;
+                }
+                handle(node->event, offset);
+                nodes.destroy(node);
+                waiting--;
+                counters.dispatched.fetch_add(1, std::memory_order_relaxed);
+            }
+            due.tail = nullptr;
+
+            if (offset < frames) render(offset, frames - offset);
+        }
+
+        /// <summary> Runs a block without splitting it, ie. for handlers that take an offset themselves like EnvelopeBank::noteOn. </summary>
+        template<typename Handle>
+        void process(size_t frames, Handle handle) {
+            process(frames, [](size_t, size_t) {}, handle);
+        }
+
+    private:
+        /// <summary> Moves everything scheduled since the last block into the wheel. </summary>
+        void drain() {
+            Event event;
+            while (incoming.pop(event)) {
+                Node* node = nodes.create();
+                if (node == nullptr) {
+                    counters.dropped.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                if (event.frame < current) {
+                    event.frame = current;
+                    counters.late.fetch_add(1, std::memory_order_relaxed);
+                }
+                node->event = event;
+                node->sequence = arrivals++;
+                insert(node);
+                waiting++;
+            }
+        }
+
+        /// <summary>
+        /// Files a node under the coarsest level its frame still differs from the current one on.
+        /// Every slot stays in order of arrival, so a cascaded event still runs before a later one filed directly.
+        /// </summary>
+        void insert(Node* node) {
+            uint64_t frame = node->event.frame;
+            for (size_t level = 0; level < Levels; level++) {
+                size_t shift = Bits * (level + 1);
+                if ((frame >> shift) == (current >> shift)) {
+                    size_t slot = (size_t)((frame >> (Bits * level)) & SlotMask);
+                    wheel[level][slot].insert(node);
+                    if (level == 0) occupied[slot / 64] |= (uint64_t)1 << (slot % 64);
+                    return;
+                }
+            }
+            overflow.insert(node);
+        }
+
+        /// <summary> Takes every event before current + frames into due, and moves current on. </summary>
+        void advance(size_t frames) {
+            uint64_t end = current + frames;
+            while (current < end)
+            {
+                uint64_t windowEnd = std::min<uint64_t>(end, (current | SlotMask) + 1);
+                size_t first = (size_t)(current & SlotMask);
+                size_t last = (size_t)((windowEnd - 1) & SlotMask);
+
+                // Only the occupied level 0 slots, word by word
+                for (size_t word = first / 64; word <= last / 64; word++) {
+                    uint64_t bits = occupied[word];
+                    if (word == first / 64) bits &= ~(uint64_t)0 << (first % 64);
+                    if (word == last / 64 && last % 64 != 63) bits &= ((uint64_t)1 << (last % 64 + 1)) - 1;
+                    while (bits != 0) {
+                        size_t slot = word * 64 + lowestBit(bits);
+                        bits &= bits - 1;
+                        due.append(wheel[0][slot]);
+                        occupied[word] &= ~((uint64_t)1 << (slot % 64));
+                    }
+                }
+
+                current = windowEnd;
+                if ((current & SlotMask) == 0) cascade();
+            }
+        }
+
+        /// <summary> Entering a new level 0 window, brings down whatever the coarser levels hold for it. </summary>
+        void cascade() {
+            size_t level = 1;
+            while (level < Levels && ((current >> (Bits * level)) & SlotMask) == 0) level++;
+
+            // Coarsest first, each refill lands in the levels below before they are emptied in turn
+            if (level == Levels) reinsert(overflow);
+            for (size_t l = std::min(level, Levels - 1); l >= 1; l--)
+                reinsert(wheel[l][(size_t)((current >> (Bits * l)) & SlotMask)]);
+        }
+
+        void reinsert(List& list) {
+            Node* node = list.head;
+            list.head = list.tail = nullptr;
+            while (node != nullptr) {
+                Node* next = node->next;
+                insert(node);
+                node = next;
+            }
+        }
+
+        static size_t lowestBit(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+            return (size_t)__builtin_ctzll(bits);
+#else
+            unsigned long index;
+            _BitScanForward64(&index, bits);
+            return (size_t)index;
+#endif
+        }
+    };
+}
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DYNAMICAUDIO_SSE 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define DYNAMICAUDIO_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace DynamicAudio {
+namespace Simd {
+
+    /// <summary> The amount of floats processed together. </summary>
+    static constexpr size_t Width = 4;
+
+    /// <summary>
+    /// Four floats processed together, SSE2 or NEON when available and plain floats otherwise.
+    /// Comparisons return a mask with every bit of a true lane set, for use with select.
+    /// </summary>
+    struct Float4 {
+#if defined(DYNAMICAUDIO_SSE)
+        __m128 v;
+        Float4() : v(_mm_setzero_ps()) {}
+        Float4(__m128 v_) : v(v_) {}
+        Float4(float value_) : v(_mm_set1_ps(value_)) {}
+        Float4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+
+        static Float4 load(const float* src) { return _mm_loadu_ps(src); }
+        void store(float* dst) const { _mm_storeu_ps(dst, v); }
+
+        friend Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+        friend Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+        friend Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+        friend Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.v, b.v); }
+
+        friend Float4 operator<(Float4 a, Float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+        friend Float4 operator>(Float4 a, Float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+        friend Float4 operator&(Float4 a, Float4 b) { return _mm_and_ps(a.v, b.v); }
+        friend Float4 operator|(Float4 a, Float4 b) { return _mm_or_ps(a.v, b.v); }
+
+        static Float4 min(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+        static Float4 max(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+        static Float4 sqrt(Float4 a) { return _mm_sqrt_ps(a.v); }
+        static Float4 abs(Float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+
+        /// <summary> Lanes of a where the mask is set, lanes of b otherwise. </summary>
+        static Float4 select(Float4 mask, Float4 a, Float4 b) {
+            return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+        }
+#elif defined(DYNAMICAUDIO_NEON)
+        float32x4_t v;
+        Float4() : v(vdupq_n_f32(0)) {}
+        Float4(float32x4_t v_) : v(v_) {}
+        Float4(float value_) : v(vdupq_n_f32(value_)) {}
+        Float4(float a, float b, float c, float d) { float lanes[4] = { a, b, c, d }; v = vld1q_f32(lanes); }
+
+        static Float4 load(const float* src) { return vld1q_f32(src); }
+        void store(float* dst) const { vst1q_f32(dst, v); }
+
+        friend Float4 operator+(Float4 a, Float4 b) { return vaddq_f32(a.v, b.v); }
+        friend Float4 operator-(Float4 a, Float4 b) { return vsubq_f32(a.v, b.v); }
+        friend Float4 operator*(Float4 a, Float4 b) { return vmulq_f32(a.v, b.v); }
+        friend Float4 operator/(Float4 a, Float4 b) {
+            // Two Newton-Raphson steps on the reciprocal estimate
+            float32x4_t r = vrecpeq_f32(b.v);
+            r = vmulq_f32(vrecpsq_f32(b.v, r), r);
+            r = vmulq_f32(vrecpsq_f32(b.v, r), r);
+            return vmulq_f32(a.v, r);
+        }
+
+        friend Float4 operator<(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcltq_f32(a.v, b.v)); }
+        friend Float4 operator>(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcgtq_f32(a.v, b.v)); }
+        friend Float4 operator&(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))); }
+        friend Float4 operator|(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))); }
+
+        static Float4 min(Float4 a, Float4 b) { return vminq_f32(a.v, b.v); }
+        static Float4 max(Float4 a, Float4 b) { return vmaxq_f32(a.v, b.v); }
+        static Float4 sqrt(Float4 a) {
+            float lanes[4]; vst1q_f32(lanes, a.v);
+            for (float& lane : lanes) lane = std::sqrt(lane);
+            return vld1q_f32(lanes);
+        }
+        static Float4 abs(Float4 a) { return vabsq_f32(a.v); }
+
+        /// <summary> Lanes of a where the mask is set, lanes of b otherwise. </summary>
+        static Float4 select(Float4 mask, Float4 a, Float4 b) {
+            return vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v);
+        }
+#else
+        float v[4];
+        Float4() : v{ 0, 0, 0, 0 } {}
+        Float4(float value_) : v{ value_, value_, value_, value_ } {}
+        Float4(float a, float b, float c, float d) : v{ a, b, c, d } {}
+
+        static Float4 load(const float* src) { return Float4(src[0], src[1], src[2], src[3]); }
+        void store(float* dst) const { for (int i = 0; i < 4; i++) dst[i] = v[i]; }
+
+        template<typename Op>
+        static Float4 each(Float4 a, Float4 b, Op op) {
+            Float4 r;
+            for (int i = 0; i < 4; i++) r.v[i] = op(a.v[i], b.v[i]);
+            return r;
+        }
+
+        static float bits(uint32_t mask) { float f; std::memcpy(&f, &mask, sizeof(f)); return f; }
+        static uint32_t bits(float f) { uint32_t mask; std::memcpy(&mask, &f, sizeof(mask)); return mask; }
+
+        friend Float4 operator+(Float4 a, Float4 b) { return each(a, b, [](float x, float y) { return x + y; }); }
+        friend Float4 operator-(Float4 a, Float4 b) { return each(a, b, [](float x, float y) { return x - y; }); }
+        friend Float4 operator*(Float4 a, Float4 b) { return each(a, b, [](float x, float y) { return x * y; }); }
+        friend Float4 operator/(Float4 a, Float4 b) { return each(a, b, [](float x, float y) { return x / y; }); }
+
+        friend Float4 operator<(Float4 a, Float4 b) { return each(a, b, [](float x, float y) { return bits(x < y ? 0xFFFFFFFFu : 0u); }); }
+        friend Float4 operator>(Float4 a, Float4 b) { return each(a, b, [](float x, float y) { return bits(x > y ? 0xFFFFFFFFu : 0u); }); }
+        friend Float4 operator&(Float4 a, Float4 b) { return each(a, b, [](float x, float y) { return bits(bits(x) & bits(y)); }); }
+        friend Float4 operator|(Float4 a, Float4 b) { return each(a, b, [](float x, float y) { return bits(bits(x) | bits(y)); }); }
+
+        static Float4 min(Float4 a, Float4 b) { return each(a, b, [](float x, float y) { return x < y ? x : y; }); }
+        static Float4 max(Float4 a, Float4 b) { return each(a, b, [](float x, float y) { return x > y ? x : y; }); }
+        static Float4 sqrt(Float4 a) { return each(a, a, [](float x, float) { return std::sqrt(x); }); }
+        static Float4 abs(Float4 a) { return each(a, a, [](float x, float) { return std::fabs(x); }); }
+
+        /// <summary> Lanes of a where the mask is set, lanes of b otherwise. </summary>
+        static Float4 select(Float4 mask, Float4 a, Float4 b) {
+            Float4 r;
+            for (int i = 0; i < 4; i++) r.v[i] = bits(mask.v[i]) ? a.v[i] : b.v[i];
+            return r;
+        }
+#endif
+
+        Float4& operator+=(Float4 other) { return *this = *this + other; }
+        Float4& operator*=(Float4 other) { return *this = *this * other; }
+
+        /// <summary> The largest of the four lanes. </summary>
+        float maxLane() const {
+            float lanes[4];
+            store(lanes);
+            float result = lanes[0];
+            for (int i = 1; i < 4; i++) result = lanes[i] > result ? lanes[i] : result;
+            return result;
+        }
+
+        /// <summary> The sum of the four lanes. </summary>
+        float sum() const {
+            float lanes[4];
+            store(lanes);
+            return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        }
+    };
+
+    /// <summary>
+    /// Four 32-bit integers processed together, for bit tricks and conversions alongside Float4.
+    /// Shifts are logical, round converts to the nearest signed integer with ties to even, as lrint.
+    /// </summary>
+    struct Int4 {
+#if defined(DYNAMICAUDIO_SSE)
+        __m128i v;
+        Int4() : v(_mm_setzero_si128()) {}
+        Int4(__m128i v_) : v(v_) {}
+        Int4(uint32_t value_) : v(_mm_set1_epi32((int)value_)) {}
+
+        static Int4 load(const uint32_t* src) { return _mm_loadu_si128((const __m128i*)src); }
+        void store(uint32_t* dst) const { _mm_storeu_si128((__m128i*)dst, v); }
+
+        friend Int4 operator^(Int4 a, Int4 b) { return _mm_xor_si128(a.v, b.v); }
+        friend Int4 operator&(Int4 a, Int4 b) { return _mm_and_si128(a.v, b.v); }
+        friend Int4 operator|(Int4 a, Int4 b) { return _mm_or_si128(a.v, b.v); }
+        Int4 operator<<(int n) const { return _mm_sll_epi32(v, _mm_cvtsi32_si128(n)); }
+        Int4 operator>>(int n) const { return _mm_srl_epi32(v, _mm_cvtsi32_si128(n)); }
+
+        static Int4 round(Float4 a) { return _mm_cvtps_epi32(a.v); }
+        Float4 asFloat() const { return _mm_castsi128_ps(v); }
+
+        /// <summary> Stores the lanes as four signed 16-bit integers, saturating. </summary>
+        void storeInt16(int16_t* dst) const { _mm_storel_epi64((__m128i*)dst, _mm_packs_epi32(v, v)); }
+
+        /// <summary> Stores the lanes of a then b as eight signed 16-bit integers, saturating. </summary>
+        static void storeInt16(int16_t* dst, Int4 a, Int4 b) { _mm_storeu_si128((__m128i*)dst, _mm_packs_epi32(a.v, b.v)); }
+#elif defined(DYNAMICAUDIO_NEON)
+        uint32x4_t v;
+        Int4() : v(vdupq_n_u32(0)) {}
+        Int4(uint32x4_t v_) : v(v_) {}
+        Int4(uint32_t value_) : v(vdupq_n_u32(value_)) {}
+
+        static Int4 load(const uint32_t* src) { return vld1q_u32(src); }
+        void store(uint32_t* dst) const { vst1q_u32(dst, v); }
+
+        friend Int4 operator^(Int4 a, Int4 b) { return veorq_u32(a.v, b.v); }
+        friend Int4 operator&(Int4 a, Int4 b) { return vandq_u32(a.v, b.v); }
+        friend Int4 operator|(Int4 a, Int4 b) { return vorrq_u32(a.v, b.v); }
+        Int4 operator<<(int n) const { return vshlq_u32(v, vdupq_n_s32(n)); }
+        Int4 operator>>(int n) const { return vshlq_u32(v, vdupq_n_s32(-n)); }
+
+        static Int4 round(Float4 a) {
+#if defined(__aarch64__) || defined(_M_ARM64)
+            return vreinterpretq_u32_s32(vcvtnq_s32_f32(a.v));
+#else
+            float lanes[4]; vst1q_f32(lanes, a.v);
+            uint32_t result[4];
+            for (int i = 0; i < 4; i++) result[i] = (uint32_t)(int32_t)std::lrint(lanes[i]);
+            return vld1q_u32(result);
+#endif
+        }
+        Float4 asFloat() const { return vreinterpretq_f32_u32(v); }
+
+        /// <summary> Stores the lanes as four signed 16-bit integers, saturating. </summary>
+        void storeInt16(int16_t* dst) const { vst1_s16(dst, vqmovn_s32(vreinterpretq_s32_u32(v))); }
+
+        /// <summary> Stores the lanes of a then b as eight signed 16-bit integers, saturating. </summary>
+        static void storeInt16(int16_t* dst, Int4 a, Int4 b) {
+            vst1q_s16(dst, vcombine_s16(vqmovn_s32(vreinterpretq_s32_u32(a.v)), vqmovn_s32(vreinterpretq_s32_u32(b.v))));
+        }
+#else
+        uint32_t v[4];
+        Int4() : v{ 0, 0, 0, 0 } {}
+        Int4(uint32_t value_) : v{ value_, value_, value_, value_ } {}
+
+        static Int4 load(const uint32_t* src) { Int4 r; for (int i = 0; i < 4; i++) r.v[i] = src[i]; return r; }
+        void store(uint32_t* dst) const { for (int i = 0; i < 4; i++) dst[i] = v[i]; }
+
+        friend Int4 operator^(Int4 a, Int4 b) { for (int i = 0; i < 4; i++) a.v[i] ^= b.v[i]; return a; }
+        friend Int4 operator&(Int4 a, Int4 b) { for (int i = 0; i < 4; i++) a.v[i] &= b.v[i]; return a; }
+        friend Int4 operator|(Int4 a, Int4 b) { for (int i = 0; i < 4; i++) a.v[i] |= b.v[i]; return a; }
+        Int4 operator<<(int n) const { Int4 r = *this; for (int i = 0; i < 4; i++) r.v[i] <<= n; return r; }
+        Int4 operator>>(int n) const { Int4 r = *this; for (int i = 0; i < 4; i++) r.v[i] >>= n; return r; }
+
+        static Int4 round(Float4 a) { Int4 r; for (int i = 0; i < 4; i++) r.v[i] = (uint32_t)(int32_t)std::lrint(a.v[i]); return r; }
+        Float4 asFloat() const { Float4 r; std::memcpy(r.v, v, sizeof(v)); return r; }
+
+        /// <summary> Stores the lanes as four signed 16-bit integers, saturating. </summary>
+        void storeInt16(int16_t* dst) const {
+            for (int i = 0; i < 4; i++) {
+                int32_t lane = (int32_t)v[i];
+                dst[i] = (int16_t)(lane > 32767 ? 32767 : (lane < -32768 ? -32768 : lane));
+            }
+        }
+
+        /// <summary> Stores the lanes of a then b as eight signed 16-bit integers, saturating. </summary>
+        static void storeInt16(int16_t* dst, Int4 a, Int4 b) { a.storeInt16(dst); b.storeInt16(dst + 4); }
+#endif
+    };
+
+    /// <summary> The amount of frames that can be processed 4 at a time. </summary>
+    inline size_t wide(size_t frames) { return frames & ~(Width - 1); }
+
+    /// <summary> out[i] = value </summary>
+    inline void fill(float* out, float value, size_t frames) {
+        Float4 v(value);
+        size_t i = 0;
+        for (; i < wide(frames); i += Width) v.store(out + i);
+        for (; i < frames; i++) out[i] = value;
+    }
+
+    /// <summary> out[i] = start + step * i </summary>
+    inline void ramp(float* out, float start, float step, size_t frames) {
+        Float4 v = Float4(0, 1, 2, 3) * Float4(step) + Float4(start);
+        Float4 advance(step * Width);
+        size_t i = 0;
+        for (; i < wide(frames); i += Width) { v.store(out + i); v += advance; }
+        for (; i < frames; i++) out[i] = start + step * (float)i;
+    }
+
+    /// <summary> buffer[i] *= gain </summary>
+    inline void scale(float* buffer, float gain, size_t frames) {
+        Float4 g(gain);
+        size_t i = 0;
+        for (; i < wide(frames); i += Width) (Float4::load(buffer + i) * g).store(buffer + i);
+        for (; i < frames; i++) buffer[i] *= gain;
+    }
+
+    /// <summary> buffer[i] *= gain[i] </summary>
+    inline void multiply(float* buffer, const float* gain, size_t frames) {
+        size_t i = 0;
+        for (; i < wide(frames); i += Width) (Float4::load(buffer + i) * Float4::load(gain + i)).store(buffer + i);
+        for (; i < frames; i++) buffer[i] *= gain[i];
+    }
+
+    /// <summary> acc[i] += src[i] </summary>
+    inline void add(float* acc, const float* src, size_t frames) {
+        size_t i = 0;
+        for (; i < wide(frames); i += Width) (Float4::load(acc + i) + Float4::load(src + i)).store(acc + i);
+        for (; i < frames; i++) acc[i] += src[i];
+    }
+
+    /// <summary> acc[i] += src[i] * gain </summary>
+    inline void multiplyAdd(float* acc, const float* src, float gain, size_t frames) {
+        Float4 g(gain);
+        size_t i = 0;
+        for (; i < wide(frames); i += Width) (Float4::load(acc + i) + Float4::load(src + i) * g).store(acc + i);
+        for (; i < frames; i++) acc[i] += src[i] * gain;
+    }
+
+    /// <summary> acc[i] += src[i] * gain, with the gain moving linearly from 'from' towards 'to' across the block. </summary>
+    inline void rampMultiplyAdd(float* acc, const float* src, float from, float to, size_t frames) {
+        if (from == to) { multiplyAdd(acc, src, from, frames); return; }
+
+        float step = (to - from) / (float)frames;
+        Float4 g = Float4(0, 1, 2, 3) * Float4(step) + Float4(from);
+        Float4 advance(step * Width);
+        size_t i = 0;
+        for (; i < wide(frames); i += Width) {
+            (Float4::load(acc + i) + Float4::load(src + i) * g).store(acc + i);
+            g += advance;
+        }
+        for (; i < frames; i++) acc[i] += src[i] * (from + step * (float)i);
+    }
+
+    /// <summary> buffer[i] *= gain, with the gain moving linearly from 'from' towards 'to' across the block. </summary>
+    inline void rampScale(float* buffer, float from, float to, size_t frames) {
+        if (from == to) { scale(buffer, from, frames); return; }
+
+        float step = (to - from) / (float)frames;
+        Float4 g = Float4(0, 1, 2, 3) * Float4(step) + Float4(from);
+        Float4 advance(step * Width);
+        size_t i = 0;
+        for (; i < wide(frames); i += Width) {
+            (Float4::load(buffer + i) * g).store(buffer + i);
+            g += advance;
+        }
+        for (; i < frames; i++) buffer[i] *= from + step * (float)i;
+    }
+
+    /// <summary> The largest absolute sample. </summary>
+    inline float peak(const float* src, size_t frames) {
+        Float4 m;
+        size_t i = 0;
+        for (; i < wide(frames); i += Width) m = Float4::max(m, Float4::abs(Float4::load(src + i)));
+        float result = m.maxLane();
+        for (; i < frames; i++) result = std::fabs(src[i]) > result ? std::fabs(src[i]) : result;
+        return result;
+    }
+
+    /// <summary> The sum of every sample squared. </summary>
+    inline float sumSquares(const float* src, size_t frames) {
+        Float4 s;
+        size_t i = 0;
+        for (; i < wide(frames); i += Width) { Float4 x = Float4::load(src + i); s += x * x; }
+        float result = s.sum();
+        for (; i < frames; i++) result += src[i] * src[i];
+        return result;
+    }
+}
+}
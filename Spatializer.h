@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Profiler.h"
+#include "Simd.h"
+#include "Vector3.h"
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// Positions sources around a listener.
+    /// Every source property lives in its own array (structure-of-arrays), so one call to
+    /// process computes distance attenuation, cone gain, speaker gains and Doppler pitch
+    /// for all sources, four at a time.
+    /// </summary>
+    class Spatializer {
+    public:
+        struct Listener {
+            Vector3 position;
+            Vector3 velocity;
+            Vector3 forward;
+            Vector3 up;
+
+            Listener() : position(), velocity(), forward(0, 0, -1), up(0, 1, 0) {}
+        };
+
+        /// <summary> How a source fades with distance and direction. </summary>
+        struct SourceSettings {
+            float minDistance;      // Full volume inside this distance
+            float maxDistance;      // No further attenuation past this distance
+            float rolloff;          // How quickly the volume falls, 1 is physically based
+            float coneInnerAngle;   // Degrees, full volume inside
+            float coneOuterAngle;   // Degrees, coneOuterGain outside
+            float coneOuterGain;
+
+            SourceSettings(float minDistance_ = 1, float maxDistance_ = 1000, float rolloff_ = 1)
+                : minDistance(minDistance_), maxDistance(maxDistance_), rolloff(rolloff_),
+                coneInnerAngle(360), coneOuterAngle(360), coneOuterGain(0) {}
+        };
+
+        /// <summary> Metres per second, used for Doppler. </summary>
+        float speedOfSound;
+
+        /// <summary> Scales the Doppler shift, 0 turns it off. </summary>
+        float dopplerFactor;
+
+        Listener listener;
+
+    private:
+        size_t count;
+
+        // Per source input, padded to a multiple of the SIMD width
+        std::vector<float> px, py, pz;
+        std::vector<float> vx, vy, vz;
+        std::vector<float> dx, dy, dz;      // Facing direction, only used by cones
+        std::vector<float> minDistance, maxDistance, rolloff;
+        std::vector<float> coneInnerCos, coneOuterCos, coneOuterGain;
+
+        // Per source output
+        std::vector<float> attenuation;     // Distance * cone
+        std::vector<float> pitch;
+        std::vector<std::vector<float>> speakers;   // [speaker][source], includes the attenuation
+
+        // Speaker directions on the listeners horizontal plane, x to the right and z to the front
+        std::vector<float> speakerX, speakerZ;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="maxSources"> Every array is allocated for this many sources up front. </param>
+        /// <param name="speakerAngles"> Degrees clockwise from the front. Two speakers use a constant-power stereo pan. </param>
+        Spatializer(size_t maxSources, const std::vector<float>& speakerAngles = { -30.0f, 30.0f })
+            : speedOfSound(343.3f), dopplerFactor(1), listener(), count(0)
+        {
+            size_t padded = (maxSources + Simd::Width - 1) / Simd::Width * Simd::Width;
+            for (std::vector<float>* array : { &px, &py, &pz, &vx, &vy, &vz, &dx, &dy, &dz,
+                &minDistance, &maxDistance, &rolloff, &coneInnerCos, &coneOuterCos, &coneOuterGain, &attenuation, &pitch })
+                array->assign(padded, 0);
+
+            speakers.assign(speakerAngles.size(), std::vector<float>(padded, 0));
+            for (float angle : speakerAngles) {
+                float radians = angle * 3.14159265358979f / 180.0f;
+                speakerX.push_back(std::sin(radians));
+                speakerZ.push_back(std::cos(radians));
+            }
+        }
+
+        size_t size() const { return count; }
+        size_t capacity() const { return px.size(); }
+        size_t speakerCount() const { return speakers.size(); }
+
+        /// <summary> Adds a source at the origin, facing forward. </summary>
+        /// <returns> The index of the source, or -1 if there is no room. </returns>
+        int addSource(const SourceSettings& settings = SourceSettings()) {
+            if (count == capacity()) return -1;
+
+            uint32_t source = (uint32_t)count++;
+            setPosition(source, Vector3());
+            setVelocity(source, Vector3());
+            setDirection(source, Vector3(0, 0, -1));
+            configure(source, settings);
+            return (int)source;
+        }
+
+        /// <summary> Removes every source. </summary>
+        void clear() { count = 0; }
+
+        void configure(uint32_t source, const SourceSettings& settings) {
+            minDistance[source] = std::max(settings.minDistance, 1e-3f);
+            maxDistance[source] = std::max(settings.maxDistance, minDistance[source]);
+            rolloff[source] = settings.rolloff;
+
+            // Cones are compared by cosine, so process never needs an arc cosine
+            float inner = std::min(settings.coneInnerAngle, settings.coneOuterAngle);
+            coneInnerCos[source] = std::cos(inner * 0.5f * 3.14159265358979f / 180.0f);
+            coneOuterCos[source] = std::cos(settings.coneOuterAngle * 0.5f * 3.14159265358979f / 180.0f);
+            coneOuterGain[source] = settings.coneOuterGain;
+        }
+
+        void setPosition(uint32_t source, const Vector3& position) { px[source] = position.x; py[source] = position.y; pz[source] = position.z; }
+        void setVelocity(uint32_t source, const Vector3& velocity) { vx[source] = velocity.x; vy[source] = velocity.y; vz[source] = velocity.z; }
+        void setDirection(uint32_t source, const Vector3& direction) {
+            Vector3 d = direction.normalized();
+            dx[source] = d.x; dy[source] = d.y; dz[source] = d.z;
+        }
+
+        Vector3 getPosition(uint32_t source) const { return Vector3(px[source], py[source], pz[source]); }
+
+        /// <summary> Distance and cone gain of each source from the last process call. </summary>
+        const float* gains() const { return attenuation.data(); }
+
+        /// <summary> Playback rate multiplier from the Doppler effect, from the last process call. </summary>
+        const float* pitches() const { return pitch.data(); }
+
+        /// <summary> The final gain of each source into one speaker, from the last process call. </summary>
+        const float* speakerGains(uint32_t speaker) const { return speakers[speaker].data(); }
+
+        /// <summary> Computes every output for every source, once per block. </summary>
+        void process() {
+            DA_PROFILE_SCOPE("Spatializer::process");
+            using Simd::Float4;
+
+            // The listeners basis, x to the right and z to the front
+            Vector3 forward = listener.forward.normalized();
+            Vector3 right = Vector3::cross(forward, listener.up).normalized();
+
+            Float4 lx(listener.position.x), ly(listener.position.y), lz(listener.position.z);
+            Float4 lvx(listener.velocity.x), lvy(listener.velocity.y), lvz(listener.velocity.z);
+            Float4 rx(right.x), ry(right.y), rz(right.z);
+            Float4 fx(forward.x), fy(forward.y), fz(forward.z);
+
+            Float4 zero(0.0f), one(1.0f), tiny(1e-6f);
+            Float4 speed(speedOfSound), doppler(dopplerFactor);
+            Float4 limit(speedOfSound * 0.999f);    // Keeps the Doppler ratio finite
+            Float4 half(0.5f);
+
+            bool stereo = speakers.size() == 2;
+
+            for (size_t i = 0; i < count; i += Simd::Width)
+            {
+                // Listener to source
+                Float4 relX = Float4::load(&px[i]) - lx;
+                Float4 relY = Float4::load(&py[i]) - ly;
+                Float4 relZ = Float4::load(&pz[i]) - lz;
+                Float4 distance = Float4::max(Float4::sqrt(relX * relX + relY * relY + relZ * relZ), tiny);
+                Float4 inverse = one / distance;
+
+                // Inverse distance, clamped between min and max distance
+                Float4 minD = Float4::load(&minDistance[i]);
+                Float4 clamped = Float4::min(Float4::max(distance, minD), Float4::load(&maxDistance[i]));
+                Float4 gain = minD / (minD + Float4::load(&rolloff[i]) * (clamped - minD));
+
+                // Cone, from the angle between the source facing and the direction to the listener
+                Float4 facing = zero - (Float4::load(&dx[i]) * relX + Float4::load(&dy[i]) * relY + Float4::load(&dz[i]) * relZ) * inverse;
+                Float4 innerCos = Float4::load(&coneInnerCos[i]);
+                Float4 outerCos = Float4::load(&coneOuterCos[i]);
+                Float4 outerGain = Float4::load(&coneOuterGain[i]);
+                Float4 t = (facing - outerCos) / Float4::max(innerCos - outerCos, tiny);
+                t = Float4::min(Float4::max(t, zero), one);
+                Float4 cone = outerGain + t * (one - outerGain);
+                cone = Float4::select(innerCos < Float4(-0.9999f), one, cone);    // Omnidirectional
+                gain = gain * cone;
+                gain.store(&attenuation[i]);
+
+                // Where the source sits around the listener
+                Float4 side = (relX * rx + relY * ry + relZ * rz) * inverse;
+                Float4 front = (relX * fx + relY * fy + relZ * fz) * inverse;
+
+                if (stereo) {
+                    // Constant-power pan from the sideways component
+                    Float4 pan = Float4::min(Float4::max(side, Float4(-1.0f)), one);
+                    (gain * Float4::sqrt((one - pan) * half)).store(&speakers[0][i]);
+                    (gain * Float4::sqrt((one + pan) * half)).store(&speakers[1][i]);
+                }
+                else {
+                    // Each speaker gets the part of the direction that points at it, normalised to constant power
+                    Float4 power = zero;
+                    for (size_t s = 0; s < speakers.size(); s++) {
+                        Float4 g = Float4::max(side * Float4(speakerX[s]) + front * Float4(speakerZ[s]), zero);
+                        g.store(&speakers[s][i]);
+                        power += g * g;
+                    }
+
+                    Float4 silent = power < tiny;
+                    Float4 even(1.0f / std::sqrt((float)speakers.size()));
+                    Float4 norm = gain / Float4::sqrt(Float4::max(power, tiny));
+                    for (size_t s = 0; s < speakers.size(); s++) {
+                        Float4 g = Float4::load(&speakers[s][i]);
+                        Float4::select(silent, gain * even, g * norm).store(&speakers[s][i]);
+                    }
+                }
+
+                // Doppler, from the velocities along the line from the source to the listener
+                Float4 toListener = zero - inverse * doppler;
+                Float4 listenerSpeed = (relX * lvx + relY * lvy + relZ * lvz) * toListener;
+                Float4 sourceSpeed = (relX * Float4::load(&vx[i]) + relY * Float4::load(&vy[i]) + relZ * Float4::load(&vz[i])) * toListener;
+                listenerSpeed = Float4::min(listenerSpeed, limit);
+                sourceSpeed = Float4::min(sourceSpeed, limit);
+                ((speed - listenerSpeed) / (speed - sourceSpeed)).store(&pitch[i]);
+            }
+        }
+    };
+}
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "EffectBase.h"
+#include "Fft.h"
+#include "Profiler.h"
+#include "Simd.h"
+#include "TripleBuffer.h"
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// Turns audio pushed from the audio thread into windowed, overlapping magnitude spectra
+    /// for visualizers and adaptive music. Each finished spectrum is published through a
+    /// TripleBuffer, so one reader thread can pick up the latest without locking.
+    /// configureBands reallocates the published spectra, so call it before audio starts rather than between pushes.
+    /// </summary>
+    class SpectrumAnalyzer {
+    public:
+        enum class Window {
+            Rectangular,
+            Hann,
+            BlackmanHarris
+        };
+
+        enum class BandScale {
+            None,
+            Mel,        // Triangular filters evenly spaced in mels
+            Octave      // Rectangular bands evenly spaced in octaves, ie. ten for 20Hz to 20kHz
+        };
+
+        struct Spectrum {
+            std::vector<float> magnitudes;  // Linear amplitude per bin, a full scale sine peaks near 1
+            std::vector<float> bands;       // Amplitude per band, empty without bands
+            uint64_t frame;                 // Frames pushed when the window ended
+            uint64_t sequence;              // Counts up by one per spectrum
+        };
+
+    private:
+        struct Band {
+            uint32_t first;     // First bin
+            uint32_t count;
+            uint32_t weights;   // Offset into bandWeights
+        };
+
+        uint32_t sampleRate;
+        size_t size;
+        size_t hop;
+        size_t maxTransforms;
+        Fft fft;
+
+        std::vector<float> history;     // The last size samples, circular
+        size_t writeIndex;
+        size_t sinceTransform;
+        uint64_t framesPushed;
+        uint64_t sequence;
+        uint64_t skippedCount;
+
+        std::vector<float> window;
+        std::vector<float> windowed;
+        std::vector<float> binRe;
+        std::vector<float> binIm;
+        float magnitudeScale;
+        float bandScaleFactor;
+
+        std::vector<Band> bandInfo;
+        std::vector<float> bandWeights;
+
+        TripleBuffer<Spectrum> published;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="sampleRate_"> Of the audio pushed. </param>
+        /// <param name="size_"> Samples per transform, a power of two. </param>
+        /// <param name="hop_"> Samples between the starts of two transforms, ie. size / 4 for 75% overlap. </param>
+        /// <param name="maxTransforms_"> The most transforms one push runs, bounding its cost. Any more hops are skipped. </param>
+        SpectrumAnalyzer(uint32_t sampleRate_, size_t size_ = 2048, size_t hop_ = 512, Window type = Window::Hann, size_t maxTransforms_ = 2)
+            : sampleRate(sampleRate_), size(size_), hop(hop_ ? hop_ : 1), maxTransforms(maxTransforms_ ? maxTransforms_ : 1), fft(size_),
+            history(size_), writeIndex(0), sinceTransform(0), framesPushed(0), sequence(0), skippedCount(0),
+            window(size_), windowed(size_), binRe(size_ / 2 + 1), binIm(size_ / 2 + 1), magnitudeScale(1), bandScaleFactor(1),
+            bandInfo(), bandWeights(),
+            published(Spectrum{ std::vector<float>(size_ / 2 + 1), std::vector<float>(), 0, 0 })
+        {
+            const double pi = 3.14159265358979323846;
+            double sum = 0, squares = 0;
+            for (size_t i = 0; i < size; i++)
+            {
+                // Periodic windows, so overlapping them sums evenly
+                double phase = 2 * pi * i / size;
+                switch (type) {
+                case Window::Rectangular: window[i] = 1; break;
+                case Window::Hann: window[i] = (float)(0.5 - 0.5 * std::cos(phase)); break;
+                case Window::BlackmanHarris:
+                    window[i] = (float)(0.35875 - 0.48829 * std::cos(phase) + 0.14128 * std::cos(2 * phase) - 0.01168 * std::cos(3 * phase));
+                    break;
+                }
+                sum += window[i];
+                squares += (double)window[i] * window[i];
+            }
+
+            // A sine's energy lands half in its positive and half in its negative frequency
+            magnitudeScale = (float)(2.0 / sum);
+
+            // A windowed sine spreads over the window's equivalent noise bandwidth in bins, 1.5 for Hann
+            bandScaleFactor = (float)(sum * sum / (size * squares));
+        }
+
+        SpectrumAnalyzer(const SpectrumAnalyzer&) = delete;
+        SpectrumAnalyzer& operator=(const SpectrumAnalyzer&) = delete;
+
+        size_t fftSize() const { return size; }
+        size_t bins() const { return size / 2 + 1; }
+        size_t bandCount() const { return bandInfo.size(); }
+
+        /// <summary> The centre frequency of a bin in Hz. </summary>
+        float binFrequency(size_t bin) const { return bin * (float)sampleRate / size; }
+
+        /// <summary> Hops that were not transformed because a push held more than maxTransforms of them. </summary>
+        uint64_t skipped() const { return skippedCount; }
+
+        static float toDecibels(float amplitude) { return 20.0f * std::log10(std::max(amplitude, 1e-10f)); }
+
+        /// <summary> Groups the bins into bands. Allocates, so call it before the analyzer is used. </summary>
+        /// <param name="scale"> How the band edges are spaced, None removes the bands. </param>
+        /// <param name="count"> The amount of bands. </param>
+        /// <param name="minHz"> The lowest band edge. </param>
+        /// <param name="maxHz"> The highest band edge, 0 for Nyquist. </param>
+        void configureBands(BandScale scale, size_t count, float minHz = 20, float maxHz = 0) {
+            bandInfo.clear();
+            bandWeights.clear();
+            if (scale == BandScale::None) count = 0;
+
+            float nyquist = sampleRate * 0.5f;
+            if (maxHz <= 0 || maxHz > nyquist) maxHz = nyquist;
+            minHz = std::max(minHz, 1.0f);
+
+            // Band b spans edges[b] to edges[b + 1], a mel band peaks at edges[b + 1] and ends at edges[b + 2]
+            size_t edgeCount = count + (scale == BandScale::Mel ? 2 : 1);
+            std::vector<float> edges(edgeCount);
+            for (size_t e = 0; e < edgeCount; e++) {
+                float t = (float)e / (edgeCount - 1);
+                if (scale == BandScale::Mel) edges[e] = fromMel(toMel(minHz) + t * (toMel(maxHz) - toMel(minHz)));
+                else edges[e] = minHz * std::pow(maxHz / minHz, t);
+            }
+
+            float binWidth = (float)sampleRate / size;
+            for (size_t b = 0; b < count; b++)
+            {
+                float low = edges[b];
+                float high = scale == BandScale::Mel ? edges[b + 2] : edges[b + 1];
+                float peak = scale == BandScale::Mel ? edges[b + 1] : 0;
+
+                // Bands narrower than a bin still get the bin nearest their centre
+                uint32_t first = (uint32_t)std::ceil(low / binWidth);
+                uint32_t last = (uint32_t)std::min<float>(std::ceil(high / binWidth) - 1, (float)(bins() - 1));
+                if (last < first) first = last = (uint32_t)std::min<float>(std::round(0.5f * (low + high) / binWidth), (float)(bins() - 1));
+
+                Band band = { first, last - first + 1, (uint32_t)bandWeights.size() };
+                for (uint32_t k = first; k <= last; k++)
+                {
+                    float f = k * binWidth;
+                    float weight = 1;
+                    if (scale == BandScale::Mel && band.count > 1)
+                        weight = f <= peak ? (f - low) / std::max(peak - low, 1e-6f) : (high - f) / std::max(high - peak, 1e-6f);
+                    bandWeights.push_back(std::max(weight, 0.0f));
+                }
+                bandInfo.push_back(band);
+            }
+
+            published.reset(Spectrum{ std::vector<float>(bins()), std::vector<float>(count), 0, 0 });
+        }
+
+        /// <summary> Adds audio, transforming once per hop. Audio thread only. </summary>
+        void push(const float* samples, size_t frames) {
+            pushWith(frames, [samples](size_t i) { return samples[i]; });
+        }
+
+        /// <summary> Adds stereo audio mixed down to mono, ie. a Mixer bus. Audio thread only. </summary>
+        void push(const float* left, const float* right, size_t frames) {
+            pushWith(frames, [left, right](size_t i) { return 0.5f * (left[i] + right[i]); });
+        }
+
+        /// <summary> The newest spectrum, or null before the first. Stays valid until the next call. Reader thread only. </summary>
+        const Spectrum* latest() {
+            published.update();
+            const Spectrum& spectrum = published.read();
+            return spectrum.sequence == 0 ? nullptr : &spectrum;
+        }
+
+        static float toMel(float hz) { return 2595.0f * std::log10(1.0f + hz / 700.0f); }
+        static float fromMel(float mel) { return 700.0f * (std::pow(10.0f, mel / 2595.0f) - 1.0f); }
+
+    private:
+        template<typename Sample>
+        void pushWith(size_t frames, Sample sample) {
+            DA_PROFILE_SCOPE("SpectrumAnalyzer::push");
+            size_t transforms = 0;
+
+            for (size_t i = 0; i < frames;)
+            {
+                // Copy up to the next hop, then transform
+                size_t take = std::min(frames - i, hop - sinceTransform);
+                for (size_t j = 0; j < take; j++) {
+                    history[writeIndex] = sample(i + j);
+                    writeIndex = writeIndex + 1 == size ? 0 : writeIndex + 1;
+                }
+                i += take;
+                sinceTransform += take;
+                framesPushed += take;
+
+                if (sinceTransform == hop) {
+                    sinceTransform = 0;
+                    if (framesPushed < size) continue;      // The first window is not full yet
+
+                    // Only the last hops of a long push are transformed, they hold the newest audio
+                    size_t hopsLeft = (frames - i) / hop;
+                    if (transforms < maxTransforms && hopsLeft < maxTransforms - transforms) {
+                        transform();
+                        transforms++;
+                    }
+                    else skippedCount++;
+                }
+            }
+        }
+
+        void transform() {
+            using Simd::Float4;
+
+            // Unwrap the history oldest first while windowing it
+            size_t tail = size - writeIndex;
+            size_t i = 0;
+            for (; i + Simd::Width <= tail; i += Simd::Width)
+                (Float4::load(history.data() + writeIndex + i) * Float4::load(window.data() + i)).store(windowed.data() + i);
+            for (; i < tail; i++) windowed[i] = history[writeIndex + i] * window[i];
+            for (size_t j = 0; j < writeIndex; j++) windowed[tail + j] = history[j] * window[tail + j];
+
+            fft.forward(windowed.data(), binRe.data(), binIm.data());
+
+            Spectrum& spectrum = published.write();
+            Fft::magnitudes(binRe.data(), binIm.data(), spectrum.magnitudes.data(), bins(), magnitudeScale);
+
+            // DC and Nyquist have no mirror image to share their energy with
+            spectrum.magnitudes[0] *= 0.5f;
+            spectrum.magnitudes[bins() - 1] *= 0.5f;
+
+            // Bands sum power over the window's noise bandwidth, so a sine inside one reads as its amplitude
+            const float* magnitude = spectrum.magnitudes.data();
+            for (size_t b = 0; b < bandInfo.size(); b++) {
+                const Band& band = bandInfo[b];
+                const float* weights = bandWeights.data() + band.weights;
+                float power = 0;
+                for (uint32_t k = 0; k < band.count; k++) {
+                    float value = magnitude[band.first + k];
+                    power += weights[k] * value * value;
+                }
+                spectrum.bands[b] = std::sqrt(power * bandScaleFactor);
+            }
+
+            spectrum.frame = framesPushed;
+            spectrum.sequence = ++sequence;
+            published.publish();
+        }
+    };
+}
+
+namespace Effect {
+
+	/// <summary> Passes its input through unchanged while feeding it to a SpectrumAnalyzer. </summary>
+	struct Analyzer : public Abstract
+	{
+		Abstract* input;
+		DynamicAudio::SpectrumAnalyzer* analyzer;
+
+		/// <summary> Constructor Definition. </summary>
+		Analyzer(Abstract* input_, DynamicAudio::SpectrumAnalyzer* analyzer_)
+			: input(input_), analyzer(analyzer_) {}
+
+		value get(value in) override {
+			value sample = input->get(in);
+			float analyzed = (sample - 128) / 128.0f;
+			analyzer->push(&analyzed, 1);
+			return sample;
+		}
+
+		void process(float* out, size_t frames) override {
+			input->process(out, frames);
+			analyzer->push(out, frames);
+		}
+
+		void skip(size_t frames) override { input->skip(frames); }
+
+		bool silent() const override { return input->silent(); }
+	};
+}
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Decoder.h"
+#include "EffectBase.h"
+#include "Profiler.h"
+#include "Result.h"
+#include "RingBuffer.h"
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// Plays a file that is never fully decoded, ie. a music track.
+    /// A producer, usually a StreamWorker, keeps a bounded ring of decoded blocks ahead
+    /// of the reader. The reader, usually the audio thread, only copies out of that ring
+    /// and never touches the disk, locks or the heap. Seeking is requested by the reader
+    /// and carried out by the producer, blocks decoded before it are dropped.
+    /// </summary>
+    class StreamingSource {
+    public:
+        struct Block {
+            std::vector<float> samples;     // Interleaved, sized once for blockFrames
+            size_t frames;
+            uint64_t start;                 // Frame of the file the block starts at
+            uint32_t generation;            // The seek it was decoded after
+        };
+
+    private:
+        std::unique_ptr<Decoder> decoder;
+        Decoder::Info decoderInfo;
+        size_t blockFrames;
+        SpscRingBuffer<Block> ring;
+
+        // Written by the reader, read by the producer
+        std::atomic<uint32_t> requested;
+        std::atomic<uint64_t> seekTarget;
+        std::atomic<bool> looping;
+
+        // Written by the producer, read by the reader
+        std::atomic<uint32_t> ended;        // Generation the decoder ran out in
+        std::atomic<uint64_t> decodeErrors;
+        uint32_t produced;
+
+        // Reader only
+        uint32_t generation;
+        size_t cursor;                      // Frames already read from the oldest block
+        uint64_t frame;
+        bool seeking;
+        std::atomic<uint64_t> underrunCount;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="decoder_"> An opened decoder, ie. from openDecoder. </param>
+        /// <param name="blockFrames_"> Frames decoded at a time. </param>
+        /// <param name="blocks"> Blocks kept ahead of the reader, rounded up to a power of two. </param>
+        StreamingSource(std::unique_ptr<Decoder> decoder_, size_t blockFrames_ = 4096, size_t blocks = 8)
+            : decoder(std::move(decoder_)), decoderInfo(decoder->info()), blockFrames(blockFrames_),
+            ring(blocks, Block{ std::vector<float>(blockFrames_ * decoder->info().channels), 0, 0, 0 }),
+            requested(1), seekTarget(0), looping(false), ended(0), decodeErrors(0), produced(1),
+            generation(1), cursor(0), frame(0), seeking(false), underrunCount(0) {}
+
+        StreamingSource(const StreamingSource&) = delete;
+        StreamingSource& operator=(const StreamingSource&) = delete;
+
+        /// <summary> Opens a file for streaming, picking the decoder by its extension. </summary>
+        static Result open(const std::string& filepath, std::unique_ptr<StreamingSource>& source, size_t blockFrames = 4096, size_t blocks = 8) {
+            std::unique_ptr<Decoder> decoder;
+            Result result = openDecoder(filepath, decoder);
+            if (result != Success) return result;
+
+            source.reset(new StreamingSource(std::move(decoder), blockFrames, blocks));
+            return Success;
+        }
+
+        const Decoder::Info& info() const { return decoderInfo; }
+        uint16_t channels() const { return decoderInfo.channels; }
+
+        /// <summary> The most frames decoded ahead of the reader. </summary>
+        size_t capacityFrames() const { return ring.capacity() * blockFrames; }
+
+        /// <summary> Whether the end wraps around to the start. Safe from any thread. </summary>
+        void setLooping(bool loop) { looping.store(loop, std::memory_order_relaxed); }
+        bool isLooping() const { return looping.load(std::memory_order_relaxed); }
+
+        /// <summary> Times the reader wanted frames that were not decoded yet, and got silence. </summary>
+        uint64_t underruns() const { return underrunCount.load(std::memory_order_relaxed); }
+
+        /// <summary> Seeks or reads the decoder failed. </summary>
+        uint64_t errors() const { return decodeErrors.load(std::memory_order_relaxed); }
+
+        //
+        // Producer side, one thread at a time
+        //
+
+        /// <summary> Decodes until the ring is full, ie. to prime a stream before it plays. Producer only. </summary>
+        /// <returns> The amount of blocks decoded. </returns>
+        size_t fill() {
+            DA_PROFILE_SCOPE("StreamingSource::fill");
+            size_t filled = 0;
+
+            while (Block* block = ring.acquireWrite())
+            {
+                uint32_t wanted = requested.load(std::memory_order_acquire);
+                if (wanted != produced) {
+                    if (!decoder->seek(seekTarget.load(std::memory_order_relaxed)))
+                        decodeErrors.fetch_add(1, std::memory_order_relaxed);
+                    produced = wanted;
+                }
+                if (ended.load(std::memory_order_relaxed) == produced) break;
+
+                block->start = decoder->tell();
+                block->generation = produced;
+                block->frames = decoder->read(block->samples.data(), blockFrames);
+
+                // Out of frames, wrap around if looping and there is anything to loop
+                if (block->frames < blockFrames) {
+                    bool rewind = looping.load(std::memory_order_relaxed) && (block->frames > 0 || block->start > 0);
+                    if (rewind && !decoder->seek(0)) {
+                        decodeErrors.fetch_add(1, std::memory_order_relaxed);
+                        rewind = false;
+                    }
+                    if (!rewind) ended.store(produced, std::memory_order_release);
+                    if (block->frames == 0) continue;
+                }
+
+                ring.commitWrite();
+                filled++;
+            }
+            return filled;
+        }
+
+        //
+        // Reader side, one thread at a time
+        //
+
+        /// <summary> Copies frames out of the ring, silence for any not decoded yet. Reader only. </summary>
+        /// <param name="out"> The samples to write. </param>
+        /// <param name="frames"> The amount of frames wanted. </param>
+        /// <param name="channel"> The channel to read, or -1 to mix every channel down. </param>
+        /// <returns> The amount of frames that came from the file. </returns>
+        size_t read(float* out, size_t frames, int channel = -1) {
+            DA_PROFILE_SCOPE("StreamingSource::read");
+            return consume(out, frames, channel);
+        }
+
+        /// <summary> Moves on without copying anything, ie. while the voice is virtual. Reader only. </summary>
+        size_t skip(size_t frames) { return consume(nullptr, frames, 0); }
+
+        /// <summary> Asks the producer to continue from a frame. Reads give silence until it has. Reader only. </summary>
+        void seek(uint64_t target) {
+            seekTarget.store(target, std::memory_order_relaxed);
+            requested.store(++generation, std::memory_order_release);
+            frame = target;
+            cursor = 0;
+            seeking = true;
+            drop();
+        }
+
+        /// <summary> The frame the next read starts at. Reader only. </summary>
+        uint64_t position() const { return frame; }
+
+        /// <summary> Whether every frame of the file has been read. Reader only. </summary>
+        bool finished() {
+            drop();
+            return ring.acquireRead() == nullptr && ended.load(std::memory_order_acquire) == generation;
+        }
+
+        /// <summary> Frames decoded and not read yet. Reader only. </summary>
+        size_t buffered() {
+            drop();
+            Block* block = ring.acquireRead();
+            if (block == nullptr) return 0;
+            return block->frames - cursor + (ring.size() - 1) * blockFrames;
+        }
+
+    private:
+        /// <summary> Throws away blocks decoded before the last seek. </summary>
+        void drop() {
+            while (Block* block = ring.acquireRead()) {
+                if (block->generation == generation) return;
+                ring.commitRead();
+            }
+        }
+
+        size_t consume(float* out, size_t frames, int channel) {
+            size_t done = 0;
+            uint16_t count = decoderInfo.channels;
+
+            while (done < frames)
+            {
+                drop();
+                Block* block = ring.acquireRead();
+                if (block == nullptr) break;
+                seeking = false;
+
+                size_t take = std::min(frames - done, block->frames - cursor);
+                if (out != nullptr) {
+                    const float* in = block->samples.data() + cursor * count;
+                    if (count == 1) std::memcpy(out + done, in, take * sizeof(float));
+                    else if (channel >= 0) for (size_t i = 0; i < take; i++) out[done + i] = in[i * count + channel];
+                    else {
+                        float scale = 1.0f / count;
+                        for (size_t i = 0; i < take; i++) {
+                            float sum = 0;
+                            for (uint16_t c = 0; c < count; c++) sum += in[i * count + c];
+                            out[done + i] = sum * scale;
+                        }
+                    }
+                }
+
+                done += take;
+                cursor += take;
+                frame = block->start + cursor;
+                if (cursor == block->frames) {
+                    cursor = 0;
+                    ring.commitRead();
+                }
+            }
+
+            if (done < frames) {
+                if (out != nullptr) std::memset(out + done, 0, (frames - done) * sizeof(float));
+                if (!seeking && ended.load(std::memory_order_acquire) != generation)
+                    underrunCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            return done;
+        }
+    };
+
+    /// <summary>
+    /// One thread decoding ahead for every stream added to it.
+    /// Streams are topped up every interval, or straight away after wake, ie. following a seek.
+    /// </summary>
+    class StreamWorker {
+    private:
+        std::vector<StreamingSource*> streams;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        std::chrono::microseconds interval;
+        bool stopping;
+        bool woken;
+        std::thread thread;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="interval_"> How often streams are topped up, well under the time a stream's ring lasts. </param>
+        StreamWorker(std::chrono::microseconds interval_ = std::chrono::milliseconds(5))
+            : streams(), interval(interval_), stopping(false), woken(false), thread()
+        {
+            thread = std::thread([this] { run(); });
+        }
+
+        ~StreamWorker() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wakeUp.notify_one();
+            thread.join();
+        }
+
+        StreamWorker(const StreamWorker&) = delete;
+        StreamWorker& operator=(const StreamWorker&) = delete;
+
+        /// <summary> Starts decoding ahead for a stream, which must outlive it being added. </summary>
+        void add(StreamingSource* stream) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                streams.push_back(stream);
+                woken = true;
+            }
+            wakeUp.notify_one();
+        }
+
+        /// <summary> Stops decoding for a stream. Once this returns the worker no longer touches it. </summary>
+        void remove(StreamingSource* stream) {
+            std::lock_guard<std::mutex> lock(mutex);
+            streams.erase(std::remove(streams.begin(), streams.end(), stream), streams.end());
+        }
+
+        /// <summary> Tops up every stream now instead of at the next interval. Takes a lock, so not from the audio thread. </summary>
+        void wake() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                woken = true;
+            }
+            wakeUp.notify_one();
+        }
+
+    private:
+        void run() {
+            DA_PROFILE_THREAD();
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopping)
+            {
+                for (StreamingSource* stream : streams) stream->fill();
+
+                woken = false;
+                wakeUp.wait_for(lock, interval, [this] { return stopping || woken; });
+            }
+        }
+    };
+}
+
+namespace Effect {
+
+	/// <summary> Plays one channel of a StreamingSource, or all of them mixed down. </summary>
+	struct Stream : public Abstract
+	{
+		DynamicAudio::StreamingSource* source;
+		int channel;
+
+		/// <summary> Constructor Definition. </summary>
+		/// <param name="channel_"> The channel to play, or -1 to mix every channel down. </param>
+		Stream(DynamicAudio::StreamingSource* source_, int channel_ = -1)
+			: source(source_), channel(channel_) {}
+
+		value get(value in) override {
+			float sample;
+			source->read(&sample, 1, channel);
+			return (value)(sample * 127 + 128);
+		}
+
+		void process(float* out, size_t frames) override {
+			source->read(out, frames, channel);
+		}
+
+		void skip(size_t frames) override { source->skip(frames); }
+	};
+}
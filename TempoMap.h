@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Chord.h"
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// The tempo and time signature of a Tune over time.
+    /// Positions are in Note durations, whole notes from the start of the tune. A beat is
+    /// one 1 / denominator note, so 120 bpm in 4 / 4 plays a whole note every two seconds.
+    /// </summary>
+    class TempoMap {
+    public:
+        struct Change {
+            double position;        // Whole notes from the start
+            double bpm;
+            uint8_t numerator;      // Time signature, ie. 3 / 4
+            uint8_t denominator;
+            double seconds;         // Seconds from the start to position, kept up to date by the map
+        };
+
+    private:
+        std::vector<Change> list;   // Sorted by position, the first is always at 0
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        TempoMap(double bpm = 120, uint8_t numerator = 4, uint8_t denominator = 4)
+            : list{ Change{ 0, bpm, numerator, denominator, 0 } } {}
+
+        /// <summary> Every change, sorted by position. </summary>
+        const std::vector<Change>& changes() const { return list; }
+
+        /// <summary> Changes the tempo from a position on, replacing any change already there. </summary>
+        void set(double position, double bpm, uint8_t numerator = 4, uint8_t denominator = 4) {
+            position = std::max(position, 0.0);
+            auto it = std::lower_bound(list.begin(), list.end(), position,
+                [](const Change& change, double p) { return change.position < p; });
+
+            Change change = { position, bpm, numerator, denominator, 0 };
+            if (it != list.end() && it->position == position) *it = change;
+            else it = list.insert(it, change);
+            updateSeconds((size_t)(it - list.begin()));
+        }
+
+        /// <summary> The change in effect at a position. </summary>
+        const Change& at(double position) const {
+            auto it = std::upper_bound(list.begin(), list.end(), position,
+                [](double p, const Change& change) { return p < change.position; });
+            return it == list.begin() ? list.front() : *(it - 1);
+        }
+
+        /// <summary> How long a whole note lasts under a change. </summary>
+        static double secondsPerWholeNote(const Change& change) {
+            return 60.0 / change.bpm * change.denominator;
+        }
+
+        /// <summary> Whole notes per bar under a change, ie. 0.75 in 3 / 4. </summary>
+        static double barLength(const Change& change) {
+            return (double)change.numerator / change.denominator;
+        }
+
+        /// <summary> Seconds from the start to a position. </summary>
+        double secondsAt(double position) const {
+            const Change& change = at(position);
+            return change.seconds + (position - change.position) * secondsPerWholeNote(change);
+        }
+
+        /// <summary> The sample frame a position starts on. Rounded from the absolute time, so frames never drift. </summary>
+        uint64_t frameAt(double position, uint32_t sampleRate) const {
+            return (uint64_t)std::llround(std::max(0.0, secondsAt(position)) * sampleRate);
+        }
+
+        /// <summary> The position playing at a time, the inverse of secondsAt. </summary>
+        double positionAt(double seconds) const {
+            auto it = std::upper_bound(list.begin(), list.end(), seconds,
+                [](double s, const Change& change) { return s < change.seconds; });
+            const Change& change = it == list.begin() ? list.front() : *(it - 1);
+            return change.position + (seconds - change.seconds) / secondsPerWholeNote(change);
+        }
+
+    private:
+        void updateSeconds(size_t from) {
+            for (size_t i = std::max<size_t>(from, 1); i < list.size(); i++)
+                list[i].seconds = list[i - 1].seconds + (list[i].position - list[i - 1].position) * secondsPerWholeNote(list[i - 1]);
+        }
+    };
+
+    /// <summary>
+    /// Where every chord and note of a Tune starts and ends, in sample frames at one sample rate.
+    /// Kept by the Tune and brought up to date from the first chord that changed, so playback
+    /// and scheduling only ever compare integers.
+    /// </summary>
+    class Timeline {
+    private:
+        uint32_t rate;
+        size_t valid;                       // Leading chords whose frames are up to date
+        std::vector<double> positions;      // Start of each chord in whole notes, plus the end of the tune
+        std::vector<uint64_t> starts;       // Start of each chord in frames, plus the end of the tune
+        std::vector<uint32_t> firstNote;    // Into noteEnds, plus one past the last note
+        std::vector<uint64_t> noteEnds;
+        size_t rebuilt;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        Timeline(uint32_t sampleRate_)
+            : rate(sampleRate_), valid(0), positions{ 0 }, starts{ 0 }, firstNote{ 0 }, noteEnds(), rebuilt(0) {}
+
+        uint32_t sampleRate() const { return rate; }
+
+        /// <summary> The amount of chords. </summary>
+        size_t size() const { return starts.size() - 1; }
+
+        /// <summary> Frames from the start to the end of the last chord. </summary>
+        uint64_t length() const { return starts.back(); }
+
+        uint64_t chordStart(size_t chord) const { return starts[chord]; }
+        uint64_t chordEnd(size_t chord) const { return starts[chord + 1]; }
+        double chordPosition(size_t chord) const { return positions[chord]; }
+
+        size_t noteCount(size_t chord) const { return firstNote[chord + 1] - firstNote[chord]; }
+
+        /// <summary> The frame each note of a chord stops on, in the chord's note order. </summary>
+        const uint64_t* noteEndFrames(size_t chord) const { return noteEnds.data() + firstNote[chord]; }
+
+        /// <summary> The chord playing at a frame, or size() past the end. </summary>
+        size_t chordAt(uint64_t frame) const {
+            auto it = std::upper_bound(starts.begin(), starts.end(), frame);
+            return it == starts.begin() ? 0 : (size_t)(it - starts.begin()) - 1;
+        }
+
+        /// <summary> Chords worked out again by the last update, to check edits stay incremental. </summary>
+        size_t lastRebuilt() const { return rebuilt; }
+
+        /// <summary> Marks a chord and everything after it as out of date. </summary>
+        void invalidate(size_t chord) { valid = std::min(valid, chord); }
+
+        /// <summary> Marks every chord still playing at or after a position as out of date, ie. after a tempo change. </summary>
+        void invalidateFrom(double position) {
+            // The first chord ending after the position
+            size_t chord = (size_t)(std::upper_bound(positions.begin() + 1, positions.begin() + valid + 1, position) - positions.begin()) - 1;
+            invalidate(chord);
+        }
+
+        /// <summary> Whether update has anything to do. </summary>
+        bool stale(size_t chordCount) const { return valid != chordCount || size() != chordCount; }
+
+        /// <summary> Works out the frames of every chord that changed. </summary>
+        void update(const std::vector<Chord>& chords, const TempoMap& tempo) {
+            size_t count = chords.size();
+            valid = std::min(valid, std::min(count, size()));
+            rebuilt = count - valid;
+
+            positions.resize(count + 1);
+            starts.resize(count + 1);
+            firstNote.resize(count + 1);
+            noteEnds.resize(firstNote[valid]);
+
+            for (size_t i = valid; i < count; i++)
+            {
+                double position = positions[i];
+                for (const Note& note : chords[i].allNotes())
+                    noteEnds.push_back(tempo.frameAt(position + note.duration, rate));
+
+                positions[i + 1] = position + chords[i].maxDuration();
+                starts[i + 1] = tempo.frameAt(positions[i + 1], rate);
+                firstNote[i + 1] = (uint32_t)noteEnds.size();
+            }
+            valid = count;
+        }
+    };
+}
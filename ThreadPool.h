@@ -0,0 +1,100 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Profiler.h"
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// A fixed set of worker threads taking jobs from one queue.
+    /// Meant for coarse work such as whole offline renders, not per-block work.
+    /// </summary>
+    class ThreadPool {
+    public:
+        typedef std::function<void()> Job;
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<Job> queue;
+        std::mutex mutex;
+        std::condition_variable available;
+        std::condition_variable idle;
+        size_t running;
+        bool stopping;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="threads"> Worker count, 0 uses one per hardware thread. </param>
+        ThreadPool(size_t threads = 0) : workers(), queue(), running(0), stopping(false)
+        {
+            if (threads == 0) threads = std::thread::hardware_concurrency();
+            if (threads == 0) threads = 1;
+
+            for (size_t i = 0; i < threads; i++)
+                workers.emplace_back([this] { work(); });
+        }
+
+        /// <summary> Finishes every queued job, then joins the workers. </summary>
+        ~ThreadPool() {
+            wait();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            available.notify_all();
+            for (std::thread& worker : workers) worker.join();
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        size_t size() const { return workers.size(); }
+
+        void submit(Job job) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(std::move(job));
+            }
+            available.notify_one();
+        }
+
+        /// <summary> Blocks until the queue is empty and no job is running. </summary>
+        void wait() {
+            std::unique_lock<std::mutex> lock(mutex);
+            idle.wait(lock, [this] { return queue.empty() && running == 0; });
+        }
+
+    private:
+        void work() {
+            DA_PROFILE_THREAD();
+            while (true)
+            {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    available.wait(lock, [this] { return stopping || !queue.empty(); });
+                    if (queue.empty()) return;
+
+                    job = std::move(queue.front());
+                    queue.pop_front();
+                    running++;
+                }
+
+                job();
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    running--;
+                    if (queue.empty() && running == 0) idle.notify_all();
+                }
+            }
+        }
+    };
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// Hands the latest value from one writer thread to one reader thread without locks or copies.
+    /// The writer fills the back slot and swaps it with the middle one, the reader swaps the
+    /// middle slot for its front one when there is something new. Neither ever waits, values
+    /// the reader was too slow for are skipped.
+    /// </summary>
+    template<typename T>
+    class TripleBuffer {
+    private:
+        static constexpr uint8_t Fresh = 4;     // Set on the middle index when the writer published into it
+        static constexpr uint8_t Index = 3;
+
+        T slots[3];
+        alignas(64) std::atomic<uint8_t> middle;
+        alignas(64) uint8_t back;       // Owned by the writer
+        alignas(64) uint8_t front;      // Owned by the reader
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="prototype"> Every slot starts as a copy of this, ie. with its buffers allocated. </param>
+        TripleBuffer(const T& prototype = T())
+            : slots{ prototype, prototype, prototype }, middle(1), back(0), front(2) {}
+
+        TripleBuffer(const TripleBuffer&) = delete;
+        TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+        /// <summary> Sets every slot back to the prototype. Neither thread may be using the buffer. </summary>
+        void reset(const T& prototype) {
+            for (T& slot : slots) slot = prototype;
+            middle.store(1);
+            back = 0;
+            front = 2;
+        }
+
+        /// <summary> The slot to fill next. Writer only. </summary>
+        T& write() { return slots[back]; }
+
+        /// <summary> Makes the filled slot the latest value. Writer only. </summary>
+        void publish() {
+            back = middle.exchange(back | Fresh, std::memory_order_acq_rel) & Index;
+        }
+
+        /// <summary> Takes the latest value if one was published since the last call. Reader only. </summary>
+        /// <returns> Whether read changed. </returns>
+        bool update() {
+            if ((middle.load(std::memory_order_relaxed) & Fresh) == 0) return false;
+            front = middle.exchange(front, std::memory_order_acq_rel) & Index;
+            return true;
+        }
+
+        /// <summary> The value taken by the last update, stays valid until the next. Reader only. </summary>
+        const T& read() const { return slots[front]; }
+    };
+}
@@ -1,16 +1,29 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 #include <tuple>
 
 #include "Chord.h"
+#include "TempoMap.h"
 
 namespace DynamicAudio {
 
     struct Tune {
         std::vector<Chord> chords;
 
-        Tune() : chords() {}
+        Tune() : chords(), tempo(), timelines() {}
+
+        // Copies share no cached timelines, each works out its own
+        Tune(const Tune& other) : chords(other.chords), tempo(other.tempo), timelines() {}
+        Tune(Tune&& other) = default;
+        Tune& operator=(const Tune& other) {
+            chords = other.chords;
+            tempo = other.tempo;
+            timelines.clear();
+            return *this;
+        }
+        Tune& operator=(Tune&& other) = default;
 
         /// <summary> Adds a chord to the tune. </summary>
         void addChord(Chord chord) {
@@ -110,5 +123,52 @@ namespace DynamicAudio {
 
             return Note::null();
         }
+
+        /// <summary> The tempo changes of the tune. </summary>
+        const TempoMap& getTempo() const {
+            return tempo;
+        }
+
+        /// <summary> Changes the tempo from a position on, see TempoMap::set. </summary>
+        void setTempo(double position, double bpm, uint8_t numerator = 4, uint8_t denominator = 4) {
+            tempo.set(position, bpm, numerator, denominator);
+            for (auto& timeline : timelines) timeline->invalidateFrom(position);
+        }
+
+        /// <summary> Replaces every tempo change. </summary>
+        void setTempo(const TempoMap& map) {
+            tempo = map;
+            for (auto& timeline : timelines) timeline->invalidate(0);
+        }
+
+        /// <summary> Marks a chord edited in place through chords, so its timeline is worked out again from there. Added chords need no touch. </summary>
+        void touch(size_t chord = 0) {
+            for (auto& timeline : timelines) timeline->invalidate(chord);
+        }
+
+        /// <summary>
+        /// The frames every chord and note starts and ends on at a sample rate.
+        /// Cached per sample rate and only worked out again from the first change, so it stays cheap to call every block.
+        /// Not safe to call from several threads at once.
+        /// </summary>
+        const Timeline& timeline(uint32_t sampleRate) const {
+            Timeline* found = nullptr;
+            for (auto& timeline : timelines)
+                if (timeline->sampleRate() == sampleRate) found = timeline.get();
+
+            if (found == nullptr) {
+                timelines.emplace_back(new Timeline(sampleRate));
+                found = timelines.back().get();
+            }
+
+            if (found->stale(chords.size())) found->update(chords, tempo);
+            return *found;
+        }
+
+    private:
+        TempoMap tempo;
+
+        // One per sample rate asked for, kept behind pointers so players can hold on to them
+        mutable std::vector<std::unique_ptr<Timeline>> timelines;
     };
 }
\ No newline at end of file
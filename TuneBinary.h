@@ -0,0 +1,409 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Result.h"
+#include "Tune.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The records below are read in place, so the host has to share the on-disk byte order.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#error "TuneBinary requires a little-endian host"
+#endif
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// A compact, versioned, little-endian binary form of a Tune.
+    /// The file is laid out so that it can be memory-mapped and queried in place,
+    /// without rebuilding the Tune from addChord / addSingle calls.
+    /// </summary>
+    struct TuneBinary {
+
+        static constexpr char MAGIC[4] = { 'D','A','T','N' };
+        static constexpr uint16_t VERSION = 1;
+
+        // Every section starts on this boundary so records can be read directly
+        static constexpr uint64_t ALIGNMENT = 8;
+
+        struct Header {
+            char     magic[4];
+            uint16_t version;
+            uint16_t headerSize;
+            uint32_t chordCount;
+            uint32_t noteCount;
+            uint32_t tempoCount;
+            uint32_t reserved;
+            uint64_t chordOffset;   // Byte offset of ChordRecord[chordCount]
+            uint64_t noteOffset;    // Byte offset of NoteRecord[noteCount]
+            uint64_t tempoOffset;   // Byte offset of TempoRecord[tempoCount]
+            uint64_t fileSize;
+        };
+
+        // A chord groups a run of notes, its start is precomputed so time queries can binary search
+        struct ChordRecord {
+            double   start;         // Sum of the lengths of all previous chords
+            double   length;        // The longest note in the chord
+            uint32_t firstNote;
+            uint32_t noteCount;
+        };
+
+        struct NoteRecord {
+            double        duration;
+            NoteValueType value;
+            uint16_t      reserved[3];
+        };
+
+        // A tempo change, positioned in whole notes from the start of the tune
+        struct TempoRecord {
+            double   position;
+            float    bpm;
+            uint8_t  numerator;     // Time signature, ie. 3 / 4
+            uint8_t  denominator;
+            uint16_t reserved;
+        };
+
+        static_assert(sizeof(Header) == 56, "Header layout changed");
+        static_assert(sizeof(ChordRecord) == 24, "ChordRecord layout changed");
+        static_assert(sizeof(NoteRecord) == 16, "NoteRecord layout changed");
+        static_assert(sizeof(TempoRecord) == 16, "TempoRecord layout changed");
+
+        /// <summary> The tempo used when none is given, 120 bpm in 4 / 4. </summary>
+        static TempoRecord defaultTempo() {
+            return TempoRecord{ 0.0, 120.0f, 4, 4, 0 };
+        }
+
+        /// <summary> The tempo changes of a TempoMap as records. </summary>
+        static std::vector<TempoRecord> tempoRecords(const TempoMap& map) {
+            std::vector<TempoRecord> records;
+            records.reserve(map.changes().size());
+            for (const TempoMap::Change& change : map.changes())
+                records.push_back(TempoRecord{ change.position, (float)change.bpm, change.numerator, change.denominator, 0 });
+            return records;
+        }
+
+        /// <summary> Serializes the Tune and its tempo map into a byte buffer laid out as the file format. </summary>
+        static std::vector<uint8_t> serialize(const Tune& tune) {
+            return serialize(tune, tempoRecords(tune.getTempo()));
+        }
+
+        /// <summary> Serializes the Tune into a byte buffer laid out as the file format. </summary>
+        /// <param name="tune"> The Tune to serialize. </param>
+        /// <param name="tempo"> The tempo changes to store instead of the Tune's own. </param>
+        /// <returns> The serialized bytes. </returns>
+        static std::vector<uint8_t> serialize(const Tune& tune, const std::vector<TempoRecord>& tempo)
+        {
+            uint64_t noteCount = 0;
+            for (const Chord& chord : tune.chords)
+                noteCount += chord.allNotes().size();
+
+            Header header = {};
+            std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = VERSION;
+            header.headerSize = sizeof(Header);
+            header.chordCount = (uint32_t)tune.chords.size();
+            header.noteCount = (uint32_t)noteCount;
+            header.tempoCount = (uint32_t)tempo.size();
+            header.chordOffset = align(sizeof(Header));
+            header.noteOffset = align(header.chordOffset + header.chordCount * sizeof(ChordRecord));
+            header.tempoOffset = align(header.noteOffset + header.noteCount * sizeof(NoteRecord));
+            header.fileSize = align(header.tempoOffset + header.tempoCount * sizeof(TempoRecord));
+
+            std::vector<uint8_t> bytes((size_t)header.fileSize, 0);
+            std::memcpy(bytes.data(), &header, sizeof(Header));
+
+            ChordRecord* chords = (ChordRecord*)(bytes.data() + header.chordOffset);
+            NoteRecord* notes = (NoteRecord*)(bytes.data() + header.noteOffset);
+
+            double start = 0;
+            uint32_t noteIndex = 0;
+            for (const Chord& chord : tune.chords)
+            {
+                ChordRecord& record = *chords++;
+                record.start = start;
+                record.length = chord.maxDuration();
+                record.firstNote = noteIndex;
+                record.noteCount = (uint32_t)chord.allNotes().size();
+
+                for (const Note& note : chord.allNotes())
+                {
+                    NoteRecord& out = notes[noteIndex++];
+                    out.duration = note.duration;
+                    out.value = note.value;
+                }
+
+                start += record.length;
+            }
+
+            if (!tempo.empty())
+                std::memcpy(bytes.data() + header.tempoOffset, tempo.data(), tempo.size() * sizeof(TempoRecord));
+
+            return bytes;
+        }
+
+        /// <summary> Writes the Tune and its tempo map to a binary file. </summary>
+        static Result write(const Tune& tune, const std::string& filepath) {
+            return write(tune, filepath, tempoRecords(tune.getTempo()));
+        }
+
+        /// <summary> Writes the Tune to a binary file. </summary>
+        /// <param name="tune"> The Tune to write. </param>
+        /// <param name="filepath"> The file to write to. </param>
+        /// <param name="tempo"> The tempo changes to store instead of the Tune's own. </param>
+        static Result write(const Tune& tune, const std::string& filepath, const std::vector<TempoRecord>& tempo)
+        {
+            std::ofstream ofs{ filepath, std::ios_base::binary | std::ios_base::trunc };
+            if (ofs.fail()) return CannotOpenFile;
+
+            std::vector<uint8_t> bytes = serialize(tune, tempo);
+            ofs.write((const char*)bytes.data(), bytes.size());
+            if (!ofs) return ProblemReadingData;
+
+            return Success;
+        }
+
+        /// <summary>
+        /// A read-only view over serialized Tune bytes.
+        /// Nothing is copied, the memory must outlive the view.
+        /// </summary>
+        class View {
+        private:
+            const uint8_t* base;
+            const Header* header;
+
+        public:
+            View() : base(nullptr), header(nullptr) {}
+
+            /// <summary> Validates the bytes and points the view at them. </summary>
+            /// <param name="data"> The serialized bytes, aligned to at least 8 bytes. </param>
+            /// <param name="size"> The amount of bytes available. </param>
+            /// <param name="view"> The view to set. </param>
+            static Result open(const void* data, size_t size, View& view)
+            {
+                const uint8_t* bytes = (const uint8_t*)data;
+                if (bytes == nullptr || size < sizeof(Header)) return BadFormatting;
+                if ((uintptr_t)bytes % ALIGNMENT != 0) return BadFormatting;
+
+                const Header* header = (const Header*)bytes;
+                if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0) return BadFormatting;
+                if (header->version != VERSION) return UnsupportedVersion;
+                if (header->headerSize != sizeof(Header) || header->fileSize > size) return BadFormatting;
+
+                // Every section must fit inside the file and be aligned for in place reads
+                if (!fits(header->chordOffset, header->chordCount, sizeof(ChordRecord), header->fileSize)) return BadFormatting;
+                if (!fits(header->noteOffset, header->noteCount, sizeof(NoteRecord), header->fileSize)) return BadFormatting;
+                if (!fits(header->tempoOffset, header->tempoCount, sizeof(TempoRecord), header->fileSize)) return BadFormatting;
+
+                // Every chord's notes must lie inside the note table, so queries never read past it
+                const ChordRecord* chords = (const ChordRecord*)(bytes + header->chordOffset);
+                for (uint32_t i = 0; i < header->chordCount; i++)
+                    if (chords[i].firstNote > header->noteCount || chords[i].noteCount > header->noteCount - chords[i].firstNote) return BadFormatting;
+
+                view.base = bytes;
+                view.header = header;
+                return Success;
+            }
+
+            /// <summary> Whether the view points at valid data. </summary>
+            bool valid() const { return header != nullptr; }
+
+            /// <summary> The amount of chords in the tune. </summary>
+            uint32_t size() const { return header->chordCount; }
+
+            /// <summary> The amount of notes across all chords. </summary>
+            uint32_t noteCount() const { return header->noteCount; }
+
+            /// <summary> The amount of bytes the tune takes up. </summary>
+            uint64_t byteSize() const { return header->fileSize; }
+
+            const ChordRecord* chords() const { return (const ChordRecord*)(base + header->chordOffset); }
+            const NoteRecord* notes() const { return (const NoteRecord*)(base + header->noteOffset); }
+            const TempoRecord* tempo() const { return (const TempoRecord*)(base + header->tempoOffset); }
+            uint32_t tempoCount() const { return header->tempoCount; }
+
+            /// <summary> Gets chord by index. </summary>
+            Chord getChord(uint32_t index) const {
+                const ChordRecord& record = chords()[index];
+                const NoteRecord* first = notes() + record.firstNote;
+
+                std::vector<Note> result;
+                result.reserve(record.noteCount);
+                for (uint32_t i = 0; i < record.noteCount; i++)
+                    result.push_back(Note(first[i].value, first[i].duration));
+
+                return Chord(result);
+            }
+
+            /// <summary>
+            /// Gets the most recent chord index to the given time.
+            /// Matches Tune::getChordIndexAtTime, but binary searches the precomputed chord starts.
+            /// </summary>
+            int getChordIndexAtTime(double time) const {
+                const ChordRecord* records = chords();
+                uint32_t count = size();
+
+                // First chord that ends at or after the time
+                uint32_t low = 0, high = count;
+                while (low < high) {
+                    uint32_t mid = low + (high - low) / 2;
+                    if (records[mid].start + records[mid].length < time) low = mid + 1;
+                    else high = mid;
+                }
+
+                if (low == count) return -1;
+                return (int)low;
+            }
+
+            /// <summary> Gets all of the notes being played at this time. </summary>
+            Chord getNotesAtTime(double time) const {
+                std::vector<Note> current = {};
+
+                int index = getChordIndexAtTime(time);
+                if (index == -1) return current;
+
+                // Chords ending exactly on the time share it with the next one
+                const ChordRecord* records = chords();
+                for (uint32_t i = (uint32_t)index; i < size() && records[i].start <= time; i++)
+                {
+                    const NoteRecord* first = notes() + records[i].firstNote;
+                    for (uint32_t n = 0; n < records[i].noteCount; n++)
+                        if (time - records[i].start <= first[n].duration)
+                            current.push_back(Note(first[n].value, first[n].duration));
+                }
+
+                return current;
+            }
+
+            /// <summary> Rebuilds a mutable Tune from the view, tempo map included. </summary>
+            Tune toTune() const {
+                Tune tune;
+                tune.chords.reserve(size());
+                for (uint32_t i = 0; i < size(); i++)
+                    tune.addChord(getChord(i));
+
+                TempoMap map;
+                for (uint32_t i = 0; i < tempoCount(); i++)
+                    map.set(tempo()[i].position, tempo()[i].bpm, tempo()[i].numerator, tempo()[i].denominator);
+                tune.setTempo(map);
+                return tune;
+            }
+
+        private:
+            static bool fits(uint64_t offset, uint64_t count, uint64_t stride, uint64_t fileSize) {
+                if (offset % ALIGNMENT != 0) return false;
+                if (offset > fileSize) return false;
+                return count <= (fileSize - offset) / stride;
+            }
+        };
+
+        /// <summary> A read-only memory mapping of a file, unmapped when destroyed. </summary>
+        class MappedFile {
+        private:
+            const uint8_t* data;
+            size_t size;
+#ifdef _WIN32
+            HANDLE file;
+            HANDLE mapping;
+#endif
+
+        public:
+            MappedFile() : data(nullptr), size(0)
+#ifdef _WIN32
+                , file(INVALID_HANDLE_VALUE), mapping(nullptr)
+#endif
+            {}
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            ~MappedFile() { close(); }
+
+            /// <summary> Maps the whole file into memory. </summary>
+            Result open(const std::string& filepath)
+            {
+                close();
+
+#ifdef _WIN32
+                file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                if (file == INVALID_HANDLE_VALUE) return CannotOpenFile;
+
+                LARGE_INTEGER length;
+                if (!GetFileSizeEx(file, &length) || length.QuadPart == 0) { close(); return ProblemReadingData; }
+
+                mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping == nullptr) { close(); return ProblemReadingData; }
+
+                data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (data == nullptr) { close(); return ProblemReadingData; }
+                size = (size_t)length.QuadPart;
+#else
+                int fd = ::open(filepath.c_str(), O_RDONLY);
+                if (fd < 0) return CannotOpenFile;
+
+                struct stat info;
+                if (fstat(fd, &info) != 0 || info.st_size == 0) { ::close(fd); return ProblemReadingData; }
+
+                void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd); // The mapping keeps its own reference
+                if (mapped == MAP_FAILED) return ProblemReadingData;
+
+                data = (const uint8_t*)mapped;
+                size = (size_t)info.st_size;
+#endif
+                return Success;
+            }
+
+            void close()
+            {
+#ifdef _WIN32
+                if (data != nullptr) UnmapViewOfFile(data);
+                if (mapping != nullptr) CloseHandle(mapping);
+                if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+                mapping = nullptr;
+                file = INVALID_HANDLE_VALUE;
+#else
+                if (data != nullptr) munmap((void*)data, size);
+#endif
+                data = nullptr;
+                size = 0;
+            }
+
+            const uint8_t* bytes() const { return data; }
+            size_t byteSize() const { return size; }
+        };
+
+        /// <summary> Maps a binary tune file and opens a view over it. </summary>
+        /// <param name="filepath"> The file to map. </param>
+        /// <param name="file"> Keeps the mapping alive, must outlive the view. </param>
+        /// <param name="view"> The view to set. </param>
+        static Result load(const std::string& filepath, MappedFile& file, View& view)
+        {
+            Result result = file.open(filepath);
+            if (result != Success) return result;
+
+            result = View::open(file.bytes(), file.byteSize(), view);
+            if (result != Success) file.close();
+            return result;
+        }
+
+    private:
+        static uint64_t align(uint64_t offset) {
+            return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        }
+    };
+}
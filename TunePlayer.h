@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "EffectBase.h"
+#include "Profiler.h"
+#include "Tune.h"
+
+namespace Effect {
+
+	/// <summary>
+	/// Plays a Tune as sine tones. Every note of a chord starts with the chord,
+	/// the next chord starts once the longest note has ended. Chord and note
+	/// boundaries come from the tune's Timeline, so the tune's tempo map applies.
+	/// </summary>
+	struct TunePlayer : public Abstract
+	{
+		const DynamicAudio::Tune* tune;
+		const DynamicAudio::Timeline* timeline;
+		double sampleRate;
+		float amplitude;		// Of each note
+
+		/// <summary> The next sample process will write. </summary>
+		uint64_t position;
+
+		// The chord under the position, and per note state for it
+		size_t chord;
+		uint64_t chordStart;
+		uint64_t chordEnd;
+		const uint64_t* noteEnds;
+		std::vector<double> phases;
+		std::vector<double> increments;
+
+		/// <summary> Constructor Definition. </summary>
+		/// <param name="tune_"> Must outlive the player and not change while playing. </param>
+		TunePlayer(const DynamicAudio::Tune* tune_, uint32_t sampleRate_, float amplitude_ = 0.2f)
+			: tune(tune_), timeline(&tune_->timeline(sampleRate_)), sampleRate(sampleRate_), amplitude(amplitude_),
+			position(0), chord(0), chordStart(0), chordEnd(0), noteEnds(nullptr)
+		{
+			// Sized for the largest chord, so playing never allocates
+			size_t largest = 0;
+			for (const DynamicAudio::Chord& c : tune->chords) largest = std::max(largest, c.allNotes().size());
+			phases.reserve(largest);
+			increments.reserve(largest);
+			enterChord(0);
+		}
+
+		/// <summary> Whether every chord has been played. </summary>
+		bool finished() const { return chord >= timeline->size(); }
+
+		/// <summary> Jumps to a sample, keeping the phase of every note as if it had played through. </summary>
+		void seek(uint64_t sample) {
+			position = sample;
+			enterChord(timeline->chordAt(sample));
+			alignPhases();
+		}
+
+		value get(value in) override {
+			float sample;
+			process(&sample, 1);
+			return (value)(sample * 127 + 128);
+		}
+
+		void process(float* out, size_t frames) override {
+			DA_PROFILE_SCOPE("TunePlayer::process");
+			std::fill(out, out + frames, 0.0f);
+
+			size_t done = 0;
+			while (done < frames && !finished())
+			{
+				size_t run = (size_t)std::min<uint64_t>(frames - done, chordEnd - position);
+
+				for (size_t n = 0; n < phases.size(); n++) {
+					if (noteEnds[n] <= position) continue;
+
+					size_t length = (size_t)std::min<uint64_t>(run, noteEnds[n] - position);
+					double phase = phases[n];
+					for (size_t i = 0; i < length; i++) {
+						out[done + i] += amplitude * (float)std::sin(phase);
+						phase += increments[n];
+					}
+					phases[n] = std::fmod(phase, 2 * 3.14159265358979);
+				}
+
+				position += run;
+				done += run;
+				if (position >= chordEnd) enterChord(chord + 1);
+			}
+		}
+
+		/// <summary> Walks the chords forward without rendering, then lines the phases up with the new position. </summary>
+		void skip(size_t frames) override {
+			position += frames;
+			if (!finished() && position >= chordEnd) enterChord(timeline->chordAt(position));
+			alignPhases();
+		}
+
+	private:
+		void alignPhases() {
+			double elapsed = (double)(position - chordStart);
+			for (size_t n = 0; n < phases.size(); n++)
+				phases[n] = std::fmod(elapsed * increments[n], 2 * 3.14159265358979);
+		}
+
+		void enterChord(size_t index) {
+			chord = index;
+			phases.clear();
+			increments.clear();
+			if (finished()) { chordStart = chordEnd = timeline->length(); noteEnds = nullptr; return; }
+
+			chordStart = timeline->chordStart(index);
+			chordEnd = timeline->chordEnd(index);
+			noteEnds = timeline->noteEndFrames(index);
+			for (const DynamicAudio::Note& note : tune->chords[index].allNotes()) {
+				phases.push_back(0);
+				increments.push_back(2 * 3.14159265358979 * DynamicAudio::Note::Value::calculateFrequency(note.value) / sampleRate);
+			}
+		}
+	};
+}
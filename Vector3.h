@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cmath>
+
+namespace DynamicAudio {
+
+    struct Vector3 {
+        float x;
+        float y;
+        float z;
+
+        Vector3() : x(0), y(0), z(0) {}
+        Vector3(float value_) : x(value_), y(value_), z(value_) {}
+        Vector3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {}
+
+        float& operator[] (int index) { return index == 0 ? x : (index == 1 ? y : z); }
+        float operator[] (int index) const { return index == 0 ? x : (index == 1 ? y : z); }
+
+        static Vector3 add(const Vector3& first, const Vector3& second) {
+            return Vector3(first.x + second.x, first.y + second.y, first.z + second.z);
+        }
+
+        static Vector3 subtract(const Vector3& first, const Vector3& second) {
+            return Vector3(first.x - second.x, first.y - second.y, first.z - second.z);
+        }
+
+        static Vector3 multiply(const Vector3& first, const Vector3& second) {
+            return Vector3(first.x * second.x, first.y * second.y, first.z * second.z);
+        }
+
+        static Vector3 divide(const Vector3& first, const Vector3& second) {
+            return Vector3(first.x / second.x, first.y / second.y, first.z / second.z);
+        }
+
+        static float dot(const Vector3& first, const Vector3& second) {
+            return first.x * second.x + first.y * second.y + first.z * second.z;
+        }
+
+        static Vector3 cross(const Vector3& first, const Vector3& second) {
+            return Vector3(
+                first.y * second.z - first.z * second.y,
+                first.z * second.x - first.x * second.z,
+                first.x * second.y - first.y * second.x
+            );
+        }
+
+        float length() const { return std::sqrt(dot(*this, *this)); }
+
+        /// <summary> The same direction with a length of 1, or zero if there is no direction. </summary>
+        Vector3 normalized() const {
+            float len = length();
+            if (len <= 0) return Vector3();
+            return Vector3(x / len, y / len, z / len);
+        }
+
+        Vector3 operator+(const Vector3& other) const { return add(*this, other); }
+        Vector3 operator-(const Vector3& other) const { return subtract(*this, other); }
+        Vector3 operator*(float scale) const { return Vector3(x * scale, y * scale, z * scale); }
+    };
+}
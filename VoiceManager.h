@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "EffectBase.h"
+#include "Profiler.h"
+#include "Simd.h"
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// Decides once per block which voices are worth rendering.
+    /// A voice whose estimated loudness falls below the threshold goes virtual: it only
+    /// skips its playback position forward, and fades back in at the right offset once
+    /// it is loud enough again.
+    /// </summary>
+    class VoiceManager {
+    public:
+        enum State : uint8_t {
+            Real,
+            Releasing,  // Rendered one last block while fading out, then virtual
+            Virtual
+        };
+
+        /// <summary> Counters, safe to read from any thread. </summary>
+        struct Stats {
+            std::atomic<uint32_t> realVoices;
+            std::atomic<uint32_t> virtualVoices;
+            std::atomic<uint64_t> promotions;   // Virtual to real
+            std::atomic<uint64_t> demotions;    // Real to virtual
+
+            Stats() : realVoices(0), virtualVoices(0), promotions(0), demotions(0) {}
+        };
+
+        /// <summary> Linear gain under which a voice goes virtual, 0.001 is -60dB. </summary>
+        float threshold;
+
+        /// <summary> A virtual voice has to reach threshold * hysteresis to become real again, so it does not flicker. </summary>
+        float hysteresis;
+
+        /// <summary> The most voices rendered at once, the quietest are virtualized past this. </summary>
+        size_t maxReal;
+
+        /// <summary> How much of the measured level is kept each block, so the estimate follows the source. </summary>
+        float levelDecay;
+
+        /// <summary> How quickly a virtual voice's level drifts back to its nominal level, so quiet passages get checked again. </summary>
+        float levelRecovery;
+
+    private:
+        size_t count;
+
+        // Per voice, padded to a multiple of the SIMD width
+        std::vector<Effect::Abstract*> sources;
+        std::vector<float> gain;        // Everything after the source, ie. spatial * channel gain
+        std::vector<float> level;       // Peak of the source itself, measured while real
+        std::vector<float> nominal;     // The level a virtual voice is assumed to return to
+        std::vector<float> priority;
+        std::vector<float> audibility;
+        std::vector<uint8_t> state;
+        std::vector<uint8_t> fadeIn;
+        std::vector<uint8_t> silence;   // Whether the last render only wrote zeros
+
+        std::vector<uint32_t> ranking;  // Scratch for maxReal, allocated up front
+        Stats counters;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="maxVoices"> Every array is allocated for this many voices up front. </param>
+        VoiceManager(size_t maxVoices, float threshold_ = 0.001f, float hysteresis_ = 2.0f)
+            : threshold(threshold_), hysteresis(hysteresis_), maxReal(maxVoices),
+            levelDecay(0.9f), levelRecovery(0.05f), count(0)
+        {
+            size_t padded = (maxVoices + Simd::Width - 1) / Simd::Width * Simd::Width;
+            sources.assign(padded, nullptr);
+            for (std::vector<float>* array : { &gain, &level, &nominal, &priority, &audibility })
+                array->assign(padded, 0);
+            state.assign(padded, Virtual);
+            fadeIn.assign(padded, 0);
+            silence.assign(padded, 0);
+            ranking.reserve(padded);
+        }
+
+        size_t size() const { return count; }
+        size_t capacity() const { return sources.size(); }
+        const Stats& stats() const { return counters; }
+
+        /// <summary> Adds a voice, real until the first update says otherwise. </summary>
+        /// <param name="source"> Anything with a position to skip, ie. a WavStream or TunePlayer. </param>
+        /// <param name="priority_"> Weights the voice when maxReal has to pick, higher is kept longer. </param>
+        /// <returns> The index of the voice, or -1 if there is no room. </returns>
+        int addVoice(Effect::Abstract* source, float priority_ = 1) {
+            if (count == capacity()) return -1;
+
+            uint32_t voice = (uint32_t)count++;
+            sources[voice] = source;
+            gain[voice] = 1;
+            level[voice] = nominal[voice] = 1;
+            priority[voice] = priority_;
+            state[voice] = Real;
+            fadeIn[voice] = 0;
+            silence[voice] = 0;
+            return (int)voice;
+        }
+
+        /// <summary> Removes every voice. </summary>
+        void clear() { count = 0; }
+
+        void setGain(uint32_t voice, float gain_) { gain[voice] = gain_; }
+
+        /// <summary> Copies a gain for every voice at once, ie. from Spatializer::gains. </summary>
+        void setGains(const float* gains) { std::copy(gains, gains + count, gain.begin()); }
+
+        /// <summary> The level a voice is expected to play at, ie. the peak of its sample. Defaults to full scale. </summary>
+        void setLevel(uint32_t voice, float level_) { level[voice] = nominal[voice] = level_; }
+
+        void setPriority(uint32_t voice, float priority_) { priority[voice] = priority_; }
+
+        State getState(uint32_t voice) const { return (State)state[voice]; }
+        bool isReal(uint32_t voice) const { return state[voice] != Virtual; }
+        float getAudibility(uint32_t voice) const { return audibility[voice]; }
+
+        /// <summary> Whether the last render of a voice was skipped, so its output is all zeros. </summary>
+        bool isSilent(uint32_t voice) const { return silence[voice] != 0; }
+
+        /// <summary> Estimates every voice's loudness and moves voices between real and virtual. Once per block, before rendering. </summary>
+        void update() {
+            DA_PROFILE_SCOPE("VoiceManager::update");
+            using Simd::Float4;
+
+            // Virtual voices have no fresh measurement, so their level drifts back to nominal
+            for (size_t voice = 0; voice < count; voice++)
+                if (state[voice] == Virtual) level[voice] += (nominal[voice] - level[voice]) * levelRecovery;
+
+            for (size_t i = 0; i < count; i += Simd::Width)
+                (Float4::load(&gain[i]) * Float4::load(&level[i])).store(&audibility[i]);
+
+            float promote = threshold * hysteresis;
+            ranking.clear();
+            for (uint32_t voice = 0; voice < count; voice++)
+            {
+                bool audible = state[voice] == Virtual ? audibility[voice] >= promote : audibility[voice] >= threshold;
+                if (audible) ranking.push_back(voice);
+                else demote(voice);
+            }
+
+            // Too many audible voices, so only the loudest (by priority) stay real
+            if (ranking.size() > maxReal) {
+                std::nth_element(ranking.begin(), ranking.begin() + maxReal, ranking.end(), [this](uint32_t a, uint32_t b) {
+                    return audibility[a] * priority[a] > audibility[b] * priority[b];
+                });
+                for (size_t i = maxReal; i < ranking.size(); i++) demote(ranking[i]);
+                ranking.resize(maxReal);
+            }
+
+            for (uint32_t voice : ranking) {
+                if (state[voice] == Virtual) {
+                    fadeIn[voice] = 1;
+                    counters.promotions.fetch_add(1, std::memory_order_relaxed);
+                }
+                state[voice] = Real;
+            }
+
+            uint32_t real = 0;
+            for (uint32_t voice = 0; voice < count; voice++) real += state[voice] != Virtual;
+            counters.realVoices.store(real, std::memory_order_relaxed);
+            counters.virtualVoices.store((uint32_t)count - real, std::memory_order_relaxed);
+        }
+
+        /// <summary> Renders a real voice or skips a virtual one. Called through Effect::Voice. </summary>
+        void render(uint32_t voice, float* out, size_t frames) {
+            Effect::Abstract* source = sources[voice];
+
+            silence[voice] = state[voice] == Virtual;
+            if (silence[voice]) {
+                source->skip(frames);
+                Simd::fill(out, 0, frames);
+                return;
+            }
+
+            source->process(out, frames);
+            level[voice] = std::max(Simd::peak(out, frames), level[voice] * levelDecay);
+
+            // Fade across the block either side of being virtual, so the switch does not click
+            if (fadeIn[voice]) {
+                Simd::rampScale(out, 0, 1, frames);
+                fadeIn[voice] = 0;
+            }
+            if (state[voice] == Releasing) {
+                Simd::rampScale(out, 1, 0, frames);
+                state[voice] = Virtual;
+            }
+        }
+
+        /// <summary> Moves a voice on without rendering it, whatever its state. </summary>
+        void skip(uint32_t voice, size_t frames) { sources[voice]->skip(frames); }
+
+    private:
+        void demote(uint32_t voice) {
+            if (state[voice] != Real) return;
+            state[voice] = Releasing;
+            fadeIn[voice] = 0;
+            counters.demotions.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+}
+
+namespace Effect {
+
+	/// <summary>
+	/// One voice of a VoiceManager, ie. the source of a Mixer channel.
+	/// The manager has to be updated for the block before this node is processed.
+	/// </summary>
+	struct Voice : public Abstract
+	{
+		DynamicAudio::VoiceManager* manager;
+		uint32_t voice;
+
+		/// <summary> Constructor Definition. </summary>
+		Voice(DynamicAudio::VoiceManager* manager_, uint32_t voice_)
+			: manager(manager_), voice(voice_) {}
+
+		value get(value in) override {
+			float sample;
+			manager->render(voice, &sample, 1);
+			return (value)(sample * 127 + 128);
+		}
+
+		void process(float* out, size_t frames) override {
+			manager->render(voice, out, frames);
+		}
+
+		void skip(size_t frames) override { manager->skip(voice, frames); }
+
+		bool silent() const override { return manager->isSilent(voice); }
+	};
+}
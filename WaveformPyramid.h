@@ -0,0 +1,379 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "AudioLoaderWav.h"
+#include "Profiler.h"
+#include "Result.h"
+#include "Simd.h"
+
+namespace DynamicAudio {
+
+    /// <summary>
+    /// A min / max / RMS overview of a loaded wave for drawing and scrubbing it at any zoom.
+    /// Level 0 summarises every bucket of baseFrames frames, each level above merges pairs of the one below,
+    /// so whatever the zoom a pixel is covered by at most three buckets of the closest level and a query
+    /// costs O(pixels) rather than O(samples). Built in one pass over the samples, and cacheable on disk
+    /// next to the asset so it is only ever built once.
+    /// </summary>
+    class WaveformPyramid {
+    public:
+        /// <summary> One bucket of one channel. </summary>
+        struct Summary {
+            float min;
+            float max;
+            float sumSquares;
+        };
+
+        /// <summary> What to draw for one pixel. </summary>
+        struct Column {
+            float min;
+            float max;
+            float rms;
+        };
+
+        static constexpr char MAGIC[4] = { 'D','A','W','P' };
+        static constexpr uint16_t VERSION = 1;
+
+        struct Header {
+            char     magic[4];
+            uint16_t version;
+            uint16_t headerSize;
+            uint32_t channels;
+            uint32_t baseFrames;
+            uint32_t levelCount;
+            uint32_t reserved;
+            uint64_t frames;
+            uint64_t fingerprint;   // Of the wave it was built from, see fingerprint
+        };
+
+        static_assert(sizeof(Header) == 40, "Header layout changed");
+        static_assert(sizeof(Summary) == 12, "Summary layout changed");
+
+    private:
+        uint32_t baseFrames;
+        uint32_t baseShift;
+        uint32_t channelCount;
+        uint64_t frameCount;
+        uint64_t sourceFingerprint;
+        std::vector<std::vector<Summary>> levels;  // Buckets of every channel side by side
+        const AudioLoaderWav::Wav* source;
+
+    public:
+        /// <summary> Constructor Definition. </summary>
+        /// <param name="baseFrames_"> Frames in a level 0 bucket, rounded up to a power of two. </param>
+        WaveformPyramid(uint32_t baseFrames_ = 256)
+            : baseFrames(1), baseShift(0), channelCount(0), frameCount(0), sourceFingerprint(0), levels(), source(nullptr)
+        {
+            while (baseFrames < baseFrames_) { baseFrames <<= 1; baseShift++; }
+        }
+
+        uint32_t channels() const { return channelCount; }
+        uint64_t frames() const { return frameCount; }
+        size_t levelCount() const { return levels.size(); }
+
+        /// <summary> Frames in one bucket of a level. </summary>
+        uint64_t bucketFrames(size_t level) const { return (uint64_t)baseFrames << level; }
+
+        /// <summary> Buckets in a level, per channel. </summary>
+        size_t bucketCount(size_t level) const { return levels[level].size() / channelCount; }
+
+        /// <summary> The buckets of a level, channel c of bucket i at i * channels() + c. </summary>
+        const Summary* level(size_t level) const { return levels[level].data(); }
+
+        /// <summary>
+        /// The wave queries zoomed in past level 0 read samples from, set by build and load.
+        /// Without one they fall back to level 0 buckets.
+        /// </summary>
+        void attach(const AudioLoaderWav::Wav* wav) { source = wav; }
+
+        /// <summary> Summarises a loaded wave. The wave stays attached, so it must outlive the pyramid or be detached. </summary>
+        /// <returns> NotSupported when the sample format cannot be read, BadFormatting when there is no data. </returns>
+        Result build(const AudioLoaderWav::Wav& wav)
+        {
+            DA_PROFILE_SCOPE("WaveformPyramid::build");
+            if (!AudioLoaderWav::isReadable(wav.fmt)) return NotSupported;
+            if (wav.data.data == nullptr) return BadFormatting;
+
+            channelCount = wav.fmt.numChannels;
+            frameCount = wav.data.size() / wav.fmt.blockAlign;
+            sourceFingerprint = fingerprint(wav);
+            source = &wav;
+            allocate();
+
+            // Converted a run of buckets at a time, the samples are only read once
+            const size_t blockBuckets = std::max<size_t>(1, 16384 / baseFrames);
+            std::vector<float> block(blockBuckets * baseFrames * channelCount);
+            Summary* out = levels[0].data();
+
+            for (uint64_t done = 0; done < frameCount; done += blockBuckets * baseFrames)
+            {
+                size_t n = (size_t)std::min<uint64_t>(blockBuckets * baseFrames, frameCount - done);
+                AudioLoaderWav::toFloat(wav.fmt, wav.data.data + done * wav.fmt.blockAlign, block.data(), n * channelCount);
+
+                for (size_t offset = 0; offset < n; offset += baseFrames) {
+                    summarize(block.data() + offset * channelCount, std::min<size_t>(baseFrames, n - offset), out);
+                    out += channelCount;
+                }
+            }
+
+            for (size_t l = 1; l < levels.size(); l++)
+                reduce(levels[l - 1], levels[l]);
+
+            return Success;
+        }
+
+        /// <summary>
+        /// Fills one column per pixel for a channel, pixel p covering the frames from
+        /// firstFrame + p * framesPerPixel up to the next pixel. Pixels off either end of the wave are zero.
+        /// </summary>
+        void query(uint32_t channel, double firstFrame, double framesPerPixel, Column* out, size_t pixels) const
+        {
+            if (levels.empty() || channel >= channelCount || !(framesPerPixel > 0)) {
+                std::fill(out, out + pixels, Column{ 0, 0, 0 });
+                return;
+            }
+
+            // The coarsest level with buckets no wider than a pixel
+            size_t l = 0;
+            while (l + 1 < levels.size() && (double)bucketFrames(l + 1) <= framesPerPixel) l++;
+            bool raw = framesPerPixel < baseFrames && source != nullptr;
+
+            for (size_t p = 0; p < pixels; p++)
+            {
+                int64_t a = (int64_t)std::floor(firstFrame + p * framesPerPixel);
+                int64_t b = std::max(a + 1, (int64_t)std::floor(firstFrame + (p + 1) * framesPerPixel));
+                a = std::max<int64_t>(a, 0);
+                b = std::min<int64_t>(b, (int64_t)frameCount);
+                if (a >= b) { out[p] = Column{ 0, 0, 0 }; continue; }
+
+                out[p] = raw ? readSamples(channel, (uint64_t)a, (uint64_t)b) : readLevel(l, channel, (uint64_t)a, (uint64_t)b);
+            }
+        }
+
+        /// <summary> Writes the pyramid to a cache file. </summary>
+        Result save(const std::string& filepath) const
+        {
+            std::ofstream ofs{ filepath, std::ios_base::binary | std::ios_base::trunc };
+            if (ofs.fail()) return CannotOpenFile;
+
+            Header header = {};
+            std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = VERSION;
+            header.headerSize = sizeof(Header);
+            header.channels = channelCount;
+            header.baseFrames = baseFrames;
+            header.levelCount = (uint32_t)levels.size();
+            header.frames = frameCount;
+            header.fingerprint = sourceFingerprint;
+
+            ofs.write((const char*)&header, sizeof(Header));
+            for (const std::vector<Summary>& buckets : levels)
+                ofs.write((const char*)buckets.data(), buckets.size() * sizeof(Summary));
+            if (!ofs) return ProblemReadingData;
+
+            return Success;
+        }
+
+        /// <summary> Reads a cache file written by save, if it was built from this wave with the same base. </summary>
+        /// <returns> BadFormatting when the file is damaged or belongs to another wave or base, NotSupported when the wave cannot be read. </returns>
+        Result load(const std::string& filepath, const AudioLoaderWav::Wav& wav)
+        {
+            DA_PROFILE_SCOPE("WaveformPyramid::load");
+            if (!AudioLoaderWav::isReadable(wav.fmt)) return NotSupported;
+
+            std::ifstream ifs{ filepath, std::ios_base::binary };
+            if (ifs.fail()) return CannotOpenFile;
+
+            Header header;
+            if (!ifs.read((char*)&header, sizeof(Header))) return BadFormatting;
+            if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) return BadFormatting;
+            if (header.version != VERSION) return UnsupportedVersion;
+            if (header.headerSize != sizeof(Header)) return BadFormatting;
+
+            if (header.channels != wav.fmt.numChannels || header.baseFrames != baseFrames
+                || header.frames != wav.data.size() / wav.fmt.blockAlign || header.fingerprint != fingerprint(wav))
+                return BadFormatting;
+
+            channelCount = header.channels;
+            frameCount = header.frames;
+            sourceFingerprint = header.fingerprint;
+            allocate();
+            if (header.levelCount != levels.size()) return BadFormatting;
+
+            for (std::vector<Summary>& buckets : levels)
+                if (!ifs.read((char*)buckets.data(), buckets.size() * sizeof(Summary))) {
+                    levels.clear();
+                    return ProblemReadingData;
+                }
+
+            source = &wav;
+            return Success;
+        }
+
+        /// <summary> Where the cache of a wave file lives, next to it. </summary>
+        static std::string cachePath(const std::string& wavPath) { return wavPath + ".dawp"; }
+
+        /// <summary> Loads the cache next to a wave file, or builds the pyramid and writes the cache if there is no valid one. </summary>
+        /// <param name="wavPath"> The file wav was loaded from. </param>
+        /// <returns> The result of building, a cache that cannot be written is not an error. </returns>
+        Result buildCached(const std::string& wavPath, const AudioLoaderWav::Wav& wav)
+        {
+            std::string path = cachePath(wavPath);
+            if (load(path, wav) == Success) return Success;
+
+            Result result = build(wav);
+            if (result == Success) save(path);
+            return result;
+        }
+
+        /// <summary>
+        /// Identifies a wave's contents cheaply, from its format, length and up to 4096 samples spread through it.
+        /// Any re-export or edit that changes the length or a sampled byte invalidates a cache.
+        /// </summary>
+        static uint64_t fingerprint(const AudioLoaderWav::Wav& wav)
+        {
+            uint64_t hash = 14695981039346656037ull;
+            auto mix = [&](const void* data, size_t size) {
+                const uint8_t* bytes = (const uint8_t*)data;
+                for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 1099511628211ull;
+            };
+
+            mix(&wav.fmt.audioFormat, sizeof(wav.fmt.audioFormat));
+            mix(&wav.fmt.numChannels, sizeof(wav.fmt.numChannels));
+            mix(&wav.fmt.sampleRate, sizeof(wav.fmt.sampleRate));
+            mix(&wav.fmt.bitsPerSample, sizeof(wav.fmt.bitsPerSample));
+            mix(&wav.data.chunkSize, sizeof(wav.data.chunkSize));
+
+            size_t size = wav.data.size();
+            if (wav.data.data != nullptr && size >= 8) {
+                size_t step = std::max<size_t>(8, size / 4096);
+                for (size_t at = 0; at + 8 <= size; at += step) mix(wav.data.data + at, 8);
+                mix(wav.data.data + size - 8, 8);
+            }
+            return hash;
+        }
+
+    private:
+        void allocate()
+        {
+            levels.clear();
+            if (frameCount == 0) return;
+
+            uint64_t buckets = (frameCount + baseFrames - 1) >> baseShift;
+            while (true) {
+                levels.emplace_back((size_t)buckets * channelCount);
+                if (buckets == 1) break;
+                buckets = (buckets + 1) / 2;
+            }
+        }
+
+        /// <summary> Summarises frames of interleaved samples into one Summary per channel. </summary>
+        void summarize(const float* in, size_t frames, Summary* out) const
+        {
+            const float inf = std::numeric_limits<float>::infinity();
+            for (uint32_t c = 0; c < channelCount; c++) out[c] = Summary{ inf, -inf, 0 };
+
+            size_t count = frames * channelCount;
+            size_t i = 0;
+
+            // With 1, 2 or 4 channels each lane always holds the same channel, so the samples are reduced interleaved
+            if (4 % channelCount == 0) {
+                Simd::Float4 lo(inf), hi(-inf), squares;
+                for (; i < Simd::wide(count); i += Simd::Width) {
+                    Simd::Float4 x = Simd::Float4::load(in + i);
+                    lo = Simd::Float4::min(lo, x);
+                    hi = Simd::Float4::max(hi, x);
+                    squares += x * x;
+                }
+
+                float l[4], h[4], s[4];
+                lo.store(l);
+                hi.store(h);
+                squares.store(s);
+                for (size_t lane = 0; lane < Simd::Width; lane++) {
+                    Summary& summary = out[lane % channelCount];
+                    summary.min = std::min(summary.min, l[lane]);
+                    summary.max = std::max(summary.max, h[lane]);
+                    summary.sumSquares += s[lane];
+                }
+            }
+
+            for (; i < count; i++) {
+                Summary& summary = out[i % channelCount];
+                summary.min = std::min(summary.min, in[i]);
+                summary.max = std::max(summary.max, in[i]);
+                summary.sumSquares += in[i] * in[i];
+            }
+        }
+
+        void reduce(const std::vector<Summary>& below, std::vector<Summary>& above) const
+        {
+            size_t belowCount = below.size() / channelCount;
+            for (size_t i = 0; i < above.size() / channelCount; i++)
+                for (uint32_t c = 0; c < channelCount; c++) {
+                    Summary merged = below[2 * i * channelCount + c];
+                    if (2 * i + 1 < belowCount) merge(merged, below[(2 * i + 1) * channelCount + c]);
+                    above[i * channelCount + c] = merged;
+                }
+        }
+
+        static void merge(Summary& into, const Summary& other) {
+            into.min = std::min(into.min, other.min);
+            into.max = std::max(into.max, other.max);
+            into.sumSquares += other.sumSquares;
+        }
+
+        /// <summary> The buckets of a level overlapping frames a to b, rounded out to whole buckets. </summary>
+        Column readLevel(size_t l, uint32_t channel, uint64_t a, uint64_t b) const
+        {
+            uint32_t shift = baseShift + (uint32_t)l;
+            uint64_t first = a >> shift;
+            uint64_t last = (b - 1) >> shift;
+
+            const Summary* buckets = levels[l].data();
+            Summary merged = buckets[first * channelCount + channel];
+            for (uint64_t i = first + 1; i <= last; i++) merge(merged, buckets[i * channelCount + channel]);
+
+            uint64_t covered = std::min((last + 1) << shift, frameCount) - (first << shift);
+            return Column{ merged.min, merged.max, std::sqrt(merged.sumSquares / covered) };
+        }
+
+        /// <summary> Fewer frames than a level 0 bucket, read straight from the attached wave. </summary>
+        Column readSamples(uint32_t channel, uint64_t a, uint64_t b) const
+        {
+            const AudioLoaderWav::Format& fmt = source->fmt;
+            const size_t chunk = std::max<size_t>(1, 256 / channelCount);
+            float samples[256];
+
+            Column column{ std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), 0 };
+            for (uint64_t f = a; f < b; f += chunk) {
+                size_t n = (size_t)std::min<uint64_t>(chunk, b - f);
+                const uint8_t* in = source->data.data + f * fmt.blockAlign;
+
+                // Whole frames when they fit, otherwise just the channel's sample of each
+                size_t first = channel, stride = channelCount, count = n * channelCount;
+                if (channelCount > 256) {
+                    AudioLoaderWav::toFloat(fmt, in + channel * (fmt.bitsPerSample / 8), samples, 1);
+                    first = 0, stride = 1, count = 1;
+                }
+                else AudioLoaderWav::toFloat(fmt, in, samples, count);
+
+                for (size_t i = first; i < count; i += stride) {
+                    column.min = std::min(column.min, samples[i]);
+                    column.max = std::max(column.max, samples[i]);
+                    column.rms += samples[i] * samples[i];
+                }
+            }
+            column.rms = std::sqrt(column.rms / (b - a));
+            return column;
+        }
+    };
+}
@@ -18,39 +18,6 @@
 - All of these editable in code during runtime
 #endif
 
-//struct Vector3 {
-//	union {
-//        struct {
-//            float x;
-//            float y;
-//            float z;
-//        };
-//        float contents[3];
-//	};
-//
-//    Vector3() : x(0), y(0), z(0) {}
-//    Vector3(float value_) : x(value_), y(value_), z(value_) {}
-//    Vector3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {}
-//
-//    float& operator[] (int index) { return contents[index]; }
-//
-//    static Vector3 add(const Vector3& first, const Vector3& second) {
-//        return Vector3(first.x + second.x, first.y + second.y, first.z + second.z);
-//    }
-//
-//    static Vector3 subtract(const Vector3& first, const Vector3& second) {
-//        return Vector3(first.x - second.x, first.y - second.y, first.z - second.z);
-//    }
-//
-//    static Vector3 multiply(const Vector3& first, const Vector3& second) {
-//        return Vector3(first.x * second.x, first.y * second.y, first.z * second.z);
-//    }
-//
-//    static Vector3 divide(const Vector3& first, const Vector3& second) {
-//        return Vector3(first.x / second.x, first.y / second.y, first.z / second.z);
-//    }
-//};
-
 //class Test_Vector3
 //{
 //public: